@@ -0,0 +1,117 @@
+#!/bin/bash
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+#echo "$0 $*"
+
+# $1 - path to sra tools (fastq-dump-new)
+# $2 - work directory (actual results and temporaries created under actual/)
+# $3 - test case ID
+# $4 - number of threads
+# $5 - spot number expected in the first record, '-' to skip the numbering check
+# $6 - spot number expected in the last record
+# $7, $8, ... - command line options for fastq-dump-new
+#
+# return codes:
+# 0 - passed
+# 1 - could not create temp dir
+# 2 - unexpected return code from the serial run
+# 3 - unexpected return code from the multithreaded run
+# 4 - outputs or statistics differ
+# 5 - records are not numbered first to last spot
+
+BINDIR=$1
+WORKDIR=$2
+CASEID=$3
+THREADS=$4
+FIRST=$5
+LAST=$6
+shift 6
+CMDLINE=$*
+
+FASTQ_DUMP="$BINDIR/fastq-dump-new"
+TEMPDIR=$WORKDIR/actual/$CASEID
+
+printf "running $CASEID: "
+
+mkdir -p $TEMPDIR
+rm -rf "${TEMPDIR:?}"/*
+if [ "$?" != "0" ] ; then
+    exit 1
+fi
+mkdir -p $TEMPDIR/serial $TEMPDIR/threads
+
+CMD="$FASTQ_DUMP -O $TEMPDIR/serial $CMDLINE 1>$TEMPDIR/serial/stdout 2>$TEMPDIR/serial.stderr"
+printf "serial... "
+eval "$CMD"
+if [ "$?" != "0" ] ; then
+    echo "serial fastq-dump failed. Command executed:"
+    echo $CMD
+    cat $TEMPDIR/serial.stderr
+    exit 2
+fi
+
+CMD="$FASTQ_DUMP --threads $THREADS -O $TEMPDIR/threads $CMDLINE 1>$TEMPDIR/threads/stdout 2>$TEMPDIR/threads.stderr"
+printf "threads... "
+eval "$CMD"
+if [ "$?" != "0" ] ; then
+    echo "multithreaded fastq-dump failed. Command executed:"
+    echo $CMD
+    cat $TEMPDIR/threads.stderr
+    exit 3
+fi
+
+printf "diff... "
+cp $TEMPDIR/serial.stderr $TEMPDIR/serial/stderr
+cp $TEMPDIR/threads.stderr $TEMPDIR/threads/stderr
+diff -r $TEMPDIR/serial $TEMPDIR/threads >$TEMPDIR/diff
+if [ "$?" != "0" ] ; then
+    head $TEMPDIR/diff
+    echo "command executed:"
+    echo $CMD
+    exit 4
+fi
+
+if [ "$FIRST" != "-" ] ; then
+    printf "numbering... "
+    # the spot number follows the first '.' of every 4th line
+    awk -v first="$FIRST" -v last="$LAST" '
+        NR % 4 == 1 {
+            split ( $1, a, "." );
+            if ( a [ 2 ] != ( n == "" ? first : n + 1 ) ) { print "record " NR ": " $1; bad = 1; exit }
+            n = a [ 2 ]
+        }
+        END { if ( ! bad && n != last ) { print "last spot " n; bad = 1 } exit bad }
+        ' $TEMPDIR/threads/stdout >$TEMPDIR/numbering
+    if [ "$?" != "0" ] ; then
+        cat $TEMPDIR/numbering
+        echo "expected spots $FIRST to $LAST, command executed:"
+        echo $CMD
+        exit 5
+    fi
+fi
+
+printf "done\n"
+rm -rf "${TEMPDIR:?}"
+
+exit 0
@@ -735,6 +735,51 @@ FIXTURE_TEST_CASE ( MultipleTables_Multiple_Columns_MultipleRows, GeneralLoaderF
     REQUIRE_EQ ( t2c2v2,    GetValue<uint8_t>   ( table2, table2column2, 2 ) );   
 }
 
+FIXTURE_TEST_CASE ( SparseTableAndColumnIds, GeneralLoaderFixture )
+{   
+    SetUpStream ( GetName() );
+    
+    const char* columnName1 = "SPOT_GROUP";
+    const char* columnName2 = "MAX_SEQ_LEN";
+    m_source . NewTableEvent ( 5, tableName );
+    m_source . NewColumnEvent ( 9, 5, columnName1, 8 );
+    m_source . NewColumnEvent ( 3, 5, columnName2, 32 );
+    m_source . OpenStreamEvent();
+    
+    string value1 = "value1";
+    m_source . CellDataEvent( 9, value1 );
+    uint32_t value2 = 12345;
+    m_source . CellDataEvent( 3, value2 );
+    m_source . NextRowEvent ( 5 );
+    
+    m_source . CloseStreamEvent();
+    REQUIRE ( Run ( m_source . MakeSource (), 0 ) );
+    
+    REQUIRE_EQ ( value1,    GetValue<string>    ( tableName, columnName1, 1 ) ); 
+    REQUIRE_EQ ( value2,    GetValue<uint32_t>  ( tableName, columnName2, 1 ) ); 
+}
+
+FIXTURE_TEST_CASE ( ManyRowsAcrossReadBlocks, GeneralLoaderFixture )
+{   // enough events for the reader to refill its block several times, with events straddling block boundaries
+    OpenStream_OneTableOneColumn ( GetName(), tableName, columnName, 8 );
+
+    const uint64_t rows = 20000;
+    for ( uint64_t i = 1; i <= rows; ++i )
+    {
+        char value [ 64 ];
+        string_printf ( value, sizeof value, NULL, "row %lu of a cell long enough to fill blocks", i );
+        m_source . CellDataEvent( 1, string ( value ) );
+        m_source . NextRowEvent ( 1 );
+    }
+    m_source . CloseStreamEvent();
+    
+    REQUIRE ( Run ( m_source . MakeSource (), 0 ) );
+    
+    REQUIRE_EQ ( string ( "row 1 of a cell long enough to fill blocks" ),       GetValue<string> ( tableName, columnName, 1 ) ); 
+    REQUIRE_EQ ( string ( "row 12345 of a cell long enough to fill blocks" ),   GetValue<string> ( tableName, columnName, 12345 ) ); 
+    REQUIRE_EQ ( string ( "row 20000 of a cell long enough to fill blocks" ),   GetValue<string> ( tableName, columnName, rows ) ); 
+}
+
 FIXTURE_TEST_CASE ( AdditionalSchemaIncludePaths_Single, GeneralLoaderFixture )
 {   
     string schemaPath = "schema";
@@ -0,0 +1,203 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the bulk integer codec used by general-writer integer compaction
+*/
+
+#include <ktst/unit_test.hpp> 
+
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "../../tools/general-loader/utf8-like-int-codec.c"
+
+using namespace std;
+using namespace ncbi::NK;
+
+TEST_SUITE(IntCodecTestSuite);
+
+template < typename T > struct Codec;
+
+template <> struct Codec < uint16_t >
+{
+    static int encode ( uint16_t v, uint8_t * s, uint8_t * e ) { return encode_uint16 ( v, s, e ); }
+    static size_t encode ( const uint16_t * v, size_t n, uint8_t * s, uint8_t * e, size_t * b ) { return encode_uint16_array ( v, n, s, e, b ); }
+    static int decode ( const uint8_t * s, const uint8_t * e, uint16_t * v, size_t n, size_t * c, size_t * b ) { return decode_uint16_array ( s, e, v, n, c, b ); }
+};
+template <> struct Codec < uint32_t >
+{
+    static int encode ( uint32_t v, uint8_t * s, uint8_t * e ) { return encode_uint32 ( v, s, e ); }
+    static size_t encode ( const uint32_t * v, size_t n, uint8_t * s, uint8_t * e, size_t * b ) { return encode_uint32_array ( v, n, s, e, b ); }
+    static int decode ( const uint8_t * s, const uint8_t * e, uint32_t * v, size_t n, size_t * c, size_t * b ) { return decode_uint32_array ( s, e, v, n, c, b ); }
+};
+template <> struct Codec < uint64_t >
+{
+    static int encode ( uint64_t v, uint8_t * s, uint8_t * e ) { return encode_uint64 ( v, s, e ); }
+    static size_t encode ( const uint64_t * v, size_t n, uint8_t * s, uint8_t * e, size_t * b ) { return encode_uint64_array ( v, n, s, e, b ); }
+    static int decode ( const uint8_t * s, const uint8_t * e, uint64_t * v, size_t n, size_t * c, size_t * b ) { return decode_uint64_array ( s, e, v, n, c, b ); }
+};
+
+// runs of small values mixed with values of every encoded length
+template < typename T > static
+vector < T > MakeValues ( size_t p_count, unsigned p_seed )
+{
+    vector < T > ret ( p_count );
+    srand ( p_seed );
+    for ( size_t i = 0; i < p_count; ++ i )
+    {
+        uint64_t v = ( ( uint64_t ) rand () << 42 ) ^ ( ( uint64_t ) rand () << 21 ) ^ ( uint64_t ) rand ();
+        ret [ i ] = ( i / 50 ) % 2 == 0 ? ( T ) ( v & 0x7F ) : ( T ) ( v >> ( rand () % 64 ) );
+    }
+    return ret;
+}
+
+// the bulk encoder has to produce exactly the bytes of the single value one
+template < typename T > static
+vector < uint8_t > EncodeOneByOne ( const vector < T > & p_values, size_t p_bufSize, size_t & p_encoded )
+{
+    vector < uint8_t > ret ( p_bufSize );
+    size_t bytes = 0;
+    for ( p_encoded = 0; p_encoded < p_values . size (); ++ p_encoded )
+    {
+        int n = Codec < T > :: encode ( p_values [ p_encoded ], & ret [ 0 ] + bytes, & ret [ 0 ] + p_bufSize );
+        if ( n <= 0 )
+            break;
+        bytes += n;
+    }
+    ret . resize ( bytes );
+    return ret;
+}
+
+template < typename T > static
+bool RoundTrip ( size_t p_count, size_t p_bufSize )
+{
+    vector < T > values = MakeValues < T > ( p_count, ( unsigned ) ( p_count + p_bufSize ) );
+    size_t expectedCount;
+    vector < uint8_t > expected = EncodeOneByOne ( values, p_bufSize, expectedCount );
+
+    vector < uint8_t > buf ( p_bufSize + 1 );
+    size_t bytes;
+    size_t count = Codec < T > :: encode ( & values [ 0 ], values . size (), & buf [ 0 ], & buf [ 0 ] + p_bufSize, & bytes );
+    if ( count != expectedCount || bytes != expected . size () || memcmp ( & buf [ 0 ], & expected [ 0 ], bytes ) != 0 )
+        return false;
+
+    vector < T > decoded ( count + 1 );
+    size_t decodedCount, decodedBytes;
+    int rc = Codec < T > :: decode ( & buf [ 0 ], & buf [ 0 ] + bytes, & decoded [ 0 ], decoded . size (), & decodedCount, & decodedBytes );
+    return rc > 0
+        && decodedCount == count
+        && decodedBytes == bytes
+        && memcmp ( & decoded [ 0 ], & values [ 0 ], count * sizeof ( T ) ) == 0;
+}
+
+TEST_CASE ( RoundTrip_16 )
+{
+    REQUIRE ( RoundTrip < uint16_t > ( 10000, 0x10000 ) );
+    REQUIRE ( RoundTrip < uint16_t > ( 10000, 777 ) ); // buffer fills up mid-array
+}
+
+TEST_CASE ( RoundTrip_32 )
+{
+    REQUIRE ( RoundTrip < uint32_t > ( 10000, 0x10000 ) );
+    REQUIRE ( RoundTrip < uint32_t > ( 10000, 777 ) );
+}
+
+TEST_CASE ( RoundTrip_64 )
+{
+    REQUIRE ( RoundTrip < uint64_t > ( 10000, 0x10000 ) );
+    REQUIRE ( RoundTrip < uint64_t > ( 10000, 777 ) );
+}
+
+TEST_CASE ( Decode_StopsAtCount )
+{
+    vector < uint8_t > buf ( 100, 5 );
+    uint32_t decoded [ 40 ];
+    size_t count, bytes;
+    REQUIRE_EQ ( 1, decode_uint32_array ( & buf [ 0 ], & buf [ 0 ] + buf . size (), decoded, 40, & count, & bytes ) );
+    REQUIRE_EQ ( ( size_t ) 40, count );
+    REQUIRE_EQ ( ( size_t ) 40, bytes );
+    REQUIRE_EQ ( ( uint32_t ) 5, decoded [ 39 ] );
+}
+
+TEST_CASE ( Decode_Truncated )
+{
+    vector < uint32_t > values ( 64, 1 );
+    values . push_back ( 0x12345678 );
+    uint8_t buf [ 128 ];
+    size_t bytes;
+    REQUIRE_EQ ( values . size (), encode_uint32_array ( & values [ 0 ], values . size (), buf, buf + sizeof buf, & bytes ) );
+    REQUIRE_EQ ( ( size_t ) 64 + 5, bytes );
+
+    uint32_t decoded [ 128 ];
+    size_t count, read;
+    REQUIRE_EQ ( ( int ) CODEC_INSUFFICIENT_BUFFER, decode_uint32_array ( buf, buf + bytes - 1, decoded, 128, & count, & read ) );
+    REQUIRE_EQ ( ( size_t ) 64, count );
+    REQUIRE_EQ ( ( size_t ) 64, read );
+}
+
+TEST_CASE ( Decode_Corrupt )
+{
+    uint8_t buf [ 64 ];
+    memset ( buf, 1, sizeof buf );
+    buf [ 40 ] = 0x80; // a continuation byte cannot start a sequence
+    
+    uint16_t decoded [ 64 ];
+    size_t count, read;
+    REQUIRE_EQ ( ( int ) CODEC_INVALID_FORMAT, decode_uint16_array ( buf, buf + sizeof buf, decoded, 64, & count, & read ) );
+    REQUIRE_EQ ( ( size_t ) 40, count );
+    REQUIRE_EQ ( ( size_t ) 40, read );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-int-codec";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    return IntCodecTestSuite ( argc, argv );
+}
+
+}
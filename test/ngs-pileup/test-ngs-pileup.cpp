@@ -114,6 +114,30 @@ FIXTURE_TEST_CASE ( SingleReference_Slice, NGSPileupFixture )
     REQUIRE_EQ ( expected, Run () );
 }
 
+FIXTURE_TEST_CASE ( SingleReference_OverlappingSlices, NGSPileupFixture )
+{   // overlapping slices are merged, no position is reported twice
+    ps . AddInput ( "ERR247027" ); 
+    ps . AddReferenceSlice ( "AL844509.2", 1212493, 2 );  
+    ps . AddReferenceSlice ( "AL844509.2", 1212492, 3 );  
+    string expected = 
+        "AL844509.2\t1212494\t1\n"
+        "AL844509.2\t1212495\t1\n";
+    REQUIRE_EQ ( expected, Run () );
+}
+
+FIXTURE_TEST_CASE ( SingleReference_Threads, NGSPileupFixture )
+{   // windows walked on several threads come out in reference order
+    ps . AddInput ( "ERR247027" ); 
+    ps . AddReferenceSlice ( "AL844509.2", 1212492, 3 );  
+    ps . AddReferenceSlice ( "AL844509.2", 0, 1212492 );  
+    string expected = Run ();
+    
+    m_str . str ( string () );
+    ps . threads = 4;
+    REQUIRE_EQ ( expected, Run () );
+    REQUIRE_NE ( string :: npos, expected . find ( "AL844509.2\t1212495\t1\n" ) );
+}
+
 #if 0
 FIXTURE_TEST_CASE ( MultipleReferences, NGSPileupFixture )
 {   
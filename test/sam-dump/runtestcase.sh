@@ -0,0 +1,109 @@
+#!/bin/bash
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+#echo "$0 $*"
+
+# $1 - path to sra tools (sam-dump)
+# $2 - work directory (actual results and temporaries created under actual/)
+# $3 - test case ID
+# $4 - index type (bai or csi)
+# $5, $6, ... - command line options for sam-dump
+#
+# return codes:
+# 0 - passed ( or samtools is not installed )
+# 1 - could not create temp dir
+# 2 - unexpected return code from sam-dump
+# 3 - unexpected return code from sam-dump --bam
+# 4 - records differ
+# 5 - records of a reference looked up through the index differ
+
+BINDIR=$1
+WORKDIR=$2
+CASEID=$3
+INDEX=$4
+shift 4
+CMDLINE=$*
+
+SAM_DUMP="$BINDIR/sam-dump"
+TEMPDIR=$WORKDIR/actual/$CASEID
+
+printf "running $CASEID: "
+
+if ! which samtools >/dev/null 2>&1 ; then
+    echo "skipped, samtools not found"
+    exit 0
+fi
+
+mkdir -p $TEMPDIR
+rm -rf "${TEMPDIR:?}"/*
+if [ "$?" != "0" ] ; then
+    exit 1
+fi
+
+CMD="$SAM_DUMP $CMDLINE 1>$TEMPDIR/sam.stdout 2>$TEMPDIR/sam.stderr"
+printf "sam... "
+eval "$CMD"
+if [ "$?" != "0" ] ; then
+    echo "sam-dump failed. Command executed:"
+    echo $CMD
+    cat $TEMPDIR/sam.stderr
+    exit 2
+fi
+
+CMD="$SAM_DUMP --bam --bam-index $TEMPDIR/out.bam.$INDEX $CMDLINE 1>$TEMPDIR/out.bam 2>$TEMPDIR/bam.stderr"
+printf "bam... "
+eval "$CMD"
+if [ "$?" != "0" ] ; then
+    echo "sam-dump --bam failed. Command executed:"
+    echo $CMD
+    cat $TEMPDIR/bam.stderr
+    exit 3
+fi
+
+printf "diff... "
+grep -v '^@' $TEMPDIR/sam.stdout >$TEMPDIR/sam.records
+samtools view $TEMPDIR/out.bam >$TEMPDIR/bam.records
+diff $TEMPDIR/sam.records $TEMPDIR/bam.records >$TEMPDIR/diff
+if [ "$?" != "0" ] ; then
+    head $TEMPDIR/diff
+    echo "command executed:"
+    echo $CMD
+    exit 4
+fi
+
+printf "index... "
+REF=`samtools idxstats $TEMPDIR/out.bam | head -n 1 | cut -f 1`
+awk -F '\t' -v ref="$REF" '$3 == ref' $TEMPDIR/sam.records >$TEMPDIR/sam.ref
+samtools view $TEMPDIR/out.bam "$REF" >$TEMPDIR/bam.ref
+diff $TEMPDIR/sam.ref $TEMPDIR/bam.ref >$TEMPDIR/diff
+if [ "$?" != "0" ] ; then
+    head $TEMPDIR/diff
+    echo "lookup of $REF through the index differs"
+    exit 5
+fi
+
+printf "done\n"
+rm -rf "${TEMPDIR:?}"
+
+exit 0
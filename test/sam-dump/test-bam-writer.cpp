@@ -0,0 +1,580 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the BAM writer of sam-dump: records written as BAM with a
+* BAI or CSI index are read back, compared and looked up through the index
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <kfs/directory.h>
+#include <kfs/file.h>
+
+#include <sysalloc.h>
+
+#include <zlib.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+#include "bam_writer.h"
+
+using namespace std;
+using namespace ncbi::NK;
+
+TEST_SUITE(BamWriterTestSuite);
+
+static uint32_t Get16 ( const string & s, size_t pos )
+{
+    return ( uint8_t ) s [ pos ] | ( ( uint32_t ) ( uint8_t ) s [ pos + 1 ] << 8 );
+}
+
+static uint32_t Get32 ( const string & s, size_t pos )
+{
+    return Get16 ( s, pos ) | ( Get16 ( s, pos + 2 ) << 16 );
+}
+
+static uint64_t Get64 ( const string & s, size_t pos )
+{
+    return Get32 ( s, pos ) | ( ( uint64_t ) Get32 ( s, pos + 4 ) << 32 );
+}
+
+static string ReadFile ( const string & path )
+{
+    ifstream in ( path . c_str (), ios::binary );
+    ostringstream s;
+    s << in . rdbuf ();
+    return s . str ();
+}
+
+/* the binning scheme of BAI and CSI */
+static uint32_t Reg2Bin ( int64_t beg, int64_t end, int min_shift, int depth )
+{
+    int l = depth;
+    int s = min_shift;
+    int64_t t = ( ( ( int64_t ) 1 << depth * 3 ) - 1 ) / 7;
+    for ( --end; l > 0; --l, s += 3, t -= ( int64_t ) 1 << l * 3 )
+    {
+        if ( beg >> s == end >> s )
+            return ( uint32_t ) ( t + ( beg >> s ) );
+    }
+    return 0;
+}
+
+static const char CigarOps [] = "MIDNSHP=X";
+
+static bool OnReference ( uint32_t op )
+{
+    return op == 0 || op == 2 || op == 3 || op == 7 || op == 8;
+}
+
+/* where a record was put: reference, extent and virtual offsets of its bytes */
+struct Placement
+{
+    int32_t ref;
+    int64_t beg;
+    int64_t end;
+    uint64_t vbeg;
+    uint64_t vend;
+};
+
+/* a BGZF file inflated, with the compressed and uncompressed start of each block */
+struct Bgzf
+{
+    string data;
+    vector < uint64_t > ustart;
+    vector < uint64_t > cstart;
+    string error;
+
+    Bgzf ( const string & file )
+    {
+        size_t pos = 0;
+        while ( error . empty () && pos < file . size () )
+        {
+            if ( file . size () - pos < 28 || file . compare ( pos, 4, "\x1f\x8b\x08\x04" ) != 0 )
+            {
+                error = "bad BGZF block";
+                break;
+            }
+            size_t const bsize = Get16 ( file, pos + 16 ) + 1;
+            uint32_t const isize = Get32 ( file, pos + bsize - 4 );
+            string u ( isize, '\0' );
+            z_stream z;
+            memset ( & z, 0, sizeof z );
+            inflateInit2 ( & z, -15 );
+            z . next_in = ( Bytef * ) file . data () + pos + 18;
+            z . avail_in = ( uInt ) ( bsize - 26 );
+            z . next_out = ( Bytef * ) & u [ 0 ];
+            z . avail_out = isize;
+            if ( inflate ( & z, Z_FINISH ) != Z_STREAM_END || z . total_out != isize ||
+                 crc32 ( 0, ( const Bytef * ) u . data (), isize ) != Get32 ( file, pos + bsize - 8 ) )
+                error = "cannot inflate BGZF block";
+            inflateEnd ( & z );
+            ustart . push_back ( data . size () );
+            cstart . push_back ( pos );
+            data += u;
+            pos += bsize;
+        }
+        if ( error . empty () && ( ustart . empty () || ustart . back () != data . size () ) )
+            error = "no EOF block";
+    }
+
+    /* the virtual offset of a position in data, an end is kept in the block it ends */
+    uint64_t VirtualOffset ( uint64_t upos, bool at_end ) const
+    {
+        size_t i = upper_bound ( ustart . begin (), ustart . end (), upos ) - ustart . begin () - 1;
+        if ( at_end && i > 0 && ustart [ i ] == upos )
+            --i;
+        while ( !at_end && i + 1 < ustart . size () && ustart [ i + 1 ] == upos )
+            ++i;
+        return ( cstart [ i ] << 16 ) | ( upos - ustart [ i ] );
+    }
+};
+
+class BamFixture
+{
+public:
+    BamFixture ()
+    :   m_rand ( 7 )
+    {
+        KDirectoryNativeDir ( & m_dir );
+        m_header = "@HD\tVN:1.4\tSO:coordinate\n@SQ\tSN:chr1\tLN:1000000\n@SQ\tSN:chr2\tLN:300000\n@RG\tID:grp1\n";
+        m_refs . push_back ( "chr1" );
+        m_refs . push_back ( "chr2" );
+    }
+    ~BamFixture ()
+    {
+        for ( vector < string > :: const_iterator i = m_files . begin (); i != m_files . end (); ++i )
+            KDirectoryRemove ( m_dir, true, "%s", i -> c_str () );
+        KDirectoryRelease ( m_dir );
+    }
+
+    uint32_t Rand ( uint32_t n )
+    {
+        m_rand = m_rand * 1103515245 + 12345;
+        return ( m_rand >> 8 ) % n;
+    }
+
+    /* sorted records on both references, some of them placed but unmapped, the rest unplaced */
+    rc_t WriteRecords ( struct bam_writer * bw, size_t count )
+    {
+        static const char * cigars [] = { "50M", "20M5I25M", "10M200N40M", "5S45M", "30M2D20M", "50=" };
+        struct bam_record * rec;
+        rc_t rc = make_bam_record ( & rec, bw );
+        int64_t pos = 0;
+        size_t i;
+
+        m_expected . clear ();
+        m_placed . clear ();
+        for ( i = 0; rc == 0 && i < count; ++i )
+        {
+            int32_t const ref = i < count / 2 ? 0 : i < count - count / 20 ? 1 : -1;
+            bool const unmapped = ref < 0 || i % 100 == 99;
+            const char * const cigar = unmapped ? "*" : cigars [ Rand ( 6 ) ];
+            uint32_t const flag = ( unmapped ? 4 : 0 ) | ( i % 2 ? 0x10 : 0 );
+            uint8_t const mapq = unmapped ? 0 : ( uint8_t ) Rand ( 61 );
+            int32_t const pnext = ( int32_t ) pos + 100;
+            int64_t const nm = ( int64_t ) Rand ( 70000 ) - 10;
+            size_t const l_seq = unmapped && ref < 0 ? 0 : 50;
+            bool const with_qual = i % 7 != 0;
+            ostringstream name, sam;
+            string seq, qual;
+            size_t j;
+
+            if ( i == count / 2 )
+                pos = 0;
+            if ( ref >= 0 && !unmapped )
+                pos += Rand ( 120 );
+            name << i;
+            for ( j = 0; j < l_seq; ++j )
+            {
+                seq += "ACGTN" [ Rand ( 5 ) ];
+                qual += ( char ) ( 33 + Rand ( 41 ) );
+            }
+
+            rc = bam_record_start ( rec, ref < 0 ? "*" : m_refs [ ref ] . c_str (), ref < 0 ? 1 : m_refs [ ref ] . size (),
+                                    ref < 0 ? -1 : ( int32_t ) pos, mapq, flag );
+            if ( rc == 0 )
+                rc = bam_record_qname ( rec, "r", 1 );
+            if ( rc == 0 )
+                rc = bam_record_qname ( rec, name . str () . c_str (), name . str () . size () );
+            if ( rc == 0 )
+                rc = bam_record_cigar ( rec, cigar, strlen ( cigar ) );
+            if ( rc == 0 && ref >= 0 && i % 2 == 0 )
+                rc = bam_record_mate ( rec, m_refs [ ref ] . c_str (), m_refs [ ref ] . size (), pnext, 150 );
+            if ( rc == 0 && l_seq > 0 )
+                rc = bam_record_seq ( rec, seq . data (), l_seq );
+            if ( rc == 0 && l_seq > 0 && with_qual )
+                rc = bam_record_qual ( rec, qual . data (), l_seq );
+            if ( rc == 0 )
+                rc = bam_record_tag_str ( rec, "RG", "grp1", 4 );
+            if ( rc == 0 )
+                rc = bam_record_tag_int ( rec, "NM", nm );
+            if ( rc == 0 )
+                rc = bam_record_tags_sam ( rec, "\tXC:A:c\tXA:B:i,1,-2,3", 21 );
+
+            sam << "r" << i << "\t" << flag << "\t" << ( ref < 0 ? "*" : m_refs [ ref ] ) << "\t"
+                << ( ref < 0 ? 0 : pos + 1 ) << "\t" << ( unsigned ) mapq << "\t" << cigar << "\t";
+            if ( ref >= 0 && i % 2 == 0 )
+                sam << "=\t" << pnext + 1 << "\t150\t";
+            else
+                sam << "*\t0\t0\t";
+            sam << ( l_seq ? seq : "*" ) << "\t" << ( l_seq && with_qual ? qual : "*" )
+                << "\tRG:Z:grp1\tNM:i:" << nm << "\tXC:A:c\tXA:B:i,1,-2,3";
+            m_expected . push_back ( sam . str () );
+
+            if ( rc == 0 )
+            {
+                const void * data;
+                size_t len;
+
+                rc = bam_record_finish ( rec, & data, & len );
+                /* in pieces, as the units of the parallel dump come */
+                while ( rc == 0 && len > 0 )
+                {
+                    size_t const n = min ( len, ( size_t ) Rand ( 300 ) + 1 );
+                    rc = bam_writer_write ( bw, data, n );
+                    data = ( const char * ) data + n;
+                    len -= n;
+                }
+            }
+        }
+        release_bam_record ( rec );
+        return rc;
+    }
+
+    rc_t Write ( const string & path, uint32_t threads, const char * index, size_t count )
+    {
+        KFile * f;
+        struct bam_writer * bw;
+        rc_t rc = KDirectoryCreateFile ( m_dir, & f, false, 0664, kcmInit, "%s", path . c_str () );
+        m_files . push_back ( path );
+        if ( index != NULL )
+            m_files . push_back ( index );
+        if ( rc != 0 )
+            return rc;
+        rc = make_bam_writer ( & bw, f, threads, index );
+        if ( rc == 0 )
+        {
+            rc = bam_writer_write ( bw, m_header . data (), m_header . size () );
+            if ( rc == 0 )
+                rc = bam_writer_end_header ( bw );
+            if ( rc == 0 )
+                rc = WriteRecords ( bw, count );
+            rc_t const rc2 = release_bam_writer ( bw, rc == 0 );
+            if ( rc == 0 )
+                rc = rc2;
+        }
+        KFileRelease ( f );
+        return rc;
+    }
+
+    /* decodes the BAM file into SAM lines and the placement of every record */
+    string Read ( const string & path, vector < string > & sam, vector < Placement > & placed )
+    {
+        Bgzf bam ( ReadFile ( path ) );
+        const string & s = bam . data;
+        if ( ! bam . error . empty () )
+            return bam . error;
+        if ( s . compare ( 0, 4, "BAM\1" ) != 0 )
+            return "no BAM magic";
+        size_t const l_text = Get32 ( s, 4 );
+        if ( s . substr ( 8, l_text ) != m_header )
+            return "header text differs";
+        size_t p = 8 + l_text;
+        uint32_t const n_ref = Get32 ( s, p );
+        vector < string > refs;
+        for ( p += 4; refs . size () < n_ref; p += 4 )
+        {
+            uint32_t const l = Get32 ( s, p );
+            refs . push_back ( s . substr ( p + 4, l - 1 ) );
+            p += 4 + l;
+        }
+        while ( p < s . size () )
+        {
+            size_t const end = p + 4 + Get32 ( s, p );
+            int32_t const ref = ( int32_t ) Get32 ( s, p + 4 );
+            int32_t const pos = ( int32_t ) Get32 ( s, p + 8 );
+            size_t const l_qname = ( uint8_t ) s [ p + 12 ];
+            uint32_t const n_cigar = Get16 ( s, p + 16 );
+            uint32_t const flag = Get16 ( s, p + 18 );
+            uint32_t const l_seq = Get32 ( s, p + 20 );
+            int32_t const next = ( int32_t ) Get32 ( s, p + 24 );
+            size_t q = p + 36 + l_qname;
+            int64_t ref_end = pos;
+            ostringstream o;
+            uint32_t i;
+
+            o << s . substr ( p + 36, l_qname - 1 ) << "\t" << flag << "\t" << ( ref < 0 ? "*" : refs [ ref ] )
+              << "\t" << pos + 1 << "\t" << ( unsigned ) ( uint8_t ) s [ p + 13 ] << "\t";
+            for ( i = 0; i < n_cigar; ++i, q += 4 )
+            {
+                uint32_t const op = Get32 ( s, q );
+                o << ( op >> 4 ) << CigarOps [ op & 0xf ];
+                if ( OnReference ( op & 0xf ) )
+                    ref_end += op >> 4;
+            }
+            o << ( n_cigar ? "\t" : "*\t" )
+              << ( next < 0 ? "*" : next == ref ? "=" : refs [ next ] ) << "\t"
+              << ( int32_t ) Get32 ( s, p + 28 ) + 1 << "\t" << ( int32_t ) Get32 ( s, p + 32 ) << "\t";
+            for ( i = 0; i < l_seq; ++i )
+                o << "=ACMGRSVTWYHKDBN" [ ( ( uint8_t ) s [ q + i / 2 ] >> ( i % 2 ? 0 : 4 ) ) & 0xf ];
+            q += ( l_seq + 1 ) / 2;
+            o << ( l_seq ? "\t" : "*\t" );
+            if ( l_seq == 0 || ( uint8_t ) s [ q ] == 0xff )
+                o << "*";
+            else
+            {
+                for ( i = 0; i < l_seq; ++i )
+                    o << ( char ) ( s [ q + i ] + 33 );
+            }
+            q += l_seq;
+            while ( q < end )
+            {
+                char const type = s [ q + 2 ];
+                o << "\t" << s . substr ( q, 2 );
+                q += 3;
+                switch ( type )
+                {
+                case 'A' : o << ":A:" << s [ q ]; q += 1; break;
+                case 'c' : o << ":i:" << ( int ) ( int8_t ) s [ q ]; q += 1; break;
+                case 'C' : o << ":i:" << ( int ) ( uint8_t ) s [ q ]; q += 1; break;
+                case 's' : o << ":i:" << ( int16_t ) Get16 ( s, q ); q += 2; break;
+                case 'S' : o << ":i:" << Get16 ( s, q ); q += 2; break;
+                case 'i' : o << ":i:" << ( int32_t ) Get32 ( s, q ); q += 4; break;
+                case 'I' : o << ":i:" << Get32 ( s, q ); q += 4; break;
+                case 'Z' :
+                    {
+                        size_t const z = s . find ( '\0', q );
+                        o << ":Z:" << s . substr ( q, z - q );
+                        q = z + 1;
+                    }
+                    break;
+                case 'B' :
+                    {
+                        uint32_t const n = Get32 ( s, q + 1 );
+                        if ( s [ q ] != 'i' )
+                            return "unexpected array type";
+                        o << ":B:i";
+                        for ( i = 0, q += 5; i < n; ++i, q += 4 )
+                            o << "," << ( int32_t ) Get32 ( s, q );
+                    }
+                    break;
+                default :
+                    return "unexpected tag type";
+                }
+            }
+            if ( q != end )
+                return "record size differs from its fields";
+            sam . push_back ( o . str () );
+
+            Placement pl = { ref, pos, ( flag & 4 ) || n_cigar == 0 || ref_end <= pos ? pos + 1 : ref_end,
+                             bam . VirtualOffset ( p, false ), bam . VirtualOffset ( end, true ) };
+            placed . push_back ( pl );
+            p = end;
+        }
+        return "";
+    }
+
+    /* every placed record has to be in a chunk of its bin and,
+       for BAI, not before the linear index of its windows */
+    string CheckIndex ( const string & path, const vector < Placement > & placed )
+    {
+        string s = ReadFile ( path );
+        int min_shift = 14, depth = 5;
+        size_t p;
+        bool const csi = s . compare ( 0, 2, "\x1f\x8b" ) == 0;
+
+        if ( csi )
+        {
+            Bgzf idx ( s );
+            if ( ! idx . error . empty () )
+                return idx . error;
+            s = idx . data;
+            if ( s . compare ( 0, 4, "CSI\1" ) != 0 )
+                return "no CSI magic";
+            min_shift = ( int ) Get32 ( s, 4 );
+            depth = ( int ) Get32 ( s, 8 );
+            p = 16 + Get32 ( s, 12 );
+        }
+        else
+        {
+            if ( s . compare ( 0, 4, "BAI\1" ) != 0 )
+                return "no BAI magic";
+            p = 4;
+        }
+        uint32_t const n_ref = Get32 ( s, p );
+        uint32_t const pseudo = ( ( 1u << ( depth + 1 ) * 3 ) - 1 ) / 7 + 1;
+        if ( n_ref != m_refs . size () )
+            return "wrong reference count";
+        p += 4;
+        for ( int32_t r = 0; r < ( int32_t ) n_ref; ++r )
+        {
+            map < uint32_t, vector < pair < uint64_t, uint64_t > > > bins;
+            vector < uint64_t > linear;
+            uint32_t const n_bin = Get32 ( s, p );
+            uint64_t on_ref = 0;
+
+            for ( p += 4; bins . size () < n_bin; )
+            {
+                uint32_t const bin = Get32 ( s, p );
+                p += csi ? 16 : 8;
+                uint32_t const n_chunk = Get32 ( s, p - 4 );
+                for ( uint32_t c = 0; c < n_chunk; ++c, p += 16 )
+                    bins [ bin ] . push_back ( make_pair ( Get64 ( s, p ), Get64 ( s, p + 8 ) ) );
+            }
+            if ( ! csi )
+            {
+                uint32_t const n_intv = Get32 ( s, p );
+                for ( p += 4; linear . size () < n_intv; p += 8 )
+                    linear . push_back ( Get64 ( s, p ) );
+            }
+            for ( vector < Placement > :: const_iterator i = placed . begin (); i != placed . end (); ++i )
+            {
+                if ( i -> ref != r )
+                    continue;
+                const vector < pair < uint64_t, uint64_t > > & chunks = bins [ Reg2Bin ( i -> beg, i -> end, min_shift, depth ) ];
+                bool found = false;
+                for ( size_t c = 0; c < chunks . size () && ! found; ++c )
+                    found = chunks [ c ] . first <= i -> vbeg && i -> vend <= chunks [ c ] . second;
+                if ( ! found )
+                    return "record is not in the chunks of its bin";
+                for ( int64_t w = i -> beg >> 14; ! csi && w <= ( i -> end - 1 ) >> 14; ++w )
+                {
+                    if ( w >= ( int64_t ) linear . size () || linear [ w ] > i -> vbeg )
+                        return "linear index is after a record";
+                }
+                ++on_ref;
+            }
+            /* mapped and unmapped counts of the pseudo-bin */
+            if ( on_ref > 0 && ( bins [ pseudo ] . size () != 2 ||
+                                 bins [ pseudo ] [ 1 ] . first + bins [ pseudo ] [ 1 ] . second != on_ref ) )
+                return "wrong record count in the pseudo-bin";
+        }
+        return "";
+    }
+
+    KDirectory * m_dir;
+    uint32_t m_rand;
+    string m_header;
+    vector < string > m_refs;
+    vector < string > m_expected;
+    vector < Placement > m_placed;
+    vector < string > m_files;
+};
+
+FIXTURE_TEST_CASE ( RoundTrip_Bai, BamFixture )
+{
+    vector < string > sam;
+    vector < Placement > placed;
+    REQUIRE_RC ( Write ( "test-bam-writer.bam", 1, "test-bam-writer.bam.bai", 20000 ) );
+    REQUIRE_EQ ( string (), Read ( "test-bam-writer.bam", sam, placed ) );
+    REQUIRE_EQ ( m_expected . size (), sam . size () );
+    for ( size_t i = 0; i < sam . size (); ++i )
+        REQUIRE_EQ ( m_expected [ i ], sam [ i ] );
+    REQUIRE_EQ ( string (), CheckIndex ( "test-bam-writer.bam.bai", placed ) );
+}
+
+FIXTURE_TEST_CASE ( RoundTrip_Csi_Threads, BamFixture )
+{
+    vector < string > sam;
+    vector < Placement > placed;
+    REQUIRE_RC ( Write ( "test-bam-writer-4.bam", 4, "test-bam-writer-4.bam.csi", 20000 ) );
+    REQUIRE_EQ ( string (), Read ( "test-bam-writer-4.bam", sam, placed ) );
+    REQUIRE_EQ ( m_expected . size (), sam . size () );
+    for ( size_t i = 0; i < sam . size (); ++i )
+        REQUIRE_EQ ( m_expected [ i ], sam [ i ] );
+    REQUIRE_EQ ( string (), CheckIndex ( "test-bam-writer-4.bam.csi", placed ) );
+}
+
+FIXTURE_TEST_CASE ( SameBytesOnThreads, BamFixture )
+{
+    REQUIRE_RC ( Write ( "test-bam-writer-t1.bam", 1, NULL, 5000 ) );
+    m_rand = 7;
+    REQUIRE_RC ( Write ( "test-bam-writer-t6.bam", 6, NULL, 5000 ) );
+    REQUIRE ( ReadFile ( "test-bam-writer-t1.bam" ) == ReadFile ( "test-bam-writer-t6.bam" ) );
+}
+
+/* a reference longer than 512M does not fit into BAI: the BAM is written without the index */
+FIXTURE_TEST_CASE ( LongReference_NeedsCsi, BamFixture )
+{
+    vector < string > sam;
+    vector < Placement > placed;
+
+    m_header = "@SQ\tSN:chr1\tLN:1000000\n@SQ\tSN:chr2\tLN:600000000\n";
+    REQUIRE_RC ( Write ( "test-bam-writer-long.bam", 1, "test-bam-writer-long.bam.bai", 100 ) );
+    REQUIRE_EQ ( string (), Read ( "test-bam-writer-long.bam", sam, placed ) );
+    REQUIRE_EQ ( m_expected . size (), sam . size () );
+    REQUIRE ( ! ifstream ( "test-bam-writer-long.bam.bai" ) );
+    REQUIRE_RC ( Write ( "test-bam-writer-long.bam", 1, "test-bam-writer-long.bam.csi", 100 ) );
+    sam . clear ();
+    placed . clear ();
+    REQUIRE_EQ ( string (), Read ( "test-bam-writer-long.bam", sam, placed ) );
+    REQUIRE_EQ ( string (), CheckIndex ( "test-bam-writer-long.bam.csi", placed ) );
+}
+
+FIXTURE_TEST_CASE ( UnknownReference, BamFixture )
+{
+    m_header = "@SQ\tSN:chr1\tLN:1000000\n";
+    REQUIRE_RC_FAIL ( Write ( "test-bam-writer-ref.bam", 1, NULL, 100 ) );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-bam-writer";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=BamWriterTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -0,0 +1,423 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the block-parallel gzip/bzip2 output of sra-pileup, sam-dump
+* and sra-dump: data written through a compression pool is decompressed again
+* and compared with what was written
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <kfs/directory.h>
+#include <kfs/file.h>
+
+#include <sysalloc.h>
+
+#include <zlib.h>
+#include <bzlib.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include "compressed_file.h"
+
+using namespace std;
+using namespace ncbi::NK;
+
+TEST_SUITE(CompressedFileTestSuite);
+
+/* the block sizes of compressed_file.c */
+static const size_t GzipBlock = 256 * 1024;
+static const size_t Bzip2Block = 900 * 1000;
+
+static string ReadFile ( const string & path )
+{
+    ifstream in ( path . c_str (), ios::binary );
+    ostringstream s;
+    s << in . rdbuf ();
+    return s . str ();
+}
+
+/* concatenated gzip-members, the number of members is returned in members */
+static bool Gunzip ( const string & in, string & out, size_t & members )
+{
+    z_stream z;
+    char buf [ 64 * 1024 ];
+    int zr = Z_OK;
+
+    out . clear ();
+    members = 0;
+    memset ( & z, 0, sizeof z );
+    if ( inflateInit2 ( & z, 15 + 32 ) != Z_OK )
+        return false;
+    z . next_in = ( Bytef * ) in . data ();
+    z . avail_in = ( uInt ) in . size ();
+    while ( z . avail_in > 0 )
+    {
+        z . next_out = ( Bytef * ) buf;
+        z . avail_out = sizeof buf;
+        zr = inflate ( & z, Z_NO_FLUSH );
+        out . append ( buf, sizeof buf - z . avail_out );
+        if ( zr == Z_STREAM_END )
+        {
+            ++members;
+            inflateReset ( & z );
+        }
+        else if ( zr != Z_OK )
+            break;
+    }
+    inflateEnd ( & z );
+    return zr == Z_STREAM_END;
+}
+
+/* concatenated bzip2-streams, the number of streams is returned in streams */
+static bool Bunzip2 ( const string & in, string & out, size_t & streams )
+{
+    bz_stream b;
+    char buf [ 64 * 1024 ];
+    int bzr = BZ_OK;
+
+    out . clear ();
+    streams = 0;
+    memset ( & b, 0, sizeof b );
+    b . next_in = ( char * ) in . data ();
+    b . avail_in = ( unsigned int ) in . size ();
+    while ( b . avail_in > 0 )
+    {
+        if ( BZ2_bzDecompressInit ( & b, 0, 0 ) != BZ_OK )
+            return false;
+        do
+        {
+            b . next_out = buf;
+            b . avail_out = sizeof buf;
+            bzr = BZ2_bzDecompress ( & b );
+            out . append ( buf, sizeof buf - b . avail_out );
+        } while ( bzr == BZ_OK && ( b . avail_in > 0 || b . avail_out == 0 ) );
+        BZ2_bzDecompressEnd ( & b );
+        if ( bzr != BZ_STREAM_END )
+            return false;
+        ++streams;
+    }
+    return bzr == BZ_STREAM_END;
+}
+
+/* a gzip-member per block, like the gzip format of compressed_file.c, for other block sizes */
+static rc_t CC GzipBlockCompress ( const uint8_t * udata, size_t ulen,
+                                   uint8_t * cdata, size_t cdata_size, size_t * clen,
+                                   struct z_stream_s * z )
+{
+    int zr;
+
+    z -> next_in = ( Bytef * ) udata;
+    z -> avail_in = ( uInt ) ulen;
+    z -> next_out = ( Bytef * ) cdata;
+    z -> avail_out = ( uInt ) cdata_size;
+    zr = deflate ( z, Z_FINISH );
+    * clen = z -> total_out;
+    deflateReset ( z );
+    return zr == Z_STREAM_END ? 0 : RC ( rcApp, rcFile, rcWriting, rcData, rcUnexpected );
+}
+
+class CompressedFixture
+{
+public:
+    CompressedFixture ()
+    :   m_rand ( 11 )
+    {
+        KDirectoryNativeDir ( & m_dir );
+    }
+    ~CompressedFixture ()
+    {
+        for ( size_t i = 0; i < m_files . size (); ++i )
+            KDirectoryRemove ( m_dir, true, "%s", m_files [ i ] . c_str () );
+        KDirectoryRelease ( m_dir );
+    }
+
+    uint32_t Rand ( uint32_t n )
+    {
+        m_rand = m_rand * 1103515245 + 12345;
+        return ( m_rand >> 8 ) % n;
+    }
+
+    /* text-like data, so it compresses, but not into nothing */
+    string MakeData ( size_t size )
+    {
+        static const char letters [] = "ACGTN\t\n0123456789";
+        string s ( size, ' ' );
+        for ( size_t i = 0; i < size; ++i )
+            s [ i ] = letters [ Rand ( Rand ( 4 ) == 0 ? sizeof letters - 1 : 4 ) ];
+        return s;
+    }
+
+    rc_t CreateFile ( const char * name, KFile ** f )
+    {
+        if ( find ( m_files . begin (), m_files . end (), name ) == m_files . end () )
+            m_files . push_back ( name );
+        return KDirectoryCreateFile ( m_dir, f, false, 0664, kcmInit, "%s", name );
+    }
+
+    /* writes data in pieces of random size, up to max_piece bytes */
+    rc_t WritePieces ( KFile * f, uint64_t & pos, const string & data, size_t max_piece )
+    {
+        rc_t rc = 0;
+        size_t done = 0;
+        while ( rc == 0 && done < data . size () )
+        {
+            size_t n = 1 + Rand ( ( uint32_t ) max_piece );
+            size_t num_writ;
+            if ( n > data . size () - done )
+                n = data . size () - done;
+            rc = KFileWriteAll ( f, pos, data . data () + done, n, & num_writ );
+            pos += num_writ;
+            done += num_writ;
+        }
+        return rc;
+    }
+
+    /* writes data through a pool of threads into name */
+    rc_t Write ( const char * name, bool bzip2, uint32_t threads, const string & data, size_t max_piece )
+    {
+        struct compress_pool * pool = NULL;
+        KFile * dst = NULL;
+        KFile * f = NULL;
+        uint64_t pos = 0;
+        rc_t rc = make_compress_pool ( & pool, threads );
+        if ( rc == 0 )
+            rc = CreateFile ( name, & dst );
+        if ( rc == 0 )
+            rc = make_pooled_compressed_file ( & f, dst, bzip2, pool );
+        if ( rc == 0 )
+            rc = WritePieces ( f, pos, data, max_piece );
+        if ( f != NULL )
+        {
+            /* releasing the file flushes it */
+            rc_t rc2 = KFileRelease ( f );
+            if ( rc == 0 )
+                rc = rc2;
+        }
+        KFileRelease ( dst );
+        release_compress_pool ( pool );
+        return rc;
+    }
+
+    /* decompresses name, returns what differs from data or an empty string */
+    string Check ( const char * name, bool bzip2, const string & data, size_t block_size )
+    {
+        string out;
+        size_t members;
+        size_t expected = data . empty () ? 1 : ( data . size () + block_size - 1 ) / block_size;
+        bool ok = bzip2 ? Bunzip2 ( ReadFile ( name ), out, members ) : Gunzip ( ReadFile ( name ), out, members );
+        ostringstream err;
+
+        if ( !ok )
+            err << name << ": cannot decompress";
+        else if ( out != data )
+            err << name << ": " << out . size () << " bytes decompressed, " << data . size () << " written";
+        else if ( members != expected )
+            err << name << ": " << members << " blocks, expected " << expected;
+        return err . str ();
+    }
+
+    KDirectory * m_dir;
+    vector < string > m_files;
+    uint32_t m_rand;
+};
+
+FIXTURE_TEST_CASE ( Gzip_Empty, CompressedFixture )
+{
+    REQUIRE_RC ( Write ( "test-cf-empty.gz", false, 4, string (), 1 ) );
+    REQUIRE_EQ ( string (), Check ( "test-cf-empty.gz", false, string (), GzipBlock ) );
+}
+
+FIXTURE_TEST_CASE ( Bzip2_Empty, CompressedFixture )
+{
+    REQUIRE_RC ( Write ( "test-cf-empty.bz2", true, 4, string (), 1 ) );
+    REQUIRE_EQ ( string (), Check ( "test-cf-empty.bz2", true, string (), Bzip2Block ) );
+}
+
+FIXTURE_TEST_CASE ( Gzip_BlockBoundaries, CompressedFixture )
+{
+    static const size_t sizes [] = { 1, GzipBlock - 1, GzipBlock, GzipBlock + 1, 3 * GzipBlock };
+    for ( size_t i = 0; i < sizeof sizes / sizeof sizes [ 0 ]; ++i )
+    {
+        string const data = MakeData ( sizes [ i ] );
+        /* in one write and in pieces that end on the boundaries, and in pieces that do not */
+        REQUIRE_RC ( Write ( "test-cf-bound.gz", false, 3, data, data . size () ) );
+        REQUIRE_EQ ( string (), Check ( "test-cf-bound.gz", false, data, GzipBlock ) );
+        REQUIRE_RC ( Write ( "test-cf-bound.gz", false, 3, data, 4096 ) );
+        REQUIRE_EQ ( string (), Check ( "test-cf-bound.gz", false, data, GzipBlock ) );
+    }
+}
+
+FIXTURE_TEST_CASE ( Bzip2_BlockBoundaries, CompressedFixture )
+{
+    static const size_t sizes [] = { Bzip2Block - 1, Bzip2Block, Bzip2Block + 1, 2 * Bzip2Block };
+    for ( size_t i = 0; i < sizeof sizes / sizeof sizes [ 0 ]; ++i )
+    {
+        string const data = MakeData ( sizes [ i ] );
+        REQUIRE_RC ( Write ( "test-cf-bound.bz2", true, 3, data, 100000 ) );
+        REQUIRE_EQ ( string (), Check ( "test-cf-bound.bz2", true, data, Bzip2Block ) );
+    }
+}
+
+FIXTURE_TEST_CASE ( Gzip_Threads, CompressedFixture )
+{
+    static const uint32_t threads [] = { 1, 2, 4, 8 };
+    string const data = MakeData ( 5 * GzipBlock + 12345 );
+    for ( size_t i = 0; i < sizeof threads / sizeof threads [ 0 ]; ++i )
+    {
+        REQUIRE_RC ( Write ( "test-cf-threads.gz", false, threads [ i ], data, 70000 ) );
+        REQUIRE_EQ ( string (), Check ( "test-cf-threads.gz", false, data, GzipBlock ) );
+    }
+}
+
+FIXTURE_TEST_CASE ( Bzip2_Threads, CompressedFixture )
+{
+    static const uint32_t threads [] = { 1, 2, 5 };
+    string const data = MakeData ( 3 * Bzip2Block + 777 );
+    for ( size_t i = 0; i < sizeof threads / sizeof threads [ 0 ]; ++i )
+    {
+        REQUIRE_RC ( Write ( "test-cf-threads.bz2", true, threads [ i ], data, 250000 ) );
+        REQUIRE_EQ ( string (), Check ( "test-cf-threads.bz2", true, data, Bzip2Block ) );
+    }
+}
+
+/* two files written in turns share the threads of one pool */
+FIXTURE_TEST_CASE ( SharedPool, CompressedFixture )
+{
+    struct compress_pool * pool;
+    KFile * dst [ 2 ] = { NULL, NULL };
+    KFile * f [ 2 ] = { NULL, NULL };
+    uint64_t pos [ 2 ] = { 0, 0 };
+    string const data [ 2 ] = { MakeData ( 4 * GzipBlock + 1 ), MakeData ( 3 * Bzip2Block - 1 ) };
+    size_t done [ 2 ] = { 0, 0 };
+
+    REQUIRE_RC ( make_compress_pool ( & pool, 3 ) );
+    REQUIRE_RC ( CreateFile ( "test-cf-shared.gz", & dst [ 0 ] ) );
+    REQUIRE_RC ( CreateFile ( "test-cf-shared.bz2", & dst [ 1 ] ) );
+    REQUIRE_RC ( make_pooled_compressed_file ( & f [ 0 ], dst [ 0 ], false, pool ) );
+    REQUIRE_RC ( make_pooled_compressed_file ( & f [ 1 ], dst [ 1 ], true, pool ) );
+    /* the files hold references to the pool */
+    REQUIRE_RC ( release_compress_pool ( pool ) );
+
+    while ( done [ 0 ] < data [ 0 ] . size () || done [ 1 ] < data [ 1 ] . size () )
+    {
+        for ( int i = 0; i < 2; ++i )
+        {
+            size_t n = 1 + Rand ( 50000 );
+            size_t num_writ;
+            if ( n > data [ i ] . size () - done [ i ] )
+                n = data [ i ] . size () - done [ i ];
+            if ( n == 0 )
+                continue;
+            REQUIRE_RC ( KFileWriteAll ( f [ i ], pos [ i ], data [ i ] . data () + done [ i ], n, & num_writ ) );
+            pos [ i ] += num_writ;
+            done [ i ] += num_writ;
+        }
+    }
+    for ( int i = 0; i < 2; ++i )
+    {
+        REQUIRE_RC ( KFileRelease ( f [ i ] ) );
+        REQUIRE_RC ( KFileRelease ( dst [ i ] ) );
+    }
+    REQUIRE_EQ ( string (), Check ( "test-cf-shared.gz", false, data [ 0 ], GzipBlock ) );
+    REQUIRE_EQ ( string (), Check ( "test-cf-shared.bz2", true, data [ 1 ], Bzip2Block ) );
+}
+
+/* the block stream with other block sizes, as the BAM writer uses it */
+FIXTURE_TEST_CASE ( BlockStream_BlockSizes, CompressedFixture )
+{
+    static const size_t block_sizes [] = { 1000, 4096, 65536 };
+    for ( size_t i = 0; i < sizeof block_sizes / sizeof block_sizes [ 0 ]; ++i )
+    {
+        size_t const bsize = block_sizes [ i ];
+        block_format const fmt = { bsize, bsize + ( bsize >> 12 ) + ( bsize >> 14 ) + 64, 15 + 16,
+                                   GzipBlockCompress, NULL, 0 };
+        size_t const sizes [] = { 0, bsize, 7 * bsize, 7 * bsize + 13 };
+        for ( size_t j = 0; j < sizeof sizes / sizeof sizes [ 0 ]; ++j )
+        {
+            string const data = MakeData ( sizes [ j ] );
+            struct compress_pool * pool;
+            struct block_stream * bs;
+            KFile * dst;
+            size_t done = 0;
+
+            REQUIRE_RC ( make_compress_pool ( & pool, 4 ) );
+            REQUIRE_RC ( CreateFile ( "test-cf-bs.gz", & dst ) );
+            REQUIRE_RC ( make_block_stream ( & bs, dst, & fmt, pool, false ) );
+            while ( done < data . size () )
+            {
+                size_t n = 1 + Rand ( ( uint32_t ) bsize * 2 );
+                if ( n > data . size () - done )
+                    n = data . size () - done;
+                REQUIRE_RC ( block_stream_append ( bs, data . data () + done, n, false, NULL, NULL ) );
+                done += n;
+            }
+            REQUIRE_RC ( block_stream_flush ( bs ) );
+            REQUIRE_RC ( release_block_stream ( bs ) );
+            REQUIRE_RC ( KFileRelease ( dst ) );
+            REQUIRE_RC ( release_compress_pool ( pool ) );
+            REQUIRE_EQ ( string (), Check ( "test-cf-bs.gz", false, data, bsize ) );
+        }
+    }
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-compressed-file";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=CompressedFileTestSuite(argc, argv);
+    return rc;
+}
+
+}
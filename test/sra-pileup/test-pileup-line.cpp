@@ -0,0 +1,455 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the samtools-pileup line builder of sra-pileup: the columns
+* built from placements served by a fake reference-iterator are compared with
+* the line builder it replaced
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <sysalloc.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include "pileup_line.h"
+#include "ref_walker_0.h"
+#include "dyn_string.h"
+#include "4na_ascii.h"
+
+using namespace std;
+using namespace ncbi::NK;
+
+TEST_SUITE(PileupLineTestSuite);
+
+/* what the fake iterator reports for a placement at the current position */
+struct TestPlacement
+{
+    PlacementRecord rec;
+    tool_rec xrec;
+    vector < uint8_t > quality;
+    int32_t state;
+    INSDC_coord_zero seq_pos;
+    vector < INSDC_4na_bin > inserted;
+    INSDC_coord_zero del_pos;
+    vector < INSDC_4na_bin > deleted;
+};
+
+struct ReferenceIterator
+{
+    vector < TestPlacement * > placements;
+    size_t next;
+};
+
+/* the parts of the reference-iterator the line builder uses */
+extern "C"
+{
+
+rc_t CC ReferenceIteratorNextPlacement ( ReferenceIterator * self, const PlacementRecord ** rec )
+{
+    if ( self -> next >= self -> placements . size () )
+        return RC ( rcAlign, rcIterator, rcAccessing, rcItem, rcDone );
+    * rec = & self -> placements [ self -> next ++ ] -> rec;
+    return 0;
+}
+
+static TestPlacement * Current ( const ReferenceIterator * self )
+{
+    return self -> placements [ self -> next - 1 ];
+}
+
+int32_t CC ReferenceIteratorState ( const ReferenceIterator * self, INSDC_coord_zero * seq_pos )
+{
+    TestPlacement * p = Current ( self );
+    * seq_pos = p -> seq_pos;
+    return p -> state;
+}
+
+uint32_t CC ReferenceIteratorBasesInserted ( const ReferenceIterator * self, const INSDC_4na_bin ** bases )
+{
+    TestPlacement * p = Current ( self );
+    * bases = p -> inserted . empty () ? NULL : & p -> inserted [ 0 ];
+    return ( uint32_t ) p -> inserted . size ();
+}
+
+/* like the real one: nothing without a bases-pointer, the bases are allocated for the caller */
+uint32_t CC ReferenceIteratorBasesDeleted ( const ReferenceIterator * self, INSDC_coord_zero * pos,
+                                            const INSDC_4na_bin ** bases )
+{
+    TestPlacement * p = Current ( self );
+    INSDC_4na_bin * copy;
+
+    if ( bases == NULL )
+        return 0;
+    * bases = NULL;
+    if ( p -> deleted . empty () )
+        return 0;
+    copy = ( INSDC_4na_bin * ) malloc ( p -> deleted . size () );
+    memmove ( copy, & p -> deleted [ 0 ], p -> deleted . size () );
+    * pos = p -> del_pos;
+    * bases = copy;
+    return ( uint32_t ) p -> deleted . size ();
+}
+
+void * CC PlacementRecordCast ( const PlacementRecord * self, uint32_t which )
+{
+    return & ( ( TestPlacement * ) self ) -> xrec;
+}
+
+}
+
+/* the line builder before the single capacity-check per placement, as it was in sra-pileup.c */
+static rc_t OldWalkRefPosition ( ReferenceIterator * ref_iter, const PlacementRecord * rec,
+                                 struct dyn_string * line, char * qual, const pileup_options * options )
+{
+    rc_t rc = 0;
+    INSDC_coord_zero seq_pos;
+    int32_t state = ReferenceIteratorState ( ref_iter, & seq_pos );
+    tool_rec * xrec = ( tool_rec * ) PlacementRecordCast ( rec, placementRecordExtension1 );
+    bool reverse = xrec -> reverse;
+
+    if ( !options -> omit_qualities )
+    {
+        if ( seq_pos < ( INSDC_coord_zero ) xrec -> quality_len )
+            * qual = xrec -> quality [ seq_pos ];
+        else
+            * qual = 2;
+    }
+
+    if ( ( state & align_iter_invalid ) == align_iter_invalid )
+        return add_char_2_dyn_string ( line, '?' );
+
+    if ( ( state & align_iter_first ) == align_iter_first )
+    {
+        char s [ 3 ];
+        int32_t c = rec -> mapq + 33;
+        if ( c > '~' ) { c = '~'; }
+        if ( c < 33 ) { c = 33; }
+        s [ 0 ] = '^';
+        s [ 1 ] = c;
+        s [ 2 ] = 0;
+        rc = add_string_2_dyn_string ( line, s );
+    }
+
+    if ( rc == 0 )
+    {
+        if ( ( state & align_iter_skip ) == align_iter_skip )
+        {
+            rc = add_char_2_dyn_string ( line, reverse ? '<' : '>' );
+            if ( !options -> omit_qualities )
+                * qual = xrec -> quality [ seq_pos + 1 ];
+        }
+        else if ( ( state & align_iter_match ) == align_iter_match )
+            rc = add_char_2_dyn_string ( line, ( reverse ? ',' : '.' ) );
+        else
+            rc = add_char_2_dyn_string ( line, _4na_to_ascii ( state, reverse ) );
+    }
+
+    if ( ( state & align_iter_insert ) == align_iter_insert )
+    {
+        const INSDC_4na_bin * bases;
+        uint32_t i;
+        uint32_t n = ReferenceIteratorBasesInserted ( ref_iter, & bases );
+
+        rc = print_2_dyn_string ( line, "+%u", n );
+        for ( i = 0; i < n && rc == 0; ++i )
+            rc = add_char_2_dyn_string ( line, _4na_to_ascii ( bases [ i ], reverse ) );
+    }
+
+    if ( ( state & align_iter_delete ) == align_iter_delete )
+    {
+        const INSDC_4na_bin * bases;
+        INSDC_coord_zero ref_pos;
+        uint32_t n = ReferenceIteratorBasesDeleted ( ref_iter, & ref_pos, & bases );
+        if ( bases != NULL )
+        {
+            uint32_t i;
+            rc = print_2_dyn_string ( line, "-%u", n );
+            for ( i = 0; i < n && rc == 0; ++i )
+                rc = add_char_2_dyn_string ( line, _4na_to_ascii ( bases [ i ], reverse ) );
+            free ( ( void * ) bases );
+        }
+    }
+
+    if ( ( ( state & align_iter_last ) == align_iter_last ) && ( rc == 0 ) )
+        rc = add_char_2_dyn_string ( line, '$' );
+
+    if ( options -> show_id )
+        rc = print_2_dyn_string ( line, "(%,lu:%,d-%,d/%u)",
+                                  rec -> id, rec -> pos + 1, rec -> pos + rec -> len, seq_pos );
+
+    return rc;
+}
+
+static rc_t OldWalkAlignments ( ReferenceIterator * ref_iter, struct dyn_string * line,
+                                struct dyn_string * qualities, const pileup_options * options )
+{
+    uint32_t depth = 0;
+    rc_t rc;
+    do
+    {
+        const PlacementRecord * rec;
+        rc = ReferenceIteratorNextPlacement ( ref_iter, & rec );
+        if ( rc == 0 )
+            rc = OldWalkRefPosition ( ref_iter, rec, line, dyn_string_char ( qualities, depth++ ), options );
+    } while ( rc == 0 );
+
+    if ( !options -> omit_qualities )
+    {
+        uint32_t i;
+        add_char_2_dyn_string ( line, '\t' );
+        for ( i = 0; i < depth; ++i )
+            add_char_2_dyn_string ( line, * dyn_string_char ( qualities, i ) + 33 );
+    }
+
+    if ( GetRCState ( rc ) == rcDone ) { rc = 0; }
+    return rc;
+}
+
+class PileupLineFixture
+{
+public:
+    PileupLineFixture ()
+    :   m_rand ( 5 ), m_line ( NULL ), m_qualities ( NULL )
+    {
+        memset ( & m_options, 0, sizeof m_options );
+        memset ( & m_dels, 0, sizeof m_dels );
+        m_iter . next = 0;
+        /* small, so the lines have to grow */
+        allocated_dyn_string ( & m_line, 16 );
+        allocated_dyn_string ( & m_qualities, 1024 );
+    }
+    ~PileupLineFixture ()
+    {
+        Clear ();
+        release_deletion_cache ( & m_dels );
+        free_dyn_string ( m_line );
+        free_dyn_string ( m_qualities );
+    }
+
+    uint32_t Rand ( uint32_t n )
+    {
+        m_rand = m_rand * 1103515245 + 12345;
+        return ( m_rand >> 8 ) % n;
+    }
+
+    void Clear ()
+    {
+        for ( size_t i = 0; i < m_iter . placements . size (); ++i )
+            delete m_iter . placements [ i ];
+        m_iter . placements . clear ();
+        m_iter . next = 0;
+    }
+
+    TestPlacement * Add ( int32_t state, bool reverse, int32_t mapq )
+    {
+        TestPlacement * p = new TestPlacement;
+        memset ( & p -> rec, 0, sizeof p -> rec );
+        p -> rec . id = 1000 + m_iter . placements . size ();
+        p -> rec . pos = 500;
+        p -> rec . len = 100;
+        p -> rec . mapq = mapq;
+        p -> quality . resize ( 100 );
+        for ( size_t i = 0; i < p -> quality . size (); ++i )
+            p -> quality [ i ] = ( uint8_t ) ( i % 41 );
+        p -> xrec . reverse = reverse;
+        p -> xrec . tlen = 0;
+        p -> xrec . quality_len = ( uint32_t ) p -> quality . size ();
+        p -> xrec . quality = & p -> quality [ 0 ];
+        p -> state = state;
+        p -> seq_pos = 10;
+        p -> del_pos = 0;
+        m_iter . placements . push_back ( p );
+        return p;
+    }
+
+    static vector < INSDC_4na_bin > Bases ( const char * acgt )
+    {
+        vector < INSDC_4na_bin > v;
+        for ( ; * acgt != 0; ++acgt )
+            v . push_back ( * acgt == 'A' ? 1 : * acgt == 'C' ? 2 : * acgt == 'G' ? 4 : * acgt == 'T' ? 8 : 15 );
+        return v;
+    }
+
+    /* a random column: matches, mismatches, skips, inserts, deletions shared by neighbours */
+    void AddRandom ( size_t count )
+    {
+        INSDC_coord_zero del_pos = 0;
+        vector < INSDC_4na_bin > del;
+
+        for ( size_t i = 0; i < count; ++i )
+        {
+            int32_t state = Rand ( 3 ) == 0 ? ( int32_t ) ( 1 << Rand ( 4 ) ) : align_iter_match;
+            TestPlacement * p;
+
+            if ( Rand ( 10 ) == 0 ) state |= align_iter_first;
+            if ( Rand ( 10 ) == 0 ) state |= align_iter_last;
+            if ( Rand ( 20 ) == 0 ) state = align_iter_skip;
+            if ( Rand ( 50 ) == 0 ) state = align_iter_invalid;
+            if ( Rand ( 8 ) == 0 ) state |= align_iter_insert;
+            if ( Rand ( 4 ) == 0 ) state |= align_iter_delete;
+            p = Add ( state, Rand ( 2 ) == 0, ( int32_t ) Rand ( 120 ) - 10 );
+            p -> seq_pos = Rand ( 98 );
+            if ( ( state & align_iter_insert ) == align_iter_insert )
+            {
+                p -> inserted . resize ( 1 + Rand ( 12 ) );
+                for ( size_t j = 0; j < p -> inserted . size (); ++j )
+                    p -> inserted [ j ] = ( INSDC_4na_bin ) Rand ( 16 );
+            }
+            if ( ( state & align_iter_delete ) == align_iter_delete )
+            {
+                /* most deletions are the same as the one before */
+                if ( del . empty () || Rand ( 3 ) == 0 )
+                {
+                    del_pos = 400 + Rand ( 200 );
+                    del . resize ( 1 + Rand ( 30 ) );
+                    for ( size_t j = 0; j < del . size (); ++j )
+                        del [ j ] = ( INSDC_4na_bin ) Rand ( 16 );
+                }
+                p -> del_pos = del_pos;
+                p -> deleted = del;
+            }
+        }
+    }
+
+    string Walk ( bool old )
+    {
+        rc_t rc;
+        m_iter . next = 0;
+        reset_dyn_string ( m_line );
+        add_string_2_dyn_string ( m_line, "chr1\t501\tA\t" );
+        if ( old )
+            rc = OldWalkAlignments ( & m_iter, m_line, m_qualities, & m_options );
+        else
+            rc = walk_placements ( & m_iter, m_line, m_qualities, & m_dels, & m_options );
+        if ( rc != 0 )
+            return "walk failed";
+        return string ( dyn_string_char ( m_line, 0 ), dyn_string_len ( m_line ) );
+    }
+
+    ReferenceIterator m_iter;
+    uint32_t m_rand;
+    pileup_options m_options;
+    deletion_cache m_dels;
+    struct dyn_string * m_line;
+    struct dyn_string * m_qualities;
+};
+
+FIXTURE_TEST_CASE ( Deletion_IsReported, PileupLineFixture )
+{
+    TestPlacement * p = Add ( align_iter_match | align_iter_delete | align_iter_first, false, 40 );
+    p -> del_pos = 510;
+    p -> deleted = Bases ( "ACG" );
+    p = Add ( align_iter_match | align_iter_delete | align_iter_last, true, 40 );
+    p -> del_pos = 510;
+    p -> deleted = Bases ( "ACG" );
+
+    m_options . omit_qualities = true;
+    REQUIRE_EQ ( string ( "chr1\t501\tA\t^I.-3ACG,-3acg$" ), Walk ( false ) );
+}
+
+FIXTURE_TEST_CASE ( Deletion_ChangesBetweenPlacements, PileupLineFixture )
+{
+    TestPlacement * p = Add ( align_iter_match | align_iter_delete, false, 0 );
+    p -> del_pos = 510;
+    p -> deleted = Bases ( "ACG" );
+    p = Add ( align_iter_match | align_iter_delete, false, 0 );
+    p -> del_pos = 510;
+    p -> deleted = Bases ( "ACGT" );
+    p = Add ( align_iter_match | align_iter_delete, false, 0 );
+    p -> del_pos = 511;
+    p -> deleted = Bases ( "CGTT" );
+    p = Add ( align_iter_match, false, 0 );
+    p = Add ( ( int32_t ) 8 | align_iter_delete, true, 0 );
+    p -> del_pos = 511;
+    p -> deleted = Bases ( "CGTT" );
+
+    m_options . omit_qualities = true;
+    REQUIRE_EQ ( string ( "chr1\t501\tA\t.-3ACG.-4ACGT.-4CGTT.t-4cgtt" ), Walk ( false ) );
+    /* the cache is kept from one position to the next */
+    REQUIRE_EQ ( string ( "chr1\t501\tA\t.-3ACG.-4ACGT.-4CGTT.t-4cgtt" ), Walk ( false ) );
+}
+
+FIXTURE_TEST_CASE ( InsertSkipAndQualities, PileupLineFixture )
+{
+    TestPlacement * p = Add ( align_iter_match | align_iter_insert | align_iter_first, false, 200 );
+    p -> inserted = Bases ( "TTAGN" );
+    p -> seq_pos = 3;
+    p = Add ( align_iter_skip, true, 0 );
+    p -> seq_pos = 4;
+    p = Add ( align_iter_invalid, false, 0 );
+    p -> seq_pos = 7;
+
+    REQUIRE_EQ ( string ( "chr1\t501\tA\t^~.+5TTAGN<?\t$&(" ), Walk ( false ) );
+}
+
+FIXTURE_TEST_CASE ( SameAsOldBuilder, PileupLineFixture )
+{
+    for ( int round = 0; round < 200; ++round )
+    {
+        Clear ();
+        AddRandom ( 1 + Rand ( round < 100 ? 20 : 400 ) );
+        m_options . omit_qualities = Rand ( 2 ) == 0;
+        m_options . show_id = Rand ( 4 ) == 0;
+        REQUIRE_EQ ( Walk ( true ), Walk ( false ) );
+    }
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-pileup-line";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=PileupLineTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -0,0 +1,401 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the parallel stat of sra-pileup: the windows a worker walks
+* and the main-thread reduces in reference-order have to print the same lines
+* as the serial walk over the whole reference
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <klib/out.h>
+#include <klib/rc.h>
+
+#include <sysalloc.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include "ref_walker_0.h"
+#include "pileup_stat.h"
+
+using namespace std;
+using namespace ncbi::NK;
+
+TEST_SUITE(PileupStatTestSuite);
+
+struct TestRead
+{
+    PlacementRecord rec;
+    tool_rec xrec;
+};
+
+struct TestRef
+{
+    string name;
+    vector < TestRead * > reads;   /* ordered by position */
+};
+
+/* a reference-window of the fake iterator, 0-based and inclusive */
+struct TestWindow
+{
+    TestRef * ref;
+    INSDC_coord_zero first;
+    INSDC_coord_zero last;
+};
+
+struct ReferenceIterator
+{
+    vector < TestWindow > windows;
+    size_t window;          /* the current window */
+    bool started;
+    bool window_pending;    /* NextReference() was called, the window not handed out yet */
+    INSDC_coord_zero pos;
+    bool spotgroup_done;
+    vector < TestRead * > at_pos;
+    size_t next;
+};
+
+/* the parts of the reference-iterator and the reference-object walk_0() uses */
+extern "C"
+{
+
+rc_t CC ReferenceIteratorNextReference ( ReferenceIterator * self, INSDC_coord_zero * first_pos,
+                                         INSDC_coord_len * len, struct ReferenceObj const ** refobj )
+{
+    if ( self -> started )
+    {
+        /* the remaining windows of the current reference */
+        TestRef * ref = self -> windows [ self -> window ] . ref;
+        while ( self -> window < self -> windows . size () && self -> windows [ self -> window ] . ref == ref )
+            ++ self -> window;
+    }
+    self -> started = true;
+    if ( self -> window >= self -> windows . size () )
+        return RC ( rcAlign, rcIterator, rcAccessing, rcItem, rcDone );
+    self -> window_pending = true;
+    * first_pos = 0;
+    * len = 0;
+    * refobj = ( struct ReferenceObj const * ) self -> windows [ self -> window ] . ref;
+    return 0;
+}
+
+rc_t CC ReferenceIteratorNextWindow ( ReferenceIterator * self, INSDC_coord_zero * first_pos, INSDC_coord_len * len )
+{
+    TestWindow * w;
+    if ( self -> window_pending )
+        self -> window_pending = false;
+    else if ( self -> window + 1 < self -> windows . size () &&
+              self -> windows [ self -> window + 1 ] . ref == self -> windows [ self -> window ] . ref )
+        ++ self -> window;
+    else
+        return RC ( rcAlign, rcIterator, rcAccessing, rcItem, rcDone );
+    w = & self -> windows [ self -> window ];
+    self -> pos = w -> first - 1;
+    * first_pos = w -> first;
+    * len = w -> last - w -> first + 1;
+    return 0;
+}
+
+rc_t CC ReferenceIteratorNextPos ( ReferenceIterator * self, bool skip_empty )
+{
+    TestWindow * w = & self -> windows [ self -> window ];
+    if ( self -> pos >= w -> last )
+        return RC ( rcAlign, rcIterator, rcAccessing, rcItem, rcDone );
+    ++ self -> pos;
+    self -> at_pos . clear ();
+    for ( size_t i = 0; i < w -> ref -> reads . size (); ++i )
+    {
+        TestRead * r = w -> ref -> reads [ i ];
+        if ( r -> rec . pos <= self -> pos && self -> pos < r -> rec . pos + ( INSDC_coord_zero ) r -> rec . len )
+            self -> at_pos . push_back ( r );
+    }
+    self -> spotgroup_done = false;
+    return 0;
+}
+
+rc_t CC ReferenceIteratorPosition ( const ReferenceIterator * self, INSDC_coord_zero * pos,
+                                    uint32_t * depth, INSDC_4na_bin * base )
+{
+    * pos = self -> pos;
+    * depth = ( uint32_t ) self -> at_pos . size ();
+    * base = ( INSDC_4na_bin ) ( 1 << ( self -> pos % 4 ) );
+    return 0;
+}
+
+rc_t CC ReferenceIteratorNextSpotGroup ( ReferenceIterator * self, const char ** name, size_t * len )
+{
+    if ( self -> spotgroup_done )
+        return RC ( rcAlign, rcIterator, rcAccessing, rcItem, rcDone );
+    self -> spotgroup_done = true;
+    self -> next = 0;
+    * name = NULL;
+    * len = 0;
+    return 0;
+}
+
+rc_t CC ReferenceIteratorNextPlacement ( ReferenceIterator * self, const PlacementRecord ** rec )
+{
+    if ( self -> next >= self -> at_pos . size () )
+        return RC ( rcAlign, rcIterator, rcAccessing, rcItem, rcDone );
+    * rec = & self -> at_pos [ self -> next ++ ] -> rec;
+    return 0;
+}
+
+int32_t CC ReferenceIteratorState ( const ReferenceIterator * self, INSDC_coord_zero * seq_pos )
+{
+    const TestRead * r = self -> at_pos [ self -> next - 1 ];
+    int32_t state = align_iter_match;
+    * seq_pos = self -> pos - r -> rec . pos;
+    if ( ( r -> rec . id + self -> pos ) % 29 == 0 )
+        return align_iter_invalid;
+    if ( * seq_pos == 0 )
+        state |= align_iter_first;
+    if ( * seq_pos + 1 == ( INSDC_coord_zero ) r -> rec . len )
+        state |= align_iter_last;
+    return state;
+}
+
+void * CC PlacementRecordCast ( const PlacementRecord * self, uint32_t which )
+{
+    return & ( ( TestRead * ) self ) -> xrec;
+}
+
+rc_t CC ReferenceObj_SeqId ( const ReferenceObj * self, const char ** seqid )
+{
+    * seqid = ( ( const TestRef * ) self ) -> name . c_str ();
+    return 0;
+}
+
+rc_t CC ReferenceObj_Name ( const ReferenceObj * self, const char ** name )
+{
+    * name = ( ( const TestRef * ) self ) -> name . c_str ();
+    return 0;
+}
+
+static rc_t CC WriteToString ( void * self, const char * buffer, size_t bytes, size_t * num_writ )
+{
+    ( ( string * ) self ) -> append ( buffer, bytes );
+    * num_writ = bytes;
+    return 0;
+}
+
+}
+
+class PileupStatFixture
+{
+public:
+    PileupStatFixture ()
+    :   m_rand ( 7 )
+    {
+        memset ( & m_options, 0, sizeof m_options );
+        KOutHandlerSet ( WriteToString, & m_out );
+    }
+    ~PileupStatFixture ()
+    {
+        for ( size_t i = 0; i < m_refs . size (); ++i )
+        {
+            for ( size_t j = 0; j < m_refs [ i ] -> reads . size (); ++j )
+                delete m_refs [ i ] -> reads [ j ];
+            delete m_refs [ i ];
+        }
+    }
+
+    uint32_t Rand ( uint32_t n )
+    {
+        m_rand = m_rand * 1103515245 + 12345;
+        return ( m_rand >> 8 ) % n;
+    }
+
+    /* reads of 20 to 170 bases on both strands, some without template-length */
+    TestRef * AddRef ( const char * name, INSDC_coord_len len, size_t reads )
+    {
+        TestRef * ref = new TestRef;
+        INSDC_coord_zero pos = 0;
+        ref -> name = name;
+        for ( size_t i = 0; i < reads && pos < ( INSDC_coord_zero ) len; ++i )
+        {
+            TestRead * r = new TestRead;
+            memset ( r, 0, sizeof * r );
+            r -> rec . id = ( int64_t ) ( m_refs . size () * 1000000 + i + 1 );
+            r -> rec . pos = pos;
+            r -> rec . len = 20 + Rand ( 150 );
+            if ( r -> rec . pos + r -> rec . len > len )
+                r -> rec . len = len - r -> rec . pos;
+            r -> xrec . reverse = Rand ( 2 ) == 0;
+            r -> xrec . tlen = Rand ( 8 ) == 0 ? 0 : ( int32_t ) Rand ( 1200 ) - 600;
+            ref -> reads . push_back ( r );
+            /* now and then a gap without coverage */
+            pos += Rand ( 40 ) == 0 ? 200 + Rand ( 300 ) : Rand ( 12 );
+        }
+        m_refs . push_back ( ref );
+        return ref;
+    }
+
+    /* the serial walk: one window per reference or slice */
+    string Serial ( const vector < TestWindow > & slices )
+    {
+        ReferenceIterator iter;
+        iter . windows = slices;
+        iter . window = 0;
+        iter . started = false;
+        iter . window_pending = false;
+        m_out . clear ();
+        if ( walk_stat ( & iter, & m_options ) != 0 )
+            return "walk failed";
+        return m_out;
+    }
+
+    /* every slice cut into windows of window_size positions, each walked by its own iterator
+       like a worker does, the windows reduced in order */
+    string Parallel ( const vector < TestWindow > & slices, INSDC_coord_len window_size )
+    {
+        stat_counters * counters = NULL;
+        rc_t rc;
+
+        m_out . clear ();
+        rc = make_stat_reduction ( & counters );
+        for ( size_t i = 0; rc == 0 && i < slices . size (); ++i )
+        {
+            for ( INSDC_coord_zero first = slices [ i ] . first; rc == 0 && first <= slices [ i ] . last;
+                  first += window_size )
+            {
+                ReferenceIterator iter;
+                TestWindow w = slices [ i ];
+                stat_window * window = NULL;
+
+                w . first = first;
+                if ( w . last - first >= ( INSDC_coord_zero ) window_size )
+                    w . last = first + window_size - 1;
+                iter . windows . push_back ( w );
+                iter . window = 0;
+                iter . started = false;
+                iter . window_pending = false;
+
+                rc = walk_stat_window ( & iter, & m_options, & window );
+                if ( rc == 0 )
+                    rc = reduce_stat_window ( counters, window, first == slices [ i ] . first );
+                release_stat_window ( window );
+            }
+        }
+        release_stat_reduction ( counters );
+        if ( rc != 0 )
+            return "walk failed";
+        return m_out;
+    }
+
+    static TestWindow Slice ( TestRef * ref, INSDC_coord_zero first, INSDC_coord_zero last )
+    {
+        TestWindow w = { ref, first, last };
+        return w;
+    }
+
+    uint32_t m_rand;
+    pileup_options m_options;
+    vector < TestRef * > m_refs;
+    string m_out;
+};
+
+FIXTURE_TEST_CASE ( WholeReferences, PileupStatFixture )
+{
+    vector < TestWindow > slices;
+    slices . push_back ( Slice ( AddRef ( "chr1", 3500, 1000 ), 0, 3499 ) );
+    slices . push_back ( Slice ( AddRef ( "chr2", 2200, 600 ), 0, 2199 ) );
+    slices . push_back ( Slice ( AddRef ( "chrM", 300, 100 ), 0, 299 ) );
+
+    string serial = Serial ( slices );
+    REQUIRE_NE ( string ( "walk failed" ), serial );
+    REQUIRE_GT ( serial . size (), ( size_t ) 100000 );
+
+    /* windows of one position, windows that cut reads, a window per reference */
+    REQUIRE_EQ ( serial, Parallel ( slices, 1 ) );
+    REQUIRE_EQ ( serial, Parallel ( slices, 7 ) );
+    REQUIRE_EQ ( serial, Parallel ( slices, 256 ) );
+    REQUIRE_EQ ( serial, Parallel ( slices, 1000 ) );
+    REQUIRE_EQ ( serial, Parallel ( slices, 5000 ) );
+}
+
+FIXTURE_TEST_CASE ( Slices, PileupStatFixture )
+{
+    TestRef * chr1 = AddRef ( "chr1", 4000, 1200 );
+    TestRef * chr2 = AddRef ( "chr2", 1500, 400 );
+    vector < TestWindow > slices;
+    slices . push_back ( Slice ( chr1, 99, 1499 ) );
+    slices . push_back ( Slice ( chr1, 2000, 3299 ) );
+    slices . push_back ( Slice ( chr2, 500, 1499 ) );
+
+    string serial = Serial ( slices );
+    REQUIRE_NE ( string ( "walk failed" ), serial );
+
+    REQUIRE_EQ ( serial, Parallel ( slices, 3 ) );
+    REQUIRE_EQ ( serial, Parallel ( slices, 333 ) );
+    REQUIRE_EQ ( serial, Parallel ( slices, 2000 ) );
+}
+
+FIXTURE_TEST_CASE ( Empty, PileupStatFixture )
+{
+    vector < TestWindow > slices;
+    slices . push_back ( Slice ( AddRef ( "chr1", 100, 0 ), 0, 99 ) );
+
+    string serial = Serial ( slices );
+    REQUIRE_EQ ( serial, Parallel ( slices, 10 ) );
+    REQUIRE_EQ ( serial, Parallel ( vector < TestWindow > (), 10 ) );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-pileup-stat";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=PileupStatTestSuite(argc, argv);
+    return rc;
+}
+
+}
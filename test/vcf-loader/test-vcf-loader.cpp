@@ -47,6 +47,7 @@
 #include <sysalloc.h>
 #include <stdexcept>
 #include <sstream>
+#include <vector>
 #include <memory.h>
 
 extern "C" {
@@ -491,11 +492,55 @@ public:
         return rc;
     }
     
+    static rc_t CC StreamLine(void* data, const VcfDataLine* line)
+    {
+        VcfReaderFixture* self = (VcfReaderFixture*)data;
+        ostringstream s;
+        s << string(line->chromosome.addr, line->chromosome.len) << ":" << line->position << ":" << string(line->altBases.addr, line->altBases.len);
+        uint32_t fieldCount = 0;
+        VNameListCount(line->genotypeFields, &fieldCount);
+        for (uint32_t i = 0; i < fieldCount; ++i)
+        {
+            const char* name;
+            VNameListGet(line->genotypeFields, i, &name);
+            s << ":" << name;
+        }
+        self->streamed.push_back(s.str());
+        return 0;
+    }
+    
+    rc_t ParseFileStream(const char* p_filename, size_t p_windowSize)
+    {
+        messages = 0;
+        messageCount = 0;
+        streamed.clear();
+        
+        const KFile* file;
+        rc_t rc = KDirectoryOpenFileRead(wd, &file, p_filename);
+        if (rc == 0)
+        {   
+            rc = VcfReaderParseStream(reader, file, p_windowSize, StreamLine, this, &messages);
+            if (messages != NULL)
+            {
+                rc_t rc2 = VNameListCount(messages, &messageCount);
+                if (rc == 0)
+                    rc = rc2;
+            }
+            
+            if (rc == 0)
+                rc = KFileRelease(file);
+            else
+                KFileRelease(file);
+        }
+        return rc;
+    }
+    
     KDirectory* wd;
     VcfReader *reader;
     string filename;
     const struct VNamelist* messages;
     uint32_t messageCount;
+    vector<string> streamed;
 };
 
 FIXTURE_TEST_CASE(VcfReader_EmptyFile, VcfReaderFixture)
@@ -609,6 +654,63 @@ FIXTURE_TEST_CASE(VcfReader_Parse_Errors, VcfReaderFixture)
     REQUIRE_EQ(string("line 4 column 31: one or more of the 8 mandatory columns are missing"), string(msg));
 }
 
+FIXTURE_TEST_CASE(VcfReader_ParseStream, VcfReaderFixture)
+{   
+    REQUIRE_RC(CreateFile(GetName(), 
+        "##fileformat=VCFv4.2\n"
+        "##fileDate=20090805\n"
+        "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+        "20\t14370\trs6054257\tG\tA\t29\tPASS\tNS=3;DP=14;AF=0.5;DB;H2\tblah1\t2blah\n"
+        "20\t17330\t.\tT\tACGTACGTACGTACGTACGTACGTACGT\t3\tq10\tNS=3;DP=11;AF=0.017\n"
+        "21\t1\t.\tT\tC\t3\tq10\tNS=3\n"
+        ));
+    // the window is smaller than a line, to make it grow and slide
+    REQUIRE_RC(ParseFileStream(GetName(), 16)); 
+    REQUIRE_EQ(0u, messageCount);
+        
+    REQUIRE_EQ((size_t)3, streamed.size());
+    REQUIRE_EQ(string("20:14370:A:blah1:2blah"), streamed[0]);
+    REQUIRE_EQ(string("20:17330:ACGTACGTACGTACGTACGTACGTACGT"), streamed[1]);
+    REQUIRE_EQ(string("21:1:C"), streamed[2]);
+    
+    // streamed lines are not kept
+    uint32_t count;
+    REQUIRE_RC(VcfReaderGetDataLineCount(reader, &count));
+    REQUIRE_EQ(0u, count);
+}
+
+FIXTURE_TEST_CASE(VcfReader_ParseStream_Errors, VcfReaderFixture)
+{   
+    REQUIRE_RC(CreateFile(GetName(), 
+        "##fileformat=VCFv4.2\n"
+        "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+        "20\t14370\trs6054257\tG\tA\t1000\tPASS\tNS=3;DP=14;AF=0.5;DB;H2\tblah1\t2blah\tetc...\n"
+        "20\t14370\trs6054257\tG\tA\t10\tPASS\n"
+        "20\t17330\t.\tT\tA\t3\tq10\tNS=3;DP=11;AF=0.017\n"
+        ));
+    REQUIRE_RC_FAIL(ParseFileStream(GetName(), 0)); 
+    REQUIRE_EQ(2u, messageCount);
+    const char* msg;
+    REQUIRE_RC(VNameListGet ( messages, 0, &msg ));
+    REQUIRE_EQ(string("line 3 column 24: invalid numeric value for 'quality'"), string(msg));
+    REQUIRE_RC(VNameListGet ( messages, 1, &msg ));
+    REQUIRE_EQ(string("line 4 column 31: one or more of the 8 mandatory columns are missing"), string(msg));
+    
+    // only the good line is handed out
+    REQUIRE_EQ((size_t)1, streamed.size());
+    REQUIRE_EQ(string("20:17330:A"), streamed[0]);
+}
+
+FIXTURE_TEST_CASE(VcfReader_ParseStream_EmptyFile, VcfReaderFixture)
+{
+    REQUIRE_RC(CreateFile(GetName(), "")); 
+    REQUIRE_RC_FAIL(ParseFileStream(GetName(), 0)); 
+    REQUIRE_EQ(1u, messageCount);
+    const char* msg;
+    REQUIRE_RC(VNameListGet ( messages, 0, &msg ));
+    REQUIRE_EQ(string("Empty file"), string(msg)); 
+}
+
 // VcfDatabase
 class VcfDatabaseFixture : public VcfReaderFixture
 {
@@ -825,6 +927,99 @@ FIXTURE_TEST_CASE(VcfDatabaseBasic, VcfDatabaseFixture)
     Teardown();
 }
 
+FIXTURE_TEST_CASE(VcfDatabaseLoad, VcfDatabaseFixture)
+{
+    Setup(GetName());
+
+    string vcfName = string(GetName()) + ".vcf";
+    REQUIRE_RC(CreateFile(vcfName.c_str(), 
+        "##fileformat=VCFv4.2\n"
+        "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+        "20\t14370\trs6054257\tG\tCCCC\t29\tPASS\tNS=3;DP=14;AF=0.5;DB;H2\n"
+        "20\t17330\t.\tT\tA\t3\tq10\tNS=3;DP=11;AF=0.017\n"
+        ));
+    const KFile* file;
+    REQUIRE_RC(KDirectoryOpenFileRead(wd, &file, vcfName.c_str()));
+    REQUIRE_RC(VcfDatabaseLoad(reader, file, m_cfgName.c_str(), m_db, &messages));
+    REQUIRE_RC(KFileRelease(file));
+
+    // verify
+    const VTable *tbl;
+    REQUIRE_RC(VDBManagerOpenTableRead(m_vdbMgr, &tbl, m_schema, (m_dbName+"/tbl/VARIANT").c_str()));
+    VCursor *cur;
+    REQUIRE_RC(VTableCreateCursorRead( tbl, (const VCursor**)&cur ));
+    
+    uint32_t position_idx, sequence_idx;
+    REQUIRE_RC(VCursorAddColumn( cur, &position_idx, "position" ));
+    REQUIRE_RC(VCursorAddColumn( cur, &sequence_idx, "sequence" ));    
+    REQUIRE_RC(VCursorOpen( cur ));
+    
+    char buf[256];
+    uint32_t row_len;
+    const uint32_t elemBits = 8;
+
+    REQUIRE_RC(VCursorReadDirect(cur, 1, position_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ((INSDC_coord_zero)(14370u % basesPerRow), *(INSDC_coord_zero*)buf);
+    REQUIRE_RC(VCursorReadDirect(cur, 1, sequence_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ(string(buf, row_len), string("CCCC"));
+    
+    REQUIRE_RC(VCursorReadDirect(cur, 2, position_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ((INSDC_coord_zero)(17330u % basesPerRow), *(INSDC_coord_zero*)buf);
+    REQUIRE_RC(VCursorReadDirect(cur, 2, sequence_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ(string(buf, row_len), string("A"));
+
+    REQUIRE_RC_FAIL(VCursorReadDirect(cur, 3, position_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    
+    REQUIRE_RC(VCursorRelease(cur));
+    REQUIRE_RC(VTableRelease(tbl));
+    KDirectoryRemove(wd, true, vcfName.c_str());
+    Teardown();
+}
+
+FIXTURE_TEST_CASE(VcfDatabase_RepeatedPosition, VcfDatabaseFixture)
+{   // consecutive lines at the same position reuse the cached translation
+    Setup(GetName());
+
+    REQUIRE_RC(CreateFile(GetName(), 
+        "##fileformat=VCFv4.2\n"
+        "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+        "20\t14370\t.\tG\tA\t29\tPASS\tNS=3\n"
+        "20\t14370\t.\tG\tCC\t29\tPASS\tNS=3\n"
+        "20\t17330\t.\tT\tA\t3\tq10\tNS=3\n"
+        ));
+    REQUIRE_RC(ParseFile(GetName())); 
+
+    REQUIRE_RC(VcfDatabaseSave(reader, m_cfgName.c_str(), m_db));
+
+    // verify
+    const VTable *tbl;
+    REQUIRE_RC(VDBManagerOpenTableRead(m_vdbMgr, &tbl, m_schema, (m_dbName+"/tbl/VARIANT").c_str()));
+    VCursor *cur;
+    REQUIRE_RC(VTableCreateCursorRead( tbl, (const VCursor**)&cur ));
+    
+    uint32_t position_idx, sequence_idx;
+    REQUIRE_RC(VCursorAddColumn( cur, &position_idx, "position" ));
+    REQUIRE_RC(VCursorAddColumn( cur, &sequence_idx, "sequence" ));    
+    REQUIRE_RC(VCursorOpen( cur ));
+    
+    char buf[256];
+    uint32_t row_len;
+    const uint32_t elemBits = 8;
+
+    REQUIRE_RC(VCursorReadDirect(cur, 1, position_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ((INSDC_coord_zero)(14370u % basesPerRow), *(INSDC_coord_zero*)buf);
+    REQUIRE_RC(VCursorReadDirect(cur, 2, position_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ((INSDC_coord_zero)(14370u % basesPerRow), *(INSDC_coord_zero*)buf);
+    REQUIRE_RC(VCursorReadDirect(cur, 2, sequence_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ(string(buf, row_len), string("CC"));
+    REQUIRE_RC(VCursorReadDirect(cur, 3, position_idx, elemBits, buf, sizeof(buf), &row_len ));    
+    REQUIRE_EQ((INSDC_coord_zero)(17330u % basesPerRow), *(INSDC_coord_zero*)buf);
+    
+    REQUIRE_RC(VCursorRelease(cur));
+    REQUIRE_RC(VTableRelease(tbl));
+    Teardown();
+}
+
 //////////////////////////////////////////// Main
 #include <kapp/args.h>
 #include <kfg/config.h>
@@ -62,6 +62,9 @@ typedef struct globals
     unsigned maxWarnCount_DupConflict;
     unsigned pid;
     unsigned minMatchCount; /* minimum number of matches to count as an alignment */
+    unsigned inflateThreads; /* number of BGZF inflater threads, 0 - inflate on parser thread */
+    unsigned parseAhead; /* number of record batches parsed ahead on a separate thread, 0 - parse on loader thread */
+    unsigned fragStore; /* enum MemBankTypes */
     int minMapQual;
     enum LoaderModes mode;
     uint32_t maxSeqLen;
@@ -48,6 +48,7 @@
 
 #include "Globals.h"
 #include "loader-imp.h"
+#include "mem-bank.h"
 
 /* MARK: Arguments and Usage */
 static char const option_input[] = "input";
@@ -80,6 +81,9 @@ static char const option_ref_file[] = "ref-file";
 static char const option_TI[] = "TI";
 static char const option_max_warn_dup_flag[] = "max-warning-dup-flag";
 static char const option_accept_hard_clip[] = "accept-hard-clip";
+static char const option_inflate_threads[] = "inflate-threads";
+static char const option_parse_ahead[] = "parse-ahead";
+static char const option_frag_store[] = "fragment-store";
 
 #define OPTION_INPUT option_input
 #define OPTION_OUTPUT option_output
@@ -102,6 +106,9 @@ static char const option_accept_hard_clip[] = "accept-hard-clip";
 #define OPTION_TI option_TI
 #define OPTION_MAX_WARN_DUP_FLAG option_max_warn_dup_flag
 #define OPTION_ACCEPT_HARD_CLIP option_accept_hard_clip
+#define OPTION_INFLATE_THREADS option_inflate_threads
+#define OPTION_PARSE_AHEAD option_parse_ahead
+#define OPTION_FRAG_STORE option_frag_store
 
 #define ALIAS_INPUT  "i"
 #define ALIAS_OUTPUT "o"
@@ -178,7 +185,7 @@ char const * sorted_usage[] =
 static
 char const * cache_size_usage[] = 
 {
-    "Set the cache size in MB for the temporary indices",
+    "Set the cache size in MB for the temporary indices of read names and unmated fragments",
     NULL
 };
 
@@ -329,6 +336,27 @@ char const * use_accept_hard_clip[] =
     NULL
 };
 
+static
+char const * use_inflate_threads[] = 
+{
+    "number of threads for decompressing BAM blocks ahead of the parser, 0 to decompress on the parser thread",
+    NULL
+};
+
+static
+char const * use_parse_ahead[] = 
+{
+    "number of batches of records to parse ahead of the loader on a separate thread, 0 to parse on the loader thread",
+    NULL
+};
+
+static
+char const * use_frag_store[] = 
+{
+    "where unmated fragments are kept: 'ram' (default), 'spill' (RAM bounded by cache-size, overflow to a file in tmpfs), 'pagefile'",
+    NULL
+};
+
 OptDef Options[] = 
 {
     /* order here is same as in param array below!!! */
@@ -361,7 +389,10 @@ OptDef Options[] =
     { OPTION_REF_FILE, ALIAS_REF_FILE, NULL, use_ref_file, 0, true, false },
     { OPTION_TI, NULL, NULL, use_TI, 1, false, false },
     { OPTION_MAX_WARN_DUP_FLAG, NULL, NULL, use_max_dup_warnings, 1, true, false },
-    { OPTION_ACCEPT_HARD_CLIP, NULL, NULL, use_accept_hard_clip, 1, false, false }
+    { OPTION_ACCEPT_HARD_CLIP, NULL, NULL, use_accept_hard_clip, 1, false, false },
+    { OPTION_INFLATE_THREADS, NULL, NULL, use_inflate_threads, 1, true, false },
+    { OPTION_PARSE_AHEAD, NULL, NULL, use_parse_ahead, 1, true, false },
+    { OPTION_FRAG_STORE, NULL, NULL, use_frag_store, 1, true, false }
 };
 
 const char* OptHelpParam[] =
@@ -396,7 +427,10 @@ const char* OptHelpParam[] =
     "path-to-file",		/* reference fasta file */
     NULL,				/* use XT->TI */
     "count",			/* max. duplicate warning count */
-    NULL				/* allow hard clipping */
+    NULL,				/* allow hard clipping */
+    "count",			/* inflater thread count */
+    "count",			/* parse-ahead queue depth */
+    "type"				/* fragment store */
 };
 
 rc_t UsageSummary (char const * progname)
@@ -778,6 +812,50 @@ rc_t CC KMain (int argc, char * argv[])
             }
         }
         
+        rc = ArgsOptionCount (args, OPTION_INFLATE_THREADS, &pcount);
+        if (rc)
+            break;
+        if (pcount == 1)
+        {
+            rc = ArgsOptionValue (args, OPTION_INFLATE_THREADS, 0, &value);
+            if (rc)
+                break;
+            G.inflateThreads = strtoul(value, &dummy, 0);
+        }
+        
+        rc = ArgsOptionCount (args, OPTION_PARSE_AHEAD, &pcount);
+        if (rc)
+            break;
+        if (pcount == 1)
+        {
+            rc = ArgsOptionValue (args, OPTION_PARSE_AHEAD, 0, &value);
+            if (rc)
+                break;
+            G.parseAhead = strtoul(value, &dummy, 0);
+        }
+        
+        rc = ArgsOptionCount (args, OPTION_FRAG_STORE, &pcount);
+        if (rc)
+            break;
+        if (pcount == 1)
+        {
+            rc = ArgsOptionValue (args, OPTION_FRAG_STORE, 0, &value);
+            if (rc)
+                break;
+            if (strcmp(value, "ram") == 0)
+                G.fragStore = mbt_RAM;
+            else if (strcmp(value, "spill") == 0)
+                G.fragStore = mbt_Spill;
+            else if (strcmp(value, "pagefile") == 0)
+                G.fragStore = mbt_PageFile;
+            else {
+                rc = RC(rcApp, rcArgv, rcAccessing, rcParam, rcIncorrect);
+                OUTMSG (("fragment-store: bad value\n"));
+                MiniUsage (args);
+                break;
+            }
+        }
+        
         rc = ArgsOptionCount (args, OPTION_MAX_WARN_DUP_FLAG, &pcount);
         if (rc)
             break;
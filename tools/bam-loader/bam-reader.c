@@ -890,6 +890,7 @@ rc_t BamReferenceInfoGetReadGroupByName ( const BamReferenceInfo *self, const ch
  
 #ifdef TENTATIVE 
 /**************************** future parsing-on-a-thread code *****************************************/
+/* bam-load parses on a thread with BAM_Reader (bam.c); this is the libalign version for bam-load.3 */
 
 #include "bam-reader.h"
 
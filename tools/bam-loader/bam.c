@@ -35,6 +35,9 @@
 #include <klib/log.h>
 #include <klib/text.h>
 #include <klib/refcount.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
 #include <sysalloc.h>
 
 #include <atomic32.h>
@@ -405,11 +408,422 @@ static rc_t BGZFileInit(BGZFile *const self, RawFile_vt *const vt)
     return 0;
 }
 
+/* MARK: BGZThreadFile *** Start ***
+ *
+ * Reads BGZF blocks ahead on a reader thread, inflates them on a pool of
+ * worker threads and gives them to the parser in file order.
+ * Compressed block boundaries are found from the BC extra field of the
+ * gzip header, so blocks can be inflated independently.
+ */
+
+#define BGZT_MAX_THREADS (64u)
+#define BGZT_BLOCKS_PER_THREAD (4u)
+
+typedef struct BGZThreadBlock BGZThreadBlock;
+typedef struct BGZThreadFile BGZThreadFile;
+typedef struct BGZThreadWorker BGZThreadWorker;
+
+struct BGZThreadBlock {
+    uint64_t fpos;      /* position in file of compressed block */
+    unsigned csize;     /* size of compressed block */
+    unsigned usize;     /* size of uncompressed data */
+    rc_t rc;
+    bool done;          /* inflated */
+    uint8_t cdata[ZLIB_BLOCK_SIZE];
+    zlib_block_t udata;
+};
+
+struct BGZThreadWorker {
+    BGZThreadFile *parent;
+    KThread *th;
+    z_stream zs;
+};
+
+struct BGZThreadFile {
+    BGZFile file;           /* MUST BE FIRST; header is read with this */
+
+    KLock *lock;
+    KCondition *have_block; /* reader -> workers */
+    KCondition *have_data;  /* workers -> parser */
+    KCondition *need_data;  /* parser -> reader */
+    KThread *reader;
+
+    BGZThreadBlock *blk;
+    BGZThreadWorker *worker;
+    unsigned nblk;
+    unsigned nworker;
+
+    uint64_t nread;         /* number of blocks read */
+    uint64_t ninflate;      /* number of blocks taken by workers */
+    uint64_t nconsumed;     /* number of blocks given to parser */
+    uint64_t fpos;          /* position in file after last consumed block */
+
+    rc_t volatile rc;       /* reader error */
+    bool volatile eof;
+    bool volatile cancel;
+};
+
+/* read exactly len bytes from underlying file; returns
+ * (rcData, rcInsufficient) if there are no more bytes at all
+ */
+static rc_t BGZThreadFileReadRaw(BufferedFile *const file, uint8_t dst[], unsigned const len)
+{
+    unsigned cur = 0;
+
+    while (cur < len) {
+        if (file->bpos == file->bmax) {
+            rc_t const rc = BufferedFileRead(file);
+            if (rc)
+                return rc;
+            if (file->bmax == 0) {
+                return cur == 0 ? RC(rcAlign, rcFile, rcReading, rcData, rcInsufficient)
+                                : RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+            }
+        }
+        {
+            unsigned n = (unsigned)(file->bmax - file->bpos);
+
+            if (n > len - cur)
+                n = len - cur;
+            memcpy(&dst[cur], &((uint8_t const *)file->buf)[file->bpos], n);
+            file->bpos += n;
+            cur += n;
+        }
+    }
+    return 0;
+}
+
+/* read one whole BGZF block into blk */
+static rc_t BGZThreadFileReadBlock(BGZThreadFile *const self, BGZThreadBlock *const blk)
+{
+    BufferedFile *const file = &self->file.file;
+    unsigned const hlen = 12; /* ID1 ID2 CM FLG MTIME(4) XFL OS XLEN(2) */
+    unsigned xlen;
+    unsigned bsize = 0;
+    unsigned i;
+    rc_t rc;
+
+    blk->fpos = BufferedFileGetPos(file);
+    rc = BGZThreadFileReadRaw(file, blk->cdata, hlen);
+    if (rc)
+        return rc;
+
+    if (blk->cdata[0] != 31 || blk->cdata[1] != 139 || blk->cdata[2] != 8 || (blk->cdata[3] & 4) == 0) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("GZIP Header not found at %lu\n", blk->fpos));
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    xlen = LE2HUI16(&blk->cdata[10]);
+    if (hlen + xlen > sizeof(blk->cdata))
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid);
+
+    rc = BGZThreadFileReadRaw(file, &blk->cdata[hlen], xlen);
+    if (rc)
+        return GetRCState(rc) == rcInsufficient ? RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort) : rc;
+
+    for (i = 0; i + 4 <= xlen; ) {
+        uint8_t const *const extra = &blk->cdata[hlen + i];
+        unsigned const slen = LE2HUI16(&extra[2]);
+
+        if (extra[0] == 'B' && extra[1] == 'C' && slen == 2 && i + 6 <= xlen) {
+            bsize = 1 + LE2HUI16(&extra[4]);
+            break;
+        }
+        i += slen + 4;
+    }
+    if (bsize == 0 || bsize < hlen + xlen || bsize > sizeof(blk->cdata)) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("BGZF Header extra field BC not found\n"));
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid); /* not BGZF */
+    }
+    rc = BGZThreadFileReadRaw(file, &blk->cdata[hlen + xlen], bsize - hlen - xlen);
+    if (rc)
+        return GetRCState(rc) == rcInsufficient ? RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort) : rc;
+
+    blk->csize = bsize;
+    blk->usize = 0;
+    blk->rc = 0;
+    blk->done = false;
+
+    return 0;
+}
+
+static rc_t BGZThreadFileReaderMain(KThread const *const th, void *const vp)
+{
+    BGZThreadFile *const self = (BGZThreadFile *)vp;
+    rc_t rc = 0;
+
+    KLockAcquire(self->lock);
+    while (!self->cancel) {
+        BGZThreadBlock *blk;
+
+        if (self->nread - self->nconsumed == self->nblk) {
+            KConditionWait(self->need_data, self->lock);
+            continue;
+        }
+        blk = &self->blk[self->nread % self->nblk];
+
+        /* the slot is not visible to anybody else until nread is advanced */
+        KLockUnlock(self->lock);
+        rc = BGZThreadFileReadBlock(self, blk);
+        KLockAcquire(self->lock);
+
+        if (rc)
+            break;
+        ++self->nread;
+        KConditionSignal(self->have_block);
+    }
+    if (rc) {
+        if (GetRCObject(rc) == (enum RCObject)rcData && GetRCState(rc) == rcInsufficient)
+            rc = 0;
+        else
+            self->rc = rc;
+    }
+    self->eof = true;
+    KConditionBroadcast(self->have_block);
+    KConditionBroadcast(self->have_data);
+    KLockUnlock(self->lock);
+
+    return 0;
+}
+
+static rc_t BGZThreadFileInflate(z_stream *const zs, BGZThreadBlock *const blk)
+{
+    rc_t rc = 0;
+    int zr;
+
+    zs->next_in = (Bytef *)blk->cdata;
+    zs->avail_in = blk->csize;
+    zs->next_out = (Bytef *)blk->udata;
+    zs->avail_out = sizeof(blk->udata);
+
+    zr = inflate(zs, Z_FINISH);
+    if (zr == Z_STREAM_END) {
+        blk->usize = (unsigned)zs->total_out; /* <= 64k */
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Zlib block size (before/after): %u/%u\n", zs->total_in, zs->total_out));
+    }
+    else {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Unexpected Zlib result %i: %s\n", zr, zs->msg ? zs->msg : "unknown"));
+        rc = RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    zr = inflateReset(zs);
+    assert(zr == Z_OK);
+
+    return rc;
+}
+
+static rc_t BGZThreadFileWorkerMain(KThread const *const th, void *const vp)
+{
+    BGZThreadWorker *const worker = (BGZThreadWorker *)vp;
+    BGZThreadFile *const self = worker->parent;
+
+    KLockAcquire(self->lock);
+    while (!self->cancel) {
+        BGZThreadBlock *blk;
+
+        if (self->ninflate == self->nread) {
+            if (self->eof)
+                break;
+            KConditionWait(self->have_block, self->lock);
+            continue;
+        }
+        blk = &self->blk[self->ninflate++ % self->nblk];
+
+        KLockUnlock(self->lock);
+        blk->rc = BGZThreadFileInflate(&worker->zs, blk);
+        KLockAcquire(self->lock);
+
+        blk->done = true;
+        KConditionBroadcast(self->have_data);
+    }
+    KLockUnlock(self->lock);
+
+    return 0;
+}
+
+static rc_t BGZThreadFileRead(BGZThreadFile *const self, zlib_block_t dst, unsigned *const pNumRead)
+{
+    rc_t rc = 0;
+
+    *pNumRead = 0;
+    KLockAcquire(self->lock);
+    for ( ; ; ) {
+        BGZThreadBlock *const blk = &self->blk[self->nconsumed % self->nblk];
+
+        if (self->nconsumed < self->nread && blk->done) {
+            rc = blk->rc;
+            if (rc == 0) {
+                memcpy(dst, blk->udata, blk->usize);
+                *pNumRead = blk->usize;
+            }
+            self->fpos = blk->fpos + blk->csize;
+            ++self->nconsumed;
+            KConditionSignal(self->need_data);
+            break;
+        }
+        if (self->eof && self->nconsumed == self->nread) {
+            rc = self->rc;
+            if (rc == 0)
+                rc = RC(rcAlign, rcFile, rcReading, rcData, rcInsufficient);
+            break;
+        }
+        KConditionWait(self->have_data, self->lock);
+    }
+    KLockUnlock(self->lock);
+
+    return rc;
+}
+
+static uint64_t BGZThreadFileGetPos(BGZThreadFile const *const self)
+{
+    return self->fpos;
+}
+
+static float BGZThreadFileProPos(BGZThreadFile const *const self)
+{
+    return self->file.file.fmax == 0 ? -1.0 : (self->fpos / (double)self->file.file.fmax);
+}
+
+static uint64_t BGZThreadFileGetSize(BGZThreadFile const *const self)
+{
+    return BufferedFileGetSize(&self->file.file);
+}
+
+static rc_t BGZThreadFileSetPos(BGZThreadFile *const self, uint64_t const pos)
+{
+    return RC(rcAlign, rcFile, rcPositioning, rcFunction, rcUnsupported);
+}
+
+static void BGZThreadFileWhack(BGZThreadFile *const self)
+{
+    unsigned i;
+
+    KLockAcquire(self->lock);
+    self->cancel = true;
+    KConditionBroadcast(self->need_data);
+    KConditionBroadcast(self->have_block);
+    KLockUnlock(self->lock);
+
+    if (self->reader) {
+        KThreadWait(self->reader, NULL);
+        KThreadRelease(self->reader);
+    }
+    for (i = 0; i != self->nworker; ++i) {
+        BGZThreadWorker *const worker = &self->worker[i];
+
+        if (worker->th) {
+            KThreadWait(worker->th, NULL);
+            KThreadRelease(worker->th);
+        }
+        inflateEnd(&worker->zs);
+    }
+    KConditionRelease(self->need_data);
+    KConditionRelease(self->have_data);
+    KConditionRelease(self->have_block);
+    KLockRelease(self->lock);
+    free(self->worker);
+    free(self->blk);
+    BGZFileWhack(&self->file);
+}
+
+/* switches an already initialized BGZFile to threaded reading;
+ * the next block to read must start at the current file position
+ */
+static rc_t BGZThreadFileInit(BGZThreadFile *const self, RawFile_vt *const vt, unsigned const threads)
+{
+    static RawFile_vt const my_vt = {
+        (rc_t (*)(void *, zlib_block_t, unsigned *))BGZThreadFileRead,
+        (uint64_t (*)(void const *))BGZThreadFileGetPos,
+        (float (*)(void const *))BGZThreadFileProPos,
+        (uint64_t (*)(void const *))BGZThreadFileGetSize,
+        (rc_t (*)(void *, uint64_t))BGZThreadFileSetPos,
+        (void (*)(void *))BGZThreadFileWhack
+    };
+    unsigned const nworker = threads < BGZT_MAX_THREADS ? threads : BGZT_MAX_THREADS;
+    unsigned i;
+    rc_t rc;
+
+    /* the BGZFile's read head is at the start of the block after the
+     * last inflated one; the reader thread continues from there */
+    self->fpos = BufferedFileGetPos(&self->file.file);
+
+    self->lock = NULL;
+    self->have_block = NULL;
+    self->have_data = NULL;
+    self->need_data = NULL;
+    self->reader = NULL;
+    self->nread = self->ninflate = self->nconsumed = 0;
+    self->rc = 0;
+    self->eof = false;
+    self->cancel = false;
+    self->nworker = 0;
+    self->nblk = nworker * BGZT_BLOCKS_PER_THREAD;
+    self->blk = calloc(self->nblk, sizeof(self->blk[0]));
+    self->worker = calloc(nworker, sizeof(self->worker[0]));
+    if (self->blk == NULL || self->worker == NULL) {
+        free(self->blk);
+        free(self->worker);
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+
+    rc = KLockMake(&self->lock);
+    if (rc == 0)
+        rc = KConditionMake(&self->have_block);
+    if (rc == 0)
+        rc = KConditionMake(&self->have_data);
+    if (rc == 0)
+        rc = KConditionMake(&self->need_data);
+
+    for (i = 0; rc == 0 && i != nworker; ++i) {
+        BGZThreadWorker *const worker = &self->worker[i];
+
+        worker->parent = self;
+        switch (inflateInit2(&worker->zs, MAX_WBITS + 16)) {
+        case Z_OK:
+            ++self->nworker;
+            rc = KThreadMake(&worker->th, BGZThreadFileWorkerMain, worker);
+            break;
+        case Z_MEM_ERROR:
+            rc = RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+            break;
+        default:
+            rc = RC(rcAlign, rcFile, rcConstructing, rcNoObj, rcUnexpected);
+            break;
+        }
+    }
+    if (rc == 0)
+        rc = KThreadMake(&self->reader, BGZThreadFileReaderMain, self);
+    if (rc == 0) {
+        *vt = my_vt;
+        return 0;
+    }
+
+    /* stop whatever was started, but keep the BGZFile usable */
+    KLockAcquire(self->lock);
+    self->cancel = true;
+    KConditionBroadcast(self->have_block);
+    KLockUnlock(self->lock);
+    for (i = 0; i != self->nworker; ++i) {
+        if (self->worker[i].th) {
+            KThreadWait(self->worker[i].th, NULL);
+            KThreadRelease(self->worker[i].th);
+        }
+        inflateEnd(&self->worker[i].zs);
+    }
+    KConditionRelease(self->need_data);
+    KConditionRelease(self->have_data);
+    KConditionRelease(self->have_block);
+    KLockRelease(self->lock);
+    free(self->worker);
+    free(self->blk);
+
+    return rc;
+}
+
 /* MARK: BAM_File structures */
 
 struct BAM_File {
     union {
         BGZFile bam;
+        BGZThreadFile bamt;
         SAMFile sam;
     } file;
     RawFile_vt vt;
@@ -483,6 +897,7 @@ struct BAM_Alignment {
     unsigned qual;
     unsigned numExtra;
     unsigned hasColor;
+    bool queued;        /* owned by a BAM_Reader batch */
     struct offset_size_s extra[1];
 };
 
@@ -1630,6 +2045,22 @@ rc_t BAM_FileRelease(const BAM_File *cself) {
     return 0;
 }
 
+/* MARK: BAM File threading */
+
+rc_t BAM_FileStartInflateThreads(BAM_File const *cself, unsigned threads)
+{
+    BAM_File *const self = (BAM_File *)cself;
+
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcSelf, rcNull);
+    if (threads == 0)
+        return RC(rcAlign, rcFile, rcConstructing, rcParam, rcInvalid);
+    if (self->isSAM || self->vt.FileRead != (rc_t (*)(void *, zlib_block_t, unsigned *))BGZFileRead)
+        return 0;
+
+    return BGZThreadFileInit(&self->file.bamt, &self->vt, threads);
+}
+
 /* MARK: BAM File positioning */
 
 float BAM_FileGetProportionalPosition(const BAM_File *self)
@@ -2730,6 +3161,283 @@ rc_t BAM_FileRead(const BAM_File *cself, const BAM_Alignment **rhs)
     return BAM_FileReadCopy(self, rhs, false);
 }
 
+/* MARK: BAM_Reader *** Start ***
+ *
+ * Parses records ahead on a thread of its own.  Parsed records are copied,
+ * together with their raw data, into batches; the batches are handed to
+ * the consumer through a bounded queue in file order.
+ */
+
+#define BAMR_MAX_DEPTH (64u)
+#define BAMR_BATCH_RECORDS (1024u)
+#define BAMR_ALIGN(X) (((X) + 7u) & ~((size_t)7u))
+
+typedef struct BAM_ReaderBatch BAM_ReaderBatch;
+typedef struct BAM_ReaderEntry BAM_ReaderEntry;
+
+struct BAM_ReaderEntry {
+    rc_t rc;            /* result of BAM_FileRead2 */
+    unsigned alnsize;   /* size of alignment struct, 0 if no record */
+    /* BAM_Alignment follows at BAMR_ALIGN(sizeof(BAM_ReaderEntry)) */
+    /* raw record data follows at BAMR_ALIGN(alnsize) after that */
+};
+
+struct BAM_ReaderBatch {
+    uint8_t *arena;
+    size_t arena_size;
+    size_t used;
+    size_t *offset;     /* [BAMR_BATCH_RECORDS] start of each entry in arena */
+    unsigned count;
+    float propos;       /* proportional position at end of batch */
+};
+
+struct BAM_Reader {
+    BAM_File const *file;
+
+    KLock *lock;
+    KCondition *have_batch; /* parser -> consumer */
+    KCondition *need_batch; /* consumer -> parser */
+    KThread *parser;
+
+    BAM_ReaderBatch *batch;
+    unsigned depth;
+
+    uint64_t nfilled;       /* number of batches filled by parser */
+    uint64_t ntaken;        /* number of batches finished by consumer */
+    unsigned current;       /* next entry in consumer's batch */
+    float propos;
+
+    rc_t last;              /* final result, sticky for consumer */
+    rc_t volatile rc;       /* parser error */
+    bool volatile eof;
+    bool volatile cancel;
+    bool holding;           /* consumer is reading batch ntaken */
+};
+
+static rc_t BAM_ReaderBatchAppend(BAM_ReaderBatch *const batch, rc_t const rc, BAM_Alignment const *const rec)
+{
+    size_t const hdrsize = BAMR_ALIGN(sizeof(BAM_ReaderEntry));
+    unsigned const alnsize = rec ? BAM_AlignmentSize(rec->numExtra) : 0;
+    size_t const need = hdrsize + (rec ? BAMR_ALIGN(alnsize) + BAMR_ALIGN(rec->datasize) : 0);
+    BAM_ReaderEntry *entry;
+
+    if (batch->used + need > batch->arena_size) {
+        size_t size = batch->arena_size ? batch->arena_size : 256u * 1024u;
+        void *temp;
+
+        while (size < batch->used + need)
+            size *= 2;
+        temp = realloc(batch->arena, size);
+        if (temp == NULL)
+            return RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+        batch->arena = temp;
+        batch->arena_size = size;
+    }
+    entry = (BAM_ReaderEntry *)&batch->arena[batch->used];
+    entry->rc = rc;
+    entry->alnsize = alnsize;
+    if (rec) {
+        uint8_t *const aln = (uint8_t *)entry + hdrsize;
+
+        memcpy(aln, rec, alnsize);
+        memcpy(aln + BAMR_ALIGN(alnsize), rec->data, rec->datasize);
+    }
+    batch->offset[batch->count++] = batch->used;
+    batch->used += need;
+
+    return 0;
+}
+
+static rc_t BAM_ReaderParserMain(KThread const *const th, void *const vp)
+{
+    BAM_Reader *const self = (BAM_Reader *)vp;
+    bool done = false;
+
+    KLockAcquire(self->lock);
+    while (!self->cancel && !done) {
+        BAM_ReaderBatch *batch;
+
+        if (self->nfilled - self->ntaken == self->depth) {
+            KConditionWait(self->need_batch, self->lock);
+            continue;
+        }
+        batch = &self->batch[self->nfilled % self->depth];
+
+        /* the slot is not visible to the consumer until nfilled is advanced */
+        KLockUnlock(self->lock);
+        batch->used = 0;
+        batch->count = 0;
+        while (batch->count < BAMR_BATCH_RECORDS) {
+            BAM_Alignment const *rec = NULL;
+            rc_t const rc = BAM_FileRead2(self->file, &rec);
+            bool const keep = rc == 0 || (GetRCObject(rc) == rcRow && GetRCState(rc) == rcEmpty);
+            rc_t const rc2 = BAM_ReaderBatchAppend(batch, rc, keep ? rec : NULL);
+
+            if (rec)
+                BAM_AlignmentRelease(rec);
+            if (rc2 && batch->count > 0) {
+                /* the error replaces the last record; it fits in the space freed */
+                batch->used = batch->offset[--batch->count];
+                BAM_ReaderBatchAppend(batch, rc2, NULL);
+            }
+            if (!keep || rc2) {
+                done = true;
+                break;
+            }
+        }
+        batch->propos = BAM_FileGetProportionalPosition(self->file);
+        KLockAcquire(self->lock);
+
+        if (batch->count == 0) {
+            /* out of memory with an empty arena */
+            self->rc = RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+            break;
+        }
+        ++self->nfilled;
+        KConditionSignal(self->have_batch);
+    }
+    self->eof = true;
+    KConditionBroadcast(self->have_batch);
+    KLockUnlock(self->lock);
+
+    return 0;
+}
+
+rc_t BAM_ReaderMake(BAM_Reader **const result, BAM_File const *const file, unsigned const depth)
+{
+    BAM_Reader *self;
+    unsigned i;
+    rc_t rc;
+
+    if (result == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcParam, rcNull);
+    *result = NULL;
+    if (file == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcParam, rcNull);
+    if (depth == 0)
+        return RC(rcAlign, rcFile, rcConstructing, rcParam, rcInvalid);
+
+    self = calloc(1, sizeof(*self));
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+
+    self->file = file;
+    /* one more than requested; the consumer holds on to one batch */
+    self->depth = (depth < BAMR_MAX_DEPTH ? depth : BAMR_MAX_DEPTH) + 1;
+    self->batch = calloc(self->depth, sizeof(self->batch[0]));
+    if (self->batch == NULL) {
+        free(self);
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+    for (i = 0; i != self->depth; ++i) {
+        self->batch[i].offset = malloc(BAMR_BATCH_RECORDS * sizeof(self->batch[i].offset[0]));
+        if (self->batch[i].offset == NULL) {
+            BAM_ReaderRelease(self);
+            return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+        }
+    }
+    rc = KLockMake(&self->lock);
+    if (rc == 0)
+        rc = KConditionMake(&self->have_batch);
+    if (rc == 0)
+        rc = KConditionMake(&self->need_batch);
+    if (rc == 0)
+        rc = KThreadMake(&self->parser, BAM_ReaderParserMain, self);
+    if (rc == 0)
+        *result = self;
+    else
+        BAM_ReaderRelease(self);
+
+    return rc;
+}
+
+rc_t BAM_ReaderRead(BAM_Reader *const self, BAM_Alignment const **const rhs)
+{
+    if (self == NULL || rhs == NULL)
+        return RC(rcAlign, rcFile, rcReading, rcParam, rcNull);
+
+    *rhs = NULL;
+    if (self->last)
+        return self->last;
+
+    KLockAcquire(self->lock);
+    for ( ; ; ) {
+        if (self->holding) {
+            BAM_ReaderBatch const *const batch = &self->batch[self->ntaken % self->depth];
+
+            if (self->current < batch->count) {
+                BAM_ReaderEntry const *const entry = (void const *)&batch->arena[batch->offset[self->current++]];
+                rc_t const rc = entry->rc;
+
+                self->propos = batch->propos;
+                KLockUnlock(self->lock);
+
+                if (entry->alnsize) {
+                    BAM_Alignment *const rec = (BAM_Alignment *)((uint8_t *)entry + BAMR_ALIGN(sizeof(*entry)));
+
+                    /* the arena may have moved since the record was copied */
+                    rec->data = (bam_alignment const *)((uint8_t const *)rec + BAMR_ALIGN(entry->alnsize));
+                    rec->storage = NULL;
+                    rec->queued = true;
+                    *rhs = rec;
+                }
+                else
+                    self->last = rc;    /* end of records */
+                return rc;
+            }
+            self->holding = false;
+            ++self->ntaken;
+            KConditionSignal(self->need_batch);
+        }
+        if (self->ntaken < self->nfilled) {
+            self->holding = true;
+            self->current = 0;
+            continue;
+        }
+        if (self->eof) {
+            self->last = self->rc ? self->rc : RC(rcAlign, rcFile, rcReading, rcRow, rcNotFound);
+            break;
+        }
+        KConditionWait(self->have_batch, self->lock);
+    }
+    KLockUnlock(self->lock);
+
+    return self->last;
+}
+
+float BAM_ReaderGetProportionalPosition(BAM_Reader const *const self)
+{
+    return self->propos;
+}
+
+rc_t BAM_ReaderRelease(BAM_Reader *const self)
+{
+    if (self != NULL) {
+        unsigned i;
+
+        if (self->lock) {
+            KLockAcquire(self->lock);
+            self->cancel = true;
+            KConditionBroadcast(self->need_batch);
+            KLockUnlock(self->lock);
+        }
+        if (self->parser) {
+            KThreadWait(self->parser, NULL);
+            KThreadRelease(self->parser);
+        }
+        KConditionRelease(self->need_batch);
+        KConditionRelease(self->have_batch);
+        KLockRelease(self->lock);
+        for (i = 0; i != self->depth; ++i) {
+            free(self->batch[i].arena);
+            free(self->batch[i].offset);
+        }
+        free(self->batch);
+        free(self);
+    }
+    return 0;
+}
+
 /* MARK: BAM File header info accessor */
 
 rc_t BAM_FileGetRefSeqById(const BAM_File *cself, int32_t id, const BAMRefSeq **rhs)
@@ -2792,6 +3500,8 @@ rc_t BAM_FileGetHeaderText(BAM_File const *cself, char const **header, size_t *h
 
 static rc_t BAM_AlignmentWhack(BAM_Alignment *self)
 {
+    if (self->queued)
+        return 0;
     if (self->parent->bufLocker == self)
         self->parent->bufLocker = NULL;
     if (self != self->parent->nocopy) {
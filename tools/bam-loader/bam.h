@@ -516,6 +516,17 @@ rc_t BAM_FileAddRef ( const BAM_File *self );
 rc_t BAM_FileRelease ( const BAM_File *self );
 
 
+/* StartInflateThreads
+ *  decompress BGZF blocks ahead of the parser using a pool of threads;
+ *  blocks are still given to the parser in file order.
+ *  does nothing for SAM files.
+ *  after this, the file can only be read sequentially.
+ *
+ *  "threads" [ IN ] - number of inflater threads
+ */
+rc_t BAM_FileStartInflateThreads ( const BAM_File *self, unsigned threads );
+
+
 /* GetPosition
  *  get the position of the about-to-be read alignment
  *  this position can be stored
@@ -564,6 +575,40 @@ rc_t BAM_FileRead ( const BAM_File *self, const BAM_Alignment **result );
 rc_t BAM_FileRead2 ( const BAM_File *self, const BAM_Alignment **result );
 
 
+/* Reader
+ *  parses records of a BAM_File ahead of the consumer on a thread of its own
+ */
+typedef struct BAM_Reader BAM_Reader;
+
+/* Make
+ *  start parsing
+ *  the file must not be read or positioned by anybody else until the
+ *  reader is released; header accessors can still be used
+ *
+ *  "depth" [ IN ] - number of batches of parsed records to queue
+ */
+rc_t BAM_ReaderMake ( BAM_Reader **result, const BAM_File *file, unsigned depth );
+
+/* Read
+ *  read an aligment
+ *  same semantics as BAM_FileRead2, except that rcInvalid is not resumable
+ *
+ *  "result" [ OUT ] - return param for BAM_Alignment object
+ *   is invalidated on next call to BAM_ReaderRead; releasing it does nothing
+ */
+rc_t BAM_ReaderRead ( BAM_Reader *self, const BAM_Alignment **result );
+
+/* GetProportionalPosition
+ *  position of the parser in the file as of the last record read
+ */
+float BAM_ReaderGetProportionalPosition ( const BAM_Reader *self );
+
+/* Release
+ *  stops the parser thread; does not release the BAM_File
+ */
+rc_t BAM_ReaderRelease ( BAM_Reader *self );
+
+
 /* Rewind
  *  reset the position back to the first aligment in the file
  */
@@ -38,7 +38,6 @@
 
 #include <kfs/directory.h>
 #include <kfs/file.h>
-#include <kdb/btree.h>
 #include <kdb/manager.h>
 #include <kdb/database.h>
 #include <kdb/table.h>
@@ -83,6 +82,7 @@
 #include "reference-writer.h"
 #include "alignment-writer.h"
 #include "mem-bank.h"
+#include "name-table.h"
 
 #define NUM_ID_SPACES (256u)
 
@@ -137,7 +137,8 @@ typedef struct FragmentInfo {
 
 typedef struct context_t {
     const KLoadProgressbar *progress[4];
-    KBTree *key2id[NUM_ID_SPACES];
+    NameTable *key2id[NUM_ID_SPACES];
+    NameTableCache *key2id_cache;
     char *key2id_names;
     MMArray *id2value;
     MemBank *frags;
@@ -295,56 +296,32 @@ static void MMArrayWhack(MMArray *self)
     free(self);
 }
 
-static rc_t OpenKBTree(KBTree **const rslt, unsigned n, unsigned max)
+static rc_t OpenNameTable(context_t *const ctx, NameTable **const rslt, unsigned n)
 {
-    size_t const cacheSize = (((G.cache_size - (G.cache_size / 2) - (G.cache_size / 8)) / max)
-                            + 0xFFFFF) & ~((size_t)0xFFFFF);
-    KFile *file = NULL;
-    KDirectory *dir;
-    char fname[4096];
-    rc_t rc;
-
-    rc = KDirectoryNativeDir(&dir);
-    if (rc)
-        return rc;
-
-    rc = string_printf(fname, sizeof(fname), NULL, "%s/key2id.%u.%u", G.tmpfs, G.pid, n); if (rc) return rc;
-    rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "%s", fname);
-    KDirectoryRemove(dir, 0, "%s", fname);
-    KDirectoryRelease(dir);
-    if (rc == 0) {
-        rc = KBTreeMakeUpdate(rslt, file, cacheSize,
-                              false, kbtOpaqueKey,
-                              1, 255, sizeof ( uint32_t ),
-                              NULL
-                              );
-        KFileRelease(file);
-#if PERF
-        if (rc == 0) {
-            static unsigned treecount = 0;
-
-            (void)PLOGMSG(klogInfo, (klogInfo, "Number of trees: $(cnt)", "cnt=%u", ++treecount));
-        }
-#endif
+    if (ctx->key2id_cache == NULL) {
+        /* what is left of the cache after the fragment store's share */
+        rc_t const rc = NameTableCacheMake(&ctx->key2id_cache, G.cache_size - (G.cache_size / 2) - (G.cache_size / 8));
+        if (rc)
+            return rc;
     }
-    return rc;
+    return NameTableMake(rslt, ctx->key2id_cache, G.tmpfs, G.pid, n);
 }
 
 static rc_t GetKeyIDOld(context_t *const ctx, uint64_t *const rslt, bool *const wasInserted, char const key[], char const name[], unsigned const namelen)
 {
     unsigned const keylen = strlen(key);
     rc_t rc;
-    uint64_t tmpKey;
+    uint32_t tmpKey;
 
     if (ctx->key2id_count == 0) {
-        rc = OpenKBTree(&ctx->key2id[0], 1, 1);
+        rc = OpenNameTable(ctx, &ctx->key2id[0], 1);
         if (rc) return rc;
         ctx->key2id_count = 1;
     }
     if (memcmp(key, name, keylen) == 0) {
         /* qname starts with read group; no append */
         tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, name, namelen);
+        rc = NameTableEntry(ctx->key2id[0], &tmpKey, wasInserted, name, namelen);
     }
     else {
         char sbuf[4096];
@@ -362,7 +339,7 @@ static rc_t GetKeyIDOld(context_t *const ctx, uint64_t *const rslt, bool *const
         rc = string_printf(buf, bsize, &actsize, "%s\t%.*s", key, (int)namelen, name);
 
         tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, buf, actsize);
+        rc = NameTableEntry(ctx->key2id[0], &tmpKey, wasInserted, buf, actsize);
         if (hbuf)
             free(hbuf);
     }
@@ -483,7 +460,7 @@ rc_t GetKeyID(context_t *const ctx,
         unsigned const h = HashKey(key, keylen);
         unsigned f;
         unsigned e = ctx->key2id_count;
-        uint64_t tmpKey;
+        uint32_t tmpKey;
 
         *rslt = 0;
         {{
@@ -528,8 +505,8 @@ rc_t GetKeyID(context_t *const ctx,
         }
         if (ctx->key2id_count < ctx->key2id_max) {
             unsigned const name_max = ctx->key2id_name_max + keylen + 1;
-            KBTree *tree;
-            rc_t rc = OpenKBTree(&tree, ctx->key2id_count + 1, 1); /* ctx->key2id_max); */
+            NameTable *tree;
+            rc_t rc = OpenNameTable(ctx, &tree, ctx->key2id_count + 1);
 
             if (rc) return rc;
 
@@ -572,7 +549,7 @@ rc_t GetKeyID(context_t *const ctx,
             }
         GET_ID:
             tmpKey = ctx->idCount[f];
-            rc = KBTreeEntry(ctx->key2id[f], &tmpKey, wasInserted, name, namelen);
+            rc = NameTableEntry(ctx->key2id[f], &tmpKey, wasInserted, name, namelen);
             if (rc == 0) {
                 *rslt = (((uint64_t)f) << 32) | tmpKey;
                 if (*wasInserted)
@@ -636,7 +613,7 @@ static rc_t SetupContext(context_t *ctx, unsigned numfiles)
         if (rc == 0)
             rc = OpenMMapFile(ctx, dir);
         if (rc == 0)
-            rc = MemBankMake(&ctx->frags, dir, G.pid, fragSize);
+            rc = MemBankMake(&ctx->frags, G.fragStore, dir, G.pid, fragSize);
         KDirectoryRelease(dir);
     }
     return rc;
@@ -724,8 +701,18 @@ static rc_t OpenBAM(const BAM_File **bam, VDatabase *db, const char bamFile[])
     rc_t rc = BAM_FileMakeWithHeader(bam, G.headerText, "%s", bamFile);
     if (rc) {
         (void)PLOGERR(klogErr, (klogErr, rc, "Failed to open '$(file)'", "file=%s", bamFile));
+        return rc;
     }
-    else if (db) {
+    if (G.inflateThreads > 0) {
+        rc = BAM_FileStartInflateThreads(*bam, G.inflateThreads);
+        if (rc) {
+            (void)PLOGERR(klogErr, (klogErr, rc, "Failed to start inflater threads for '$(file)'", "file=%s", bamFile));
+            BAM_FileRelease(*bam);
+            *bam = NULL;
+            return rc;
+        }
+    }
+    if (db) {
         KMetadata *dbmeta;
 
         rc = VDatabaseOpenMetadataUpdate(db, &dbmeta);
@@ -1158,6 +1145,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
                        bool *had_alignments, bool *had_sequences)
 {
     const BAM_File *bam;
+    BAM_Reader *reader = NULL;
     const BAM_Alignment *rec;
     KDataBuffer buf;
     KDataBuffer fragBuf;
@@ -1232,6 +1220,12 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
     if (rc)
         return rc;
 
+    if (G.parseAhead > 0) {
+        rc = BAM_ReaderMake(&reader, bam, G.parseAhead);
+        if (rc) {
+            (void)PLOGERR(klogErr, (klogErr, rc, "Failed to start parser thread for '$(file)'", "file=%s", bamFile));
+        }
+    }
     if (rc == 0) {
         (void)PLOGMSG(klogInfo, (klogInfo, "Loading '$(file)'", "file=%s", bamFile));
     }
@@ -1256,7 +1250,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
         uint64_t ti = 0;
         uint32_t csSeqLen = 0;
 
-        rc = BAM_FileRead2(bam, &rec);
+        rc = reader ? BAM_ReaderRead(reader, &rec) : BAM_FileRead2(bam, &rec);
         if (rc) {
             if (GetRCModule(rc) == rcAlign && GetRCObject(rc) == rcRow && GetRCState(rc) == rcNotFound) {
                 (void)PLOGMSG(klogInfo, (klogInfo, "EOF '$(file)'; read $(read); processed $(proc)", "file=%s,read=%lu,proc=%lu", bamFile, (unsigned long)recordsRead, (unsigned long)recordsProcessed));
@@ -1276,7 +1270,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
         ++recordsRead;
         
         {
-            float const new_value = BAM_FileGetProportionalPosition(bam) * 100.0;
+            float const new_value = (reader ? BAM_ReaderGetProportionalPosition(reader) : BAM_FileGetProportionalPosition(bam)) * 100.0;
             float const delta = new_value - progress;
             if (delta > 1.0) {
                 KLoadProgressbar_Process(ctx->progress[0], delta, false);
@@ -1530,7 +1524,7 @@ MIXED_BASE_AND_COLOR:
         }
         rc = GetKeyID(ctx, &keyId, &wasInserted, spotGroup, name, namelen);
         if (rc) {
-            (void)PLOGERR(klogErr, (klogErr, rc, "KBTreeEntry: failed on key '$(key)'", "key=%.*s", namelen, name));
+            (void)PLOGERR(klogErr, (klogErr, rc, "NameTableEntry: failed on key '$(key)'", "key=%.*s", namelen, name));
             goto LOOP_END;
         }
         rc = MMArrayGet(ctx->id2value, (void **)&value, keyId);
@@ -2064,6 +2058,7 @@ MIXED_BASE_AND_COLOR:
                      "The file contained no records that were processed.");
         rc = RC(rcAlign, rcFile, rcReading, rcData, rcEmpty);
     }
+    BAM_ReaderRelease(reader);
     BAM_FileRelease(bam);
     MMArrayLock(ctx->id2value);
     KDataBufferWhack(&buf);
@@ -2310,10 +2305,11 @@ static rc_t ArchiveBAM(VDBManager *mgr, VDatabase *db,
     }
 /*** No longer need memory for key2id ***/
     for (i = 0; i != ctx.key2id_count; ++i) {
-        KBTreeDropBacking(ctx.key2id[i]);
-        KBTreeRelease(ctx.key2id[i]);
+        NameTableWhack(ctx.key2id[i]);
         ctx.key2id[i] = NULL;
     }
+    NameTableCacheWhack(ctx.key2id_cache);
+    ctx.key2id_cache = NULL;
     free(ctx.key2id_names);
     ctx.key2id_names = NULL;
 /*******************/
@@ -26,182 +26,530 @@
 
 #include <klib/defs.h>
 #include <klib/rc.h>
-
-extern "C" {
-#include "mem-bank.h"
-}
-
-#define USE_KMEMBANK 0
-
-#if USE_KMEMBANK
+#include <klib/log.h>
+#include <klib/printf.h>
 #include <kfs/file.h>
 #include <kfs/directory.h>
 #include <kfs/pagefile.h>
 #include <kfs/pmem.h>
-#include <klib/log.h>
-#include <klib/printf.h>
 
-#define FRAG_CHUNK_SIZE (128)
+extern "C" {
+#include "mem-bank.h"
+}
+
+#include <map>
+#include <list>
+#include <set>
+#include <deque>
+#include <utility>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
 
 struct MemBank {
-    KMemBank *fragsOne;
-    KMemBank *fragsBoth;
+    virtual ~MemBank() {}
+    virtual rc_t Alloc(uint32_t *id, size_t bytes, bool clear, bool longlived) = 0;
+    virtual rc_t Write(uint32_t id, uint64_t pos, void const *buffer, size_t bsize, size_t *num_writ) = 0;
+    virtual rc_t Size(uint32_t id, size_t *size) const = 0;
+    virtual rc_t Read(uint32_t id, uint64_t pos, void *buffer, size_t bsize, size_t *num_read) const = 0;
+    virtual rc_t Free(uint32_t id) = 0;
 };
 
-static rc_t OpenMBankFile(KMemBank **const mbank, KDirectory *const dir, int const pid, char const *const suffix, size_t const climit)
+static rc_t CreateTempFile(KFile **const file, KDirectory *const dir, int const pid, char const *const name)
 {
-    KFile *file = NULL;
     char fname[4096];
-    rc_t rc = string_printf(fname, sizeof(fname), NULL, "frag_data%s.%u", suffix, pid);
+    rc_t rc = string_printf(fname, sizeof(fname), NULL, "%s.%u", name, pid);
     
     if (rc)
         return rc;
     
-    rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "%s", fname);
+    rc = KDirectoryCreateFile(dir, file, true, 0600, kcmInit, "%s", fname);
     KDirectoryRemove(dir, 0, "%s", fname);
-    if (rc == 0) {
-        KPageFile *backing;
-        
-        rc = KPageFileMakeUpdate(&backing, file, climit, false);
-        KFileRelease(file);
-        if (rc == 0) {
-            rc = KMemBankMake(mbank, FRAG_CHUNK_SIZE, 0, backing);
-            KPageFileRelease(backing);
-        }
-    }
     return rc;
 }
 
-static rc_t MemBank_Make(MemBank **rslt, KDirectory *const dir, int const pid, size_t const climits[2])
-{
+/* MARK: page file backed store */
+
+#define FRAG_CHUNK_SIZE (128)
+
+class PageFileBank : public MemBank {
     KMemBank *fragsOne;
+    KMemBank *fragsBoth;
+    uint64_t allocs;
+    uint64_t bytes;
+
+    PageFileBank(KMemBank *const One, KMemBank *const Both)
+    : fragsOne(One)
+    , fragsBoth(Both)
+    , allocs(0)
+    , bytes(0)
+    {}
     
-    rc_t rc = OpenMBankFile(&fragsOne, dir, pid, "One", climits[0]);
-    if (rc == 0) {
-        KMemBank *fragsBoth;
+    KMemBank *bank(uint32_t const id) const
+    {
+        return (id & 1) ? fragsOne : fragsBoth;
+    }
+
+    static rc_t OpenMBankFile(KMemBank **const mbank, KDirectory *const dir, int const pid, char const *const suffix, size_t const climit)
+    {
+        KFile *file = NULL;
+        char fname[64];
+        rc_t rc = string_printf(fname, sizeof(fname), NULL, "frag_data%s", suffix);
         
-        rc = OpenMBankFile(&fragsBoth, dir, pid, "Both", climits[1]);
+        if (rc == 0)
+            rc = CreateTempFile(&file, dir, pid, fname);
+        if (rc == 0) {
+            KPageFile *backing;
+            
+            rc = KPageFileMakeUpdate(&backing, file, climit, false);
+            KFileRelease(file);
+            if (rc == 0) {
+                rc = KMemBankMake(mbank, FRAG_CHUNK_SIZE, 0, backing);
+                KPageFileRelease(backing);
+            }
+        }
+        return rc;
+    }
+public:
+    static rc_t Make(MemBank **const rslt, KDirectory *const dir, int const pid, size_t const climits[2])
+    {
+        KMemBank *fragsOne;
         
+        rc_t rc = OpenMBankFile(&fragsOne, dir, pid, "One", climits[0]);
         if (rc == 0) {
-            MemBank *const self = reinterpret_cast<MemBank *>(malloc(sizeof(self)));
-
-            if (self) {
-                self->fragsOne = fragsOne;
-                self->fragsBoth = fragsBoth;
-
-                *rslt = self;
-                return 0;
+            KMemBank *fragsBoth;
+            
+            rc = OpenMBankFile(&fragsBoth, dir, pid, "Both", climits[1]);
+            if (rc == 0) {
+                try {
+                    *rslt = new PageFileBank(fragsOne, fragsBoth);
+                    return 0;
+                }
+                catch (std::bad_alloc const &e) {
+                    rc = RC(rcApp, rcFile, rcConstructing, rcMemory, rcExhausted);
+                }
+                KMemBankRelease(fragsBoth);
             }
-            rc = RC(rcApp, rcFile, rcConstructing, rcMemory, rcExhausted);
-            KMemBankRelease(fragsBoth);
+            KMemBankRelease(fragsOne);
         }
+        return rc;
+    }
+    ~PageFileBank()
+    {
+        (void)PLOGMSG(klogInfo, (klogInfo, "fragment store (page file): $(allocs) allocations, $(bytes) bytes", "allocs=%lu,bytes=%lu", (unsigned long)allocs, (unsigned long)bytes));
+        KMemBankRelease(fragsBoth);
         KMemBankRelease(fragsOne);
     }
-    return rc;
-}
+    rc_t Alloc(uint32_t *const Id, size_t const size, bool const clear, bool const longlived)
+    {
+        uint64_t id = 0;
+        KMemBank *const mbank = longlived ? fragsOne : fragsBoth;
+        rc_t const rc = KMemBankAlloc(mbank, &id, size, clear);
+        
+        if (rc)
+            return rc;
+        if ((id >> 31) != 0) {
+            rc_t const rc = RC(rcApp, rcFile, rcAllocating, rcId, rcExcessive);
+            (void)PLOGERR(klogErr, (klogErr, rc, "membank '$(which)': id space overflow", "which=%s", longlived ? "fragsOne" : "fragsBoth"));
+            return rc;
+        }
+        Id[0] = (uint32_t)((id << 1) + (longlived ? 1 : 0));
+        ++allocs;
+        bytes += size;
+        return 0;
+    }
+    rc_t Write(uint32_t const id, uint64_t const pos, void const *const buffer, size_t const size, size_t *const num_writ)
+    {
+        return KMemBankWrite(bank(id), id >> 1, pos, buffer, size, num_writ);
+    }
+    rc_t Size(uint32_t const id, size_t *const rslt) const
+    {
+        uint64_t size = 0;
+        rc_t const rc = KMemBankSize(bank(id), id >> 1, &size);
+        
+        *rslt = size;
+        return rc;
+    }
+    rc_t Read(uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize, size_t *const num_read) const
+    {
+        return KMemBankRead(bank(id), id >> 1, pos, buffer, bsize, num_read);
+    }
+    rc_t Free(uint32_t const id)
+    {
+        return KMemBankFree(bank(id), id >> 1);
+    }
+};
 
-void MemBank_Release(MemBank *const self)
-{
-    KMemBankRelease(self->fragsBoth);
-    KMemBankRelease(self->fragsOne);
-    free(self);
-}
+/* MARK: memory store with optional spill file */
 
-rc_t MemBank_Alloc(MemBank *const self, uint32_t *const Id, size_t const size, bool const clear, bool const longlived)
+class spill_error : public std::runtime_error
 {
-    uint64_t id = 0;
-    KMemBank *const mbank = longlived ? self->fragsOne : self->fragsBoth;
-    rc_t rc = KMemBankAlloc(mbank, &id, size, clear);
-    uint32_t const id_out = (uint32_t)((id << 1) + (longlived ? 1 : 0));
+public:
+    rc_t const rc;
+    
+    spill_error(rc_t const RC) : std::runtime_error("fragment spill file error"), rc(RC) {}
+};
 
-    if ((uint64_t)id_out != ((id << 1) + (longlived ? 1 : 0))) {
-        PLOGMSG(klogFatal, (klogFatal, "membank '$(which)': id space overflow", longlived ? "fragsOne" : "fragsBoth"));
-        abort();
-    }
-    Id[0] = id_out;
-    return rc;
-}
+#define SPILL_PAGE_SIZE (16 * 1024)
+#define SPILL_GRAIN (16)
 
-rc_t MemBank_Write(MemBank *const self, uint32_t const id, uint64_t const pos, void const *const buffer, size_t const size, size_t *const num_writ)
+/* write-back cache of spill file pages, the least recently used page is
+ * written back first.
+ * pages past the end of the file are filled in the cache, so fragments spilled
+ * there reach the file in page sized writes; reads and writes of pages that
+ * are not cached go to the file as they are, a spilled fragment is mostly
+ * read just once.
+ */
+class page_cache
 {
-    uint64_t const myId = id >> 1;
-    bool const longlived = (id & 1) ? true : false;
-    KMemBank *const mbank = longlived ? self->fragsOne : self->fragsBoth;
+    struct page {
+        char *data;
+        bool dirty;
+        std::list<uint64_t>::iterator lru;
+    };
+    typedef std::map<uint64_t, page> my_pages_t;
+    typedef std::list<uint64_t> my_lru_t;
+    my_pages_t pages;
+    my_lru_t lru;           /* page numbers, most recently used first */
+    KFile *file;
+    uint64_t fileSize;      /* bytes written to file so far */
+    my_pages_t::size_type const max_pages;
     
-    return KMemBankWrite(mbank, myId, pos, buffer, size, num_writ);
-}
-
-rc_t MemBank_Size(MemBank const *const self, uint32_t const id, size_t *const rslt)
-{
-    uint64_t const myId = id >> 1;
-    bool const longlived = (id & 1) ? true : false;
-    KMemBank const *const mbank = longlived ? self->fragsOne : self->fragsBoth;
-    uint64_t size;
-    rc_t const rc = KMemBankSize(mbank, myId, &size);
+public:
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t file_reads;
+    uint64_t file_writes;
+    uint64_t page_writes;
     
-    *rslt = size;
-    return rc;
-}
-
-rc_t MemBank_Read(MemBank const *const self, uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize, size_t *const num_read)
-{
-    uint64_t const myId = id >> 1;
-    bool const longlived = (id & 1) ? true : false;
-    KMemBank *const mbank = longlived ? self->fragsOne : self->fragsBoth;
-
-    return KMemBankRead(mbank, myId, pos, buffer, bsize, num_read);
-}
+private:
+    void WriteBack(uint64_t const n, page &p)
+    {
+        uint64_t const pos = n * SPILL_PAGE_SIZE;
+        size_t num_writ = 0;
+        rc_t const rc = KFileWriteAll(file, pos, p.data, SPILL_PAGE_SIZE, &num_writ);
+        if (rc)
+            throw spill_error(rc);
+        if (num_writ != SPILL_PAGE_SIZE)
+            throw spill_error(RC(rcApp, rcFile, rcWriting, rcTransfer, rcIncomplete));
+        if (fileSize < pos + SPILL_PAGE_SIZE)
+            fileSize = pos + SPILL_PAGE_SIZE;
+        p.dirty = false;
+        ++page_writes;
+    }
+    /* the cached page or NULL */
+    page *find(uint64_t const n)
+    {
+        my_pages_t::iterator const i = pages.find(n);
+        
+        ++lookups;
+        if (i == pages.end())
+            return 0;
+        lru.splice(lru.begin(), lru, i->second.lru);
+        ++hits;
+        return &i->second;
+    }
+    /* a page past the end of the file, nothing of it has been written yet */
+    page &add(uint64_t const n)
+    {
+        char *data = 0;
+        
+        if (pages.size() >= max_pages) {
+            my_pages_t::iterator const j = pages.find(lru.back());
+            
+            if (j->second.dirty)
+                WriteBack(j->first, j->second);
+            data = j->second.data;
+            pages.erase(j);
+            lru.pop_back();
+        }
+        else {
+            data = reinterpret_cast<char *>(malloc(SPILL_PAGE_SIZE));
+            if (data == 0)
+                throw std::bad_alloc();
+        }
+        std::fill(data, data + SPILL_PAGE_SIZE, 0);
+        lru.push_front(n);
+        
+        page &p = pages[n];
+        p.data = data;
+        p.dirty = false;
+        p.lru = lru.begin();
+        return p;
+    }
+public:
+    page_cache(KFile *const File, size_t const bytes)
+    : file(File)
+    , fileSize(0)
+    , max_pages(bytes > 4 * SPILL_PAGE_SIZE ? bytes / SPILL_PAGE_SIZE : 4)
+    , lookups(0)
+    , hits(0)
+    , file_reads(0)
+    , file_writes(0)
+    , page_writes(0)
+    {}
+    ~page_cache()
+    {
+        for (my_pages_t::iterator i = pages.begin(); i != pages.end(); ++i)
+            free(i->second.data);
+    }
+    size_t Bytes() const
+    {
+        return max_pages * SPILL_PAGE_SIZE;
+    }
+    void Read(uint64_t pos, void *const buffer, size_t const size)
+    {
+        char *dst = reinterpret_cast<char *>(buffer);
+        char *const end = dst + size;
+        
+        while (dst != end) {
+            size_t const offset = pos % SPILL_PAGE_SIZE;
+            size_t const n = std::min<size_t>(SPILL_PAGE_SIZE - offset, end - dst);
+            page const *const p = find(pos / SPILL_PAGE_SIZE);
+            
+            if (p)
+                std::copy(p->data + offset, p->data + offset + n, dst);
+            else {
+                size_t num_read = 0;
+                rc_t const rc = KFileReadAll(file, pos, dst, n, &num_read);
+                if (rc)
+                    throw spill_error(rc);
+                if (num_read != n)
+                    throw spill_error(RC(rcApp, rcFile, rcReading, rcTransfer, rcIncomplete));
+                ++file_reads;
+            }
+            dst += n;
+            pos += n;
+        }
+    }
+    void Write(uint64_t pos, void const *const data, size_t const size)
+    {
+        char const *src = reinterpret_cast<char const *>(data);
+        char const *const end = src + size;
+        
+        while (src != end) {
+            size_t const offset = pos % SPILL_PAGE_SIZE;
+            size_t const n = std::min<size_t>(SPILL_PAGE_SIZE - offset, end - src);
+            uint64_t const pageno = pos / SPILL_PAGE_SIZE;
+            page *p = find(pageno);
+            
+            if (p == 0 && pos - offset >= fileSize)
+                p = &add(pageno);
+            if (p) {
+                std::copy(src, src + n, p->data + offset);
+                p->dirty = true;
+            }
+            else {
+                size_t num_writ = 0;
+                rc_t const rc = KFileWriteAll(file, pos, src, n, &num_writ);
+                if (rc)
+                    throw spill_error(rc);
+                if (num_writ != n)
+                    throw spill_error(RC(rcApp, rcFile, rcWriting, rcTransfer, rcIncomplete));
+                ++file_writes;
+            }
+            src += n;
+            pos += n;
+        }
+    }
+};
 
-rc_t MemBank_Free(MemBank *const self, uint32_t const id)
+/* space in the spill file; sizes are rounded up to SPILL_GRAIN,
+ * a request takes the smallest hole it fits in and the rest stays a hole,
+ * freed space is merged with the holes next to it and given back at the end
+ */
+class spill_space
 {
-    uint64_t const myId = id >> 1;
-    bool const longlived = (id & 1) ? true : false;
-    KMemBank *const mbank = longlived ? self->fragsOne : self->fragsBoth;
-
-    return KMemBankFree(mbank, myId);
-}
-
-#else
-
-#include <map>
-#include <set>
-#include <vector>
-#include <iostream>
-#include <stdexcept>
-#include <algorithm>
+    typedef std::map<uint64_t, uint64_t> my_holes_t;                /* position -> size */
+    typedef std::set<std::pair<uint64_t, uint64_t> > my_by_size_t;  /* (size, position) */
+    my_holes_t holes;
+    my_by_size_t by_size;
+    
+public:
+    uint64_t size;          /* end of used space */
+    uint64_t max_size;
+    
+private:
+    static uint64_t Class(size_t const bytes)
+    {
+        return (bytes + (SPILL_GRAIN - 1)) & ~(uint64_t)(SPILL_GRAIN - 1);
+    }
+    void Insert(uint64_t const pos, uint64_t const bytes)
+    {
+        holes[pos] = bytes;
+        by_size.insert(std::make_pair(bytes, pos));
+    }
+    void Erase(my_holes_t::iterator const i)
+    {
+        by_size.erase(std::make_pair(i->second, i->first));
+        holes.erase(i);
+    }
+public:
+    spill_space() : size(0), max_size(0) {}
+    
+    uint64_t Alloc(size_t const bytes)
+    {
+        uint64_t const need = Class(bytes);
+        my_by_size_t::iterator const fit = by_size.lower_bound(std::make_pair(need, (uint64_t)0));
+        
+        if (fit != by_size.end()) {
+            uint64_t const pos = fit->second;
+            uint64_t const have = fit->first;
+            
+            Erase(holes.find(pos));
+            if (have > need)
+                Insert(pos + need, have - need);
+            return pos;
+        }
+        uint64_t const pos = size;
+        
+        size += need;
+        if (max_size < size)
+            max_size = size;
+        return pos;
+    }
+    void Free(uint64_t pos, size_t const bytes)
+    {
+        uint64_t end = pos + Class(bytes);
+        my_holes_t::iterator const next = holes.find(end);
+        
+        if (next != holes.end()) {
+            end += next->second;
+            Erase(next);
+        }
+        my_holes_t::iterator const prev = holes.lower_bound(pos);
+        if (prev != holes.begin()) {
+            my_holes_t::iterator i = prev;
+            
+            --i;
+            if (i->first + i->second == pos) {
+                pos = i->first;
+                Erase(i);
+            }
+        }
+        if (end == size)
+            size = pos;
+        else
+            Insert(pos, end - pos);
+    }
+};
 
+/* fragments live in RAM until the RAM in use would exceed the limit;
+ * then the oldest ones are spilled, fragments whose mate is not
+ * expected nearby going first.
+ * a sixteenth of the limit is kept for the spill file's page cache.
+ */
 class pmem
 {
     struct allocation {
-        void *memory;
+        void *memory;       /* NULL if spilled */
         size_t size;
+        uint64_t spill;     /* position in spill file */
+        uint64_t serial;
         
-        allocation(int = 0) : memory(0), size(0) {}
+        allocation(int = 0) : memory(0), size(0), spill(0), serial(0) {}
     };
     typedef std::map<uint32_t, struct allocation> my_map_t;
     typedef std::set<uint32_t> my_set_t;
+    typedef std::deque<std::pair<uint32_t, uint64_t> > my_queue_t;
     my_map_t in_use;
     my_set_t no_use;
+    my_queue_t queue[2];    /* in allocation order; [1] is long lived */
+    KFile *spillFile;
+    mutable page_cache cache;
+    spill_space space;
+    size_t const limit;     /* 0 is unlimited */
+    size_t in_ram;
+    uint64_t serial;
+    
     my_map_t::size_type max_in_use;
     my_set_t::size_type max_no_use;
     my_map_t::size_type total_allocs;
     my_map_t::size_type total_frees;
+    size_t max_in_ram;
+    uint64_t spilled;
+    uint64_t spilled_bytes;
+    mutable uint64_t reads;
+    mutable uint64_t read_hits;
     
-    void *get(uint32_t const id) const
+    allocation &get(uint32_t const id)
+    {
+        my_map_t::iterator const i = in_use.find(id);
+        
+        if (i == in_use.end())
+            throw std::runtime_error("attempt to access invalid id");
+        
+        return i->second;
+    }
+    allocation const &get(uint32_t const id) const
     {
         my_map_t::const_iterator const i = in_use.find(id);
         
         if (i == in_use.end())
             throw std::runtime_error("attempt to access invalid id");
         
-        return i->second.memory;
+        return i->second;
+    }
+    void Spill(allocation &a)
+    {
+        uint64_t const pos = space.Alloc(a.size);
+        
+        cache.Write(pos, a.memory, a.size);
+        
+        free(a.memory);
+        a.memory = 0;
+        a.spill = pos;
+        in_ram -= a.size;
+        ++spilled;
+        spilled_bytes += a.size;
+    }
+    /* make room for size more bytes */
+    void Evict(size_t const size)
+    {
+        while (in_ram + size > limit) {
+            my_queue_t &q = queue[1].empty() ? queue[0] : queue[1];
+            
+            if (q.empty())
+                break;
+            
+            std::pair<uint32_t, uint64_t> const front = q.front();
+            q.pop_front();
+            
+            my_map_t::iterator const i = in_use.find(front.first);
+            if (i != in_use.end() && i->second.serial == front.second && i->second.memory != 0)
+                Spill(i->second);
+        }
+    }
+    /* drop queue entries of freed or spilled fragments */
+    void Compact(my_queue_t &q)
+    {
+        my_queue_t keep;
+        
+        for (my_queue_t::const_iterator j = q.begin(); j != q.end(); ++j) {
+            my_map_t::const_iterator const i = in_use.find(j->first);
+            
+            if (i != in_use.end() && i->second.serial == j->second && i->second.memory != 0)
+                keep.push_back(*j);
+        }
+        q.swap(keep);
     }
 public:
-    pmem(int = 0)
-    : max_in_use(0)
+    pmem(KFile *const SpillFile = 0, size_t const Limit = 0)
+    : spillFile(SpillFile)
+    , cache(SpillFile, Limit / 16)
+    , limit(SpillFile == 0 ? 0 : Limit > 2 * cache.Bytes() ? Limit - cache.Bytes() : Limit / 2)
+    , in_ram(0)
+    , serial(0)
+    , max_in_use(0)
     , max_no_use(0)
     , total_allocs(0)
     , total_frees(0)
+    , max_in_ram(0)
+    , spilled(0)
+    , spilled_bytes(0)
+    , reads(0)
+    , read_hits(0)
     {}
     ~pmem() {
         my_map_t::iterator i;
@@ -210,29 +558,43 @@ public:
             free(i->second.memory);
             ++total_frees;
         }
-#if 0
-        std::cerr << "max. used: " << max_in_use << std::endl;
-        std::cerr << "max. free: " << max_no_use << std::endl;
-        std::cerr << "num alloc: " << total_allocs << std::endl;
-        std::cerr << "num frees: " << total_frees << std::endl;
-#endif
+        KFileRelease(spillFile);
+        (void)PLOGMSG(klogInfo, (klogInfo, "fragment store: $(allocs) allocations, max. $(max) in use, max. $(ram) bytes in RAM", "allocs=%lu,max=%lu,ram=%lu", (unsigned long)total_allocs, (unsigned long)max_in_use, (unsigned long)max_in_ram));
+        if (limit != 0) {
+            (void)PLOGMSG(klogInfo, (klogInfo, "fragment store: spilled $(count) fragments, $(bytes) bytes; $(reads) reads, hit rate $(rate)%",
+                                     "count=%lu,bytes=%lu,reads=%lu,rate=%.1f", (unsigned long)spilled, (unsigned long)spilled_bytes, (unsigned long)reads,
+                                     reads ? (100.0 * read_hits) / reads : 100.0));
+            (void)PLOGMSG(klogInfo, (klogInfo, "fragment store: spill file max. $(size) bytes; page cache hit rate $(rate)%, $(pages) pages written back, $(reads) reads and $(writes) writes past the cache",
+                                     "size=%lu,rate=%.1f,pages=%lu,reads=%lu,writes=%lu", (unsigned long)space.max_size,
+                                     cache.lookups ? (100.0 * cache.hits) / cache.lookups : 100.0, (unsigned long)cache.page_writes,
+                                     (unsigned long)cache.file_reads, (unsigned long)cache.file_writes));
+        }
     }
     
-    void Write(uint32_t id, size_t const offset, size_t const size, void const *const data) const
+    void Write(uint32_t id, size_t const offset, size_t const size, void const *const data)
     {
-        if (offset + size <= this->Size(id)) {
-            char *dst = reinterpret_cast<char *>(get(id)) + offset;
-            char const *src = reinterpret_cast<char const *>(data);
-            
-            std::copy(src, src + size, dst);
+        allocation const &a = get(id);
+
+        if (offset + size <= a.size) {
+            if (a.memory) {
+                char *dst = reinterpret_cast<char *>(a.memory) + offset;
+                char const *src = reinterpret_cast<char const *>(data);
+                
+                std::copy(src, src + size, dst);
+            }
+            else
+                cache.Write(a.spill + offset, data, size);
             return;
         }
         throw std::runtime_error("attempt to write more than was allocated");
     }
-    uint32_t Alloc(size_t const size, bool const clear = true)
+    uint32_t Alloc(size_t const size, bool const clear = true, bool const longlived = false)
     {
         my_map_t::key_type new_key;
         
+        if (limit != 0)
+            Evict(size);
+        
         if (no_use.begin() == no_use.end()) {
             my_map_t::size_type const new_id = in_use.size() + 1;
 
@@ -249,17 +611,29 @@ public:
             new_key = *j;
             no_use.erase(j);
         }
-        my_map_t::iterator const i = in_use.insert(my_map_t::value_type(new_key, 0)).first;
-        
         void *const alloc = calloc(1, size);
-        if (alloc) {
-            i->second.memory = alloc;
-            i->second.size = size;
+        if (alloc == 0) {
+            no_use.insert(new_key);
+            throw std::bad_alloc();
+        }
+        allocation &a = in_use[new_key];
+        
+        a.memory = alloc;
+        a.size = size;
+        a.serial = ++serial;
+        in_ram += size;
+        if (max_in_ram < in_ram)
+            max_in_ram = in_ram;
+        ++total_allocs;
+        
+        if (limit != 0) {
+            my_queue_t &q = queue[longlived ? 1 : 0];
             
-            ++total_allocs;
-            return i->first;
+            q.push_back(std::make_pair(new_key, a.serial));
+            if (q.size() > 1024 && q.size() > 2 * in_use.size())
+                Compact(q);
         }
-        throw std::bad_alloc();
+        return new_key;
     }
     void Free(uint32_t const id)
     {
@@ -268,14 +642,19 @@ public:
         if (i == in_use.end())
             throw std::runtime_error("attempt to free invalid id");
         
-        void *const alloc = i->second.memory;
+        allocation const a = i->second;
 
         no_use.insert(id);
         if (max_no_use < no_use.size())
             max_no_use = no_use.size();
 
         in_use.erase(i);
-        free(alloc);
+        if (a.memory) {
+            free(a.memory);
+            in_ram -= a.size;
+        }
+        else
+            space.Free(a.spill, a.size);
         ++total_frees;
     }
     size_t Size(uint32_t const id) const
@@ -287,191 +666,196 @@ public:
         
         return i->second.size;
     }
-    void const *Read(uint32_t const id) const
+    void Read(uint32_t const id, size_t const offset, size_t const size, void *const buffer) const
     {
-        return get(id);
-    }
-};
-
-rc_t MemBank_Make(MemBank **bank, struct KDirectory * = 0, int = 0, size_t const * = 0)
-{
-    try {
-        pmem *const rslt = new pmem;
-        
-        *bank = reinterpret_cast<MemBank *>(rslt);
-        return 0;
-    }
-    catch (std::bad_alloc const &e) {
-        return RC(rcApp, rcFile, rcConstructing, rcMemory, rcExhausted);
-    }
-    catch (std::exception const &e) {
-        std::cout << e.what() << std::endl;
-        abort();
-    }
-    catch (...) {
-        std::cout << "this is bad!" << std::endl;
-        abort();
-    }
-}
-
-void MemBank_Release(MemBank *const self)
-{
-    delete reinterpret_cast<pmem *>(self);
-}
-
-rc_t MemBank_Alloc(MemBank *const Self, uint32_t *const id, size_t const bytes, bool const clear, bool const longlived)
-{
-    try {
-        pmem *const self = reinterpret_cast<pmem *>(Self);
+        allocation const &a = get(id);
         
-        *id = self->Alloc(bytes, clear);
-        return 0;
-    }
-    catch (std::bad_alloc const &e) {
-        return RC(rcApp, rcFile, rcAllocating, rcMemory, rcExhausted);
-    }
-    catch (std::exception const &e) {
-        std::cerr << e.what() << std::endl;
-        abort();
-    }
-    catch (...) {
-        std::cout << "this is bad!" << std::endl;
-        abort();
+        ++reads;
+        if (a.memory) {
+            char const *src = reinterpret_cast<char const *>(a.memory) + offset;
+            
+            std::copy(src, src + size, reinterpret_cast<char *>(buffer));
+            ++read_hits;
+        }
+        else
+            cache.Read(a.spill + offset, buffer, size);
     }
-}
-
-rc_t MemBank_Write(MemBank *const Self, uint32_t const id, uint64_t const pos, void const *const buffer, size_t const bsize, size_t *const num_writ)
-{
-    try {
-        pmem *const self = reinterpret_cast<pmem *>(Self);
-        
-        *num_writ = 0;
+};
 
-        size_t const size = self->Size((uint32_t)id);
-        
-        if (pos >= size)
+class RAMBank : public MemBank {
+    pmem self;
+public:
+    RAMBank(KFile *const spillFile = 0, size_t const limit = 0) : self(spillFile, limit) {}
+    
+    rc_t Alloc(uint32_t *const id, size_t const bytes, bool const clear, bool const longlived)
+    {
+        try {
+            *id = self.Alloc(bytes, clear, longlived);
             return 0;
-        
-        size_t const actsize = (bsize + pos > size) ? (size - pos) : size;
-        
-        *num_writ = actsize;
-        self->Write(id, pos, actsize, buffer);
-        
-        return 0;
-    }
-    catch (std::exception const &e) {
-        std::cerr << e.what() << std::endl;
-        abort();
-    }
-    catch (...) {
-        std::cout << "this is bad!" << std::endl;
-        abort();
-    }
-}
-
-rc_t MemBank_Size(MemBank const *const Self, uint32_t const id, size_t *const size)
-{
-    try {
-        pmem const *const self = reinterpret_cast<pmem const *>(Self);
-        
-        *size = self->Size(id);
-        return 0;
-    }
-    catch (std::exception const &e) {
-        std::cerr << e.what() << std::endl;
-        abort();
+        }
+        catch (std::bad_alloc const &e) {
+            return RC(rcApp, rcFile, rcAllocating, rcMemory, rcExhausted);
+        }
+        catch (spill_error const &e) {
+            return e.rc;
+        }
+        catch (std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+            abort();
+        }
+        catch (...) {
+            std::cout << "this is bad!" << std::endl;
+            abort();
+        }
     }
-    catch (...) {
-        std::cout << "this is bad!" << std::endl;
-        abort();
+    
+    rc_t Write(uint32_t const id, uint64_t const pos, void const *const buffer, size_t const bsize, size_t *const num_writ)
+    {
+        try {
+            *num_writ = 0;
+            
+            size_t const size = self.Size(id);
+            
+            if (pos >= size)
+                return 0;
+            
+            size_t const actsize = (bsize + pos > size) ? (size - pos) : bsize;
+            
+            self.Write(id, pos, actsize, buffer);
+            *num_writ = actsize;
+            
+            return 0;
+        }
+        catch (spill_error const &e) {
+            return e.rc;
+        }
+        catch (std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+            abort();
+        }
+        catch (...) {
+            std::cout << "this is bad!" << std::endl;
+            abort();
+        }
     }
-}
-
-rc_t MemBank_Read(MemBank const *const Self, uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize, size_t *const num_read)
-{
-    try {
-        pmem const *const self = reinterpret_cast<pmem const *>(Self);
-        
-        *num_read = 0;
-        
-        size_t const size = self->Size(id);
-        char const *data = reinterpret_cast<char const *>(self->Read(id)) + pos;
-        
-        if (pos >= size)
+    
+    rc_t Size(uint32_t const id, size_t *const size) const
+    {
+        try {
+            *size = self.Size(id);
             return 0;
-        
-        size_t const actsize = (bsize + pos > size) ? (size - pos) : size;
-        
-        *num_read = actsize;
-        
-        char *dst = reinterpret_cast<char *>(buffer);
-        std::copy(data, data + actsize, dst);
-        
-        return 0;
+        }
+        catch (std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+            abort();
+        }
+        catch (...) {
+            std::cout << "this is bad!" << std::endl;
+            abort();
+        }
     }
-    catch (std::exception const &e) {
-        std::cerr << e.what() << std::endl;
-        abort();
+    
+    rc_t Read(uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize, size_t *const num_read) const
+    {
+        try {
+            *num_read = 0;
+            
+            size_t const size = self.Size(id);
+            
+            if (pos >= size)
+                return 0;
+            
+            size_t const actsize = (bsize + pos > size) ? (size - pos) : bsize;
+            
+            self.Read(id, pos, actsize, buffer);
+            *num_read = actsize;
+            
+            return 0;
+        }
+        catch (spill_error const &e) {
+            return e.rc;
+        }
+        catch (std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+            abort();
+        }
+        catch (...) {
+            std::cout << "this is bad!" << std::endl;
+            abort();
+        }
     }
-    catch (...) {
-        std::cout << "this is bad!" << std::endl;
-        abort();
+    
+    rc_t Free(uint32_t const id)
+    {
+        try {
+            self.Free(id);
+            return 0;
+        }
+        catch (std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+            abort();
+        }
+        catch (...) {
+            std::cout << "this is bad!" << std::endl;
+            abort();
+        }
     }
-}
+};
 
-rc_t MemBank_Free(MemBank *const Self, uint32_t const id)
+static rc_t MemBank_Make(MemBank **const bank, int const type, KDirectory *const dir, int const pid, size_t const climits[2])
 {
+    if (type == mbt_PageFile)
+        return PageFileBank::Make(bank, dir, pid, climits);
+    
+    KFile *spillFile = 0;
+    if (type == mbt_Spill) {
+        rc_t const rc = CreateTempFile(&spillFile, dir, pid, "frag_spill");
+        if (rc)
+            return rc;
+    }
     try {
-        pmem *const self = reinterpret_cast<pmem *>(Self);
-        
-        self->Free(id);
+        *bank = new RAMBank(spillFile, climits[0] + climits[1]);
         return 0;
     }
-    catch (std::exception const &e) {
-        std::cerr << e.what() << std::endl;
-        abort();
-    }
-    catch (...) {
-        std::cout << "this is bad!" << std::endl;
-        abort();
+    catch (std::bad_alloc const &e) {
+        KFileRelease(spillFile);
+        return RC(rcApp, rcFile, rcConstructing, rcMemory, rcExhausted);
     }
 }
-#endif
 
 extern "C" {
-    rc_t MemBankMake(MemBank **bank, struct KDirectory *dir, int pid, size_t const climits[2])
+    rc_t MemBankMake(MemBank **bank, int type, struct KDirectory *dir, int pid, size_t const climits[2])
     {
-      return MemBank_Make(bank, dir, pid, climits);
+        return MemBank_Make(bank, type, dir, pid, climits);
     }
     
     void MemBankRelease(MemBank *const self)
     {
-        MemBank_Release(self);
+        delete self;
     }
     
-    rc_t MemBankAlloc(MemBank *const Self, uint32_t *const id, size_t const bytes, bool const clear, bool const longlived)
+    rc_t MemBankAlloc(MemBank *const self, uint32_t *const id, size_t const bytes, bool const clear, bool const longlived)
     {
-        return MemBank_Alloc(Self, id, bytes, clear, longlived);
+        return self->Alloc(id, bytes, clear, longlived);
     }
     
-    rc_t MemBankWrite(MemBank *const Self, uint32_t const id, uint64_t const pos, void const *const buffer, size_t const bsize, size_t *const num_writ)
+    rc_t MemBankWrite(MemBank *const self, uint32_t const id, uint64_t const pos, void const *const buffer, size_t const bsize, size_t *const num_writ)
     {
-        return MemBank_Write(Self, id, pos, buffer, bsize, num_writ);
+        return self->Write(id, pos, buffer, bsize, num_writ);
     }
     
-    rc_t MemBankSize(MemBank const *const Self, uint32_t const id, size_t *const size)
+    rc_t MemBankSize(MemBank const *const self, uint32_t const id, size_t *const size)
     {
-        return MemBank_Size(Self, id, size);
+        return self->Size(id, size);
     }
     
-    rc_t MemBankRead(MemBank const *const Self, uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize, size_t *const num_read)
+    rc_t MemBankRead(MemBank const *const self, uint32_t const id, uint64_t const pos, void *const buffer, size_t const bsize, size_t *const num_read)
     {
-        return MemBank_Read(Self, id, pos, buffer, bsize, num_read);
+        return self->Read(id, pos, buffer, bsize, num_read);
     }
     
-    rc_t MemBankFree(MemBank *const Self, uint32_t const id)
+    rc_t MemBankFree(MemBank *const self, uint32_t const id)
     {
-        return MemBank_Free(Self, id);
+        return self->Free(id);
     }
 }
-
@@ -26,7 +26,17 @@
 
 typedef struct MemBank MemBank;
 
-rc_t MemBankMake(MemBank **rslt, struct KDirectory *dir, int pid, size_t const climits[2]);
+enum MemBankTypes {
+    mbt_RAM,        /* everything in RAM */
+    mbt_Spill,      /* RAM up to climits[0] + climits[1], then oldest fragments spill to a file through a page cache */
+    mbt_PageFile    /* KMemBank on page files with caches of climits[0] and climits[1] */
+};
+
+/* Make
+ *  temporary files are created in dir
+ *  the store logs its statistics when released
+ */
+rc_t MemBankMake(MemBank **rslt, int type, struct KDirectory *dir, int pid, size_t const climits[2]);
 
 void MemBankRelease(MemBank *self);
 
@@ -0,0 +1,475 @@
+/* ===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#include <klib/defs.h>
+#include <klib/rc.h>
+#include <klib/log.h>
+#include <klib/printf.h>
+
+#include <sysalloc.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "name-table.h"
+
+#define NT_INITIAL_BITS (16u)
+#define NT_MAX_BITS (32u)
+#define NT_ARENA_CHUNK_BITS (24u)   /* 16MB */
+#define NT_ARENA_CHUNK_SIZE ((size_t)1 << NT_ARENA_CHUNK_BITS)
+#define NT_ARENA_MAX_CHUNKS (1u << 16)
+#define NT_MAX_NAME_LEN (0xFFFFu)
+#define NT_NONE (~(unsigned)0)
+
+typedef struct NameTableSlot NameTableSlot;
+typedef struct NameTableCacheEntry NameTableCacheEntry;
+
+/* pos == 0 is an empty slot; the first bytes of the arena are never used */
+struct NameTableSlot {
+    uint32_t hash;
+    uint32_t id;
+    uint64_t pos;   /* (chunk << 32) | offset in chunk of name in arena */
+};
+
+/* a mapped arena chunk; entries are in a list, most recently used first,
+ * unused ones are in a list of their own */
+struct NameTableCacheEntry {
+    NameTable *table;
+    unsigned chunk;
+    unsigned prev;
+    unsigned next;
+};
+
+struct NameTableCache {
+    NameTableCacheEntry *entry;
+    unsigned max;           /* number of chunks that may be mapped */
+    unsigned used;          /* number of entries ever used */
+    unsigned head;          /* most recently used */
+    unsigned tail;          /* least recently used */
+    unsigned free;          /* unused entries, linked by next */
+    uint64_t maps;
+    uint64_t unmaps;
+};
+
+struct NameTable {
+    NameTableSlot *slot;
+    NameTableCache *cache;
+    uint8_t **chunk;        /* [chunks]; NULL if not mapped */
+    unsigned *entry;        /* [chunks]; cache entry of mapped chunk, NT_NONE for the last one */
+    uint64_t count;
+    uint64_t mask;          /* number of slots - 1 */
+    size_t arena_used;      /* used bytes in last chunk */
+    unsigned chunks;
+    unsigned chunks_alloc;
+    unsigned bits;
+    int slot_fd;
+    int arena_fd;
+    unsigned pid;
+    unsigned n;
+    unsigned generation;    /* number of times slot table was grown */
+    char tmpdir[4096];
+};
+
+/* FNV-1a */
+static uint32_t NameTableHash(char const name[], size_t const namelen)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    size_t i;
+
+    for (i = 0; i < namelen; ++i)
+        h = (h ^ (uint8_t)name[i]) * 0x100000001b3ull;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static rc_t NameTableOpenFile(NameTable const *const self, int *const fd, char const suffix[])
+{
+    char fname[4096];
+    rc_t rc = string_printf(fname, sizeof(fname), NULL, "%s/key2id.%u.%u.%s%u", self->tmpdir, self->pid, self->n, suffix, self->generation);
+
+    if (rc)
+        return rc;
+
+    *fd = open(fname, O_RDWR|O_TRUNC|O_CREAT, S_IRUSR|S_IWUSR);
+    if (*fd < 0)
+        return RC(rcExe, rcFile, rcCreating, rcFile, rcNotFound);
+    unlink(fname);
+    return 0;
+}
+
+static rc_t NameTableMapSlots(NameTable *const self, NameTableSlot **const rslt, int *const fd, unsigned const bits)
+{
+    size_t const size = sizeof(NameTableSlot) << bits;
+    void *base;
+    rc_t rc = NameTableOpenFile(self, fd, "h");
+
+    if (rc)
+        return rc;
+
+    /* the file is sparse; unused slots read as zero */
+    if (ftruncate(*fd, size) != 0) {
+        close(*fd);
+        return RC(rcExe, rcFile, rcResizing, rcSize, rcExcessive);
+    }
+    base = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_FILE|MAP_SHARED, *fd, 0);
+    if (base == MAP_FAILED) {
+        close(*fd);
+        return RC(rcExe, rcMemMap, rcConstructing, rcMemory, rcExhausted);
+    }
+    *rslt = base;
+    return 0;
+}
+
+static void NameTableUnmapSlots(NameTableSlot *const slot, int const fd, unsigned const bits)
+{
+    munmap(slot, sizeof(NameTableSlot) << bits);
+    close(fd);
+}
+
+static rc_t NameTableGrow(NameTable *const self)
+{
+    unsigned const bits = self->bits + 1;
+    uint64_t const mask = ((uint64_t)1 << bits) - 1;
+    NameTableSlot *slot;
+    int fd;
+    uint64_t i;
+    rc_t rc;
+
+    if (bits > NT_MAX_BITS)
+        return RC(rcExe, rcTree, rcAllocating, rcConstraint, rcViolated);
+
+    ++self->generation;
+    rc = NameTableMapSlots(self, &slot, &fd, bits);
+    if (rc)
+        return rc;
+
+    for (i = 0; i <= self->mask; ++i) {
+        NameTableSlot const *const src = &self->slot[i];
+
+        if (src->pos != 0) {
+            uint64_t j = src->hash & mask;
+
+            while (slot[j].pos != 0)
+                j = (j + 1) & mask;
+            slot[j] = *src;
+        }
+    }
+    NameTableUnmapSlots(self->slot, self->slot_fd, self->bits);
+    self->slot = slot;
+    self->slot_fd = fd;
+    self->bits = bits;
+    self->mask = mask;
+
+    return 0;
+}
+
+static void NameTableCacheUnlink(NameTableCache *const self, unsigned const e)
+{
+    NameTableCacheEntry *const entry = &self->entry[e];
+
+    if (entry->prev != NT_NONE)
+        self->entry[entry->prev].next = entry->next;
+    else
+        self->head = entry->next;
+    if (entry->next != NT_NONE)
+        self->entry[entry->next].prev = entry->prev;
+    else
+        self->tail = entry->prev;
+}
+
+static void NameTableCachePushHead(NameTableCache *const self, unsigned const e)
+{
+    NameTableCacheEntry *const entry = &self->entry[e];
+
+    entry->prev = NT_NONE;
+    entry->next = self->head;
+    if (self->head != NT_NONE)
+        self->entry[self->head].prev = e;
+    else
+        self->tail = e;
+    self->head = e;
+}
+
+static void NameTableUnmapChunk(NameTable *const self, unsigned const chunk)
+{
+    NameTableCache *const cache = self->cache;
+    unsigned const e = self->entry[chunk];
+
+    munmap(self->chunk[chunk], NT_ARENA_CHUNK_SIZE);
+    self->chunk[chunk] = NULL;
+    ++cache->unmaps;
+
+    NameTableCacheUnlink(cache, e);
+    cache->entry[e].next = cache->free;
+    cache->free = e;
+}
+
+static rc_t NameTableMapChunk(NameTable *const self, unsigned const chunk)
+{
+    void *const base = mmap(NULL, NT_ARENA_CHUNK_SIZE, PROT_READ|PROT_WRITE, MAP_FILE|MAP_SHARED, self->arena_fd, (off_t)chunk << NT_ARENA_CHUNK_BITS);
+
+    if (base == MAP_FAILED) {
+        (void)PLOGMSG(klogErr, (klogErr, "Failed to map name arena chunk $(chunk)", "chunk=%u", chunk));
+        return RC(rcExe, rcMemMap, rcConstructing, rcMemory, rcExhausted);
+    }
+    self->chunk[chunk] = base;
+    self->entry[chunk] = NT_NONE;
+    ++self->cache->maps;
+    return 0;
+}
+
+/* puts a mapped chunk in the cache, unmapping the least recently used one if needed */
+static void NameTableCacheAdd(NameTable *const self, unsigned const chunk)
+{
+    NameTableCache *const cache = self->cache;
+    unsigned e;
+
+    if (cache->free == NT_NONE && cache->used == cache->max) {
+        NameTableCacheEntry const *const lru = &cache->entry[cache->tail];
+
+        NameTableUnmapChunk(lru->table, lru->chunk);
+    }
+    if (cache->free != NT_NONE) {
+        e = cache->free;
+        cache->free = cache->entry[e].next;
+    }
+    else
+        e = cache->used++;
+
+    cache->entry[e].table = self;
+    cache->entry[e].chunk = chunk;
+    NameTableCachePushHead(cache, e);
+    self->entry[chunk] = e;
+}
+
+/* the chunk being filled stays mapped and is not in the cache */
+static rc_t NameTableGetChunk(NameTable *const self, unsigned const chunk, uint8_t **const base)
+{
+    if (self->chunk[chunk] == NULL) {
+        rc_t const rc = NameTableMapChunk(self, chunk);
+        if (rc)
+            return rc;
+        NameTableCacheAdd(self, chunk);
+    }
+    else if (self->entry[chunk] != NT_NONE && self->cache->head != self->entry[chunk]) {
+        NameTableCacheUnlink(self->cache, self->entry[chunk]);
+        NameTableCachePushHead(self->cache, self->entry[chunk]);
+    }
+    *base = self->chunk[chunk];
+    return 0;
+}
+
+/* names never cross a chunk boundary */
+static rc_t NameTableArenaAlloc(NameTable *const self, uint64_t *const pos, uint8_t **const dst, size_t const size)
+{
+    if (self->chunks == 0 || self->arena_used + size > NT_ARENA_CHUNK_SIZE) {
+        off_t const fsize = (off_t)(self->chunks + 1) << NT_ARENA_CHUNK_BITS;
+        rc_t rc;
+
+        if (self->chunks == NT_ARENA_MAX_CHUNKS)
+            return RC(rcExe, rcTree, rcAllocating, rcConstraint, rcViolated);
+        if (self->chunks == self->chunks_alloc) {
+            unsigned const alloc = self->chunks_alloc ? 2 * self->chunks_alloc : 16;
+            uint8_t **const chunk = realloc(self->chunk, alloc * sizeof(chunk[0]));
+            unsigned *entry;
+
+            if (chunk == NULL)
+                return RC(rcExe, rcTree, rcAllocating, rcMemory, rcExhausted);
+            self->chunk = chunk;
+            entry = realloc(self->entry, alloc * sizeof(entry[0]));
+            if (entry == NULL)
+                return RC(rcExe, rcTree, rcAllocating, rcMemory, rcExhausted);
+            self->entry = entry;
+            self->chunks_alloc = alloc;
+        }
+        if (ftruncate(self->arena_fd, fsize) != 0)
+            return RC(rcExe, rcFile, rcResizing, rcSize, rcExcessive);
+
+        rc = NameTableMapChunk(self, self->chunks);
+        if (rc)
+            return rc;
+        /* the filled chunk goes to the cache */
+        if (self->chunks > 0)
+            NameTableCacheAdd(self, self->chunks - 1);
+        ++self->chunks;
+        /* keep position 0 from ever being used */
+        self->arena_used = self->chunks == 1 ? 8 : 0;
+    }
+    *pos = ((uint64_t)(self->chunks - 1) << 32) | self->arena_used;
+    *dst = &self->chunk[self->chunks - 1][self->arena_used];
+    self->arena_used += size;
+
+    return 0;
+}
+
+static rc_t NameTableArenaGet(NameTable *const self, uint64_t const pos, uint8_t const **const entry)
+{
+    uint8_t *base;
+    rc_t const rc = NameTableGetChunk(self, (unsigned)(pos >> 32), &base);
+
+    if (rc == 0)
+        *entry = &base[(uint32_t)pos];
+    return rc;
+}
+
+rc_t NameTableCacheMake(NameTableCache **const rslt, size_t const bytes)
+{
+    NameTableCache *const self = calloc(1, sizeof(*self));
+
+    if (self == NULL)
+        return RC(rcExe, rcTree, rcConstructing, rcMemory, rcExhausted);
+
+    self->max = bytes / NT_ARENA_CHUNK_SIZE > 2 ? (unsigned)(bytes / NT_ARENA_CHUNK_SIZE) : 2;
+    self->entry = calloc(self->max, sizeof(self->entry[0]));
+    if (self->entry == NULL) {
+        free(self);
+        return RC(rcExe, rcTree, rcConstructing, rcMemory, rcExhausted);
+    }
+    self->head = self->tail = self->free = NT_NONE;
+    *rslt = self;
+    return 0;
+}
+
+void NameTableCacheWhack(NameTableCache *const self)
+{
+    if (self) {
+        (void)PLOGMSG(klogInfo, (klogInfo, "name tables: $(maps) arena chunks mapped, $(unmaps) unmapped to stay within $(max) chunks", "maps=%lu,unmaps=%lu,max=%u", (unsigned long)self->maps, (unsigned long)self->unmaps, self->max));
+        free(self->entry);
+        free(self);
+    }
+}
+
+rc_t NameTableMake(NameTable **const rslt, NameTableCache *const cache, char const tmpdir[], unsigned const pid, unsigned const n)
+{
+    NameTable *const self = calloc(1, sizeof(*self));
+    rc_t rc;
+
+    if (self == NULL)
+        return RC(rcExe, rcTree, rcConstructing, rcMemory, rcExhausted);
+
+    self->cache = cache;
+    self->pid = pid;
+    self->n = n;
+    self->bits = NT_INITIAL_BITS;
+    self->mask = ((uint64_t)1 << self->bits) - 1;
+    rc = string_printf(self->tmpdir, sizeof(self->tmpdir), NULL, "%s", tmpdir);
+    if (rc == 0)
+        rc = NameTableOpenFile(self, &self->arena_fd, "n");
+    if (rc == 0) {
+        rc = NameTableMapSlots(self, &self->slot, &self->slot_fd, self->bits);
+        if (rc == 0) {
+            *rslt = self;
+            return 0;
+        }
+        close(self->arena_fd);
+    }
+    free(self);
+    return rc;
+}
+
+void NameTableWhack(NameTable *const self)
+{
+    if (self) {
+        unsigned i;
+
+        for (i = 0; i != self->chunks; ++i) {
+            if (self->chunk[i] == NULL)
+                continue;
+            if (self->entry[i] != NT_NONE)
+                NameTableUnmapChunk(self, i);
+            else
+                munmap(self->chunk[i], NT_ARENA_CHUNK_SIZE);
+        }
+        close(self->arena_fd);
+        NameTableUnmapSlots(self->slot, self->slot_fd, self->bits);
+        free(self->entry);
+        free(self->chunk);
+        free(self);
+    }
+}
+
+rc_t NameTableEntry(NameTable *const self, uint32_t *const id, bool *const wasInserted, char const name[], size_t const namelen)
+{
+    uint32_t const hash = NameTableHash(name, namelen);
+    uint64_t i = hash & self->mask;
+
+    if (namelen > NT_MAX_NAME_LEN)
+        return RC(rcExe, rcName, rcInserting, rcString, rcTooLong);
+
+    /* the 32-bit hash acts as a fingerprint; names are only compared when it matches */
+    for ( ; ; ) {
+        NameTableSlot const *const slot = &self->slot[i];
+
+        if (slot->pos == 0)
+            break;
+        if (slot->hash == hash) {
+            uint8_t const *entry;
+            size_t len;
+            rc_t const rc = NameTableArenaGet(self, slot->pos, &entry);
+
+            if (rc)
+                return rc;
+            len = entry[0] | ((size_t)entry[1] << 8);
+            if (len == namelen && memcmp(&entry[2], name, namelen) == 0) {
+                *id = slot->id;
+                *wasInserted = false;
+                return 0;
+            }
+        }
+        i = (i + 1) & self->mask;
+    }
+    {
+        uint64_t pos;
+        uint8_t *entry;
+        rc_t rc = NameTableArenaAlloc(self, &pos, &entry, namelen + 2);
+
+        if (rc)
+            return rc;
+
+        entry[0] = (uint8_t)namelen;
+        entry[1] = (uint8_t)(namelen >> 8);
+        memcpy(&entry[2], name, namelen);
+
+        /* keep load factor at or below 3/4 */
+        if ((self->count + 1) * 4 > (self->mask + 1) * 3) {
+            rc = NameTableGrow(self);
+            if (rc)
+                return rc;
+            i = hash & self->mask;
+            while (self->slot[i].pos != 0)
+                i = (i + 1) & self->mask;
+        }
+        self->slot[i].hash = hash;
+        self->slot[i].id = *id;
+        self->slot[i].pos = pos;
+        ++self->count;
+        *wasInserted = true;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/* ===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+/* NameTable
+ *  maps names to ids; an open addressing hash table of
+ *  { hash, id, position of name } and an arena of names.
+ *  both live in memory mapped files in a temporary directory,
+ *  so they can grow past physical memory.
+ */
+typedef struct NameTable NameTable;
+
+/* NameTableCache
+ *  bounds the memory of the name arenas of all tables made with it;
+ *  arenas are mapped in chunks, the least recently used chunk is
+ *  unmapped when a chunk has to be mapped and "bytes" are in use.
+ *  the chunk each table is filling and the hash tables are always mapped.
+ */
+typedef struct NameTableCache NameTableCache;
+
+rc_t NameTableCacheMake(NameTableCache **rslt, size_t bytes);
+
+/* Whack
+ *  after all tables made with it
+ */
+void NameTableCacheWhack(NameTableCache *self);
+
+rc_t NameTableMake(NameTable **rslt, NameTableCache *cache, char const tmpdir[], unsigned pid, unsigned n);
+
+void NameTableWhack(NameTable *self);
+
+/* Entry
+ *  find name; if not found, insert it with id = *id
+ *  "id" [ IN/OUT ] - id to use if inserted; id of name
+ */
+rc_t NameTableEntry(NameTable *self, uint32_t *id, bool *wasInserted, char const name[], size_t namelen);
@@ -4,6 +4,9 @@
 #include <klib/out.h>
 #include <kfc/defs.h>
 #include <kapp/main.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 
 #include <klib/rc.h>
 #include <kfc/rc.h>
@@ -12,10 +15,13 @@
 
 #include <string.h>         /* strcmp () */
 
+#include <iostream>
+
 #include "args.hpp"
 #include "filters.hpp"
 
-#include "koutstream"
+#include "formatter.hpp"
+#include "writer.hpp"
 
 namespace ngs {
 
@@ -32,14 +38,27 @@ public :
     static const char * _sM_categoryName;
     static const char * _sM_fastaName;
     static const char * _sM_legacyReportName;
+    static const char * _sM_threadsName;
+    static const char * _sM_splitFilesName;
+    static const char * _sM_split3Name;
+    static const char * _sM_gzipName;
+    static const char * _sM_outDirName;
 
     static const int64_t _sM_minSpotIdDefValue = 1;
     static const int64_t _sM_maxSpotIdDefValue = 0;
+    static const uint32_t _sM_threadsDefValue = 1;
+    static const uint32_t _sM_threadsMaxValue = 256;
 
 public :
     typedef AArgs PAPAHEN;
     typedef Read :: ReadCategory ReadCategory;
 
+    enum SplitMode {
+        splitNone,      /* everything to stdout */
+        splitFiles,     /* fragment N to <NAME>_N.fastq */
+        split3          /* mates to <NAME>_1/_2, rest to <NAME>.fastq */
+    };
+
 public :
     DumpArgs ();
     ~DumpArgs ();
@@ -67,6 +86,18 @@ public :
     inline bool legacyReport () const
                 { return _M_legacyReport; };
 
+    inline uint32_t threads () const
+                { return _M_threads; };
+
+    inline SplitMode split () const
+                { return _M_split; };
+
+    inline bool gzip () const
+                { return _M_gzip; };
+
+    inline const String & outDir () const
+                { return _M_outDir; };
+
 protected :
     void __customInit ();
     void __customParse ();
@@ -83,6 +114,10 @@ private :
     ReadCategory _M_category;   /* -Y | --category */
     uint64_t _M_fasta;          /* -A | --fasta */
     bool _M_legacyReport;       /* -L | --legacy-report */
+    uint32_t _M_threads;        /* -t | --threads */
+    SplitMode _M_split;         /* --split-files | --split-3 */
+    bool _M_gzip;               /* --gzip */
+    String _M_outDir;           /* -O | --outdir */
 };
 
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
@@ -96,6 +131,11 @@ const char * DumpArgs :: _sM_minReadLengthName = "minReadLength";
 const char * DumpArgs :: _sM_categoryName = "category";
 const char * DumpArgs :: _sM_fastaName = "fasta";
 const char * DumpArgs :: _sM_legacyReportName = "legacy-report";
+const char * DumpArgs :: _sM_threadsName = "threads";
+const char * DumpArgs :: _sM_splitFilesName = "split-files";
+const char * DumpArgs :: _sM_split3Name = "split-3";
+const char * DumpArgs :: _sM_gzipName = "gzip";
+const char * DumpArgs :: _sM_outDirName = "outdir";
 
 DumpArgs :: DumpArgs ()
 :   AArgs ()
@@ -106,6 +146,10 @@ DumpArgs :: DumpArgs ()
 ,   _M_category ( Read :: all )
 ,   _M_fasta ( 0 )
 ,   _M_legacyReport ( false )
+,   _M_threads ( _sM_threadsDefValue )
+,   _M_split ( splitNone )
+,   _M_gzip ( false )
+,   _M_outDir ( "" )
 {
 }   /* DumpArgs :: DumpArgs () */
 
@@ -214,6 +258,70 @@ DumpArgs :: __customInit ()
 
         addOpt ( TheOpt );
     }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_threadsName );
+        TheOpt . setAliases ( "t" );
+        TheOpt . setParam ( "count" );
+        TheOpt . setNeedValue ( true );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Number of worker threads. Spot range is split into chunks which are formatted in parallel and written in spot order. Optional, default value <1>" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_splitFilesName );
+        TheOpt . setNeedValue ( false );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Write reads into separate files. Read N is written to <NAME>_N.fastq" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_split3Name );
+        TheOpt . setNeedValue ( false );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Write mates of paired spots into <NAME>_1.fastq and <NAME>_2.fastq, and reads of other spots into <NAME>.fastq" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_gzipName );
+        TheOpt . setNeedValue ( false );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Compress output files using gzip, used only with file splitting" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_outDirName );
+        TheOpt . setAliases ( "O" );
+        TheOpt . setParam ( "path" );
+        TheOpt . setNeedValue ( true );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Output directory for split files. Optional, default is current directory" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
 }   /* DumpArgs :: __customInit () */
 
 void
@@ -226,6 +334,10 @@ DumpArgs :: __customDispose ()
     _M_category = Read :: all;
     _M_fasta = 0;
     _M_legacyReport = false;
+    _M_threads = _sM_threadsDefValue;
+    _M_split = splitNone;
+    _M_gzip = false;
+    _M_outDir = "";
 }   /* DumpArgs :: __customDispose () */
 
 void
@@ -349,6 +461,51 @@ DumpArgs :: __customParse ()
 
     _M_legacyReport = optVal ( _sM_legacyReportName ) . exist ();
 
+    _M_threads = _sM_threadsDefValue;
+    optV = optVal ( _sM_threadsName );
+    if ( optV . exist () ) {
+        if ( optV . valCount () != 1 ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: Too many \"" ) + _sM_threadsName + "\" values");
+        }
+
+        _M_threads = optV . uint32Val ();
+        if ( _M_threads == 0 ) {
+            _M_threads = _sM_threadsDefValue;
+        }
+        if ( _sM_threadsMaxValue < _M_threads ) {
+            _M_threads = _sM_threadsMaxValue;
+        }
+    }
+
+    _M_split = splitNone;
+    if ( optVal ( _sM_splitFilesName ) . exist () ) {
+        if ( optVal ( _sM_split3Name ) . exist () ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: parameter \"" ) + _sM_splitFilesName + "\" can not coexists with parameter \"" + _sM_split3Name + "\"");
+        }
+
+        _M_split = splitFiles;
+    }
+    else {
+        if ( optVal ( _sM_split3Name ) . exist () ) {
+            _M_split = split3;
+        }
+    }
+
+    _M_gzip = optVal ( _sM_gzipName ) . exist ();
+    if ( _M_gzip && _M_split == splitNone ) {
+        throw ErrorMsg ( String ( "__custromParse: ERROR: parameter \"" ) + _sM_gzipName + "\" could be used only with file splitting" );
+    }
+
+    _M_outDir = "";
+    optV = optVal ( _sM_outDirName );
+    if ( optV . exist () ) {
+        if ( optV . valCount () != 1 ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: Too many \"" ) + _sM_outDirName + "\" values");
+        }
+
+        _M_outDir = optV . val ();
+    }
+
 }   /* DumpArgs :: __customParse () */
 
 }; /* namespace ngs */
@@ -473,109 +630,430 @@ setupFilters ( AFilters & Filters, const DumpArgs & TheArgs )
     }
 }   /* setupFilters () */
 
+typedef std :: vector < OutBuffer > VOutBuffer;
+
+/*))
+ //  Formats Iterator into output buffer with index Idx, and if Output
+ //  is not NULL, passes buffer to output when it is full enough
+((*/
+static
+inline
+OutBuffer &
+outBuffer ( VOutBuffer & Out, size_t Idx )
+{
+    if ( Out . size () <= Idx ) {
+        Out . resize ( Idx + 1 );
+    }
+
+    return Out [ Idx ];
+}   /* outBuffer () */
+
+static
+inline
+void
+checkFlush ( VOutBuffer & Out, size_t Idx, DumpOutput * Output )
+{
+    if ( Output != NULL && Out [ Idx ] . full () ) {
+        Output -> write ( Idx, Out [ Idx ] );
+    }
+}   /* checkFlush () */
+
+/*))
+ //  Routes read to output buffers depending on split mode :
+ //      splitNone  - whole read to output 0
+ //      splitFiles - fragment N to output N
+ //      split3     - if there are two fragments, they are going to
+ //                   outputs 1 and 2, otherwise to output 0
+((*/
 static
 void
-dumpFastQ (
-        int64_t SpotId,
-        const ngs :: String & CollectionName,
-        const ReadIterator & Iterator
+dumpRead (
+        VOutBuffer & Out,
+        DumpOutput * Output,
+        ReadIterator & Iterator,
+        const RecordFormatter & Formatter,
+        DumpArgs :: SplitMode Split,
+        int64_t SpotId
 )
 {
-        /*)  We do not check values for arguments validity!
-         (*/
-    StringRef ReadName = Iterator . getReadName ();
-    StringRef Bases = Iterator . getReadBases ();
-    StringRef Qualities = Iterator . getReadQualities ();
+    if ( Split == DumpArgs :: splitNone ) {
+        Formatter . format ( outBuffer ( Out, 0 ), SpotId, Iterator );
+        checkFlush ( Out, 0, Output );
+        return;
+    }
 
-        /*)  First, we are doint base header
-         (*/
-    kout << "@"
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Bases . size ()
-        << '\n'
-        ;
-
-        /*)  Second is going base itsefl
-         (*/
-    kout << Bases
-        << '\n'
-        ;
+    bool Mates = Split == DumpArgs :: split3
+                    && Iterator . getNumFragments () == 2
+                    ;
 
-        /*)  Third, header for qualities
-         (*/
-    kout << '+'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Qualities . size ()
-        << '\n'
-        ;
-
-        /*)  Finally there are qualities
-         (*/
-    kout << Qualities
-        << '\n'
-        ;
-}   /* dumpFastQ () */
+    for ( size_t Idx = 1; Iterator . nextFragment (); Idx ++ ) {
+        size_t OutIdx = Idx;
+        if ( Split == DumpArgs :: split3 && ! Mates ) {
+            OutIdx = 0;
+        }
+
+        Formatter . formatFragment ( outBuffer ( Out, OutIdx ), SpotId, Iterator );
+        checkFlush ( Out, OutIdx, Output );
+    }
+}   /* dumpRead () */
 
+/*))
+ //  Dumps reads from spot range [ FirstSpot, FirstSpot + SpotCount )
+ //  That method is used by both serial and multithreaded modes, so
+ //  output for the same range is always the same. If Output is NULL
+ //  everything stays in buffers.
+((*/
 static
 void
-dumpFastA (
-        int64_t SpotId,
-        const ngs :: String & CollectionName,
-        const ReadIterator & Iterator,
-        uint64_t Width
+dumpSpotRange (
+        VOutBuffer & Out,
+        DumpOutput * Output,
+        ReadCollection & RCol,
+        const RecordFormatter & Formatter,
+        AFilters & Filters,
+        const DumpArgs & TheArgs,
+        int64_t FirstSpot,
+        int64_t SpotCount
 )
 {
-        /*)  We do not check values for arguments validity!
-         (*/
-    StringRef ReadName = Iterator . getReadName ();
-    StringRef Bases = Iterator . getReadBases ();
+    ReadIterator Iterator = RCol . getReadRange (
+                                            FirstSpot,
+                                            SpotCount,
+                                            TheArgs . category ()
+                                            );
 
-    uint64_t __l = Bases . size ();
+    for ( int64_t llp = FirstSpot ; Iterator . nextRead (); llp ++ ) {
 
-        /*)  First, we are doing base header
+        if ( Filters . checkIt ( Iterator ) ) {
+            dumpRead (
+                    Out,
+                    Output,
+                    Iterator,
+                    Formatter,
+                    TheArgs . split (),
+                    llp
+                    );
+        }
+    }
+}   /* dumpSpotRange () */
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/* Multithreaded dump                                            */
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+/*)))
+ ///    Spot range is split into chunks of _sM_chunkSize spots. Each
+ \\\    worker thread opens it's own ReadCollection, picks up the next
+ ///    chunk, formats it into the chunk buffer, and marks it done. The
+ \\\    main thread writes chunks strictly in spot order. Number of
+ ///    chunks in flight is limited by the size of the chunk ring, so
+ \\\    memory usage does not depend on the size of the run.
+(((*/
+class DumpPool {
+public :
+    static const int64_t _sM_chunkSize = 16384;
+
+public :
+    DumpPool (
+            const DumpArgs & TheArgs,
+            int64_t MinSpot,
+            int64_t MaxSpot
+            );
+    ~DumpPool ();
+
+        /*) Starts workers, writes chunks in order, joins workers and
+         /  merges their filter statistics into Filters
+        (*/
+    void run ( AFilters & Filters, DumpOutput & Output );
+
+private :
+    struct Chunk {
+        VOutBuffer _M_text;     /* buffer per output */
+        bool _M_done;
+    };
+
+    struct Worker {
+        DumpPool * _M_pool;
+        KThread * _M_thread;
+        AFilters * _M_filters;
+    };
+
+    typedef std :: vector < Chunk > VChunk;
+    typedef std :: vector < Worker > VWorker;
+
+    static rc_t CC __workerMain ( const KThread * Self, void * Data );
+    void __work ( Worker & TheWorker );
+
+        /*) both methods should be called under lock
          (*/
-    kout << '>'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << __l
-        << '\n'
-        ;
-
-        /*)  Second is going base itself by width
+    bool __takeChunk ( int64_t & ChunkNo );
+    void __fail ( const ngs :: String & Message );
+
+    void __join ();
+
+private :
+    const DumpArgs & _M_args;
+
+    int64_t _M_minSpot;
+    int64_t _M_maxSpot;
+    int64_t _M_chunkQty;
+
+    int64_t _M_nextChunk;       /* next chunk to pick by worker */
+    int64_t _M_emittedChunk;    /* next chunk to write */
+
+    VChunk _M_chunks;           /* ring of chunks in flight */
+    VWorker _M_workers;
+
+    KLock * _M_lock;
+    KCondition * _M_chunkDone;  /* worker -> writer */
+    KCondition * _M_chunkFree;  /* writer -> workers */
+
+    bool _M_failed;
+    ngs :: String _M_error;
+};  /* class DumpPool */
+
+DumpPool :: DumpPool (
+                    const DumpArgs & TheArgs,
+                    int64_t MinSpot,
+                    int64_t MaxSpot
+)
+:   _M_args ( TheArgs )
+,   _M_minSpot ( MinSpot )
+,   _M_maxSpot ( MaxSpot )
+,   _M_chunkQty ( 0 )
+,   _M_nextChunk ( 0 )
+,   _M_emittedChunk ( 0 )
+,   _M_chunks ()
+,   _M_workers ()
+,   _M_lock ( NULL )
+,   _M_chunkDone ( NULL )
+,   _M_chunkFree ( NULL )
+,   _M_failed ( false )
+,   _M_error ( "" )
+{
+    _M_chunkQty = ( MaxSpot - MinSpot + _sM_chunkSize ) / _sM_chunkSize;
+
+        /*) Two chunks per worker : one is formatting, one is waiting
+         /  to be written
+        (*/
+    Chunk TheChunk;
+    TheChunk . _M_done = false;
+    _M_chunks . resize ( 2 * TheArgs . threads (), TheChunk );
+
+    if ( KLockMake ( & _M_lock ) != 0 ) {
+        throw ErrorMsg ( "DumpPool: Can not make lock" );
+    }
+
+    if ( KConditionMake ( & _M_chunkDone ) != 0
+        || KConditionMake ( & _M_chunkFree ) != 0 ) {
+        KConditionRelease ( _M_chunkDone );
+        KLockRelease ( _M_lock );
+        throw ErrorMsg ( "DumpPool: Can not make condition" );
+    }
+}   /* DumpPool :: DumpPool () */
+
+DumpPool :: ~DumpPool ()
+{
+    try {
+        __join ();
+
+        for ( VWorker :: iterator __b = _M_workers . begin (); __b != _M_workers . end (); __b ++ ) {
+            delete __b -> _M_filters;
+        }
+        _M_workers . clear ();
+    }
+    catch ( ... ) {
+        /* Ha! */
+    }
+
+    KConditionRelease ( _M_chunkFree );
+    KConditionRelease ( _M_chunkDone );
+    KLockRelease ( _M_lock );
+}   /* DumpPool :: ~DumpPool () */
+
+rc_t CC
+DumpPool :: __workerMain ( const KThread * Self, void * Data )
+{
+    Worker * TheWorker = ( Worker * ) Data;
+
+    try {
+        TheWorker -> _M_pool -> __work ( * TheWorker );
+    }
+    catch ( std :: exception & E ) {
+        KLockAcquire ( TheWorker -> _M_pool -> _M_lock );
+        TheWorker -> _M_pool -> __fail ( E . what () );
+        KLockUnlock ( TheWorker -> _M_pool -> _M_lock );
+    }
+    catch ( ... ) {
+        KLockAcquire ( TheWorker -> _M_pool -> _M_lock );
+        TheWorker -> _M_pool -> __fail ( "UNKNOWN exception in worker thread" );
+        KLockUnlock ( TheWorker -> _M_pool -> _M_lock );
+    }
+
+    return 0;
+}   /* DumpPool :: __workerMain () */
+
+bool
+DumpPool :: __takeChunk ( int64_t & ChunkNo )
+{
+    int64_t __r = ( int64_t ) _M_chunks . size ();
+
+    while ( ! _M_failed && _M_nextChunk < _M_chunkQty ) {
+        if ( _M_nextChunk < _M_emittedChunk + __r ) {
+            ChunkNo = _M_nextChunk ++;
+            return true;
+        }
+
+        KConditionWait ( _M_chunkFree, _M_lock );
+    }
+
+    return false;
+}   /* DumpPool :: __takeChunk () */
+
+void
+DumpPool :: __fail ( const ngs :: String & Message )
+{
+    if ( ! _M_failed ) {
+        _M_failed = true;
+        _M_error = Message;
+    }
+
+    KConditionBroadcast ( _M_chunkDone );
+    KConditionBroadcast ( _M_chunkFree );
+}   /* DumpPool :: __fail () */
+
+void
+DumpPool :: __work ( Worker & TheWorker )
+{
+        /*)  Each worker uses it's own collection and iterators
          (*/
+    ngs :: String Acc ( _M_args . accession () . c_str () );
+    ReadCollection RCol = ncbi :: NGS :: openReadCollection ( Acc );
+    RecordFormatter Formatter (
+                            RCol . getName (),
+                            _M_args . fastaDump (),
+                            _M_args . fastaDumpWidth ()
+                            );
 
-    uint64_t __p = 0;
-    const char * __s = Bases . data ();
+    int64_t ChunkNo = 0;
 
+    while ( true ) {
+        KLockAcquire ( _M_lock );
+        bool __g = __takeChunk ( ChunkNo );
+        KLockUnlock ( _M_lock );
 
-    if ( 0 < Width ) {
-        while ( __p < __l ) {
-            uint64_t __t = std :: min ( Width, __l - __p );
+        if ( ! __g ) {
+            break;
+        }
+
+        int64_t __f = _M_minSpot + ChunkNo * _sM_chunkSize;
+        int64_t __c = std :: min ( _sM_chunkSize, _M_maxSpot - __f + 1 );
+
+            /*) Chunk slot is not touched by writer until it is done,
+             /  and it can not be reused until it is written. Buffer
+             /  of slot is reused, so there is no allocations after
+             /  first round of chunks
+            (*/
+        Chunk & TheChunk = _M_chunks [ ChunkNo % _M_chunks . size () ];
+
+        dumpSpotRange (
+                    TheChunk . _M_text,
+                    NULL,
+                    RCol,
+                    Formatter,
+                    * TheWorker . _M_filters,
+                    _M_args,
+                    __f,
+                    __c
+                    );
+
+        KLockAcquire ( _M_lock );
+        TheChunk . _M_done = true;
+        KConditionBroadcast ( _M_chunkDone );
+        KLockUnlock ( _M_lock );
+    }
+}   /* DumpPool :: __work () */
+
+void
+DumpPool :: run ( AFilters & Filters, DumpOutput & Output )
+{
+    uint32_t Threads = _M_args . threads ();
+    if ( _M_chunkQty < ( int64_t ) Threads ) {
+        Threads = ( uint32_t ) _M_chunkQty;
+    }
 
-            kout << std :: string ( __s, ( std :: string :: size_type ) __p, ( std :: string :: size_type ) __t ) << "\n" ;
+    _M_workers . reserve ( Threads );
 
-            __p += __t;
+    for ( uint32_t llp = 0; llp < Threads; llp ++ ) {
+        Worker TheWorker;
+        TheWorker . _M_pool = this;
+        TheWorker . _M_thread = NULL;
+        TheWorker . _M_filters = new AFilters ( Filters . source () );
+        setupFilters ( * TheWorker . _M_filters, _M_args );
+
+        _M_workers . push_back ( TheWorker );
+
+        Worker & Added = _M_workers . back ();
+        if ( KThreadMake ( & Added . _M_thread, __workerMain, & Added ) != 0 ) {
+            KLockAcquire ( _M_lock );
+            __fail ( "DumpPool: Can not make thread" );
+            KLockUnlock ( _M_lock );
+            break;
         }
     }
-    else {
-        kout << __s << "\n" ;
+
+        /*) Writing chunks in order
+         (*/
+    KLockAcquire ( _M_lock );
+    while ( ! _M_failed && _M_emittedChunk < _M_chunkQty ) {
+        Chunk & TheChunk = _M_chunks [ _M_emittedChunk % _M_chunks . size () ];
+        if ( ! TheChunk . _M_done ) {
+            KConditionWait ( _M_chunkDone, _M_lock );
+            continue;
+        }
+
+        KLockUnlock ( _M_lock );
+
+        try {
+            for ( size_t llp = 0; llp < TheChunk . _M_text . size (); llp ++ ) {
+                Output . write ( llp, TheChunk . _M_text [ llp ] );
+            }
+        }
+        catch ( std :: exception & E ) {
+            KLockAcquire ( _M_lock );
+            __fail ( E . what () );
+            break;
+        }
+
+        KLockAcquire ( _M_lock );
+        TheChunk . _M_done = false;
+        _M_emittedChunk ++;
+        KConditionBroadcast ( _M_chunkFree );
     }
+    KLockUnlock ( _M_lock );
 
-}   /* dumpFastA () */
+    __join ();
+
+    if ( _M_failed ) {
+        throw ErrorMsg ( _M_error );
+    }
+
+    for ( VWorker :: iterator __b = _M_workers . begin (); __b != _M_workers . end (); __b ++ ) {
+        Filters . merge ( * __b -> _M_filters );
+    }
+}   /* DumpPool :: run () */
+
+void
+DumpPool :: __join ()
+{
+    for ( VWorker :: iterator __b = _M_workers . begin (); __b != _M_workers . end (); __b ++ ) {
+        if ( __b -> _M_thread != NULL ) {
+            KThreadWait ( __b -> _M_thread, NULL );
+            KThreadRelease ( __b -> _M_thread );
+            __b -> _M_thread = NULL;
+        }
+    }
+}   /* DumpPool :: __join () */
 
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
@@ -591,6 +1069,12 @@ run ( const DumpArgs & TheArgs )
     ngs :: String Acc ( TheArgs . accession () . c_str () );
     ReadCollection RCol = ncbi :: NGS :: openReadCollection ( Acc );
 
+        /*) Records are numbered by spot id, in serial and in
+         /  multithreaded mode, so spot id 0 is dumped as 1, and
+         /  swapped minimum and maximum dump and number the same
+         /  range as unswapped ones (serial dump used to number
+         /  from minSpotId as given)
+        (*/
     int64_t minSpot = TheArgs . minSpotId ();
     int64_t maxSpot = TheArgs . maxSpotId ();
 
@@ -608,32 +1092,56 @@ run ( const DumpArgs & TheArgs )
         maxSpot = Id;
     }
 
-    ReadIterator Iterator = RCol.getReadRange (
-                                            minSpot,
-                                            maxSpot - minSpot + 1,
-                                            TheArgs . category ()
-                                            );
-
-    ngs :: String ReadCollectionName = RCol.getName ();
-
     AFilters Filters ( TheArgs . accession () );
     setupFilters ( Filters, TheArgs );
 
-    for ( int64_t llp = TheArgs . minSpotId () ; Iterator.nextRead (); llp ++ ) {
-
-        if ( Filters . checkIt ( Iterator ) ) {
-            if ( TheArgs . fastaDump () ) {
-                dumpFastA ( llp, ReadCollectionName, Iterator, TheArgs . fastaDumpWidth () );
-            }
-            else { 
-                dumpFastQ ( llp, ReadCollectionName, Iterator );
-            }
+        /*) Spot numbers are assigned by position in the spot range,
+         /  and that works for chunks only if every spot in range
+         /  is iterated, so category filtering forces serial mode
+        (*/
+    bool Parallel = 1 < TheArgs . threads ()
+                    && TheArgs . category () == Read :: all
+                    && DumpPool :: _sM_chunkSize < maxSpot - minSpot + 1
+                    ;
+
+    DumpOutput Output (
+                    TheArgs . split () != DumpArgs :: splitNone,
+                    TheArgs . outDir (),
+                    RCol . getName (),
+                    TheArgs . fastaDump (),
+                    TheArgs . gzip ()
+                    );
+
+    if ( Parallel ) {
+        DumpPool Pool ( TheArgs, minSpot, maxSpot );
+        Pool . run ( Filters, Output );
+    }
+    else {
+        RecordFormatter Formatter (
+                                RCol . getName (),
+                                TheArgs . fastaDump (),
+                                TheArgs . fastaDumpWidth ()
+                                );
+        VOutBuffer Out;
+
+        dumpSpotRange (
+                    Out,
+                    & Output,
+                    RCol,
+                    Formatter,
+                    Filters,
+                    TheArgs,
+                    minSpot,
+                    maxSpot - minSpot + 1
+                    );
+
+        for ( size_t llp = 0; llp < Out . size (); llp ++ ) {
+            Output . write ( llp, Out [ llp ] );
         }
     }
 
-    kout.flush ();
+    Output . close ();
 
     std :: cerr << Filters . report ( TheArgs . legacyReport () );
 
 }   /* run () */
-
@@ -82,6 +82,12 @@ AFilter :: report () const
     return "";
 }   /* AFilter :: report () */
 
+void
+AFilter :: merge ( const AFilter & Other )
+{
+    _M_rejected += Other . _M_rejected;
+}   /* AFilter :: merge () */
+
 String
 AFilter :: reason () const
 {
@@ -273,6 +279,25 @@ AFilters :: addLengthFilter ( uint64_t minLength )
     addFilter ( new __SpotLengthFilter ( minLength ) );
 }   /* AFilters :: addLengthFilter () */
 
+void
+AFilters :: merge ( const AFilters & Other )
+{
+    if ( _M_filters . size () != Other . _M_filters . size () ) {
+        throw ErrorMsg ( "AFilters :: merge () - filters are set up differently" );
+    }
+
+    for ( size_t llp = 0; llp < _M_filters . size (); llp ++ ) {
+        AFilter * __f = _M_filters [ llp ];
+        AFilter * __o = Other . _M_filters [ llp ];
+
+        if ( __f != NULL && __o != NULL ) {
+            __f -> merge ( * __o );
+        }
+    }
+
+    _M_confirmed += Other . _M_confirmed;
+}   /* AFilters :: merge () */
+
 String
 AFilters :: report ( bool legacyStyle ) const
 {
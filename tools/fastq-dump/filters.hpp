@@ -54,6 +54,11 @@ public :
 
     virtual String report () const;
 
+        /* Adds statistics of other filter of the same kind,
+         * used to collect results of multithreaded run
+         */
+    void merge ( const AFilter & Other );
+
 protected :
         /* That method should be called from 'checkIt()' for stat
          */
@@ -93,6 +98,11 @@ public :
 
     String report ( bool legacyStyle = false ) const;
 
+        /* Adds statistics of other filters set, which should be
+         * set up in the same way as that one
+         */
+    void merge ( const AFilters & Other );
+
 private :
     void init ();
     void dispose ();
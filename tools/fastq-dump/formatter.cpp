@@ -0,0 +1,418 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <sysalloc.h>
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <klib/out.h>
+#include <klib/writer.h>
+
+#include <ngs/ReadCollection.hpp>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "formatter.hpp"
+
+using namespace std;
+using namespace ngs;
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+/*))
+ //     OutBuffer
+((*/
+const size_t OutBuffer :: _sM_flushSize;
+
+OutBuffer :: OutBuffer ( size_t InitialCapacity )
+:   _M_buf ( NULL )
+,   _M_size ( 0 )
+,   _M_capacity ( 0 )
+{
+    if ( InitialCapacity != 0 ) {
+        __grow ( InitialCapacity );
+    }
+}   /* OutBuffer :: OutBuffer () */
+
+OutBuffer :: OutBuffer ( const OutBuffer & Buf )
+:   _M_buf ( NULL )
+,   _M_size ( 0 )
+,   _M_capacity ( 0 )
+{
+    * this = Buf;
+}   /* OutBuffer :: OutBuffer () */
+
+OutBuffer :: ~OutBuffer ()
+{
+    if ( _M_buf != NULL ) {
+        free ( _M_buf );
+    }
+
+    _M_buf = NULL;
+    _M_size = 0;
+    _M_capacity = 0;
+}   /* OutBuffer :: ~OutBuffer () */
+
+OutBuffer &
+OutBuffer :: operator = ( const OutBuffer & Buf )
+{
+    if ( this != & Buf ) {
+        clear ();
+
+        if ( ! Buf . empty () ) {
+            memmove ( reserve ( Buf . size () ), Buf . data (), Buf . size () );
+            commit ( Buf . size () );
+        }
+    }
+
+    return * this;
+}   /* OutBuffer :: operator = () */
+
+void
+OutBuffer :: swap ( OutBuffer & Buf )
+{
+    char * __b = _M_buf;
+    _M_buf = Buf . _M_buf;
+    Buf . _M_buf = __b;
+
+    size_t __s = _M_size;
+    _M_size = Buf . _M_size;
+    Buf . _M_size = __s;
+
+    size_t __c = _M_capacity;
+    _M_capacity = Buf . _M_capacity;
+    Buf . _M_capacity = __c;
+}   /* OutBuffer :: swap () */
+
+void
+OutBuffer :: __grow ( size_t Qty )
+{
+    size_t __c = _M_capacity == 0 ? 4096 : _M_capacity;
+    while ( __c - _M_size < Qty ) {
+        __c *= 2;
+    }
+
+    char * __b = ( char * ) realloc ( _M_buf, __c );
+    if ( __b == NULL ) {
+        throw ErrorMsg ( "OutBuffer :: __grow () - out of memory" );
+    }
+
+    _M_buf = __b;
+    _M_capacity = __c;
+}   /* OutBuffer :: __grow () */
+
+void
+OutBuffer :: write ()
+{
+    KWrtWriter __w = KOutWriterGet ();
+    void * __d = KOutDataGet ();
+
+    if ( __w == NULL ) {
+        throw ErrorMsg ( "OutBuffer :: write () - output handler is not set" );
+    }
+
+    size_t __p = 0;
+    while ( __p < _M_size ) {
+        size_t __n = 0;
+
+        rc_t __rc = __w ( __d, _M_buf + __p, _M_size - __p, & __n );
+        if ( __rc != 0 || __n == 0 ) {
+            throw ErrorMsg ( "OutBuffer :: write () - failed to write output" );
+        }
+
+        __p += __n;
+    }
+
+    clear ();
+}   /* OutBuffer :: write () */
+
+/*))
+ //     RecordFormatter
+((*/
+
+    /*) Two digits at once
+     (*/
+static const char _sM_digits [] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899"
+    ;
+
+    /*) Max size of decimal int64_t with sign
+     (*/
+static const size_t _sM_maxDec = 20;
+
+static const char _sM_length [] = " length=";
+static const size_t _sM_lengthSize = sizeof ( _sM_length ) - 1;
+
+RecordFormatter :: RecordFormatter (
+                                const String & CollectionName,
+                                bool Fasta,
+                                uint64_t FastaWidth
+)
+:   _M_fastqPrefix ( String ( "@" ) + CollectionName + "." )
+,   _M_qualPrefix ( String ( "+" ) + CollectionName + "." )
+,   _M_fastaPrefix ( String ( ">" ) + CollectionName + "." )
+,   _M_fasta ( Fasta )
+,   _M_fastaWidth ( FastaWidth )
+{
+}   /* RecordFormatter :: RecordFormatter () */
+
+RecordFormatter :: ~RecordFormatter ()
+{
+}   /* RecordFormatter :: ~RecordFormatter () */
+
+size_t
+RecordFormatter :: int2dec ( char * To, int64_t Value )
+{
+    char __t [ _sM_maxDec ];
+    char * __e = __t + sizeof ( __t );
+    char * __p = __e;
+
+    bool __n = Value < 0;
+    uint64_t __v = __n
+                    ? ( uint64_t ) 0 - ( uint64_t ) Value
+                    : ( uint64_t ) Value
+                    ;
+
+    while ( 100 <= __v ) {
+        size_t __i = ( size_t ) ( __v % 100 ) * 2;
+        __v /= 100;
+
+        * -- __p = _sM_digits [ __i + 1 ];
+        * -- __p = _sM_digits [ __i ];
+    }
+
+    if ( 10 <= __v ) {
+        size_t __i = ( size_t ) __v * 2;
+        * -- __p = _sM_digits [ __i + 1 ];
+        * -- __p = _sM_digits [ __i ];
+    }
+    else {
+        * -- __p = ( char ) ( '0' + __v );
+    }
+
+    if ( __n ) {
+        * -- __p = '-';
+    }
+
+    size_t __l = __e - __p;
+    memmove ( To, __p, __l );
+
+    return __l;
+}   /* RecordFormatter :: int2dec () */
+
+    /*) Appends '<PREFIX><SPOT> <NAME> length=<LEN>\n'
+     /  There should be enough space in buffer
+    (*/
+static
+inline
+char *
+__header (
+        char * To,
+        const ngs :: String & Prefix,
+        int64_t SpotId,
+        const StringRef & ReadName,
+        uint64_t Length
+)
+{
+    memmove ( To, Prefix . data (), Prefix . size () );
+    To += Prefix . size ();
+
+    To += RecordFormatter :: int2dec ( To, SpotId );
+    * To ++ = ' ';
+
+    memmove ( To, ReadName . data (), ReadName . size () );
+    To += ReadName . size ();
+
+    memmove ( To, _sM_length, _sM_lengthSize );
+    To += _sM_lengthSize;
+
+    To += RecordFormatter :: int2dec ( To, ( int64_t ) Length );
+    * To ++ = '\n';
+
+    return To;
+}   /* __header () */
+
+static
+inline
+size_t
+__headerSize ( const ngs :: String & Prefix, const StringRef & ReadName )
+{
+    return Prefix . size ()
+            + _sM_maxDec
+            + 1
+            + ReadName . size ()
+            + _sM_lengthSize
+            + _sM_maxDec
+            + 1
+            ;
+}   /* __headerSize () */
+
+void
+RecordFormatter :: format (
+                        OutBuffer & Out,
+                        int64_t SpotId,
+                        const ReadIterator & Iterator
+) const
+{
+        /*)  We do not check values for arguments validity!
+         (*/
+    if ( _M_fasta ) {
+        __fastA (
+                Out,
+                SpotId,
+                Iterator . getReadName (),
+                Iterator . getReadBases ()
+                );
+    }
+    else {
+        __fastQ (
+                Out,
+                SpotId,
+                Iterator . getReadName (),
+                Iterator . getReadBases (),
+                Iterator . getReadQualities ()
+                );
+    }
+}   /* RecordFormatter :: format () */
+
+void
+RecordFormatter :: formatFragment (
+                        OutBuffer & Out,
+                        int64_t SpotId,
+                        const ReadIterator & Iterator
+) const
+{
+    if ( _M_fasta ) {
+        __fastA (
+                Out,
+                SpotId,
+                Iterator . getReadName (),
+                Iterator . getFragmentBases ()
+                );
+    }
+    else {
+        __fastQ (
+                Out,
+                SpotId,
+                Iterator . getReadName (),
+                Iterator . getFragmentBases (),
+                Iterator . getFragmentQualities ()
+                );
+    }
+}   /* RecordFormatter :: formatFragment () */
+
+void
+RecordFormatter :: __fastQ (
+                        OutBuffer & Out,
+                        int64_t SpotId,
+                        const StringRef & ReadName,
+                        const StringRef & Bases,
+                        const StringRef & Qualities
+) const
+{
+    size_t __n = __headerSize ( _M_fastqPrefix, ReadName )
+                + Bases . size ()
+                + 1
+                + __headerSize ( _M_qualPrefix, ReadName )
+                + Qualities . size ()
+                + 1
+                ;
+
+    char * __b = Out . reserve ( __n );
+    char * __p = __b;
+
+        /*)  Header, bases, header for qualities, qualities
+         (*/
+    __p = __header ( __p, _M_fastqPrefix, SpotId, ReadName, Bases . size () );
+
+    memmove ( __p, Bases . data (), Bases . size () );
+    __p += Bases . size ();
+    * __p ++ = '\n';
+
+    __p = __header ( __p, _M_qualPrefix, SpotId, ReadName, Qualities . size () );
+
+    memmove ( __p, Qualities . data (), Qualities . size () );
+    __p += Qualities . size ();
+    * __p ++ = '\n';
+
+    Out . commit ( __p - __b );
+}   /* RecordFormatter :: __fastQ () */
+
+void
+RecordFormatter :: __fastA (
+                        OutBuffer & Out,
+                        int64_t SpotId,
+                        const StringRef & ReadName,
+                        const StringRef & Bases
+) const
+{
+    uint64_t __l = Bases . size ();
+    uint64_t __w = _M_fastaWidth == 0 ? __l : _M_fastaWidth;
+
+        /*)  Each line of bases takes one extra character for newline
+         (*/
+    size_t __n = __headerSize ( _M_fastaPrefix, ReadName )
+                + __l
+                + ( __w == 0 ? 1 : ( __l + __w - 1 ) / __w + 1 )
+                ;
+
+    char * __b = Out . reserve ( __n );
+    char * __p = __b;
+
+    __p = __header ( __p, _M_fastaPrefix, SpotId, ReadName, __l );
+
+    const char * __s = Bases . data ();
+
+    if ( _M_fastaWidth == 0 ) {
+        memmove ( __p, __s, __l );
+        __p += __l;
+        * __p ++ = '\n';
+    }
+    else {
+        for ( uint64_t __o = 0; __o < __l; __o += __w ) {
+            uint64_t __t = __l - __o < __w ? __l - __o : __w;
+
+            memmove ( __p, __s + __o, __t );
+            __p += __t;
+            * __p ++ = '\n';
+        }
+    }
+
+    Out . commit ( __p - __b );
+}   /* RecordFormatter :: __fastA () */
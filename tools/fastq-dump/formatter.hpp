@@ -0,0 +1,161 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_outpost_formatter_
+#define _h_outpost_formatter_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <ngs/ErrorMsg.hpp>
+#include <ngs/StringRef.hpp>
+
+/*)))   Namespace
+ (((*/
+namespace ngs {
+
+/*))
+ // Some forwards
+((*/
+class ReadIterator;
+
+/*)))
+ ///    Growing output buffer. Memory is allocated only when buffer
+ \\\    needs to grow, so clear () and reuse are free. Buffer is written
+ ///    to standard output with single write call.
+(((*/
+class OutBuffer {
+public :
+        /* Buffer will be written out when it contains that much
+         */
+    static const size_t _sM_flushSize = 4 * 1024 * 1024;
+
+public :
+    OutBuffer ( size_t InitialCapacity = 0 );
+    OutBuffer ( const OutBuffer & Buf );
+    ~OutBuffer ();
+
+    OutBuffer & operator = ( const OutBuffer & Buf );
+
+    inline const char * data () const { return _M_buf; };
+    inline size_t size () const { return _M_size; };
+    inline bool empty () const { return _M_size == 0; };
+    inline bool full () const { return _sM_flushSize <= _M_size; };
+
+    inline void clear () { _M_size = 0; };
+
+        /* Exchanges content and memory with other buffer
+         */
+    void swap ( OutBuffer & Buf );
+
+        /* Returns pointer to at least 'Qty' bytes of free space at
+         * the end of buffer. Use commit () to accept written data
+         */
+    inline char * reserve ( size_t Qty )
+            {
+                if ( _M_capacity - _M_size < Qty ) {
+                    __grow ( Qty );
+                }
+                return _M_buf + _M_size;
+            };
+    inline void commit ( size_t Qty ) { _M_size += Qty; };
+
+        /* Writes content of buffer to standard output and clears it
+         */
+    void write ();
+
+private :
+    void __grow ( size_t Qty );
+
+    char * _M_buf;
+    size_t _M_size;
+    size_t _M_capacity;
+};  /* class OutBuffer */
+
+/*)))
+ ///    Formats FASTQ or FASTA records into OutBuffer. Header prefixes
+ \\\    are built once, every record is formatted with single capacity
+ ///    check and plain memory copies.
+(((*/
+class RecordFormatter {
+public :
+    RecordFormatter (
+                const String & CollectionName,
+                bool Fasta,
+                uint64_t FastaWidth
+                );
+    ~RecordFormatter ();
+
+    void format (
+                OutBuffer & Out,
+                int64_t SpotId,
+                const ReadIterator & Iterator
+                ) const;
+
+        /* Formats current fragment of read as separate record. Header
+         * is the same as for whole read, with length of fragment
+         */
+    void formatFragment (
+                OutBuffer & Out,
+                int64_t SpotId,
+                const ReadIterator & Iterator
+                ) const;
+
+        /* Converts integer to decimal representation, returns amount
+         * of characters written. Buffer should be at least 20 bytes
+         */
+    static size_t int2dec ( char * To, int64_t Value );
+
+private :
+    void __fastQ (
+                OutBuffer & Out,
+                int64_t SpotId,
+                const StringRef & ReadName,
+                const StringRef & Bases,
+                const StringRef & Qualities
+                ) const;
+    void __fastA (
+                OutBuffer & Out,
+                int64_t SpotId,
+                const StringRef & ReadName,
+                const StringRef & Bases
+                ) const;
+
+private :
+    String _M_fastqPrefix;          /* "@NAME." */
+    String _M_qualPrefix;           /* "+NAME." */
+    String _M_fastaPrefix;          /* ">NAME." */
+
+    bool _M_fasta;
+    uint64_t _M_fastaWidth;
+};  /* class RecordFormatter */
+
+/*)))   Namespace
+ (((*/
+}; /* namespace ngs */
+
+#endif /* _h_outpost_formatter_ */
@@ -0,0 +1,407 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <sysalloc.h>
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <klib/rc.h>
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <kfs/gzip.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
+#include <sstream>
+
+#include "writer.hpp"
+
+using namespace std;
+using namespace ngs;
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+/*))
+ //     AWriter
+((*/
+AWriter :: AWriter ()
+{
+}   /* AWriter :: AWriter () */
+
+AWriter :: ~AWriter ()
+{
+}   /* AWriter :: ~AWriter () */
+
+void
+AWriter :: close ()
+{
+}   /* AWriter :: close () */
+
+/*))
+ //     StdoutWriter
+((*/
+StdoutWriter :: StdoutWriter ()
+{
+}   /* StdoutWriter :: StdoutWriter () */
+
+StdoutWriter :: ~StdoutWriter ()
+{
+}   /* StdoutWriter :: ~StdoutWriter () */
+
+void
+StdoutWriter :: write ( OutBuffer & Buf )
+{
+    Buf . write ();
+}   /* StdoutWriter :: write () */
+
+/*))
+ //     FileWriter
+((*/
+const size_t FileWriter :: _sM_bufferQty;
+
+static
+ngs :: String
+__rcMessage ( const ngs :: String & Message, rc_t RC )
+{
+    stringstream __s;
+    __s << Message << " ( RC = " << RC << " )";
+    return __s . str ();
+}   /* __rcMessage () */
+
+FileWriter :: FileWriter ( const String & Path, bool GZip )
+:   _M_path ( Path )
+,   _M_file ( NULL )
+,   _M_pos ( 0 )
+,   _M_free ()
+,   _M_filled ()
+,   _M_filledHead ( 0 )
+,   _M_lock ( NULL )
+,   _M_haveData ( NULL )
+,   _M_haveFree ( NULL )
+,   _M_thread ( NULL )
+,   _M_closing ( false )
+,   _M_rc ( 0 )
+{
+    KDirectory * Dir;
+    rc_t RCt = KDirectoryNativeDir ( & Dir );
+    if ( RCt == 0 ) {
+        RCt = KDirectoryCreateFile (
+                                Dir,
+                                & _M_file,
+                                false,
+                                0664,
+                                kcmInit | kcmParents,
+                                "%s",
+                                _M_path . c_str ()
+                                );
+        KDirectoryRelease ( Dir );
+    }
+    if ( RCt != 0 ) {
+        throw ErrorMsg ( __rcMessage ( "FileWriter: Can not create file '" + _M_path + "'", RCt ) );
+    }
+
+    if ( GZip ) {
+        KFile * GZ;
+        RCt = KFileMakeGzipForWrite ( & GZ, _M_file );
+        KFileRelease ( _M_file );
+        _M_file = GZ;
+
+        if ( RCt != 0 ) {
+            _M_file = NULL;
+            throw ErrorMsg ( __rcMessage ( "FileWriter: Can not make gzip file '" + _M_path + "'", RCt ) );
+        }
+    }
+
+    _M_free . reserve ( _sM_bufferQty );
+    _M_filled . reserve ( _sM_bufferQty );
+    for ( size_t llp = 0; llp < _sM_bufferQty; llp ++ ) {
+        _M_free . push_back ( _M_buffers + llp );
+    }
+
+    RCt = KLockMake ( & _M_lock );
+    if ( RCt == 0 ) {
+        RCt = KConditionMake ( & _M_haveData );
+        if ( RCt == 0 ) {
+            RCt = KConditionMake ( & _M_haveFree );
+            if ( RCt == 0 ) {
+                RCt = KThreadMake ( & _M_thread, __threadMain, this );
+            }
+        }
+    }
+
+    if ( RCt != 0 ) {
+        __dispose ();
+        throw ErrorMsg ( __rcMessage ( "FileWriter: Can not start writer thread for '" + _M_path + "'", RCt ) );
+    }
+}   /* FileWriter :: FileWriter () */
+
+FileWriter :: ~FileWriter ()
+{
+    try {
+        close ();
+    }
+    catch ( ... ) {
+        /* Ha! */
+    }
+}   /* FileWriter :: ~FileWriter () */
+
+rc_t CC
+FileWriter :: __threadMain ( const KThread * Self, void * Data )
+{
+    ( ( FileWriter * ) Data ) -> __run ();
+
+    return 0;
+}   /* FileWriter :: __threadMain () */
+
+void
+FileWriter :: __run ()
+{
+    KLockAcquire ( _M_lock );
+
+    while ( true ) {
+        if ( _M_filledHead == _M_filled . size () ) {
+            if ( _M_closing ) {
+                break;
+            }
+
+            KConditionWait ( _M_haveData, _M_lock );
+            continue;
+        }
+
+        OutBuffer * Buf = _M_filled [ _M_filledHead ++ ];
+        if ( _M_filledHead == _M_filled . size () ) {
+            _M_filled . clear ();
+            _M_filledHead = 0;
+        }
+
+            /*) After first error we just drain the queue
+             (*/
+        rc_t RCt = _M_rc;
+
+        KLockUnlock ( _M_lock );
+
+        if ( RCt == 0 && ! Buf -> empty () ) {
+            size_t NumWrit = 0;
+            RCt = KFileWriteAll (
+                            _M_file,
+                            _M_pos,
+                            Buf -> data (),
+                            Buf -> size (),
+                            & NumWrit
+                            );
+            if ( RCt == 0 && NumWrit != Buf -> size () ) {
+                RCt = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+            }
+            _M_pos += NumWrit;
+        }
+        Buf -> clear ();
+
+        KLockAcquire ( _M_lock );
+        if ( _M_rc == 0 ) {
+            _M_rc = RCt;
+        }
+        _M_free . push_back ( Buf );
+        KConditionSignal ( _M_haveFree );
+    }
+
+    KLockUnlock ( _M_lock );
+}   /* FileWriter :: __run () */
+
+void
+FileWriter :: write ( OutBuffer & Buf )
+{
+    if ( _M_thread == NULL ) {
+        throw ErrorMsg ( "FileWriter: Writing to closed file '" + _M_path + "'" );
+    }
+
+    if ( Buf . empty () ) {
+        return;
+    }
+
+    KLockAcquire ( _M_lock );
+
+    while ( _M_free . empty () && _M_rc == 0 ) {
+        KConditionWait ( _M_haveFree, _M_lock );
+    }
+
+    rc_t RCt = _M_rc;
+    if ( RCt == 0 ) {
+        OutBuffer * Free = _M_free . back ();
+        _M_free . pop_back ();
+
+        Free -> swap ( Buf );
+
+        _M_filled . push_back ( Free );
+        KConditionSignal ( _M_haveData );
+    }
+
+    KLockUnlock ( _M_lock );
+
+    if ( RCt != 0 ) {
+        throw ErrorMsg ( __rcMessage ( "FileWriter: Can not write to '" + _M_path + "'", RCt ) );
+    }
+}   /* FileWriter :: write () */
+
+void
+FileWriter :: close ()
+{
+    if ( _M_thread == NULL ) {
+        return;
+    }
+
+    KLockAcquire ( _M_lock );
+    _M_closing = true;
+    KConditionSignal ( _M_haveData );
+    KLockUnlock ( _M_lock );
+
+    KThreadWait ( _M_thread, NULL );
+
+        /*) Releasing file flushes gzip stream, so it could fail too
+         (*/
+    rc_t RCt = KFileRelease ( _M_file );
+    _M_file = NULL;
+
+    if ( _M_rc == 0 ) {
+        _M_rc = RCt;
+    }
+
+    __dispose ();
+
+    if ( _M_rc != 0 ) {
+        throw ErrorMsg ( __rcMessage ( "FileWriter: Can not write to '" + _M_path + "'", _M_rc ) );
+    }
+}   /* FileWriter :: close () */
+
+void
+FileWriter :: __dispose ()
+{
+    if ( _M_thread != NULL ) {
+        KThreadRelease ( _M_thread );
+        _M_thread = NULL;
+    }
+
+    KConditionRelease ( _M_haveFree );
+    _M_haveFree = NULL;
+
+    KConditionRelease ( _M_haveData );
+    _M_haveData = NULL;
+
+    KLockRelease ( _M_lock );
+    _M_lock = NULL;
+
+    KFileRelease ( _M_file );
+    _M_file = NULL;
+}   /* FileWriter :: __dispose () */
+
+/*))
+ //     DumpOutput
+((*/
+DumpOutput :: DumpOutput (
+                        bool Split,
+                        const String & OutDir,
+                        const String & BaseName,
+                        bool Fasta,
+                        bool GZip
+)
+:   _M_split ( Split )
+,   _M_outDir ( OutDir )
+,   _M_baseName ( BaseName )
+,   _M_extension ( Fasta ? ".fasta" : ".fastq" )
+,   _M_gzip ( GZip )
+,   _M_writers ()
+{
+    if ( _M_gzip ) {
+        _M_extension += ".gz";
+    }
+
+    if ( ! _M_outDir . empty () && _M_outDir [ _M_outDir . size () - 1 ] != '/' ) {
+        _M_outDir += '/';
+    }
+
+    if ( ! _M_split ) {
+        _M_writers . push_back ( new StdoutWriter () );
+    }
+}   /* DumpOutput :: DumpOutput () */
+
+DumpOutput :: ~DumpOutput ()
+{
+    for ( VWriter :: iterator __b = _M_writers . begin (); __b != _M_writers . end (); __b ++ ) {
+        if ( * __b != NULL ) {
+            delete * __b;
+        }
+        * __b = NULL;
+    }
+    _M_writers . clear ();
+}   /* DumpOutput :: ~DumpOutput () */
+
+AWriter *
+DumpOutput :: __writer ( size_t Idx )
+{
+    if ( _M_writers . size () <= Idx ) {
+        if ( ! _M_split ) {
+            throw ErrorMsg ( "DumpOutput: There is only one output without splitting" );
+        }
+
+        _M_writers . resize ( Idx + 1, NULL );
+    }
+
+    AWriter * __w = _M_writers [ Idx ];
+    if ( __w == NULL ) {
+        stringstream __s;
+        __s << _M_outDir << _M_baseName;
+        if ( Idx != 0 ) {
+            __s << "_" << Idx;
+        }
+        __s << _M_extension;
+
+        __w = new FileWriter ( __s . str (), _M_gzip );
+        _M_writers [ Idx ] = __w;
+    }
+
+    return __w;
+}   /* DumpOutput :: __writer () */
+
+void
+DumpOutput :: write ( size_t Idx, OutBuffer & Buf )
+{
+    if ( ! Buf . empty () ) {
+        __writer ( Idx ) -> write ( Buf );
+    }
+}   /* DumpOutput :: write () */
+
+void
+DumpOutput :: close ()
+{
+    for ( VWriter :: iterator __b = _M_writers . begin (); __b != _M_writers . end (); __b ++ ) {
+        if ( * __b != NULL ) {
+            ( * __b ) -> close ();
+        }
+    }
+}   /* DumpOutput :: close () */
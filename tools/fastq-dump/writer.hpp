@@ -0,0 +1,165 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_outpost_writer_
+#define _h_outpost_writer_
+
+#include <vector>
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <ngs/ErrorMsg.hpp>
+
+#include "formatter.hpp"
+
+/*))
+ // Some forwards
+((*/
+struct KFile;
+struct KLock;
+struct KCondition;
+struct KThread;
+
+/*)))   Namespace
+ (((*/
+namespace ngs {
+
+/*))
+ // Abstract output stream. Takes content of buffer and leaves buffer
+ // empty. Buffer capacity could be changed, because implementation
+ // may swap buffer instead of copying.
+((*/
+class AWriter {
+public :
+    AWriter ();
+    virtual ~AWriter ();
+
+    virtual void write ( OutBuffer & Buf ) = 0;
+
+        /* Flushes everything and releases output, errors are thrown
+         * from here too
+         */
+    virtual void close ();
+};  /* class AWriter */
+
+/*))
+ // Writes to standard output through KOut handler
+((*/
+class StdoutWriter : public AWriter {
+public :
+    StdoutWriter ();
+    ~StdoutWriter ();
+
+    void write ( OutBuffer & Buf );
+};  /* class StdoutWriter */
+
+/*))
+ // Writes to a file, optionally gzip compressed, on it's own thread.
+ // write () passes filled buffer to the thread in exchange for free
+ // one, and waits only if all buffers are in flight.
+((*/
+class FileWriter : public AWriter {
+public :
+    static const size_t _sM_bufferQty = 4;
+
+public :
+    FileWriter ( const String & Path, bool GZip );
+    ~FileWriter ();
+
+    void write ( OutBuffer & Buf );
+    void close ();
+
+    inline const String & path () const { return _M_path; };
+
+private :
+    static rc_t CC __threadMain ( const struct KThread * Self, void * Data );
+    void __run ();
+
+    void __dispose ();
+
+private :
+    String _M_path;
+
+    struct KFile * _M_file;
+    uint64_t _M_pos;
+
+    OutBuffer _M_buffers [ _sM_bufferQty ];
+    std :: vector < OutBuffer * > _M_free;
+    std :: vector < OutBuffer * > _M_filled;    /* FIFO */
+    size_t _M_filledHead;
+
+    struct KLock * _M_lock;
+    struct KCondition * _M_haveData;
+    struct KCondition * _M_haveFree;
+    struct KThread * _M_thread;
+
+    bool _M_closing;
+    rc_t _M_rc;
+};  /* class FileWriter */
+
+/*))
+ // Set of outputs. Output with index 0 is the main output : standard
+ // output if there is no file splitting, or <NAME>.fastq otherwise.
+ // Output with index N is <NAME>_N.fastq. Files are created when
+ // output is written first time.
+((*/
+class DumpOutput {
+public :
+    typedef std :: vector < AWriter * > VWriter;
+
+public :
+    DumpOutput ( 
+            bool Split,
+            const String & OutDir,
+            const String & BaseName,
+            bool Fasta,
+            bool GZip
+            );
+    ~DumpOutput ();
+
+    void write ( size_t Idx, OutBuffer & Buf );
+    void close ();
+
+private :
+    AWriter * __writer ( size_t Idx );
+
+private :
+    bool _M_split;
+    String _M_outDir;
+    String _M_baseName;
+    String _M_extension;
+    bool _M_gzip;
+
+    VWriter _M_writers;
+};  /* class DumpOutput */
+
+/*)))   Namespace
+ (((*/
+}; /* namespace ngs */
+
+#endif /* _h_outpost_writer_ */
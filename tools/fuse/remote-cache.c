@@ -35,13 +35,15 @@
 #include <kns/stream.h>
 #include <kfs/directory.h>
 #include <kfs/file.h>
-#include <kfs/cacheteefile.h>
 #include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
 #include <vfs/path.h>
 #include <vfs/manager.h>
 #include <kapp/main.h>
 
 #include <os-native.h>
+#include <atomic.h>
 
 #include "remote-cache.h"
 
@@ -212,18 +214,115 @@ static size_t _CacheEntryNo = 0;
 static uint32_t _HttpBlockSize = 0;
 static bool _DisklessMode = false;
 
+    /*)) Size of cache : bytes in cache files and limit for them, 0
+     //  means no limit. When limit is exceeded, entries which are not
+     \\  opened by anybody are evicted in order of last access. Bytes
+     //  and evictions are guarded by _CacheLock
+    ((*/
+static uint64_t _CacheMaxBytes = 0;
+static uint64_t _CacheBytes = 0;
+static uint64_t _CacheEvictions = 0;
+static atomic64_t _CacheHits;
+static atomic64_t _CacheMisses;
+    /*) Clock for last access, it is ticking on each read
+     (*/
+static atomic64_t _CacheTick;
+
+    /*)) Cache file is filled by blocks. Each block could be absent,
+     //  fetching by some reader, or present in cache file
+    ((*/
+#define RCACHE_BLOCK_ABSENT     0
+#define RCACHE_BLOCK_FETCHING   1
+#define RCACHE_BLOCK_PRESENT    2
+
+#define RCACHE_DEFAULT_BLOCK_SIZE   ( 32 * 1024 )
+    /*) That many idle HTTP connections are kept by entry
+     (*/
+#define RCACHE_IDLE_CONNECTIONS     8
+
 struct RCacheEntry {
     BSTNode AsIs;
 
     KRefcount refcount;
+        /*) refcount, and opening of file
+         (*/
     KLock * mutabor;
 
     char * Name;
     char * Url;
 
+        /*) Completed cache file
+         (*/
     const KFile * File;
+
+        /*)) Everything below is guarded by 'blocker', which is never
+         //  held during I/O, so reads of blocks already fetched do
+         \\  not wait for anybody, and misses of different blocks
+         //  are fetched concurrently
+        ((*/
+    KLock * blocker;
+    KCondition * fetched;
+    bool Ready;
+
+    uint64_t FileSize;
+    uint32_t BlockSize;
+    uint64_t BlockQty;
+    uint64_t PresentQty;
+    uint8_t * Blocks;
+
+        /*) Incomplete cache file, NULL in diskless mode
+         (*/
+    KFile * CacheFile;
+
+    const KFile * Idle [ RCACHE_IDLE_CONNECTIONS ];
+    size_t IdleQty;
+
+        /*) Access pattern : last block read, number of sequential
+         |  reads before, and first block which was not read ahead
+        (*/
+    uint64_t LastBlock;
+    uint32_t SeqReads;
+    uint64_t AheadBlock;
+
+        /*) Bytes stored in cache files, and tick of last read
+         (*/
+    uint64_t DiskBytes;
+    uint64_t LastAccess;
+};
+
+/*)))
+ ///  Readahead: when entry is read sequentially, next blocks are
+ \\\  fetched in background by pool of threads. Window is in blocks,
+ ///  and bytes which are queued or fetched are limited
+(((*/
+#define RCACHE_READAHEAD_THREADS    4
+#define RCACHE_READAHEAD_WINDOW     16
+#define RCACHE_READAHEAD_MAX_BYTES  ( 32 * 1024 * 1024 )
+    /*) That many sequential reads in a row starts readahead
+     (*/
+#define RCACHE_SEQUENTIAL_READS     2
+
+struct RCacheAheadJob {
+    struct RCacheAheadJob * Next;
+
+    struct RCacheEntry * Entry;
+    uint64_t First;
+    uint64_t Qty;
+    uint64_t Size;
 };
 
+static uint32_t _ReadaheadWindow = RCACHE_READAHEAD_WINDOW;
+static uint64_t _ReadaheadMaxBytes = RCACHE_READAHEAD_MAX_BYTES;
+
+    /* That lock is guarding queue and counter of bytes in flight */
+static KLock * _AheadLock = NULL;
+static KCondition * _AheadCond = NULL;
+static struct RCacheAheadJob * _AheadHead = NULL;
+static struct RCacheAheadJob * _AheadTail = NULL;
+static uint64_t _AheadInFlight = 0;
+static bool _AheadQuit = false;
+static KThread * _AheadThreads [ RCACHE_READAHEAD_THREADS ];
+
 /*))
  //  Some extremely useful methods
 ((*/
@@ -473,6 +572,68 @@ RemoteCacheSetHttpBlockSize ( uint32_t HttpBlockSize )
     return RetVal;
 }   /* RemoteCacheSetHttpBlockSize () */
 
+/*
+ *  Lyrics: This method will set readahead for sequential reads.
+ *  Same as above, it is better to set it once before cache created
+ */
+void CC
+RemoteCacheSetReadahead ( uint32_t Window, uint64_t MaxBytes )
+{
+    _ReadaheadWindow = Window;
+    _ReadaheadMaxBytes = MaxBytes;
+}   /* RemoteCacheSetReadahead () */
+
+/*
+ *  Lyrics: This method will set limit for bytes stored in cache
+ *  files and return previous value. 0 means no limit
+ */
+uint64_t CC
+RemoteCacheSetMaxSize ( uint64_t MaxBytes )
+{
+    uint64_t RetVal = _CacheMaxBytes;
+
+    _CacheMaxBytes = MaxBytes;
+
+    return RetVal;
+}   /* RemoteCacheSetMaxSize () */
+
+/*
+ *  Lyrics: Counters are for whole life of cache, and Bytes is
+ *  what is stored in cache files right now
+ */
+void CC
+RemoteCacheGetStats (
+                uint64_t * Hits,
+                uint64_t * Misses,
+                uint64_t * Evictions,
+                uint64_t * Bytes
+)
+{
+    uint64_t RetEvictions, RetBytes;
+
+    RetEvictions = RetBytes = 0;
+
+    if ( _CacheLock != NULL && KLockAcquire ( _CacheLock ) == 0 ) {
+        RetEvictions = _CacheEvictions;
+        RetBytes = _CacheBytes;
+
+        KLockUnlock ( _CacheLock );
+    }
+
+    if ( Hits != NULL ) {
+        * Hits = atomic64_read ( & _CacheHits );
+    }
+    if ( Misses != NULL ) {
+        * Misses = atomic64_read ( & _CacheMisses );
+    }
+    if ( Evictions != NULL ) {
+        * Evictions = RetEvictions;
+    }
+    if ( Bytes != NULL ) {
+        * Bytes = RetBytes;
+    }
+}   /* RemoteCacheGetStats () */
+
 /*
  * Lyrics: Cache initialising: keeping in memory cache path 
  *         cache path could be a NULL, and in that case no cacheing
@@ -589,6 +750,8 @@ _DisposeKNSManager ()
  *    Creating directory if it does not exist
  *    Removing content of directory if it is something here
  */
+rc_t CC _RCacheAheadStart ();
+
 rc_t CC
 RemoteCacheCreate ()
 {
@@ -637,8 +800,16 @@ RemoteCacheCreate ()
 
                 /* Initializing BSTree */
             BSTreeInit ( & _Cache );
+            _CacheBytes = 0;
+            _CacheEvictions = 0;
+            atomic64_set ( & _CacheHits, 0 );
+            atomic64_set ( & _CacheMisses, 0 );
+            atomic64_set ( & _CacheTick, 0 );
                 /* Initializing _CacheLock */
             RCt = KLockMake ( & _CacheLock );
+            if ( RCt == 0 ) {
+                RCt = _RCacheAheadStart ();
+            }
         }
     }
 
@@ -651,6 +822,7 @@ RemoteCacheCreate ()
 }   /* RemoteCacheCreate () */
 
 rc_t CC _RCacheEntryDestroy ( struct RCacheEntry * Entry );
+rc_t CC _RCacheAheadStop ();
 
 void CC
 _RcAcHeEnTrYwHaCk ( BSTNode * Node, void * UnusedParam )
@@ -670,6 +842,7 @@ rc_t CC
 RemoteCacheDispose ()
 {
     rc_t RCt;
+    uint64_t Hits, Misses, Evictions, Bytes;
 
     if ( RemoteCacheIsDisklessMode () ) {
         LOGMSG( klogInfo, "[RemoteCache] leaving diskless mode\n" );
@@ -691,6 +864,12 @@ RemoteCacheDispose ()
         return 0;
     }
 
+        /* Stopping readahead before cache files are gone */
+    _RCacheAheadStop ();
+
+    RemoteCacheGetStats ( & Hits, & Misses, & Evictions, & Bytes );
+    PLOGMSG ( klogInfo, ( klogInfo, "[RemoteCache] hits $(h) misses $(m) evictions $(e) bytes $(b)", PLOG_4(PLOG_U64(h),PLOG_U64(m),PLOG_U64(e),PLOG_U64(b)), Hits, Misses, Evictions, Bytes ) );
+
     RCt = _CheckRemoveOldCacheDirectory ( _CacheRoot );
     if ( RCt == 0 ) {
         * _CacheRoot = 0;
@@ -751,6 +930,37 @@ _RCacheEntryDestroy ( struct RCacheEntry * self )
         /*)) Reverse order. I suppose it will be destoryed only
          //  in particualr cases, so no locking :|
         ((*/
+            /*) Connections
+             (*/
+        while ( 0 < self -> IdleQty ) {
+            self -> IdleQty --;
+            ReleaseComplain ( KFileRelease, self -> Idle [ self -> IdleQty ] );
+            self -> Idle [ self -> IdleQty ] = NULL;
+        }
+            /*) CacheFile
+             (*/
+        if ( self -> CacheFile != NULL ) {
+            ReleaseComplain ( KFileRelease, self -> CacheFile );
+            self -> CacheFile = NULL;
+        }
+            /*) Blocks
+             (*/
+        if ( self -> Blocks != NULL ) {
+            free ( self -> Blocks );
+            self -> Blocks = NULL;
+        }
+            /*) fetched
+             (*/
+        if ( self -> fetched != NULL ) {
+            ReleaseComplain ( KConditionRelease, self -> fetched );
+            self -> fetched = NULL;
+        }
+            /*) blocker
+             (*/
+        if ( self -> blocker != NULL ) {
+            ReleaseComplain ( KLockRelease, self -> blocker );
+            self -> blocker = NULL;
+        }
             /*) File
              (*/
         if ( self -> File != NULL ) {
@@ -834,6 +1044,16 @@ _RCacheEntryMake (
         /*) mutabor
          (*/
     RCt = KLockMake ( & ( Entry -> mutabor ) );
+    if ( RCt == 0 ) {
+            /*) blocker
+             (*/
+        RCt = KLockMake ( & ( Entry -> blocker ) );
+    }
+    if ( RCt == 0 ) {
+            /*) fetched
+             (*/
+        RCt = KConditionMake ( & ( Entry -> fetched ) );
+    }
 
     if ( RCt == 0 ) {
         if ( ! RemoteCacheIsDisklessMode () ) {
@@ -1038,12 +1258,121 @@ RCacheEntryAddRef ( struct RCacheEntry * self )
     return RCt;
 }   /* RCacheEntryAddRef () */
 
+/*))
+ //  Each concurrent fetch is using it's own HTTP connection. Idle
+ \\  connections are kept by entry for reuse
+((*/
+static
+rc_t CC
+_RCacheEntryGetConnection (
+                        struct RCacheEntry * self,
+                        const struct KFile ** File
+)
+{
+    rc_t RCt;
+
+    RCt = 0;
+    * File = NULL;
+
+    RCt = KLockAcquire ( self -> blocker );
+    if ( RCt == 0 ) {
+        if ( 0 < self -> IdleQty ) {
+            self -> IdleQty --;
+            * File = self -> Idle [ self -> IdleQty ];
+            self -> Idle [ self -> IdleQty ] = NULL;
+        }
+
+        KLockUnlock ( self -> blocker );
+    }
+
+    if ( RCt == 0 && * File == NULL ) {
+        RCt = KNSManagerMakeHttpFile (
+                                    _ManagerOfKNS,
+                                    File,
+                                    NULL, /* no open connections */
+                                    0x01010000,
+                                    self -> Url
+                                    );
+    }
+
+    return RCt;
+}   /* _RCacheEntryGetConnection () */
+
+static
+void CC
+_RCacheEntryPutConnection (
+                        struct RCacheEntry * self,
+                        const struct KFile * File
+)
+{
+    if ( File == NULL ) {
+        return;
+    }
+
+    if ( KLockAcquire ( self -> blocker ) == 0 ) {
+        if ( self -> IdleQty < RCACHE_IDLE_CONNECTIONS ) {
+            self -> Idle [ self -> IdleQty ] = File;
+            self -> IdleQty ++;
+            File = NULL;
+        }
+
+        KLockUnlock ( self -> blocker );
+    }
+
+    if ( File != NULL ) {
+        ReleaseComplain ( KFileRelease, File );
+    }
+}   /* _RCacheEntryPutConnection () */
+
+/*))
+ //  Path to cache file, incomplete one has ".cache" suffix
+((*/
+static
+rc_t CC
+_RCacheEntryPath (
+                struct RCacheEntry * self,
+                bool Incomplete,
+                char * Buffer,
+                size_t BufferSize
+)
+{
+    rc_t RCt;
+    char CachePath [ 4096 ];
+    size_t NumWrit;
+
+    RCt = 0;
+    * CachePath = 0;
+    NumWrit = 0;
+
+    RCt = _GetCachePath ( CachePath, sizeof ( CachePath ) );
+    if ( RCt == 0 ) {
+        RCt = string_printf (
+                            Buffer,
+                            BufferSize,
+                            & NumWrit,
+                            "%s/%s%s",
+                            CachePath,
+                            self -> Name,
+                            Incomplete ? ".cache" : ""
+                            );
+    }
+
+    return RCt;
+}   /* _RCacheEntryPath () */
+
 rc_t CC
 _RCacheEntryReleaseWithoutLock ( struct RCacheEntry * self )
 {
     /*)) This method called from special place, so no NULL checks
+     //  Nobody is reading entry now. Block map is kept, and will be
+     \\  used when entry will be opened again
      ((*/
 
+    if ( KLockAcquire ( self -> blocker ) == 0 ) {
+        self -> Ready = false;
+        KLockUnlock ( self -> blocker );
+    }
+
     if ( self -> File != NULL ) {
 /*
 RmOutMsg ( "|||<-- Releasing [%s][%s]\n", self -> Name, self -> Url );
@@ -1052,6 +1381,17 @@ RmOutMsg ( "|||<-- Releasing [%s][%s]\n", self -> Name, self -> Url );
         self -> File = NULL;
     }
 
+    if ( self -> CacheFile != NULL ) {
+        ReleaseComplain ( KFileRelease, self -> CacheFile );
+        self -> CacheFile = NULL;
+    }
+
+    while ( 0 < self -> IdleQty ) {
+        self -> IdleQty --;
+        ReleaseComplain ( KFileRelease, self -> Idle [ self -> IdleQty ] );
+        self -> Idle [ self -> IdleQty ] = NULL;
+    }
+
     return 0;
 }   /*  _RCacheEntryReleaseWithoutLock () */
 
@@ -1092,6 +1432,31 @@ RCacheEntryRelease ( struct RCacheEntry * self )
     return RCt;
 }   /* RCacheEntryRelease () */
 
+/*))
+ //  Completed cache file gets it's real name. It is still
+ \\  opened, and it will be reopened as local file next time
+((*/
+static
+void CC
+_RCacheEntryRenameCompleted ( struct RCacheEntry * self )
+{
+    char From [ 4096 ], To [ 4096 ];
+    struct KDirectory * Directory;
+
+    Directory = NULL;
+
+    if ( _RCacheEntryPath ( self, true, From, sizeof ( From ) ) == 0
+        && _RCacheEntryPath ( self, false, To, sizeof ( To ) ) == 0
+        && KDirectoryNativeDir ( & Directory ) == 0
+    ) {
+        if ( KDirectoryRename ( Directory, false, From, To ) != 0 ) {
+PLOGMSG ( klogWarn, ( klogWarn, "|||<- Failed to rename completed file $(n)$(u)", PLOG_2(PLOG_S(n),PLOG_S(u)), self -> Name, self -> Url ) );
+        }
+
+        ReleaseComplain ( KDirectoryRelease, Directory );
+    }
+}   /* _RCacheEntryRenameCompleted () */
+
 rc_t CC
 _RCacheEntryOpenFileReadRemote (
                             struct RCacheEntry * self,
@@ -1100,11 +1465,13 @@ _RCacheEntryOpenFileReadRemote (
 {
     rc_t RCt;
     struct KDirectory * Directory;
-    const struct KFile * HttpFile, * TeeFile;
+    const struct KFile * HttpFile;
+    char CachePath [ 4096 ];
 
     RCt = 0;
     Directory = NULL;
-    HttpFile = TeeFile = NULL;
+    HttpFile = NULL;
+    * CachePath = 0;
 
     if ( self == NULL ) {
         return RC ( rcExe, rcFile, rcOpening, rcParam, rcNull );
@@ -1119,35 +1486,89 @@ RmOutMsg ( "|||<-- Opening [R] [%s][%s]\n", self -> Name, self -> Url );
 RmOutMsg ( "  |<-- Cache Entry [%s]\n", Path );
 */
 
-    RCt = KNSManagerMakeHttpFile (
-                                _ManagerOfKNS,
-                                & HttpFile,
-                                NULL, /* no open connections */
-                                0x01010000,
-                                self -> Url
-                                );
+        /*) Size of remote file. Connection will be reused by read
+         (*/
+    if ( self -> Blocks == NULL ) {
+        RCt = _RCacheEntryGetConnection ( self, & HttpFile );
+        if ( RCt == 0 ) {
+            RCt = KFileSize ( HttpFile, & ( self -> FileSize ) );
+            if ( RCt == 0 ) {
+                _RCacheEntryPutConnection ( self, HttpFile );
+            }
+            else {
+                ReleaseComplain ( KFileRelease, HttpFile );
+            }
+        }
+    }
+
+    if ( RCt != 0 || RemoteCacheIsDisklessMode () ) {
+        return RCt;
+    }
+
+    RCt = _RCacheEntryPath ( self, true, CachePath, sizeof ( CachePath ) );
+    if ( RCt == 0 ) {
+        RCt = KDirectoryNativeDir ( & Directory );
+    }
     if ( RCt == 0 ) {
-        if ( RemoteCacheIsDisklessMode () ) {
-            self -> File = ( KFile * ) HttpFile;
+        if ( self -> Blocks != NULL
+            && KDirectoryPathType ( Directory, CachePath ) == kptFile
+        ) {
+                /*) It was opened before, and blocks fetched are here
+                 (*/
+            RCt = KDirectoryOpenFileWrite (
+                                        Directory,
+                                        & ( self -> CacheFile ),
+                                        true,
+                                        CachePath
+                                        );
         }
         else {
-            RCt = KDirectoryNativeDir ( & Directory );
-            if ( RCt == 0 ) {
-                RCt = KDirectoryMakeCacheTee (
+            RCt = KDirectoryCreateFile (
                                     Directory,
-                                    & TeeFile,
-                                    HttpFile,
-                                    _HttpBlockSize, /* blocksize */
-                                    Path
+                                    & ( self -> CacheFile ),
+                                    true,
+                                    0664,
+                                    kcmInit,
+                                    CachePath
                                     );
-                if ( RCt == 0 ) {
-                    self -> File = ( KFile * ) TeeFile;
+            if ( RCt == 0 ) {
+                RCt = KFileSetSize ( self -> CacheFile, self -> FileSize );
+            }
+            if ( RCt == 0 ) {
+                self -> BlockSize = _HttpBlockSize == 0
+                                        ? RCACHE_DEFAULT_BLOCK_SIZE
+                                        : _HttpBlockSize
+                                        ;
+                self -> BlockQty = ( self -> FileSize + self -> BlockSize - 1 )
+                                                        / self -> BlockSize;
+                self -> PresentQty = 0;
+
+                if ( self -> Blocks != NULL ) {
+                    free ( self -> Blocks );
+                }
+                self -> Blocks = ( uint8_t * ) calloc (
+                                            self -> BlockQty + 1,
+                                            sizeof ( uint8_t )
+                                            );
+                if ( self -> Blocks == NULL ) {
+                    RCt = RC ( rcExe, rcFile, rcOpening, rcMemory, rcExhausted );
                 }
+            }
 
-                ReleaseComplain ( KDirectoryRelease, Directory );
+                /*) Empty file has no blocks to fetch, and it is
+                 |  completed as soon as it is created
+                (*/
+            if ( RCt == 0 && self -> BlockQty == 0 ) {
+                _RCacheEntryRenameCompleted ( self );
             }
-            ReleaseComplain ( KFileRelease, HttpFile );
         }
+
+        ReleaseComplain ( KDirectoryRelease, Directory );
+    }
+
+    if ( RCt != 0 && self -> CacheFile != NULL ) {
+        ReleaseComplain ( KFileRelease, self -> CacheFile );
+        self -> CacheFile = NULL;
     }
 
     return RCt;
@@ -1214,22 +1635,15 @@ rc_t CC
 _RCacheEntryOpenFileRead ( struct RCacheEntry * self)
 {
     rc_t RCt;
-    char Buffer [ 4096 ], ThePath [ 4096 ];
-    size_t TheSize;
+    char ThePath [ 4096 ];
 
     RCt = 0;
-    TheSize = 0;
-    * Buffer = 0;
     * ThePath = 0;
 
     if ( self == NULL ) {
         return RC ( rcExe, rcFile, rcOpening, rcParam, rcNull );
     }
 
-    if ( self -> File != NULL ) {
-        return 0;
-    }
-
         /*)  Do that before messing with disk
          (*/
     if ( RemoteCacheIsDisklessMode () ) {
@@ -1239,24 +1653,16 @@ _RCacheEntryOpenFileRead ( struct RCacheEntry * self)
 
             /*)  First we should to make path to real cache file
              (*/
-        RCt = _GetCachePath ( Buffer, sizeof ( Buffer ) );
-        if ( RCt == 0 ) {
-            RCt = string_printf (
-                                ThePath,
-                                sizeof ( ThePath ),
-                                & TheSize,
-                                "%s/%s",
-                                Buffer,
-                                self -> Name
-                                );
-        }
-
+        RCt = _RCacheEntryPath ( self, false, ThePath, sizeof ( ThePath ) );
         if ( RCt != 0 ) {
             return RCt;
         }
 
         if ( _RCacheCheckCompleted ( ThePath ) ) {
             RCt = _RCacheEntryOpenFileReadLocal ( self, ThePath );
+            if ( RCt == 0 ) {
+                RCt = KFileSize ( self -> File, & ( self -> FileSize ) );
+            }
         }
         else {
             RCt = _RCacheEntryOpenFileReadRemote ( self, ThePath );
@@ -1264,83 +1670,862 @@ _RCacheEntryOpenFileRead ( struct RCacheEntry * self)
 
     }
 
+    if ( RCt == 0 ) {
+        RCt = KLockAcquire ( self -> blocker );
+        if ( RCt == 0 ) {
+            self -> Ready = true;
+
+            KLockUnlock ( self -> blocker );
+        }
+    }
+
     return RCt;
 }   /* _RCacheEntryOpenFileRead () */
 
+/*))
+ //  Opening file on first read. Only that one is done under mutabor
+((*/
+static
 rc_t CC
-RCacheEntryRead (
-            struct RCacheEntry * self,
-            char * Buffer,
-            size_t SizeToRead,
-            uint64_t Offset,
-            size_t * NumReaded
-)
+_RCacheEntryOpen ( struct RCacheEntry * self )
 {
     rc_t RCt;
+    bool Ready;
     int llp;
     const int NumAttempts = 3;
 
     RCt = 0;
+    Ready = false;
     llp = 0;
 
-    if ( self == NULL ) { 
-        return RC ( rcExe, rcFile, rcReading, rcParam, rcNull );
+    RCt = KLockAcquire ( self -> blocker );
+    if ( RCt == 0 ) {
+        Ready = self -> Ready;
+        self -> LastAccess = atomic64_add_and_read ( & _CacheTick, 1 );
+
+        KLockUnlock ( self -> blocker );
+    }
+
+    if ( RCt != 0 || Ready ) {
+        return RCt;
     }
 
         /*)  Here we are locking
          (*/
     RCt = KLockAcquire ( self -> mutabor );
-
     if ( RCt == 0 ) {
-
         for ( llp = 0; llp < NumAttempts; llp ++ ) {
-                /*) There could be non zero value from previous pass
+                /*) Somebody could open it while we were waiting
                  (*/
-            if ( RCt != 0 ) {
-PLOGMSG ( klogErr, ( klogErr, "|||<- Trying to read file $(n)$(u) at attempt $(l)", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp + 1 ) );
+            if ( KLockAcquire ( self -> blocker ) == 0 ) {
+                Ready = self -> Ready;
+
+                KLockUnlock ( self -> blocker );
+            }
+            if ( Ready ) {
                 RCt = 0;
+                break;
             }
 
-                /*) If error happen on previous pass file is released
-                 (*/
-            if ( self -> File == NULL ) {
-                /*)  We are opening file for read here
-                 (*/
-                RCt = _RCacheEntryOpenFileRead ( self );
-/*
-RmOutMsg ( "|||<-- Opening file [%s][%s] [A=%d]\n", self -> Name, self -> Url, RCt );
-*/
+            if ( RCt != 0 ) {
+PLOGMSG ( klogErr, ( klogErr, "|||<- Trying to open file $(n)$(u) at attempt $(l)", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp + 1 ) );
             }
 
-            if ( RCt == 0 ) {
-                RCt = KFileRead (
-                                self -> File,
-                                Offset,
-                                Buffer,
-                                SizeToRead,
-                                NumReaded
-                                );
+            RCt = _RCacheEntryOpenFileRead ( self );
 /*
-RmOutMsg ( "|||<-- Reading [%s][%s] [O=%d][S=%d][R=%d][A=%d]\n", self -> Name, self -> Url, Offset, SizeToRead, * NumReaded, RCt );
+RmOutMsg ( "|||<-- Opening file [%s][%s] [A=%d]\n", self -> Name, self -> Url, RCt );
 */
-                if ( RCt == 0 ) {
-                    break;
-                }
+            if ( RCt == 0 ) {
+                break;
             }
-/*
-RmOutMsg ( "|||<- Failed to read file [%s][%s] at attempt [%d]\n", self -> Name, self -> Url, llp + 1 );
-*/
-            _RCacheEntryReleaseWithoutLock ( self );
 
+            _RCacheEntryReleaseWithoutLock ( self );
         }
 
         if ( RCt != 0 ) {
-PLOGMSG ( klogErr, ( klogErr, "|||<- Failed to read file $(n)$(u) after $(l) attempts", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp + 1 ) );
+PLOGMSG ( klogErr, ( klogErr, "|||<- Failed to open file $(n)$(u) after $(l) attempts", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp ) );
         }
 
         KLockUnlock ( self -> mutabor );
     }
 
+    return RCt;
+}   /* _RCacheEntryOpen () */
+
+/*))
+ //  Reading remote file by it's own connection. Connection which
+ \\  failed is dropped, and next attempt will use new one
+((*/
+static
+rc_t CC
+_RCacheEntryReadRemote (
+                    struct RCacheEntry * self,
+                    char * Buffer,
+                    size_t SizeToRead,
+                    uint64_t Offset,
+                    size_t * NumReaded,
+                    bool Exactly
+)
+{
+    rc_t RCt;
+    const struct KFile * HttpFile;
+    int llp;
+    const int NumAttempts = 3;
+
+    RCt = 0;
+    HttpFile = NULL;
+    llp = 0;
+
+    for ( llp = 0; llp < NumAttempts; llp ++ ) {
+            /*) There could be non zero value from previous pass
+             (*/
+        if ( RCt != 0 ) {
+PLOGMSG ( klogErr, ( klogErr, "|||<- Trying to read file $(n)$(u) at attempt $(l)", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp + 1 ) );
+            RCt = 0;
+        }
+
+        RCt = _RCacheEntryGetConnection ( self, & HttpFile );
+        if ( RCt == 0 ) {
+            RCt = Exactly
+                    ? KFileReadAll (
+                                HttpFile,
+                                Offset,
+                                Buffer,
+                                SizeToRead,
+                                NumReaded
+                                )
+                    : KFileRead (
+                                HttpFile,
+                                Offset,
+                                Buffer,
+                                SizeToRead,
+                                NumReaded
+                                )
+                    ;
+            if ( RCt == 0 && Exactly && * NumReaded != SizeToRead ) {
+                RCt = RC ( rcExe, rcFile, rcReading, rcTransfer, rcIncomplete );
+            }
+/*
+RmOutMsg ( "|||<-- Reading [%s][%s] [O=%d][S=%d][R=%d][A=%d]\n", self -> Name, self -> Url, Offset, SizeToRead, * NumReaded, RCt );
+*/
+            if ( RCt == 0 ) {
+                _RCacheEntryPutConnection ( self, HttpFile );
+                break;
+            }
+
+            ReleaseComplain ( KFileRelease, HttpFile );
+            HttpFile = NULL;
+        }
+/*
+RmOutMsg ( "|||<- Failed to read file [%s][%s] at attempt [%d]\n", self -> Name, self -> Url, llp + 1 );
+*/
+    }
+
+    if ( RCt != 0 ) {
+PLOGMSG ( klogErr, ( klogErr, "|||<- Failed to read file $(n)$(u) after $(l) attempts", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp ) );
+    }
+
+    return RCt;
+}   /* _RCacheEntryReadRemote () */
+
+/*)))
+ ///  Eviction: entry which is not opened by anybody has no files
+ \\\  opened and no readahead jobs, so it's cache files could be
+ ///  removed, and it will be fetched again on next open. Entries are
+ \\\  never removed from _Cache, so they could be used without lock
+(((*/
+struct RCacheVictim {
+    struct RCacheEntry * Entry;
+    uint64_t LastAccess;
+};
+
+static
+void CC
+_RCacheVictimCandidate ( BSTNode * Node, void * Data )
+{
+    struct RCacheEntry * Entry;
+    struct RCacheVictim * Victim;
+
+    Entry = ( struct RCacheEntry * ) Node;
+    Victim = ( struct RCacheVictim * ) Data;
+
+    if ( KLockAcquire ( Entry -> blocker ) == 0 ) {
+        if ( ! Entry -> Ready
+            && Entry -> DiskBytes != 0
+            && ( Victim -> Entry == NULL
+                || Entry -> LastAccess < Victim -> LastAccess )
+        ) {
+            Victim -> Entry = Entry;
+            Victim -> LastAccess = Entry -> LastAccess;
+        }
+
+        KLockUnlock ( Entry -> blocker );
+    }
+}   /* _RCacheVictimCandidate () */
+
+/*))
+ //  Should be called under mutabor. Returns number of bytes freed,
+ \\  which is 0 if entry was opened meanwhile
+((*/
+static
+uint64_t CC
+_RCacheEntryEvict ( struct RCacheEntry * self )
+{
+    uint64_t Bytes;
+    char Path [ 4096 ];
+    struct KDirectory * Directory;
+    bool Incomplete;
+
+    Bytes = 0;
+    Directory = NULL;
+
+    if ( KLockAcquire ( self -> blocker ) == 0 ) {
+        if ( ! self -> Ready ) {
+            Bytes = self -> DiskBytes;
+            self -> DiskBytes = 0;
+            self -> PresentQty = 0;
+
+            if ( self -> Blocks != NULL ) {
+                free ( self -> Blocks );
+                self -> Blocks = NULL;
+            }
+        }
+
+        KLockUnlock ( self -> blocker );
+    }
+
+    if ( Bytes == 0 ) {
+        return 0;
+    }
+
+        /*) There could be completed or incomplete cache file
+         (*/
+    if ( KDirectoryNativeDir ( & Directory ) == 0 ) {
+        for ( Incomplete = false; ; Incomplete = true ) {
+            if ( _RCacheEntryPath ( self, Incomplete, Path, sizeof ( Path ) ) == 0
+                && KDirectoryPathType ( Directory, Path ) == kptFile
+            ) {
+                if ( KDirectoryRemove ( Directory, false, Path ) != 0 ) {
+PLOGMSG ( klogWarn, ( klogWarn, "|||<- Failed to remove evicted file $(n)$(u)", PLOG_2(PLOG_S(n),PLOG_S(u)), self -> Name, self -> Url ) );
+                }
+            }
+
+            if ( Incomplete ) {
+                break;
+            }
+        }
+
+        ReleaseComplain ( KDirectoryRelease, Directory );
+    }
+
+    return Bytes;
+}   /* _RCacheEntryEvict () */
+
+/*))
+ //  Accounting bytes fetched to cache files, and evicting least
+ \\  recently read entries until cache fits to limit. If all entries
+ //  are opened, cache will stay bigger for a while
+((*/
+static
+void CC
+_RCacheGrow ( uint64_t Bytes )
+{
+    struct RCacheVictim Victim;
+    uint64_t Freed;
+    bool Over;
+
+    if ( KLockAcquire ( _CacheLock ) != 0 ) {
+        return;
+    }
+    _CacheBytes += Bytes;
+
+    while ( true ) {
+        Over = _CacheMaxBytes != 0 && _CacheMaxBytes < _CacheBytes;
+
+        Victim . Entry = NULL;
+        Victim . LastAccess = 0;
+        if ( Over ) {
+            BSTreeForEach ( & _Cache, false, _RCacheVictimCandidate, & Victim );
+        }
+
+        KLockUnlock ( _CacheLock );
+
+        if ( Victim . Entry == NULL ) {
+            break;
+        }
+
+            /*) Victim could be opened while we were waiting for it
+             (*/
+        Freed = 0;
+        if ( KLockAcquire ( Victim . Entry -> mutabor ) == 0 ) {
+            Freed = _RCacheEntryEvict ( Victim . Entry );
+
+            KLockUnlock ( Victim . Entry -> mutabor );
+        }
+
+        if ( KLockAcquire ( _CacheLock ) != 0 ) {
+            break;
+        }
+
+        if ( Freed != 0 ) {
+            _CacheBytes = Freed < _CacheBytes ? _CacheBytes - Freed : 0;
+            _CacheEvictions ++;
+PLOGMSG ( klogInfo, ( klogInfo, "|||<- Evicted file $(n)$(u) [$(b) bytes]", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_U64(b)), Victim . Entry -> Name, Victim . Entry -> Url, Freed ) );
+        }
+    }
+}   /* _RCacheGrow () */
+
+/*))
+ //  Fetching Qty blocks starting from First to cache file. Blocks
+ \\  are marked as RCACHE_BLOCK_FETCHING by caller
+((*/
+static
+rc_t CC
+_RCacheEntryFetchBlocks (
+                    struct RCacheEntry * self,
+                    uint64_t First,
+                    uint64_t Qty
+)
+{
+    rc_t RCt;
+    char * Buffer;
+    uint64_t Offset;
+    size_t Size, NumReaded, NumWrit;
+    bool Completed;
+    uint64_t llp;
+
+    RCt = 0;
+    Buffer = NULL;
+    Offset = First * self -> BlockSize;
+    Size = Qty * self -> BlockSize;
+    NumReaded = NumWrit = 0;
+    Completed = false;
+
+    if ( self -> FileSize < Offset + Size ) {
+        Size = self -> FileSize - Offset;
+    }
+
+    Buffer = ( char * ) malloc ( Size );
+    if ( Buffer == NULL ) {
+        RCt = RC ( rcExe, rcFile, rcReading, rcMemory, rcExhausted );
+    }
+
+    if ( RCt == 0 ) {
+        RCt = _RCacheEntryReadRemote (
+                                    self,
+                                    Buffer,
+                                    Size,
+                                    Offset,
+                                    & NumReaded,
+                                    true
+                                    );
+    }
+    if ( RCt == 0 ) {
+        RCt = KFileWriteAll (
+                        self -> CacheFile,
+                        Offset,
+                        Buffer,
+                        Size,
+                        & NumWrit
+                        );
+        if ( RCt == 0 && NumWrit != Size ) {
+            RCt = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+        }
+    }
+
+    if ( Buffer != NULL ) {
+        free ( Buffer );
+    }
+
+        /*) Blocks which failed are absent, and next reader will try
+         |  to fetch them again
+        (*/
+    if ( KLockAcquire ( self -> blocker ) == 0 ) {
+        for ( llp = First; llp < First + Qty; llp ++ ) {
+            self -> Blocks [ llp ] = RCt == 0
+                                        ? RCACHE_BLOCK_PRESENT
+                                        : RCACHE_BLOCK_ABSENT
+                                        ;
+        }
+        if ( RCt == 0 ) {
+            self -> PresentQty += Qty;
+            self -> DiskBytes += Size;
+            Completed = self -> PresentQty == self -> BlockQty;
+        }
+
+        KConditionBroadcast ( self -> fetched );
+        KLockUnlock ( self -> blocker );
+    }
+
+    if ( Completed ) {
+        _RCacheEntryRenameCompleted ( self );
+    }
+
+    if ( RCt == 0 ) {
+        _RCacheGrow ( Size );
+    }
+
+    return RCt;
+}   /* _RCacheEntryFetchBlocks () */
+
+/*))
+ //  Making sure that all blocks of range are in cache file. Blocks
+ \\  which are fetched by other readers are waited for, and others
+ //  are fetched by that reader
+((*/
+static
+rc_t CC
+_RCacheEntryFetchRange (
+                    struct RCacheEntry * self,
+                    uint64_t Offset,
+                    size_t Size
+)
+{
+    rc_t RCt;
+    uint64_t Block, Last, Qty;
+    bool Missed;
+
+    RCt = 0;
+    Block = Offset / self -> BlockSize;
+    Last = ( Offset + Size - 1 ) / self -> BlockSize;
+    Qty = 0;
+    Missed = false;
+
+    while ( RCt == 0 && Block <= Last ) {
+        Qty = 0;
+
+        RCt = KLockAcquire ( self -> blocker );
+        if ( RCt != 0 ) {
+            break;
+        }
+
+        while ( RCt == 0
+                && self -> Blocks [ Block ] == RCACHE_BLOCK_FETCHING
+        ) {
+            RCt = KConditionWait ( self -> fetched, self -> blocker );
+        }
+
+        if ( RCt == 0 ) {
+                /*) Taking all absent blocks in a row, they will be
+                 |  fetched by single request
+                (*/
+            while ( Block + Qty <= Last
+                    && self -> Blocks [ Block + Qty ] == RCACHE_BLOCK_ABSENT
+            ) {
+                self -> Blocks [ Block + Qty ] = RCACHE_BLOCK_FETCHING;
+                Qty ++;
+            }
+        }
+
+        KLockUnlock ( self -> blocker );
+
+        if ( RCt == 0 ) {
+            if ( Qty == 0 ) {
+                    /*) Cache hit
+                     (*/
+                Block ++;
+            }
+            else {
+                RCt = _RCacheEntryFetchBlocks ( self, Block, Qty );
+                Block += Qty;
+                Missed = true;
+            }
+        }
+    }
+
+    atomic64_inc ( Missed ? & _CacheMisses : & _CacheHits );
+
+    return RCt;
+}   /* _RCacheEntryFetchRange () */
+
+/*))
+ //  Readahead pool
+((*/
+static
+rc_t CC
+_RCacheAheadWorker ( const KThread * Self, void * Data )
+{
+    struct RCacheAheadJob * Job;
+
+    while ( true ) {
+        Job = NULL;
+
+        if ( KLockAcquire ( _AheadLock ) != 0 ) {
+            break;
+        }
+
+        while ( ! _AheadQuit && _AheadHead == NULL ) {
+            if ( KConditionWait ( _AheadCond, _AheadLock ) != 0 ) {
+                break;
+            }
+        }
+
+        if ( ! _AheadQuit && _AheadHead != NULL ) {
+            Job = _AheadHead;
+            _AheadHead = Job -> Next;
+            if ( _AheadHead == NULL ) {
+                _AheadTail = NULL;
+            }
+        }
+
+        KLockUnlock ( _AheadLock );
+
+        if ( Job == NULL ) {
+            break;
+        }
+
+            /*) If it failed, blocks are absent again, and reader will
+             |  fetch them itself
+            (*/
+        _RCacheEntryFetchBlocks ( Job -> Entry, Job -> First, Job -> Qty );
+
+        if ( KLockAcquire ( _AheadLock ) == 0 ) {
+            _AheadInFlight -= Job -> Size;
+
+            KLockUnlock ( _AheadLock );
+        }
+
+        RCacheEntryRelease ( Job -> Entry );
+        free ( Job );
+    }
+
+    return 0;
+}   /* _RCacheAheadWorker () */
+
+rc_t CC
+_RCacheAheadStart ()
+{
+    rc_t RCt;
+    size_t llp;
+
+    RCt = 0;
+    llp = 0;
+
+    if ( _ReadaheadWindow == 0 || _ReadaheadMaxBytes == 0 ) {
+        return 0;
+    }
+
+    _AheadQuit = false;
+    _AheadInFlight = 0;
+
+    RCt = KLockMake ( & _AheadLock );
+    if ( RCt == 0 ) {
+        RCt = KConditionMake ( & _AheadCond );
+    }
+
+    for ( llp = 0; RCt == 0 && llp < RCACHE_READAHEAD_THREADS; llp ++ ) {
+        RCt = KThreadMake (
+                        & ( _AheadThreads [ llp ] ),
+                        _RCacheAheadWorker,
+                        NULL
+                        );
+    }
+
+    if ( RCt != 0 ) {
+        _RCacheAheadStop ();
+    }
+
+    return RCt;
+}   /* _RCacheAheadStart () */
+
+rc_t CC
+_RCacheAheadStop ()
+{
+    struct RCacheAheadJob * Job;
+    size_t llp;
+
+    Job = NULL;
+    llp = 0;
+
+    if ( _AheadLock == NULL ) {
+        return 0;
+    }
+
+    if ( KLockAcquire ( _AheadLock ) == 0 ) {
+        _AheadQuit = true;
+        if ( _AheadCond != NULL ) {
+            KConditionBroadcast ( _AheadCond );
+        }
+
+        KLockUnlock ( _AheadLock );
+    }
+
+    for ( llp = 0; llp < RCACHE_READAHEAD_THREADS; llp ++ ) {
+        if ( _AheadThreads [ llp ] != NULL ) {
+            KThreadWait ( _AheadThreads [ llp ], NULL );
+            ReleaseComplain ( KThreadRelease, _AheadThreads [ llp ] );
+            _AheadThreads [ llp ] = NULL;
+        }
+    }
+
+        /*) Jobs which were not started
+         (*/
+    while ( _AheadHead != NULL ) {
+        Job = _AheadHead;
+        _AheadHead = Job -> Next;
+
+        RCacheEntryRelease ( Job -> Entry );
+        free ( Job );
+    }
+    _AheadTail = NULL;
+    _AheadInFlight = 0;
+
+    if ( _AheadCond != NULL ) {
+        ReleaseComplain ( KConditionRelease, _AheadCond );
+        _AheadCond = NULL;
+    }
+
+    ReleaseComplain ( KLockRelease, _AheadLock );
+    _AheadLock = NULL;
+
+    return 0;
+}   /* _RCacheAheadStop () */
+
+/*))
+ //  Reserving room for readahead of up to Qty blocks. Qty will be
+ \\  decreased to fit into limit of bytes in flight
+((*/
+static
+uint64_t CC
+_RCacheAheadReserve ( uint64_t * Qty, uint32_t BlockSize )
+{
+    uint64_t Size;
+
+    Size = 0;
+
+    if ( KLockAcquire ( _AheadLock ) == 0 ) {
+        if ( _AheadInFlight < _ReadaheadMaxBytes ) {
+            uint64_t Room = ( _ReadaheadMaxBytes - _AheadInFlight )
+                                                            / BlockSize;
+            if ( Room < * Qty ) {
+                * Qty = Room;
+            }
+        }
+        else {
+            * Qty = 0;
+        }
+
+        Size = * Qty * BlockSize;
+        _AheadInFlight += Size;
+
+        KLockUnlock ( _AheadLock );
+    }
+    else {
+        * Qty = 0;
+    }
+
+    return Size;
+}   /* _RCacheAheadReserve () */
+
+static
+void CC
+_RCacheAheadEnqueue ( struct RCacheAheadJob * Job )
+{
+    if ( KLockAcquire ( _AheadLock ) == 0 ) {
+        Job -> Next = NULL;
+        if ( _AheadTail == NULL ) {
+            _AheadHead = _AheadTail = Job;
+        }
+        else {
+            _AheadTail -> Next = Job;
+            _AheadTail = Job;
+        }
+        KConditionSignal ( _AheadCond );
+
+        KLockUnlock ( _AheadLock );
+    }
+}   /* _RCacheAheadEnqueue () */
+
+/*))
+ //  Detecting sequential reads of entry, and scheduling readahead
+ \\  of up to window blocks after that read. Blocks are claimed
+ //  as RCACHE_BLOCK_FETCHING here, so readers will wait for them
+((*/
+static
+void CC
+_RCacheEntryReadAhead (
+                    struct RCacheEntry * self,
+                    uint64_t Offset,
+                    size_t Size
+)
+{
+    struct RCacheAheadJob * Jobs, * JobsTail, * Job;
+    uint64_t First, Last, Block, End, Qty, Bytes, llp;
+
+    Jobs = JobsTail = Job = NULL;
+
+    if ( _AheadLock == NULL || Size == 0 ) {
+        return;
+    }
+
+    First = Offset / self -> BlockSize;
+    Last = ( Offset + Size - 1 ) / self -> BlockSize;
+
+    if ( KLockAcquire ( self -> blocker ) != 0 ) {
+        return;
+    }
+
+    if ( First == self -> LastBlock || First == self -> LastBlock + 1 ) {
+        if ( self -> SeqReads < RCACHE_SEQUENTIAL_READS ) {
+            self -> SeqReads ++;
+        }
+    }
+    else {
+        self -> SeqReads = 0;
+        self -> AheadBlock = 0;
+    }
+    self -> LastBlock = Last;
+
+        /*) Window is refilled when reader passed half of it, so
+         |  blocks are fetched by runs, not one by one
+        (*/
+    if ( RCACHE_SEQUENTIAL_READS <= self -> SeqReads
+        && self -> AheadBlock <= Last + 1 + _ReadaheadWindow / 2
+    ) {
+        Block = self -> AheadBlock < Last + 1 ? Last + 1 : self -> AheadBlock;
+        End = Last + 1 + _ReadaheadWindow;
+        if ( self -> BlockQty < End ) {
+            End = self -> BlockQty;
+        }
+
+        while ( Block < End ) {
+            if ( self -> Blocks [ Block ] != RCACHE_BLOCK_ABSENT ) {
+                Block ++;
+                continue;
+            }
+
+            Qty = 0;
+            while ( Block + Qty < End
+                    && self -> Blocks [ Block + Qty ] == RCACHE_BLOCK_ABSENT
+            ) {
+                Qty ++;
+            }
+
+            Bytes = _RCacheAheadReserve ( & Qty, self -> BlockSize );
+            if ( Qty == 0 ) {
+                break;
+            }
+
+            Job = ( struct RCacheAheadJob * ) calloc (
+                                        1,
+                                        sizeof ( struct RCacheAheadJob )
+                                        );
+            if ( Job == NULL ) {
+                if ( KLockAcquire ( _AheadLock ) == 0 ) {
+                    _AheadInFlight -= Bytes;
+                    KLockUnlock ( _AheadLock );
+                }
+                break;
+            }
+
+            for ( llp = Block; llp < Block + Qty; llp ++ ) {
+                self -> Blocks [ llp ] = RCACHE_BLOCK_FETCHING;
+            }
+            Job -> Entry = self;
+            Job -> First = Block;
+            Job -> Qty = Qty;
+            Job -> Size = Bytes;
+            if ( JobsTail == NULL ) {
+                Jobs = Job;
+            }
+            else {
+                JobsTail -> Next = Job;
+            }
+            JobsTail = Job;
+
+            Block += Qty;
+        }
+
+        self -> AheadBlock = Block;
+    }
+
+    KLockUnlock ( self -> blocker );
+
+        /*) Reader holds reference, so entry is alive here. Each job
+         |  holds it's own reference until blocks are fetched
+        (*/
+    while ( Jobs != NULL ) {
+        Job = Jobs;
+        Jobs = Job -> Next;
+
+        RCacheEntryAddRef ( self );
+        _RCacheAheadEnqueue ( Job );
+    }
+}   /* _RCacheEntryReadAhead () */
+
+rc_t CC
+RCacheEntryRead (
+            struct RCacheEntry * self,
+            char * Buffer,
+            size_t SizeToRead,
+            uint64_t Offset,
+            size_t * NumReaded
+)
+{
+    rc_t RCt;
+
+    RCt = 0;
+
+    if ( self == NULL || NumReaded == NULL ) { 
+        return RC ( rcExe, rcFile, rcReading, rcParam, rcNull );
+    }
+
+    * NumReaded = 0;
+
+        /*)  Entry lock is taken only to open file
+         (*/
+    RCt = _RCacheEntryOpen ( self );
+    if ( RCt != 0 ) {
+        return RCt;
+    }
+
+    if ( self -> FileSize <= Offset || SizeToRead == 0 ) {
+        return 0;
+    }
+    if ( self -> FileSize - Offset < SizeToRead ) {
+        SizeToRead = self -> FileSize - Offset;
+    }
+
+    if ( self -> File != NULL ) {
+            /*) Completed cache file
+             (*/
+        atomic64_inc ( & _CacheHits );
+
+        RCt = KFileReadAll (
+                        self -> File,
+                        Offset,
+                        Buffer,
+                        SizeToRead,
+                        NumReaded
+                        );
+    }
+    else if ( self -> CacheFile == NULL ) {
+            /*) Diskless mode
+             (*/
+        RCt = _RCacheEntryReadRemote (
+                                    self,
+                                    Buffer,
+                                    SizeToRead,
+                                    Offset,
+                                    NumReaded,
+                                    false
+                                    );
+    }
+    else {
+        _RCacheEntryReadAhead ( self, Offset, SizeToRead );
+
+        RCt = _RCacheEntryFetchRange ( self, Offset, SizeToRead );
+        if ( RCt == 0 ) {
+            RCt = KFileReadAll (
+                            self -> CacheFile,
+                            Offset,
+                            Buffer,
+                            SizeToRead,
+                            NumReaded
+                            );
+        }
+    }
+
     return RCt;
 }   /* RCacheEntryRead () */
 
@@ -104,6 +104,34 @@ rc_t CC RCacheEntryRead (
     ((*/
 uint32_t CC RemoteCacheSetHttpBlockSize ( uint32_t HttpBlockSize );
 
+    /*))
+     //  This method will set readahead for sequential reads: Window
+     \\  is the number of blocks fetched in background after a read,
+     //  0 disables readahead, and MaxBytes limits bytes which are
+     \\  queued or being fetched in background for all files
+    ((*/
+void CC RemoteCacheSetReadahead ( uint32_t Window, uint64_t MaxBytes );
+
+    /*))
+     //  This method will set limit for bytes stored in cache files,
+     \\  0 means no limit. Files which are not opened are evicted in
+     //  order of last read when limit is exceeded. Returns previous
+     \\  value of limit
+    ((*/
+uint64_t CC RemoteCacheSetMaxSize ( uint64_t MaxBytes );
+
+    /*))
+     //  This method will return number of reads served from cache,
+     \\  reads which fetched data, files evicted, and bytes which are
+     //  stored in cache files. Any pointer could be NULL
+    ((*/
+void CC RemoteCacheGetStats (
+                        uint64_t * Hits,
+                        uint64_t * Misses,
+                        uint64_t * Evictions,
+                        uint64_t * Bytes
+                        );
+
     /*))
      //  This method will set path for local cache dir
      \\
@@ -447,6 +447,13 @@ void CoreUsage(int fd, const char *progName, bool showHelp, bool showVersion, bo
                 "                                       level is an integer value from 1 to 10,\n"
                 "                                       which correspond to block sizes:\n"
                 "                                       32K,64K,128K,256K,512K,1M,2M,4M,8M,16M\n"
+                "    -A|--readahead <blocks>            Number of blocks fetched in background after\n"
+                "                                       sequential reads, 0 - no readahead, default: 16.\n"
+                "    -M|--readahead-max <MB>            Limit of data fetched in background for all\n"
+                "                                       files, in megabytes, default: 32.\n"
+                "    -S|--cache-size <MB>               Limit of local cache size, in megabytes. Files\n"
+                "                                       which are not opened are evicted when limit\n"
+                "                                       is exceeded, default: 0 - no limit.\n"
                 );
             KOutMsg(
                 "    --SRA-check <secs>                 Check SRA config and runs for update\n"
@@ -503,6 +510,7 @@ rc_t CC KMain(int argc, char *argv[])
     uint32_t heart_beat_check = 30, log_sync = 0, sra_sync = 0;
     int log_fd = STDOUT_FILENO;
     uint32_t block_level = 0, block_size = 0;
+    uint32_t readahead = 16, readahead_max = 32, cache_size = 0;
 
 #ifdef SRAFUSER_LOGLOCALTIME
     KLogFmtFlagsSet(klogFmtLocalTimestamp);
@@ -526,6 +534,12 @@ rc_t CC KMain(int argc, char *argv[])
             xml_root = argv[++i];
         } else if(!strcmp(argv[i], "-B") || !strcmp(argv[i], "--Blevel")) {
             block_level = AsciiToU32(argv[++i], NULL, NULL);
+        } else if(!strcmp(argv[i], "-A") || !strcmp(argv[i], "--readahead")) {
+            readahead = AsciiToU32(argv[++i], NULL, NULL);
+        } else if(!strcmp(argv[i], "-M") || !strcmp(argv[i], "--readahead-max")) {
+            readahead_max = AsciiToU32(argv[++i], NULL, NULL);
+        } else if(!strcmp(argv[i], "-S") || !strcmp(argv[i], "--cache-size")) {
+            cache_size = AsciiToU32(argv[++i], NULL, NULL);
         } else if(!strcmp(argv[i], "-ds") || !strcmp(argv[i], "--SRA-check")) {
             sra_sync = AsciiToU32(argv[++i], NULL, NULL);
         } else if(!strcmp(argv[i], "-u") || !strcmp (argv[i], "--unmount")) {
@@ -612,6 +626,8 @@ rc_t CC KMain(int argc, char *argv[])
     else {
         block_size = 0;
     }
+    RemoteCacheSetReadahead ( readahead, ( uint64_t ) readahead_max * 1024 * 1024 );
+    RemoteCacheSetMaxSize ( ( uint64_t ) cache_size * 1024 * 1024 );
     if( i != argc ) {
         LOGERR(klogErr, RC(rcExe, rcArgv, rcValidating, rcParam, rcExcessive), argv[i]);
         CoreUsage(log_fd, argv[0], true, false, true);
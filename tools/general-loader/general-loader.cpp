@@ -43,10 +43,13 @@ using namespace std;
 
 ///////////// GeneralLoader::Reader
 
-GeneralLoader::Reader::Reader( const struct KStream& p_input )
+GeneralLoader::Reader::Reader( const struct KStream& p_input, size_t p_blockSize )
 :   m_input ( p_input ),
-    m_buffer ( 0 ),
-    m_bufSize ( 0 ),
+    m_block ( 0 ),
+    m_blockSize ( p_blockSize ),
+    m_pos ( 0 ),
+    m_end ( 0 ),
+    m_data ( 0 ),
     m_readCount ( 0 )
 {
     KStreamAddRef ( & m_input );
@@ -55,36 +58,86 @@ GeneralLoader::Reader::Reader( const struct KStream& p_input )
 GeneralLoader::Reader::~Reader()
 {
     KStreamRelease ( & m_input );
-    free ( m_buffer );
+    free ( m_block );
 }
 
 rc_t 
-GeneralLoader::Reader::Read( void * p_buffer, size_t p_size )
+GeneralLoader::Reader::Fill( size_t p_size )
 {
-    pLogMsg ( klogInfo, "general-loader: reading $(s) bytes", "s=%u", ( unsigned int ) p_size );
+    if ( m_end - m_pos >= p_size )
+    {
+        return 0;
+    }
+    
+    if ( m_block == 0 || p_size > m_blockSize )
+    {   // a payload larger than the block grows the block
+        size_t newSize = m_blockSize;
+        while ( newSize < p_size )
+        {
+            newSize *= 2;
+        }
+        char* newBlock = ( char * ) malloc ( newSize );
+        if ( newBlock == 0 )
+        {
+            return RC ( rcExe, rcFile, rcReading, rcMemory, rcExhausted );
+        }
+        if ( m_block != 0 )
+        {
+            memmove ( newBlock, m_block + m_pos, m_end - m_pos );
+            free ( m_block );
+        }
+        m_block = newBlock;
+        m_blockSize = newSize;
+    }
+    else
+    {   // move the unconsumed tail to the front
+        memmove ( m_block, m_block + m_pos, m_end - m_pos );
+    }
+    m_end -= m_pos;
+    m_pos = 0;
+    
+    while ( m_end < p_size )
+    {
+        size_t num_read;
+        rc_t rc = KStreamRead ( & m_input, m_block + m_end, m_blockSize - m_end, & num_read );
+        if ( rc != 0 )
+        {
+            return rc;
+        }
+        if ( num_read == 0 )
+        {   // same as KStreamReadExactly on a short stream
+            return RC ( rcNS, rcFile, rcReading, rcTransfer, rcIncomplete );
+        }
+        PLOGMSG ( klogInfo, ( klogInfo, "general-loader: read $(s) bytes", "s=%u", ( unsigned int ) num_read ) );
+        m_end += num_read;
+    }
+    return 0;
+}
 
-    m_readCount += p_size;
-    return KStreamReadExactly ( & m_input, p_buffer, p_size );
+rc_t 
+GeneralLoader::Reader::Read( void * p_buffer, size_t p_size )
+{
+    rc_t rc = Fill ( p_size );
+    if ( rc == 0 )
+    {
+        memmove ( p_buffer, m_block + m_pos, p_size );
+        m_pos += p_size;
+        m_readCount += p_size;
+    }
+    return rc;
 }
 
 rc_t 
 GeneralLoader::Reader::Read( size_t p_size )
 {
-    if ( p_size > m_bufSize )
+    rc_t rc = Fill ( p_size );
+    if ( rc == 0 )
     {
-        m_buffer = realloc ( m_buffer, p_size );
-        if ( m_buffer == 0 )
-        {
-            m_bufSize = 0;
-            m_readCount = 0;
-            return RC ( rcExe, rcFile, rcReading, rcMemory, rcExhausted );
-        }
+        m_data = m_block + m_pos;
+        m_pos += p_size;
+        m_readCount += p_size;
     }
-    
-    pLogMsg ( klogInfo, "general-loader: reading $(s) bytes", "s=%u", ( unsigned int ) p_size );
-    
-    m_readCount += p_size;
-    return KStreamReadExactly ( & m_input, m_buffer, p_size );
+    return rc;
 }
 
 void 
@@ -99,6 +152,8 @@ GeneralLoader::Reader::Align( uint8_t p_bytes )
 
 ///////////// GeneralLoader
 
+const uint32_t GeneralLoader::NoCursor;
+
 GeneralLoader::GeneralLoader ( const struct KStream& p_input )
 :   m_reader ( p_input ),
     m_mgr ( 0 ),
@@ -313,7 +368,7 @@ GeneralLoader :: ReadEvents()
             {   
                 uint32_t tableId = ncbi :: id ( evt_header );
                 pLogMsg ( klogInfo, "general-loader event: New-Table, id=$(i)", "i=%u", tableId );
-                if ( m_tables . find ( tableId ) == m_tables . end() )
+                if ( FindCursor ( tableId ) == 0 )
                 {
                     uint32_t table_name_size;
                     rc = m_reader . Read ( & table_name_size, sizeof ( table_name_size ) );
@@ -328,6 +383,10 @@ GeneralLoader :: ReadEvents()
                             rc = MakeCursor ( tableName );
                             if ( rc == 0 )
                             {
+                                if ( tableId >= m_tables . size () )
+                                {
+                                    m_tables . resize ( tableId + 1, NoCursor );
+                                }
                                 m_tables [ tableId ] = ( uint32_t ) m_cursors . size() - 1;
                             }
                         }
@@ -350,10 +409,9 @@ GeneralLoader :: ReadEvents()
                 rc = m_reader . Read ( & table_id , sizeof ( table_id ) );
                 if ( rc == 0 )
                 {
-                    TableIdToCursor::const_iterator table = m_tables . find ( table_id );
-                    if ( table != m_tables . end() )
+                    if ( FindCursor ( table_id ) != 0 )
                     {
-                        if ( m_columns . find ( column_id ) == m_columns . end () )
+                        if ( FindColumn ( column_id ) == 0 )
                         {
                             uint32_t elem_size;
                             rc = m_reader . Read ( & elem_size , sizeof ( elem_size ) );
@@ -368,7 +426,7 @@ GeneralLoader :: ReadEvents()
                                     {
                                         pLogMsg ( klogInfo, "general-loader: adding column '$(c)'", "c=%.*s", 
                                                             col_name_size, ( const char * ) m_reader . GetBuffer () );
-                                        uint32_t cursor_idx = table -> second;
+                                        uint32_t cursor_idx = m_tables [ table_id ];
                                         uint32_t column_idx;
                                         rc = VCursorAddColumn ( m_cursors [ cursor_idx ], 
                                                                 & column_idx, 
@@ -380,6 +438,14 @@ GeneralLoader :: ReadEvents()
                                             col . cursorIdx = cursor_idx;
                                             col . columnIdx = column_idx;
                                             col . elemBits  = elem_size;
+                                            if ( column_id >= m_columns . size () )
+                                            {
+                                                Column unused;
+                                                unused . cursorIdx = NoCursor;
+                                                unused . columnIdx = 0;
+                                                unused . elemBits  = 0;
+                                                m_columns . resize ( column_id + 1, unused );
+                                            }
                                             m_columns [ column_id ] = col;
                                             pLogMsg ( klogInfo, 
                                                       "general-loader: tableId = $(t), added column '$(c)', columnIdx = $(i1), elemBits = $(i2)",  
@@ -406,20 +472,20 @@ GeneralLoader :: ReadEvents()
         case evt_cell_data:
             {
                 uint32_t column_id = ncbi :: id ( evt_header );
-                pLogMsg ( klogInfo, "general-loader event: Cell-Data, id=$(i)", "i=%u", column_id );
+                PLOGMSG ( klogInfo, ( klogInfo, "general-loader event: Cell-Data, id=$(i)", "i=%u", column_id ) );
                 
-                Columns::const_iterator curIt = m_columns . find ( column_id );
-                if ( curIt != m_columns . end () )
+                const Column* colp = FindColumn ( column_id );
+                if ( colp != 0 )
                 {
-                    const Column& col = curIt -> second;
+                    const Column& col = * colp;
                     uint32_t elem_count;
                     rc = m_reader . Read ( & elem_count, sizeof ( elem_count ) );   
                     if ( rc == 0 )
                     {
-                        pLogMsg ( klogInfo,     
+                        PLOGMSG ( klogInfo, ( klogInfo,     
                                   "general-loader: columnIdx = $(i), elem size=$(s) bits, elem count=$(c)",
                                   "i=%u,s=%u,c=%u", 
-                                  col . columnIdx, col . elemBits, elem_count );
+                                  col . columnIdx, col . elemBits, elem_count ) );
                         rc = m_reader . Read ( ( col . elemBits * elem_count + 7 ) / 8 );   
                         if ( rc == 0 )
                         {
@@ -442,20 +508,20 @@ GeneralLoader :: ReadEvents()
         case evt_cell_default: //TODO: this code is a twin brother of evt_cell_data. refactor.
             {
                 uint32_t column_id = ncbi :: id ( evt_header );
-                pLogMsg ( klogInfo, "general-loader event: Cell-Default, id=$(i)", "i=%u", column_id );
+                PLOGMSG ( klogInfo, ( klogInfo, "general-loader event: Cell-Default, id=$(i)", "i=%u", column_id ) );
                 
-                Columns::const_iterator curIt = m_columns . find ( column_id );
-                if ( curIt != m_columns . end () )
+                const Column* colp = FindColumn ( column_id );
+                if ( colp != 0 )
                 {
-                    const Column& col = curIt -> second;
+                    const Column& col = * colp;
                     uint32_t elem_count;
                     rc = m_reader . Read ( & elem_count, sizeof ( elem_count ) );   
                     if ( rc == 0 )
                     {
-                        pLogMsg ( klogInfo,     
+                        PLOGMSG ( klogInfo, ( klogInfo,     
                                   "general-loader: columnIdx = $(i), elem size=$(s) bits, elem count=$(c)",
                                   "i=%u,s=%u,c=%u", 
-                                  col . columnIdx, col . elemBits, elem_count );
+                                  col . columnIdx, col . elemBits, elem_count ) );
                         rc = m_reader . Read ( ( col . elemBits * elem_count + 7 ) / 8 );   
                         if ( rc == 0 )
                         {
@@ -487,11 +553,10 @@ GeneralLoader :: ReadEvents()
         case evt_next_row:
             {
                 uint32_t table_id = ncbi :: id ( evt_header );
-                pLogMsg ( klogInfo, "general-loader event: Next-Row, id=$(i)", "i=%u", table_id );
-                TableIdToCursor::const_iterator table = m_tables . find ( table_id );
-                if ( table != m_tables . end() )
+                PLOGMSG ( klogInfo, ( klogInfo, "general-loader event: Next-Row, id=$(i)", "i=%u", table_id ) );
+                VCursor * cursor = FindCursor ( table_id );
+                if ( cursor != 0 )
                 {
-                    VCursor * cursor = m_cursors [ table -> second ];
                     rc = VCursorCommitRow ( cursor );
                     if ( rc == 0 )
                     {
@@ -31,7 +31,6 @@
 
 #include <string>
 #include <vector>
-#include <map>
 
 #include "general-writer.h"
 
@@ -119,21 +118,22 @@ private:
     // Active cursors
     typedef std::vector < struct VCursor * > Cursors;
 
-    // from table id to VCursor
-    // value_type : index into Cursors
-    typedef std::map < uint32_t, uint32_t > TableIdToCursor; 
+    // marks an id that has not been declared by the stream
+    static const uint32_t NoCursor = ~ ( uint32_t ) 0;
+
+    // from table id to VCursor, indexed by the (1-based) table id
+    // value_type : index into Cursors, NoCursor if the id is unused
+    typedef std::vector < uint32_t > TableIdToCursor; 
     
     typedef struct 
     {
-        uint32_t cursorIdx;     // index into Cursors
+        uint32_t cursorIdx;     // index into Cursors, NoCursor if the id is unused
         uint32_t columnIdx;     // index in the VCursor
         uint32_t elemBits;
     } Column;
     
-    // From column id to VCursor.
-    // value_type::first    : index into Cursors
-    // value_type::second   : colIdx in the VCursor
-    typedef std::map < uint32_t, Column > Columns; 
+    // From column id to VCursor, indexed by the (1-based) column id
+    typedef std::vector < Column > Columns; 
     
     typedef std::vector < std::string > Paths;
 
@@ -151,11 +151,22 @@ private:
     
     static void SplitAndAdd( Paths& p_paths, const std::string& p_path );
     
+    const Column* FindColumn ( uint32_t p_id ) const
+    {
+        return p_id < m_columns . size () && m_columns [ p_id ] . cursorIdx != NoCursor ? & m_columns [ p_id ] : 0;
+    }
+    struct VCursor* FindCursor ( uint32_t p_tableId ) const
+    {
+        return p_tableId < m_tables . size () && m_tables [ p_tableId ] != NoCursor ? m_cursors [ m_tables [ p_tableId ] ] : 0;
+    }
     
+    
+    // Pulls the input in large blocks and hands out events from the block in place;
+    // a payload is only moved when it straddles the end of a block
     class Reader
     {
     public:
-        Reader( const struct KStream& p_input );
+        Reader( const struct KStream& p_input, size_t p_blockSize = 256 * 1024 );
         ~Reader();
         
         // read into caller's buffer
@@ -164,16 +175,22 @@ private:
         // if rc == 0, there are p_size bytes available through GetBuffer until the next call to Read
         rc_t Read( size_t p_size ); 
         
-        const void* GetBuffer() const { return m_buffer; }
+        const void* GetBuffer() const { return m_data; }
         
         void Align( uint8_t p_bytes = 4 );
         
         uint64_t GetReadCount() { return m_readCount; }
         
     private:
+        // make p_size bytes available contiguously at m_block + m_pos
+        rc_t Fill( size_t p_size );
+        
         const struct KStream& m_input;
-        void* m_buffer;
-        size_t m_bufSize;
+        char* m_block;
+        size_t m_blockSize;
+        size_t m_pos;       // first unconsumed byte in m_block
+        size_t m_end;       // end of the data in m_block
+        const void* m_data; // result of the last Read( size_t )
         uint64_t m_readCount;
     };
     
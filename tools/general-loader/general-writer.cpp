@@ -316,45 +316,24 @@ namespace ncbi
     }
 
     template < class T >
-    int encode_int ( T val, uint8_t * start, uint8_t * end );
+    size_t encode_array ( const T * values, size_t count, uint8_t * start, uint8_t * end, size_t * num_bytes );
 
     template <>
-    int encode_int < uint16_t > ( uint16_t val, uint8_t * start, uint8_t * end )
+    size_t encode_array < uint16_t > ( const uint16_t * values, size_t count, uint8_t * start, uint8_t * end, size_t * num_bytes )
     {
-        int ret = encode_uint16 ( val, start, end );
-        if ( ret > 0 )
-        {
-            uint16_t val2;
-            int ret2 = decode_uint16 ( start, start + ret, & val2 );
-            assert ( ret == ret2 && val == val2 );
-        }
-        return ret;
+        return encode_uint16_array ( values, count, start, end, num_bytes );
     }
 
     template <>
-    int encode_int < uint32_t > ( uint32_t val, uint8_t * start, uint8_t * end )
+    size_t encode_array < uint32_t > ( const uint32_t * values, size_t count, uint8_t * start, uint8_t * end, size_t * num_bytes )
     {
-        int ret = encode_uint32 ( val, start, end );
-        if ( ret > 0 )
-        {
-            uint32_t val2;
-            int ret2 = decode_uint32 ( start, start + ret, & val2 );
-            assert ( ret == ret2 && val == val2 );
-        }
-        return ret;
+        return encode_uint32_array ( values, count, start, end, num_bytes );
     }
 
     template <>
-    int encode_int < uint64_t > ( uint64_t val, uint8_t * start, uint8_t * end )
+    size_t encode_array < uint64_t > ( const uint64_t * values, size_t count, uint8_t * start, uint8_t * end, size_t * num_bytes )
     {
-        int ret = encode_uint64 ( val, start, end );
-        if ( ret > 0 )
-        {
-            uint64_t val2;
-            int ret2 = decode_uint64 ( start, start + ret, & val2 );
-            assert ( ret == ret2 && val == val2 );
-        }
-        return ret;
+        return encode_uint64_array ( values, count, start, end, num_bytes );
     }
 
     struct encode_result { uint32_t num_elems, num_bytes; };
@@ -364,29 +343,17 @@ namespace ncbi
     template < class T > static
     encode_result encode_buffer ( uint8_t * buffer, const void * data, uint32_t first, uint32_t elem_count )
     {
-        uint8_t * start = buffer;
-        uint8_t * end = buffer + bsize;
         const T * input = ( const T * ) data;
 
-        uint32_t i;
-        for ( i = first; i < elem_count; ++ i )
-        {
-            int num_writ = encode_int < T > ( input [ i ], start, end );
-            if ( num_writ <= 0 )
-            {
-                if ( num_writ < 0 )
-                    throw "error encoding integer data";
-                break;
-            }
-            start += num_writ;
-        }
+        size_t num_bytes;
+        size_t num_elems = encode_array < T > ( input + first, elem_count - first, buffer, buffer + bsize, & num_bytes );
 
-        if ( start == buffer )
+        if ( num_bytes == 0 )
             throw "INTERNAL ERROR: no data to encode";
 
         encode_result rslt;
-        rslt . num_elems = i;
-        rslt . num_bytes = start - buffer;
+        rslt . num_elems = first + ( uint32_t ) num_elems;
+        rslt . num_bytes = ( uint32_t ) num_bytes;
 
         return rslt;
     }
@@ -299,24 +299,24 @@ namespace gw_dump
      *  deeply check contents for adherance to protocol
      */
     template < class T >
-    int decode_int ( const uint8_t * start, const uint8_t * end, T * decoded );
+    int decode_array ( const uint8_t * start, const uint8_t * end, T * decoded, size_t count, size_t * num_decoded, size_t * num_read );
 
     template <>
-    int decode_int < uint16_t > ( const uint8_t * start, const uint8_t * end, uint16_t * decoded )
+    int decode_array < uint16_t > ( const uint8_t * start, const uint8_t * end, uint16_t * decoded, size_t count, size_t * num_decoded, size_t * num_read )
     {
-        return decode_uint16 ( start, end, decoded );
+        return decode_uint16_array ( start, end, decoded, count, num_decoded, num_read );
     }
 
     template <>
-    int decode_int < uint32_t > ( const uint8_t * start, const uint8_t * end, uint32_t * decoded )
+    int decode_array < uint32_t > ( const uint8_t * start, const uint8_t * end, uint32_t * decoded, size_t count, size_t * num_decoded, size_t * num_read )
     {
-        return decode_uint32 ( start, end, decoded );
+        return decode_uint32_array ( start, end, decoded, count, num_decoded, num_read );
     }
 
     template <>
-    int decode_int < uint64_t > ( const uint8_t * start, const uint8_t * end, uint64_t * decoded )
+    int decode_array < uint64_t > ( const uint8_t * start, const uint8_t * end, uint64_t * decoded, size_t count, size_t * num_decoded, size_t * num_read )
     {
-        return decode_uint64 ( start, end, decoded );
+        return decode_uint64_array ( start, end, decoded, count, num_decoded, num_read );
     }
 
     template < class T > static
@@ -326,13 +326,14 @@ namespace gw_dump
         const uint8_t * end = data_buffer + data_size;
 
         size_t unpacked_size;
-        for ( unpacked_size = 0; start < end; unpacked_size += sizeof ( T ) )
+        for ( unpacked_size = 0; start < end; )
         {
-            T decoded;
-            int num_read = decode_int < T > ( start, end, & decoded );
-            if ( num_read <= 0 )
+            T decoded [ 1024 ];
+            size_t num_decoded, num_read;
+            int rc = decode_array < T > ( start, end, decoded, sizeof decoded / sizeof decoded [ 0 ], & num_decoded, & num_read );
+            if ( rc <= 0 )
             {
-                switch ( num_read )
+                switch ( rc )
                 {
                 case CODEC_INSUFFICIENT_BUFFER:
                     throw "truncated data in packed integer buffer";
@@ -345,6 +346,7 @@ namespace gw_dump
                 }
             }
             start += num_read;
+            unpacked_size += num_decoded * sizeof ( T );
         }
 
         return unpacked_size;
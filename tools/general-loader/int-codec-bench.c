@@ -0,0 +1,161 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* int-codec-bench
+ *  times encode_uintXX/decode_uintXX called per value against the
+ *  encode_uintXX_array/decode_uintXX_array bulk versions on a few
+ *  value distributions typical of general-writer integer columns
+ *
+ *  usage: int-codec-bench [ count [ rounds ] ]
+ */
+
+#include "utf8-like-int-codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static
+double now ( void )
+{
+    struct timespec ts;
+    clock_gettime ( CLOCK_MONOTONIC, & ts );
+    return ts . tv_sec + ts . tv_nsec * 1e-9;
+}
+
+static
+uint32_t next_random ( uint64_t * state )
+{
+    * state = * state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ( uint32_t ) ( * state >> 33 );
+}
+
+enum { dist_counts, dist_mostly_small, dist_positions, dist_count };
+
+static const char * dist_names [] = { "counts (< 128)", "mostly small", "positions" };
+
+static
+uint64_t make_value ( int dist, uint64_t * state )
+{
+    switch ( dist )
+    {
+    case dist_counts:
+        return next_random ( state ) % 100;
+    case dist_mostly_small:
+        return next_random ( state ) % 16 == 0 ? next_random ( state ) : next_random ( state ) % 128;
+    default:
+        return next_random ( state ) % 250000000;
+    }
+}
+
+#define BENCH( BITS ) \
+static \
+void bench_uint ## BITS ( int dist, size_t count, unsigned rounds ) \
+{ \
+    uint ## BITS ## _t * values = malloc ( count * sizeof * values ); \
+    uint ## BITS ## _t * decoded = malloc ( count * sizeof * decoded ); \
+    uint8_t * buf = malloc ( count * 9 ); \
+    uint8_t * xend = buf + count * 9; \
+    uint64_t state = 1; \
+    size_t i, num_bytes = 0; \
+    double t, t_enc1 = 0, t_encN = 0, t_dec1 = 0, t_decN = 0; \
+    unsigned r; \
+ \
+    if ( values == NULL || decoded == NULL || buf == NULL ) \
+    { \
+        fprintf ( stderr, "out of memory\n" ); \
+        exit ( 1 ); \
+    } \
+    for ( i = 0; i < count; ++ i ) \
+        values [ i ] = ( uint ## BITS ## _t ) make_value ( dist, & state ); \
+ \
+    for ( r = 0; r < rounds; ++ r ) \
+    { \
+        uint8_t * p = buf; \
+        uint8_t const * q = buf; \
+        size_t n, m; \
+ \
+        t = now (); \
+        for ( i = 0; i < count; ++ i ) \
+            p += encode_uint ## BITS ( values [ i ], p, xend ); \
+        t_enc1 += now () - t; \
+        num_bytes = p - buf; \
+ \
+        t = now (); \
+        for ( i = 0; i < count; ++ i ) \
+            q += decode_uint ## BITS ( q, buf + num_bytes, & decoded [ i ] ); \
+        t_dec1 += now () - t; \
+ \
+        t = now (); \
+        encode_uint ## BITS ## _array ( values, count, buf, xend, & n ); \
+        t_encN += now () - t; \
+ \
+        t = now (); \
+        decode_uint ## BITS ## _array ( buf, buf + n, decoded, count, & m, & n ); \
+        t_decN += now () - t; \
+ \
+        if ( m != count || memcmp ( values, decoded, count * sizeof * values ) != 0 ) \
+        { \
+            fprintf ( stderr, "uint%d %s: round trip failed\n", BITS, dist_names [ dist ] ); \
+            exit ( 2 ); \
+        } \
+    } \
+ \
+    printf ( "uint%-3d %-16s %5.2f bytes/value  encode %7.1f -> %7.1f  decode %7.1f -> %7.1f Mvalues/s\n", \
+             BITS, dist_names [ dist ], ( double ) num_bytes / count, \
+             count * rounds / t_enc1 * 1e-6, count * rounds / t_encN * 1e-6, \
+             count * rounds / t_dec1 * 1e-6, count * rounds / t_decN * 1e-6 ); \
+ \
+    free ( buf ); \
+    free ( decoded ); \
+    free ( values ); \
+}
+
+BENCH ( 16 )
+BENCH ( 32 )
+BENCH ( 64 )
+
+int main ( int argc, char * argv [] )
+{
+    size_t count = argc > 1 ? strtoul ( argv [ 1 ], NULL, 0 ) : 1000000;
+    unsigned rounds = argc > 2 ? strtoul ( argv [ 2 ], NULL, 0 ) : 20;
+    int dist;
+
+    if ( count == 0 || rounds == 0 )
+    {
+        fprintf ( stderr, "usage: %s [ count [ rounds ] ]\n", argv [ 0 ] );
+        return 1;
+    }
+
+    for ( dist = 0; dist < dist_count; ++ dist )
+    {
+        bench_uint16 ( dist, count, rounds );
+        bench_uint32 ( dist, count, rounds );
+        bench_uint64 ( dist, count, rounds );
+    }
+    return 0;
+}
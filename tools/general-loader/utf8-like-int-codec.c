@@ -685,3 +685,388 @@ int decode_uint64 ( uint8_t const* buf_start, uint8_t const* buf_xend, uint64_t*
 
     return ret;
 }
+
+
+/* bulk encoding/decoding
+ *  the only sequences that vectorize without shuffle tables are 1-byte ones,
+ *  which is also what counts and small deltas mostly are; anything else
+ *  goes through the single value functions above
+ */
+#if defined __AVX2__
+#include <immintrin.h>
+#define ASCII_RUN 32
+#elif defined __SSE2__
+#include <emmintrin.h>
+#define ASCII_RUN 16
+#endif
+
+#ifdef ASCII_RUN
+
+/* number of leading bytes of src, in whole ASCII_RUN blocks, that are all < 0x80 */
+static size_t ascii_run_bytes ( uint8_t const* src, size_t max )
+{
+    size_t n = 0;
+    for ( ; n + ASCII_RUN <= max; n += ASCII_RUN )
+    {
+#if defined __AVX2__
+        if ( _mm256_movemask_epi8 ( _mm256_loadu_si256 ( ( __m256i const* ) ( src + n ) ) ) != 0 )
+            break;
+#else
+        if ( _mm_movemask_epi8 ( _mm_loadu_si128 ( ( __m128i const* ) ( src + n ) ) ) != 0 )
+            break;
+#endif
+    }
+    return n;
+}
+
+/* widen n ( a multiple of 16 ) 1-byte sequences */
+static void widen_uint16 ( uint8_t const* src, size_t n, uint16_t* dst )
+{
+    __m128i const zero = _mm_setzero_si128 ();
+    size_t i;
+    for ( i = 0; i < n; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128 ( ( __m128i const* ) ( src + i ) );
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i ), _mm_unpacklo_epi8 ( v, zero ) );
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i + 8 ), _mm_unpackhi_epi8 ( v, zero ) );
+    }
+}
+
+static void widen_uint32 ( uint8_t const* src, size_t n, uint32_t* dst )
+{
+    __m128i const zero = _mm_setzero_si128 ();
+    size_t i;
+    for ( i = 0; i < n; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128 ( ( __m128i const* ) ( src + i ) );
+        __m128i lo = _mm_unpacklo_epi8 ( v, zero );
+        __m128i hi = _mm_unpackhi_epi8 ( v, zero );
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i ), _mm_unpacklo_epi16 ( lo, zero ) );
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i + 4 ), _mm_unpackhi_epi16 ( lo, zero ) );
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i + 8 ), _mm_unpacklo_epi16 ( hi, zero ) );
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i + 12 ), _mm_unpackhi_epi16 ( hi, zero ) );
+    }
+}
+
+static void widen_uint64 ( uint8_t const* src, size_t n, uint64_t* dst )
+{
+    __m128i const zero = _mm_setzero_si128 ();
+    size_t i;
+    for ( i = 0; i < n; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128 ( ( __m128i const* ) ( src + i ) );
+        __m128i w [ 2 ];
+        int j;
+        w [ 0 ] = _mm_unpacklo_epi8 ( v, zero );
+        w [ 1 ] = _mm_unpackhi_epi8 ( v, zero );
+        for ( j = 0; j < 2; ++ j )
+        {
+            __m128i lo = _mm_unpacklo_epi16 ( w [ j ], zero );
+            __m128i hi = _mm_unpackhi_epi16 ( w [ j ], zero );
+            uint64_t* d = dst + i + j * 8;
+            _mm_storeu_si128 ( ( __m128i* ) ( d ), _mm_unpacklo_epi32 ( lo, zero ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( d + 2 ), _mm_unpackhi_epi32 ( lo, zero ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( d + 4 ), _mm_unpacklo_epi32 ( hi, zero ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( d + 6 ), _mm_unpackhi_epi32 ( hi, zero ) );
+        }
+    }
+}
+
+/* number of leading values, in blocks of 16, that are all <= MAX_VALUE_BYTE_1; narrows them into dst */
+static size_t narrow_uint16 ( uint16_t const* values, size_t max, uint8_t* dst )
+{
+    __m128i const high = _mm_set1_epi16 ( ( short ) ~ MAX_VALUE_BYTE_1 );
+    __m128i const zero = _mm_setzero_si128 ();
+    size_t i;
+    for ( i = 0; i + 16 <= max; i += 16 )
+    {
+        __m128i a = _mm_loadu_si128 ( ( __m128i const* ) ( values + i ) );
+        __m128i b = _mm_loadu_si128 ( ( __m128i const* ) ( values + i + 8 ) );
+        if ( _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( _mm_and_si128 ( _mm_or_si128 ( a, b ), high ), zero ) ) != 0xFFFF )
+            break;
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i ), _mm_packus_epi16 ( a, b ) );
+    }
+    return i;
+}
+
+static size_t narrow_uint32 ( uint32_t const* values, size_t max, uint8_t* dst )
+{
+    __m128i const high = _mm_set1_epi32 ( ~ MAX_VALUE_BYTE_1 );
+    __m128i const zero = _mm_setzero_si128 ();
+    size_t i;
+    for ( i = 0; i + 16 <= max; i += 16 )
+    {
+        __m128i a = _mm_loadu_si128 ( ( __m128i const* ) ( values + i ) );
+        __m128i b = _mm_loadu_si128 ( ( __m128i const* ) ( values + i + 4 ) );
+        __m128i c = _mm_loadu_si128 ( ( __m128i const* ) ( values + i + 8 ) );
+        __m128i d = _mm_loadu_si128 ( ( __m128i const* ) ( values + i + 12 ) );
+        __m128i any = _mm_or_si128 ( _mm_or_si128 ( a, b ), _mm_or_si128 ( c, d ) );
+        if ( _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( _mm_and_si128 ( any, high ), zero ) ) != 0xFFFF )
+            break;
+        /* values are < 0x80, so the signed saturating pack is exact */
+        _mm_storeu_si128 ( ( __m128i* ) ( dst + i ),
+                           _mm_packus_epi16 ( _mm_packs_epi32 ( a, b ), _mm_packs_epi32 ( c, d ) ) );
+    }
+    return i;
+}
+
+static size_t narrow_uint64 ( uint64_t const* values, size_t max, uint8_t* dst )
+{
+    __m128i const high = _mm_set_epi32 ( -1, ~ MAX_VALUE_BYTE_1, -1, ~ MAX_VALUE_BYTE_1 );
+    __m128i const zero = _mm_setzero_si128 ();
+    size_t i;
+    for ( i = 0; i + 16 <= max; i += 16 )
+    {
+        __m128i any = zero;
+        size_t j;
+        for ( j = 0; j < 16; j += 2 )
+            any = _mm_or_si128 ( any, _mm_loadu_si128 ( ( __m128i const* ) ( values + i + j ) ) );
+        if ( _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( _mm_and_si128 ( any, high ), zero ) ) != 0xFFFF )
+            break;
+        for ( j = 0; j < 16; ++ j )
+            dst [ i + j ] = ( uint8_t ) values [ i + j ];
+    }
+    return i;
+}
+
+#endif /* ASCII_RUN */
+
+size_t encode_uint16_array ( uint16_t const* values, size_t count, uint8_t* buf_start, uint8_t* buf_xend, size_t* ret_bytes )
+{
+    uint8_t* dst = buf_start;
+    size_t i = 0;
+#ifdef ASCII_RUN
+    size_t probe = 0; /* where to try for a run of 1-byte values again */
+#endif
+
+    while ( i < count )
+    {
+        int num_writ;
+#ifdef ASCII_RUN
+        size_t max = count - i;
+        if ( max > ( size_t ) ( buf_xend - dst ) )
+            max = buf_xend - dst;
+        if ( max >= 16 && i >= probe && values [ i ] <= MAX_VALUE_BYTE_1 )
+        {
+            size_t n = narrow_uint16 ( values + i, max, dst );
+            if ( n == 0 )
+                probe = i + 16;
+            i += n;
+            dst += n;
+            if ( i == count )
+                break;
+        }
+#endif
+        num_writ = encode_uint16 ( values [ i ], dst, buf_xend );
+        if ( num_writ <= 0 )
+            break;
+        dst += num_writ;
+        ++ i;
+    }
+
+    * ret_bytes = dst - buf_start;
+    return i;
+}
+
+int decode_uint16_array ( uint8_t const* buf_start, uint8_t const* buf_xend, uint16_t* ret_values, size_t count, size_t* ret_count, size_t* ret_bytes )
+{
+    uint8_t const* src = buf_start;
+    size_t i = 0;
+    int ret = 1;
+#ifdef ASCII_RUN
+    size_t probe = 0; /* where to try for a run of 1-byte values again */
+#endif
+
+    while ( i < count && src < buf_xend )
+    {
+        int num_read;
+#ifdef ASCII_RUN
+        size_t max = count - i;
+        if ( max > ( size_t ) ( buf_xend - src ) )
+            max = buf_xend - src;
+        if ( max >= ASCII_RUN && i >= probe && src [ 0 ] <= MAX_VALUE_BYTE_1 )
+        {
+            size_t n = ascii_run_bytes ( src, max );
+            if ( n == 0 )
+                probe = i + ASCII_RUN;
+            widen_uint16 ( src, n, ret_values + i );
+            i += n;
+            src += n;
+            if ( i == count || src == buf_xend )
+                break;
+        }
+#endif
+        num_read = decode_uint16 ( src, buf_xend, ret_values + i );
+        if ( num_read <= 0 )
+        {
+            ret = num_read;
+            break;
+        }
+        src += num_read;
+        ++ i;
+    }
+
+    * ret_count = i;
+    * ret_bytes = src - buf_start;
+    return ret;
+}
+
+size_t encode_uint32_array ( uint32_t const* values, size_t count, uint8_t* buf_start, uint8_t* buf_xend, size_t* ret_bytes )
+{
+    uint8_t* dst = buf_start;
+    size_t i = 0;
+#ifdef ASCII_RUN
+    size_t probe = 0; /* where to try for a run of 1-byte values again */
+#endif
+
+    while ( i < count )
+    {
+        int num_writ;
+#ifdef ASCII_RUN
+        size_t max = count - i;
+        if ( max > ( size_t ) ( buf_xend - dst ) )
+            max = buf_xend - dst;
+        if ( max >= 16 && i >= probe && values [ i ] <= MAX_VALUE_BYTE_1 )
+        {
+            size_t n = narrow_uint32 ( values + i, max, dst );
+            if ( n == 0 )
+                probe = i + 16;
+            i += n;
+            dst += n;
+            if ( i == count )
+                break;
+        }
+#endif
+        num_writ = encode_uint32 ( values [ i ], dst, buf_xend );
+        if ( num_writ <= 0 )
+            break;
+        dst += num_writ;
+        ++ i;
+    }
+
+    * ret_bytes = dst - buf_start;
+    return i;
+}
+
+int decode_uint32_array ( uint8_t const* buf_start, uint8_t const* buf_xend, uint32_t* ret_values, size_t count, size_t* ret_count, size_t* ret_bytes )
+{
+    uint8_t const* src = buf_start;
+    size_t i = 0;
+    int ret = 1;
+#ifdef ASCII_RUN
+    size_t probe = 0; /* where to try for a run of 1-byte values again */
+#endif
+
+    while ( i < count && src < buf_xend )
+    {
+        int num_read;
+#ifdef ASCII_RUN
+        size_t max = count - i;
+        if ( max > ( size_t ) ( buf_xend - src ) )
+            max = buf_xend - src;
+        if ( max >= ASCII_RUN && i >= probe && src [ 0 ] <= MAX_VALUE_BYTE_1 )
+        {
+            size_t n = ascii_run_bytes ( src, max );
+            if ( n == 0 )
+                probe = i + ASCII_RUN;
+            widen_uint32 ( src, n, ret_values + i );
+            i += n;
+            src += n;
+            if ( i == count || src == buf_xend )
+                break;
+        }
+#endif
+        num_read = decode_uint32 ( src, buf_xend, ret_values + i );
+        if ( num_read <= 0 )
+        {
+            ret = num_read;
+            break;
+        }
+        src += num_read;
+        ++ i;
+    }
+
+    * ret_count = i;
+    * ret_bytes = src - buf_start;
+    return ret;
+}
+
+size_t encode_uint64_array ( uint64_t const* values, size_t count, uint8_t* buf_start, uint8_t* buf_xend, size_t* ret_bytes )
+{
+    uint8_t* dst = buf_start;
+    size_t i = 0;
+#ifdef ASCII_RUN
+    size_t probe = 0; /* where to try for a run of 1-byte values again */
+#endif
+
+    while ( i < count )
+    {
+        int num_writ;
+#ifdef ASCII_RUN
+        size_t max = count - i;
+        if ( max > ( size_t ) ( buf_xend - dst ) )
+            max = buf_xend - dst;
+        if ( max >= 16 && i >= probe && values [ i ] <= MAX_VALUE_BYTE_1 )
+        {
+            size_t n = narrow_uint64 ( values + i, max, dst );
+            if ( n == 0 )
+                probe = i + 16;
+            i += n;
+            dst += n;
+            if ( i == count )
+                break;
+        }
+#endif
+        num_writ = encode_uint64 ( values [ i ], dst, buf_xend );
+        if ( num_writ <= 0 )
+            break;
+        dst += num_writ;
+        ++ i;
+    }
+
+    * ret_bytes = dst - buf_start;
+    return i;
+}
+
+int decode_uint64_array ( uint8_t const* buf_start, uint8_t const* buf_xend, uint64_t* ret_values, size_t count, size_t* ret_count, size_t* ret_bytes )
+{
+    uint8_t const* src = buf_start;
+    size_t i = 0;
+    int ret = 1;
+#ifdef ASCII_RUN
+    size_t probe = 0; /* where to try for a run of 1-byte values again */
+#endif
+
+    while ( i < count && src < buf_xend )
+    {
+        int num_read;
+#ifdef ASCII_RUN
+        size_t max = count - i;
+        if ( max > ( size_t ) ( buf_xend - src ) )
+            max = buf_xend - src;
+        if ( max >= ASCII_RUN && i >= probe && src [ 0 ] <= MAX_VALUE_BYTE_1 )
+        {
+            size_t n = ascii_run_bytes ( src, max );
+            if ( n == 0 )
+                probe = i + ASCII_RUN;
+            widen_uint64 ( src, n, ret_values + i );
+            i += n;
+            src += n;
+            if ( i == count || src == buf_xend )
+                break;
+        }
+#endif
+        num_read = decode_uint64 ( src, buf_xend, ret_values + i );
+        if ( num_read <= 0 )
+        {
+            ret = num_read;
+            break;
+        }
+        src += num_read;
+        ++ i;
+    }
+
+    * ret_count = i;
+    * ret_bytes = src - buf_start;
+    return ret;
+}
@@ -60,6 +60,28 @@ int decode_uint32 ( uint8_t const* buf_start, uint8_t const* buf_xend, uint32_t*
 int encode_uint64 ( uint64_t value_to_encode, uint8_t* buf_start, uint8_t* buf_xend );
 int decode_uint64 ( uint8_t const* buf_start, uint8_t const* buf_xend, uint64_t* ret_decoded );
 
+/*
+bulk versions of the above, producing the same bytes as calling encode_uintXX/decode_uintXX
+in a loop; runs of 1-byte values are handled 16 or 32 at a time where SSE2/AVX2 is available
+
+all encode_uintXX_array encode values [ 0, count ) until one does not fit and return:
+    the number of values encoded, *ret_bytes: number of bytes written to buf_start
+
+all decode_uintXX_array decode until count values are decoded or buf_xend is reached and return:
+    value <= 0: error:   one of CODEC_* above, CODEC_INSUFFICIENT_BUFFER for a truncated last value
+    value > 0:  success
+    in either case *ret_count values were decoded from the first *ret_bytes bytes of buf_start
+*/
+
+size_t encode_uint16_array ( uint16_t const* values, size_t count, uint8_t* buf_start, uint8_t* buf_xend, size_t* ret_bytes );
+int decode_uint16_array ( uint8_t const* buf_start, uint8_t const* buf_xend, uint16_t* ret_values, size_t count, size_t* ret_count, size_t* ret_bytes );
+
+size_t encode_uint32_array ( uint32_t const* values, size_t count, uint8_t* buf_start, uint8_t* buf_xend, size_t* ret_bytes );
+int decode_uint32_array ( uint8_t const* buf_start, uint8_t const* buf_xend, uint32_t* ret_values, size_t count, size_t* ret_count, size_t* ret_bytes );
+
+size_t encode_uint64_array ( uint64_t const* values, size_t count, uint8_t* buf_start, uint8_t* buf_xend, size_t* ret_bytes );
+int decode_uint64_array ( uint8_t const* buf_start, uint8_t const* buf_xend, uint64_t* ret_values, size_t count, size_t* ret_count, size_t* ret_bytes );
+
 
 #ifdef __cplusplus
 }
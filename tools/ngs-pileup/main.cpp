@@ -36,8 +36,10 @@
 
 #include <sysalloc.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include <iostream>
+#include <limits>
 
 #define OPTION_REF     "aligned-region"
 #define ALIAS_REF      "r"
@@ -45,11 +47,17 @@ const char * ref_usage[] = { "Filter by position on genome.",
                              "Name can either be file specific or canonical",
                              "(ex: \"chr1\" or \"1\").",
                              "\"from\" and \"to\" are 1-based coordinates",
+                             "(ex: \"chr1:1000-2000\"), may be repeated",
                              NULL };
                              
+#define OPTION_THREADS "threads"
+const char * threads_usage[] = { "Number of threads walking references, default 1.",
+                                 NULL };
+                             
 OptDef options[] =
 {   /*name,           alias,         hfkt, usage-help,    maxcount, needs value, required */
     { OPTION_REF,     ALIAS_REF,     NULL, ref_usage,     0,        true,        false },
+    { OPTION_THREADS, NULL,          NULL, threads_usage, 1,        true,        false },
 };
 
 
@@ -81,6 +89,9 @@ rc_t CC Usage ( const Args * args )
     UsageSummary ( progname );
     KOutMsg ( "Options:\n" );
    
+    HelpOptionLine ( ALIAS_REF, OPTION_REF, "name[:from-to]", ref_usage );
+    HelpOptionLine ( NULL, OPTION_THREADS, "count", threads_usage );
+    
     HelpOptionsStandard ();
     HelpVersion ( fullpath, KAppVersion() );
     
@@ -97,6 +108,46 @@ ver_t CC KAppVersion ( void )
 {
     return NGS_PILEUP_VERS;
 }
+
+/* name[:from[-to]] */
+static
+void AddRegion ( NGS_Pileup::Settings& settings, const std::string& region )
+{
+    std::string::size_type colon = region . rfind ( ':' );
+    if ( colon != std::string::npos && colon + 1 < region . size () )
+    {
+        const char * from = region . c_str () + colon + 1;
+        char * end;
+        int64_t first = strtoll ( from, & end, 10 );
+        if ( end != from && first > 0 )
+        {
+            const int64_t toEnd = std::numeric_limits < int64_t > :: max ();
+            int64_t last = toEnd;
+            if ( * end == '-' )
+            {
+                const char * to = end + 1;
+                last = strtoll ( to, & end, 10 );
+                if ( end == to )
+                {
+                    last = toEnd;
+                }
+            }
+            if ( * end == 0 )
+            {
+                if ( last < first )
+                {
+                    throw ngs :: ErrorMsg ( "invalid region: " + region );
+                }
+                settings . AddReferenceSlice ( region . substr ( 0, colon ), 
+                                               first - 1, 
+                                               last == toEnd ? toEnd : last - first + 1 );
+                return;
+            }
+        }
+    }
+    settings . AddReference ( region );
+}
+
 rc_t CC KMain( int argc, char *argv [] )
 {
     Args * args;
@@ -111,19 +162,32 @@ rc_t CC KMain( int argc, char *argv [] )
             uint32_t pcount;
             
             rc = ArgsOptionCount ( args, OPTION_REF, &pcount );
-            if ( pcount > 1 )
+            for ( uint32_t i = 0; rc == 0 && i < pcount; ++ i )
             {
-                throw ngs :: ErrorMsg ( "multiple positions are not supported at this point" );
+                const char * value;
+                rc = ArgsOptionValue ( args, OPTION_REF, i, & value );  
+                if ( rc != 0 )
+                {
+                    throw ngs :: ErrorMsg ( "ArgsOptionValue (" OPTION_REF ") failed" );
+                }
+                AddRegion ( settings, value );
             }
-            if ( pcount == 1 )
+            
+            rc = ArgsOptionCount ( args, OPTION_THREADS, &pcount );
+            if ( rc == 0 && pcount == 1 )
             {
                 const char * value;
-                rc = ArgsOptionValue ( args, OPTION_REF, 0, & value );  
+                rc = ArgsOptionValue ( args, OPTION_THREADS, 0, & value );  
                 if ( rc != 0 )
                 {
-                    throw ngs :: ErrorMsg ( "ArgsOptionValue (" OPTION_REF ") failed" );
+                    throw ngs :: ErrorMsg ( "ArgsOptionValue (" OPTION_THREADS ") failed" );
+                }
+                int threads = atoi ( value );
+                if ( threads < 1 )
+                {
+                    throw ngs :: ErrorMsg ( "invalid number of threads" );
                 }
-                settings . AddReference ( value );
+                settings . threads = threads;
             }
             
             rc = ArgsParamCount ( args, &pcount );
@@ -27,44 +27,86 @@
 #include "ngs-pileup.hpp"
 
 #include <iostream>
+#include <sstream>
+#include <algorithm>
 
 #include <ngs/ncbi/NGS.hpp>
+#include <ngs/ErrorMsg.hpp>
 #include <ngs/ReadCollection.hpp>
 #include <ngs/PileupIterator.hpp>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
 using namespace std;
 
+typedef vector < ngs :: ReadCollection > Collections;
+
+static
+void OpenCollections ( const NGS_Pileup :: Settings :: Inputs & p_inputs, Collections & p_cols )
+{
+    for ( NGS_Pileup :: Settings :: Inputs :: const_iterator i = p_inputs . begin(); 
+          i != p_inputs . end (); 
+          ++i )
+    {   
+        p_cols . push_back ( ncbi :: NGS :: openReadCollection ( *i ) );
+    }
+}
+
 struct NGS_Pileup::TargetReference
 {
-    typedef pair < int64_t, int64_t >       Slice;
+    typedef pair < int64_t, int64_t >       Slice; /* first, last; 0-based, inclusive */
     typedef vector < Slice >                Slices;
-    typedef vector < ngs :: Reference >     Targets;
-    typedef vector < ngs :: PileupIterator> Pileups;
+    
+    /* the same reference in one of the inputs, reopened by each thread walking it */
+    struct Source
+    {
+        size_t m_input;
+        string m_commonName;
+    };
+    typedef vector < Source >               Sources;
     
     string  m_canonicalName;
-    Slices  m_slices;
-    Targets m_targets;
-    Pileups m_pileups;
+    int64_t m_length;
+    Slices  m_slices;   /* sorted, not overlapping */
+    Sources m_sources;
     bool    m_complete;
     
-    TargetReference ( ngs :: Reference p_ref )
-    : m_canonicalName ( p_ref . getCanonicalName() ), m_complete ( true )
-    {
-        AddReference ( p_ref );
-    }
-    TargetReference ( ngs :: Reference p_ref, 
-                      int64_t p_first, 
-                      int64_t p_last )
-    : m_canonicalName ( p_ref . getCanonicalName() ), m_complete ( false )
+    TargetReference ( const ngs :: Reference & p_ref, size_t p_input )
+    : m_canonicalName ( p_ref . getCanonicalName() ), m_length ( p_ref . getLength () ), m_complete ( false )
     {
-        AddReference ( p_ref );
+        AddReference ( p_ref, p_input );
     }
     ~TargetReference ()
     {
     }
     
-    void AddSlice ( int64_t p_first, int64_t p_last )
+    void AddSlice ( int64_t p_first, int64_t p_length )
     {
+        if ( m_complete || p_first < 0 || p_first >= m_length || p_length <= 0 )
+        {
+            return;
+        }
+        if ( p_length > m_length - p_first )
+        {
+            p_length = m_length - p_first;
+        }
+        
+        // merge with the overlapping and adjacent slices so no position is reported twice
+        Slice slice ( p_first, p_first + p_length - 1 );
+        Slices :: iterator i = m_slices . begin ();
+        while ( i != m_slices . end () && i -> second + 1 < slice . first )
+        {
+            ++ i;
+        }
+        while ( i != m_slices . end () && i -> first <= slice . second + 1 )
+        {
+            slice . first = min ( slice . first, i -> first );
+            slice . second = max ( slice . second, i -> second );
+            i = m_slices . erase ( i );
+        }
+        m_slices . insert ( i, slice );
     }
     void MakeComplete ()
     {
@@ -72,27 +114,31 @@ struct NGS_Pileup::TargetReference
         m_slices . clear();
     }
     
-    void AddReference ( ngs :: Reference p_ref )
+    void AddReference ( const ngs :: Reference & p_ref, size_t p_input )
     {
-        m_targets. push_back ( p_ref );
+        Source src;
+        src . m_input = p_input;
+        src . m_commonName = p_ref . getCommonName ();
+        m_sources . push_back ( src );
     }
     
-    void Process ( ostream& out )
+    void Process ( const Collections & p_cols, int64_t p_first, int64_t p_last, ostream& out ) const
     {
-        int64_t firstPos = 0;
-        int64_t lastPos = m_targets . front () . getLength () - 1;
-
-        // create pileup iterators 
-        for ( Targets::iterator i = m_targets.begin(); i != m_targets.end(); ++i ) 
+        typedef vector < ngs :: PileupIterator> Pileups;
+        Pileups pileups;
+        
+        // create pileup iterators over the window only
+        for ( Sources::const_iterator i = m_sources.begin(); i != m_sources.end(); ++i ) 
         {
-            m_pileups . push_back ( i -> getPileups ( ngs::Alignment::all ) );
+            ngs :: Reference ref = p_cols [ i -> m_input ] . getReference ( i -> m_commonName );
+            pileups . push_back ( ref . getPileupSlice ( p_first, p_last - p_first + 1, ngs::Alignment::all ) );
         }
         
-        int64_t curPos = firstPos;
-        while ( curPos <= lastPos ) 
+        int64_t curPos = p_first;
+        while ( curPos <= p_last ) 
         {
             uint32_t total_depth = 0;
-            for ( Pileups :: iterator i = m_pileups . begin (); i != m_pileups. end (); ++i )
+            for ( Pileups :: iterator i = pileups . begin (); i != pileups. end (); ++i )
             {
                 bool next = i -> nextPileup ();
                 assert ( next );
@@ -104,7 +150,7 @@ struct NGS_Pileup::TargetReference
                 out << m_canonicalName
                     << '\t' << ( curPos + 1 ) // convert to 1-based position to emulate samtools
                     << '\t' << total_depth
-                    << endl;
+                    << '\n';
             }
             
             ++ curPos;
@@ -115,66 +161,325 @@ struct NGS_Pileup::TargetReference
 class NGS_Pileup::TargetReferences : public vector < TargetReference >
 {
 public :
-    void AddComplete ( ngs :: Reference ref )
+    TargetReference & Add ( const ngs :: Reference & ref, size_t input )
     {
         string name = ref . getCanonicalName ();
         for ( iterator i = begin(); i != end (); ++ i )
         {   
             if ( i -> m_canonicalName == name )
             {
-                i -> AddReference ( ref );
-                return;
+                i -> AddReference ( ref, input );
+                return * i;
             }
         }
         // not found - add new reference
-        push_back ( TargetReference ( ref ) );
+        push_back ( TargetReference ( ref, input ) );
+        return back ();
     }
 };
- 
-NGS_Pileup::NGS_Pileup ( const Settings& p_settings )
-: m_settings( p_settings )
+
+/* walks target references in windows of limited size, on several threads if requested; 
+   output of the windows is written in order */
+class NGS_Pileup::Walker
 {
-}
+public:
+    static const int64_t WindowSize = 256 * 1024;
+    
+    Walker ( const Settings& p_settings, const TargetReferences& p_references );
+    ~Walker ();
+    
+    void Run ( ostream& out );
+    
+private:
+    struct Window
+    {
+        const TargetReference* m_target;
+        int64_t m_first;
+        int64_t m_last;
+    };
+    typedef vector < Window > Windows;
+    
+    struct Chunk
+    {
+        string  m_text;
+        bool    m_done;
+    };
+    typedef vector < Chunk > Chunks;
+    
+    static rc_t CC WorkerMain ( const KThread * self, void * data );
+    void Work ();
+    
+    // called under lock
+    bool TakeWindow ( size_t& p_idx );
+    void Fail ( const string& p_message );
+    
+    void Join ();
+    
+    const Settings& m_settings;
+    Windows         m_windows;
+    
+    vector < KThread* > m_threads;
+    Chunks  m_chunks;           /* ring of windows in flight */
+    size_t  m_nextWindow;       /* next window to take by a worker */
+    size_t  m_writtenWindow;    /* next window to write */
+    
+    KLock*      m_lock;
+    KCondition* m_windowDone;   /* worker -> writer */
+    KCondition* m_chunkFree;    /* writer -> workers */
+    
+    bool    m_failed;
+    string  m_error;
+};
 
-static
-bool FindReference ( const NGS_Pileup :: Settings :: References & requested, const ngs :: Reference & ref )
+NGS_Pileup::Walker::Walker ( const Settings& p_settings, const TargetReferences& p_references )
+:   m_settings ( p_settings ),
+    m_nextWindow ( 0 ),
+    m_writtenWindow ( 0 ),
+    m_lock ( 0 ),
+    m_windowDone ( 0 ),
+    m_chunkFree ( 0 ),
+    m_failed ( false )
 {
-    for ( NGS_Pileup :: Settings :: References :: const_iterator i = requested . begin(); 
-          i != requested . end (); 
-          ++i )
+    for ( TargetReferences :: const_iterator i = p_references . begin(); i != p_references . end (); ++i )
     {   
-        if ( i->m_name == ref . getCanonicalName () || i->m_name == ref . getCommonName () )
+        TargetReference :: Slices slices = i -> m_slices;
+        if ( i -> m_complete )
+        {
+            slices . push_back ( TargetReference :: Slice ( 0, i -> m_length - 1 ) );
+        }
+        for ( TargetReference :: Slices :: const_iterator s = slices . begin(); s != slices . end (); ++s )
+        {   
+            for ( int64_t first = s -> first; first <= s -> second; first += WindowSize )
+            {
+                Window w;
+                w . m_target = & * i;
+                w . m_first = first;
+                w . m_last = min ( s -> second, first + WindowSize - 1 );
+                m_windows . push_back ( w );
+            }
+        }
+    }
+}
+
+NGS_Pileup::Walker::~Walker ()
+{
+    Join ();
+    KConditionRelease ( m_chunkFree );
+    KConditionRelease ( m_windowDone );
+    KLockRelease ( m_lock );
+}
+
+void 
+NGS_Pileup::Walker::Run ( ostream& out )
+{
+    size_t threads = min ( (size_t)m_settings . threads, m_windows . size () );
+    if ( threads <= 1 )
+    {
+        Collections cols;
+        OpenCollections ( m_settings . inputs, cols );
+        for ( Windows :: const_iterator i = m_windows . begin(); i != m_windows . end (); ++i )
+        {   
+            i -> m_target -> Process ( cols, i -> m_first, i -> m_last, out );
+        }
+        out . flush ();
+        return;
+    }
+    
+    if ( KLockMake ( & m_lock ) != 0 || 
+         KConditionMake ( & m_windowDone ) != 0 || 
+         KConditionMake ( & m_chunkFree ) != 0 )
+    {
+        throw ngs :: ErrorMsg ( "failed to create synchronization objects" );
+    }
+    
+    // 2 chunks per thread: one being filled, one waiting to be written
+    Chunk chunk;
+    chunk . m_done = false;
+    m_chunks . resize ( 2 * threads, chunk );
+    
+    for ( size_t i = 0; i < threads; ++ i )
+    {
+        KThread* t;
+        if ( KThreadMake ( & t, WorkerMain, this ) != 0 )
+        {
+            KLockAcquire ( m_lock );
+            Fail ( "failed to create a thread" );
+            KLockUnlock ( m_lock );
+            break;
+        }
+        m_threads . push_back ( t );
+    }
+    
+    KLockAcquire ( m_lock );
+    while ( ! m_failed && m_writtenWindow < m_windows . size () )
+    {
+        Chunk& c = m_chunks [ m_writtenWindow % m_chunks . size () ];
+        if ( ! c . m_done )
+        {
+            KConditionWait ( m_windowDone, m_lock );
+            continue;
+        }
+        
+        // the chunk is not touched by workers until it is written and released
+        KLockUnlock ( m_lock );
+        out . write ( c . m_text . data (), c . m_text . size () );
+        KLockAcquire ( m_lock );
+        
+        c . m_done = false;
+        ++ m_writtenWindow;
+        KConditionBroadcast ( m_chunkFree );
+    }
+    KLockUnlock ( m_lock );
+    
+    Join ();
+    out . flush ();
+    
+    if ( m_failed )
+    {
+        throw ngs :: ErrorMsg ( m_error );
+    }
+}
+
+rc_t CC
+NGS_Pileup::Walker::WorkerMain ( const KThread * self, void * data )
+{
+    Walker* walker = ( Walker * ) data;
+    try
+    {
+        walker -> Work ();
+    }
+    catch ( exception& ex )
+    {
+        KLockAcquire ( walker -> m_lock );
+        walker -> Fail ( ex . what () );
+        KLockUnlock ( walker -> m_lock );
+    }
+    catch ( ... )
+    {
+        KLockAcquire ( walker -> m_lock );
+        walker -> Fail ( "unknown exception in a worker thread" );
+        KLockUnlock ( walker -> m_lock );
+    }
+    return 0;
+}
+
+void 
+NGS_Pileup::Walker::Work ()
+{
+    // each thread uses its own collections and iterators
+    Collections cols;
+    OpenCollections ( m_settings . inputs, cols );
+    
+    ostringstream out;
+    size_t idx;
+    while ( true )
+    {
+        KLockAcquire ( m_lock );
+        bool more = TakeWindow ( idx );
+        KLockUnlock ( m_lock );
+        if ( ! more )
+        {
+            break;
+        }
+        
+        const Window& w = m_windows [ idx ];
+        out . str ( string () );
+        w . m_target -> Process ( cols, w . m_first, w . m_last, out );
+        
+        Chunk& c = m_chunks [ idx % m_chunks . size () ];
+        c . m_text = out . str ();
+        
+        KLockAcquire ( m_lock );
+        c . m_done = true;
+        KConditionBroadcast ( m_windowDone );
+        KLockUnlock ( m_lock );
+    }
+}
+
+bool 
+NGS_Pileup::Walker::TakeWindow ( size_t& p_idx )
+{
+    while ( ! m_failed && m_nextWindow < m_windows . size () )
+    {
+        if ( m_nextWindow < m_writtenWindow + m_chunks . size () )
         {
+            p_idx = m_nextWindow ++;
             return true;
         }
+        KConditionWait ( m_chunkFree, m_lock );
     }
     return false;
 }
-    
+
+void 
+NGS_Pileup::Walker::Fail ( const string& p_message )
+{
+    if ( ! m_failed )
+    {
+        m_failed = true;
+        m_error = p_message;
+    }
+    KConditionBroadcast ( m_windowDone );
+    KConditionBroadcast ( m_chunkFree );
+}
+
+void 
+NGS_Pileup::Walker::Join ()
+{
+    for ( vector < KThread* > :: iterator i = m_threads . begin(); i != m_threads . end (); ++i )
+    {   
+        KThreadWait ( *i, NULL );
+        KThreadRelease ( *i );
+    }
+    m_threads . clear ();
+}
+ 
+NGS_Pileup::NGS_Pileup ( const Settings& p_settings )
+: m_settings( p_settings )
+{
+}
+
 void 
 NGS_Pileup::Run () const
 {
     TargetReferences references;
     
     // build the set of target references
-    for ( Settings :: Inputs :: const_iterator i = m_settings . inputs . begin(); 
-          i != m_settings . inputs . end (); 
-          ++i )
+    Collections cols;
+    OpenCollections ( m_settings . inputs, cols );
+    for ( size_t input = 0; input < cols . size (); ++ input )
     {   
-        ngs :: ReadCollection col = ncbi :: NGS :: openReadCollection ( *i );
-        ngs :: ReferenceIterator refIt = col . getReferences ();
+        ngs :: ReferenceIterator refIt = cols [ input ] . getReferences ();
         while ( refIt . nextReference () )
         {
             if ( m_settings . references . empty () ) // all references requested
             {
                 /* need to create a Reference object that is not attached to the iterator, so as
                     it is not invalidated on the next call to refIt.NextReference() */
-                references . AddComplete ( col . getReference ( refIt. getCommonName () ) );
+                references . Add ( cols [ input ] . getReference ( refIt. getCommonName () ), input ) . MakeComplete ();
+                continue;
             }
-            else if ( FindReference ( m_settings . references, refIt ) )
-            {
-                //TODO: handle slices
-                references . AddComplete ( col . getReference ( refIt. getCommonName () ) );
+            
+            TargetReference* target = 0;
+            for ( Settings :: References :: const_iterator i = m_settings . references . begin(); 
+                  i != m_settings . references . end (); 
+                  ++i )
+            {   
+                if ( i->m_name == refIt . getCanonicalName () || i->m_name == refIt . getCommonName () )
+                {
+                    if ( target == 0 )
+                    {
+                        target = & references . Add ( cols [ input ] . getReference ( refIt. getCommonName () ), input );
+                    }
+                    if ( i -> m_full )
+                    {
+                        target -> MakeComplete ();
+                    }
+                    else
+                    {
+                        target -> AddSlice ( i -> m_firstPos, i -> m_length );
+                    }
+                }
             }
         }
     }
@@ -182,10 +487,7 @@ NGS_Pileup::Run () const
     ostream & out ( m_settings . output != (ostream*)0 ? * m_settings . output : cout );
     
     // walk the references and output pileups
-    for ( TargetReferences :: iterator i = references . begin(); i != references . end (); ++i )
-    {   
-        i -> Process ( out );
-    }
+    Walker ( m_settings, references ) . Run ( out );
 }
 
 //// NGS_Pileup::Settings
@@ -199,8 +501,8 @@ NGS_Pileup::Settings::AddReference ( const string& commonOrCanonicalName )
 void 
 NGS_Pileup::Settings::AddReferenceSlice ( const string& commonOrCanonicalName, 
                                         int64_t firstPos, 
-                                        int64_t lastPos )
+                                        int64_t length )
 { 
-    references . push_back ( ReferenceSlice ( commonOrCanonicalName, firstPos, lastPos ) ); 
+    references . push_back ( ReferenceSlice ( commonOrCanonicalName, firstPos, length ) ); 
 }
 
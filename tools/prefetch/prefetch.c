@@ -54,6 +54,11 @@
 #include <kfs/gzip.h> /* KFileMakeGzipForRead */
 #include <kfs/subfile.h> /* KFileMakeSubRead */
 
+#include <kproc/cond.h> /* KCondition */
+#include <kproc/lock.h> /* KLock */
+#include <kproc/thread.h> /* KThread */
+
+#include <klib/checksum.h> /* MD5State */
 #include <klib/container.h> /* BSTree */
 #include <klib/data-buffer.h> /* KDataBuffer */
 #include <klib/log.h> /* PLOGERR */
@@ -189,6 +194,8 @@ typedef struct {
     size_t maxSize;
     uint64_t heartbeat;
 
+    uint32_t parallel; /* number of concurrent http connections per file */
+
     bool noAscp;
     bool noHttp;
 
@@ -954,8 +961,693 @@ static rc_t MainDownloaded(Main *self, const char *path) {
     return 0;
 }
 
-static rc_t MainDownloadFile(Resolved *self,
-    Main *main, const char *to)
+/********** Md5Pipe **********/
+
+/* Digests the downloaded data on its own thread
+   while the next chunk is being fetched.
+   The downloader fills one of MD5_PIPE_SLOTS buffers and posts it;
+   the digest thread appends the posted buffers to MD5 in order. */
+#define MD5_PIPE_SLOTS 4
+
+typedef struct {
+    KLock *lock;
+    KCondition *cond;
+    KThread *thread;
+
+    void *buffer[MD5_PIPE_SLOTS];
+    size_t size[MD5_PIPE_SLOTS];
+    uint64_t head; /* next slot to digest */
+    uint64_t tail; /* next slot to fill */
+    bool done;
+
+    MD5State *md5;
+} Md5Pipe;
+
+static rc_t CC Md5PipeThread(const KThread *thread, void *data) {
+    Md5Pipe *self = data;
+    rc_t rc = 0;
+
+    assert(self);
+
+    rc = KLockAcquire(self->lock);
+    while (rc == 0) {
+        uint32_t slot = 0;
+
+        while (rc == 0 && self->head == self->tail && !self->done) {
+            rc = KConditionWait(self->cond, self->lock);
+        }
+        if (rc != 0 || self->head == self->tail) {
+            break;
+        }
+
+        slot = self->head % MD5_PIPE_SLOTS;
+        KLockUnlock(self->lock);
+
+        MD5StateAppend(self->md5, self->buffer[slot], self->size[slot]);
+
+        rc = KLockAcquire(self->lock);
+        if (rc == 0) {
+            ++self->head;
+            KConditionBroadcast(self->cond);
+        }
+    }
+    if (rc == 0) {
+        KLockUnlock(self->lock);
+    }
+
+    return rc;
+}
+
+static rc_t Md5PipeInit(Md5Pipe *self, MD5State *md5, size_t bsize) {
+    rc_t rc = 0;
+    uint32_t i = 0;
+
+    assert(self && md5);
+    memset(self, 0, sizeof *self);
+    self->md5 = md5;
+
+    for (i = 0; i < MD5_PIPE_SLOTS; ++i) {
+        self->buffer[i] = malloc(bsize);
+        if (self->buffer[i] == NULL) {
+            return RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+        }
+    }
+
+    rc = KLockMake(&self->lock);
+    DISP_RC(rc, "KLockMake");
+    if (rc == 0) {
+        rc = KConditionMake(&self->cond);
+        DISP_RC(rc, "KConditionMake");
+    }
+    if (rc == 0) {
+        rc = KThreadMake(&self->thread, Md5PipeThread, self);
+        DISP_RC(rc, "KThreadMake");
+    }
+
+    return rc;
+}
+
+/* returns a free buffer of bsize bytes to read the next chunk into */
+static rc_t Md5PipeGetBuffer(Md5Pipe *self, void **buffer) {
+    rc_t rc = 0;
+
+    assert(self && buffer);
+
+    rc = KLockAcquire(self->lock);
+    while (rc == 0 && self->tail - self->head == MD5_PIPE_SLOTS) {
+        rc = KConditionWait(self->cond, self->lock);
+    }
+    if (rc == 0) {
+        *buffer = self->buffer[self->tail % MD5_PIPE_SLOTS];
+        KLockUnlock(self->lock);
+    }
+
+    return rc;
+}
+
+/* hands the buffer returned by Md5PipeGetBuffer to the digest thread */
+static rc_t Md5PipePost(Md5Pipe *self, size_t size) {
+    rc_t rc = 0;
+
+    assert(self);
+
+    rc = KLockAcquire(self->lock);
+    if (rc == 0) {
+        self->size[self->tail % MD5_PIPE_SLOTS] = size;
+        ++self->tail;
+        KConditionBroadcast(self->cond);
+        KLockUnlock(self->lock);
+    }
+
+    return rc;
+}
+
+/* waits until all posted data is digested */
+static rc_t Md5PipeWhack(Md5Pipe *self) {
+    rc_t rc = 0;
+    uint32_t i = 0;
+
+    assert(self);
+
+    if (self->thread != NULL) {
+        rc_t status = 0;
+        if (KLockAcquire(self->lock) == 0) {
+            self->done = true;
+            KConditionBroadcast(self->cond);
+            KLockUnlock(self->lock);
+        }
+        rc = KThreadWait(self->thread, &status);
+        if (rc == 0) {
+            rc = status;
+        }
+        RELEASE(KThread, self->thread);
+    }
+
+    RELEASE(KCondition, self->cond);
+    RELEASE(KLock, self->lock);
+
+    for (i = 0; i < MD5_PIPE_SLOTS; ++i) {
+        free(self->buffer[i]);
+        self->buffer[i] = NULL;
+    }
+
+    return rc;
+}
+
+/********** Segmented (parallel) http download **********/
+
+/* The remote file is split into segments of PAR_SEGMENT_SIZE bytes.
+   Workers fetch the segments over their own http connections
+   and write them in place into a preallocated "<cache>.part" file.
+   Completed segments are appended to the "<cache>.part.ranges" sidecar:
+   the first line is "<file size> <segment size>",
+   every next line is the index of a completed segment.
+   An interrupted download is resumed from the sidecar;
+   neither file starts with "<cache>.tmp" so _KDirectoryClean keeps them.
+   When the file is verified a separate thread digests the segments
+   in file order as soon as they are complete. */
+#define PAR_SEGMENT_SIZE ( 64 * 1024 * 1024 )
+
+typedef struct {
+    Resolved *resolved;
+    const Main *main;
+    const char *part;
+
+    KFile *out;
+    KFile *ranges;
+    uint64_t rangesPos;
+
+    uint64_t remoteSz;
+    uint64_t segSz;
+    uint64_t nSeg;
+    bool *done;
+    uint64_t next;
+    uint64_t nDone;
+
+    KLock *lock;
+    KCondition *cond; /* signaled when a segment is complete */
+    bool finished; /* all workers have exited */
+    rc_t rc; /* the first error reported by a worker */
+
+    MD5State *md5;
+} ParDownload;
+
+static rc_t ParDownloadFinishSegment(ParDownload *self, uint64_t seg) {
+    rc_t rc = 0;
+    char line[32] = "";
+    size_t num_writ = 0;
+
+    assert(self && seg < self->nSeg);
+
+    rc = string_printf(line, sizeof line, &num_writ, "%lu\n", seg);
+    if (rc == 0) {
+        rc = KFileWriteAll(self->ranges,
+            self->rangesPos, line, num_writ, &num_writ);
+        self->rangesPos += num_writ;
+    }
+    if (rc == 0) {
+        self->done[seg] = true;
+        ++self->nDone;
+    }
+    return rc;
+}
+
+static bool ParDownloadNextSegment(ParDownload *self, uint64_t *seg) {
+    assert(self && seg);
+
+    if (self->rc != 0) {
+        return false;
+    }
+    while (self->next < self->nSeg && self->done[self->next]) {
+        ++self->next;
+    }
+    if (self->next >= self->nSeg) {
+        return false;
+    }
+    *seg = self->next++;
+    return true;
+}
+
+static rc_t ParDownloadSegment(ParDownload *self,
+    const KFile *in, void *buffer, uint64_t seg)
+{
+    rc_t rc = 0;
+    uint64_t pos = seg * self->segSz;
+    uint64_t end = pos + self->segSz;
+
+    if (end > self->remoteSz) {
+        end = self->remoteSz;
+    }
+
+    while (rc == 0 && pos < end) {
+        size_t num_read = 0;
+        size_t num_writ = 0;
+        size_t size = self->main->bsize;
+        if (size > end - pos) {
+            size = end - pos;
+        }
+
+        rc = Quitting();
+        if (rc == 0) {
+            rc = KFileRead(in, pos, buffer, size, &num_read);
+            if (rc != 0) {
+                DISP_RC2(rc, "Cannot KFileRead",
+                    self->resolved->remote.str->addr);
+            }
+            else if (num_read == 0) {
+                rc = RC(rcExe, rcFile, rcReading, rcTransfer, rcIncomplete);
+                PLOGERR(klogErr, (klogErr, rc,
+                    "$(path) ends at $(pos): expected size is $(size)",
+                    "path=%S,pos=%lu,size=%lu",
+                    self->resolved->remote.str, pos, self->remoteSz));
+            }
+        }
+        if (rc == 0) {
+            rc = KFileWriteAll(self->out, pos, buffer, num_read, &num_writ);
+            DISP_RC2(rc, "Cannot KFileWrite", self->part);
+            pos += num_writ;
+        }
+    }
+
+    return rc;
+}
+
+static rc_t CC ParDownloadThread(const KThread *thread, void *data) {
+    ParDownload *self = data;
+    const KFile *in = NULL;
+    void *buffer = NULL;
+    rc_t rc = 0;
+
+    assert(self && self->main && self->resolved);
+
+    buffer = malloc(self->main->bsize);
+    if (buffer == NULL) {
+        rc = RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    if (rc == 0) {
+        rc = _KFileOpenRemote(&in,
+            self->main->kns, self->resolved->remote.str->addr);
+        if (rc != 0) {
+            PLOGERR(klogInt, (klogInt, rc, "failed to open file for $(path)",
+                "path=%S", self->resolved->remote.str));
+        }
+    }
+
+    while (rc == 0) {
+        uint64_t seg = 0;
+        bool found = false;
+
+        rc = KLockAcquire(self->lock);
+        if (rc == 0) {
+            found = ParDownloadNextSegment(self, &seg);
+            KLockUnlock(self->lock);
+        }
+        if (rc != 0 || !found) {
+            break;
+        }
+
+        rc = ParDownloadSegment(self, in, buffer, seg);
+
+        if (KLockAcquire(self->lock) == 0) {
+            if (rc == 0) {
+                rc = ParDownloadFinishSegment(self, seg);
+                DISP_RC2(rc, "Cannot update ranges of", self->part);
+            }
+            if (rc == 0) {
+                STSMSG(STS_FIN, ("%s: %lu of %lu segments done",
+                    self->part, self->nDone, self->nSeg));
+                if (self->cond != NULL) {
+                    KConditionBroadcast(self->cond);
+                }
+            }
+            if (rc != 0 && self->rc == 0) {
+                self->rc = rc;
+            }
+            KLockUnlock(self->lock);
+        }
+    }
+
+    if (rc != 0 && KLockAcquire(self->lock) == 0) {
+        if (self->rc == 0) {
+            self->rc = rc;
+        }
+        KLockUnlock(self->lock);
+    }
+
+    RELEASE(KFile, in);
+    free(buffer);
+
+    return rc;
+}
+
+/* Digests the segments in file order as the workers complete them.
+   They are read back from the output file while still in the page cache. */
+static rc_t CC ParDownloadMd5Thread(const KThread *thread, void *data) {
+    ParDownload *self = data;
+    rc_t rc = 0;
+    void *buffer = NULL;
+    uint64_t seg = 0;
+
+    assert(self && self->main && self->md5);
+
+    buffer = malloc(self->main->bsize);
+    if (buffer == NULL) {
+        return RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    for (seg = 0; rc == 0 && seg < self->nSeg; ++seg) {
+        bool ready = false;
+        uint64_t pos = seg * self->segSz;
+        uint64_t end = pos + self->segSz;
+        if (end > self->remoteSz) {
+            end = self->remoteSz;
+        }
+
+        rc = KLockAcquire(self->lock);
+        while (rc == 0
+            && !self->done[seg] && !self->finished && self->rc == 0)
+        {
+            rc = KConditionWait(self->cond, self->lock);
+        }
+        if (rc == 0) {
+            ready = self->done[seg];
+            KLockUnlock(self->lock);
+        }
+        if (!ready) {
+            break; /* the download failed: nothing to verify */
+        }
+
+        while (rc == 0 && pos < end) {
+            size_t num_read = 0;
+            size_t size = self->main->bsize;
+            if (size > end - pos) {
+                size = end - pos;
+            }
+            rc = KFileReadAll(self->out, pos, buffer, size, &num_read);
+            if (rc == 0 && num_read == 0) {
+                rc = RC(rcExe, rcFile, rcReading, rcFile, rcInsufficient);
+            }
+            DISP_RC2(rc, "Cannot KFileRead", self->part);
+            if (rc == 0) {
+                MD5StateAppend(self->md5, buffer, num_read);
+                pos += num_read;
+            }
+        }
+    }
+
+    free(buffer);
+
+    return rc;
+}
+
+/* Reads the ranges sidecar of a previous interrupted download.
+   Nothing is reused when it was made for another file or segment size. */
+static rc_t ParDownloadLoadRanges(ParDownload *self,
+    KDirectory *dir, const char *name)
+{
+    rc_t rc = 0;
+    const KFile *f = NULL;
+    uint64_t size = 0;
+    char *text = NULL;
+    size_t num_read = 0;
+
+    assert(self && dir && name);
+
+    if (KDirectoryPathType(dir, "%s", name) != kptFile) {
+        return 0;
+    }
+
+    rc = KDirectoryOpenFileRead(dir, &f, "%s", name);
+    if (rc == 0) {
+        rc = KFileSize(f, &size);
+    }
+    if (rc == 0) {
+        text = malloc(size + 1);
+        if (text == NULL) {
+            rc = RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+        }
+    }
+    if (rc == 0) {
+        rc = KFileReadAll(f, 0, text, size, &num_read);
+    }
+    RELEASE(KFile, f);
+
+    if (rc == 0) {
+        char *p = text;
+        char *end = NULL;
+        uint64_t remoteSz = 0;
+        uint64_t segSz = 0;
+        text[num_read] = '\0';
+
+        remoteSz = strtou64(p, &end, 10);
+        p = end;
+        segSz = strtou64(p, &end, 10);
+        p = end;
+
+        if (remoteSz != self->remoteSz || segSz != self->segSz) {
+            STSMSG(STS_INFO, ("%s does not match %S: starting over",
+                name, self->resolved->remote.str));
+        }
+        else {
+            /* only newline-terminated lines were written completely */
+            char *last = strrchr(p, '\n');
+            if (last != NULL) {
+                last[1] = '\0';
+            }
+            while (last != NULL && *p != '\0') {
+                uint64_t seg = strtou64(p, &end, 10);
+                if (end == p) {
+                    break;
+                }
+                if (seg < self->nSeg && !self->done[seg]) {
+                    self->done[seg] = true;
+                    ++self->nDone;
+                }
+                p = end;
+            }
+            if (self->nDone > 0) {
+                STSMSG(STS_TOP, (" Resuming download: "
+                    "%lu of %lu segments are already complete",
+                    self->nDone, self->nSeg));
+            }
+        }
+    }
+
+    free(text);
+
+    return rc;
+}
+
+static rc_t ParDownloadSaveRanges(ParDownload *self,
+    KDirectory *dir, const char *name)
+{
+    rc_t rc = 0;
+    uint64_t seg = 0;
+    char line[64] = "";
+    size_t num_writ = 0;
+
+    assert(self && dir && name);
+
+    rc = KDirectoryCreateFile(dir, &self->ranges,
+        false, 0664, kcmInit | kcmParents, "%s", name);
+    DISP_RC2(rc, "Cannot OpenFileWrite", name);
+
+    if (rc == 0) {
+        rc = string_printf(line, sizeof line, &num_writ,
+            "%lu %lu\n", self->remoteSz, self->segSz);
+    }
+    if (rc == 0) {
+        rc = KFileWriteAll(self->ranges, 0, line, num_writ, &num_writ);
+        self->rangesPos = num_writ;
+    }
+
+    for (seg = 0; rc == 0 && seg < self->nSeg; ++seg) {
+        if (self->done[seg]) {
+            rc = string_printf(line, sizeof line, &num_writ, "%lu\n", seg);
+            if (rc == 0) {
+                rc = KFileWriteAll(self->ranges,
+                    self->rangesPos, line, num_writ, &num_writ);
+                self->rangesPos += num_writ;
+            }
+        }
+    }
+
+    return rc;
+}
+
+static rc_t MainDownloadFileParallel(Resolved *self,
+    Main *main, const char *to, MD5State *md5)
+{
+    rc_t rc = 0;
+    ParDownload pd;
+    KThread **threads = NULL;
+    KThread *digest = NULL;
+    uint32_t nThreads = 0;
+    uint32_t i = 0;
+    uint64_t size = 0;
+    size_t num_writ = 0;
+
+    char part[PATH_MAX] = "";
+    char ranges[PATH_MAX] = "";
+
+    assert(self && main && self->cache && self->remoteSz > 0);
+
+    memset(&pd, 0, sizeof pd);
+    pd.resolved = self;
+    pd.main = main;
+    pd.part = part;
+    pd.remoteSz = self->remoteSz;
+    pd.segSz = PAR_SEGMENT_SIZE;
+    pd.nSeg = (pd.remoteSz + pd.segSz - 1) / pd.segSz;
+    pd.md5 = md5;
+
+    rc = string_printf(part, sizeof part, &num_writ, "%S.part", self->cache);
+    DISP_RC2(rc, "string_printf(part)", self->cache->addr);
+    if (rc == 0) {
+        rc = string_printf(ranges, sizeof ranges, &num_writ,
+            "%S.part.ranges", self->cache);
+        DISP_RC2(rc, "string_printf(part.ranges)", self->cache->addr);
+    }
+
+    if (rc == 0) {
+        pd.done = calloc(pd.nSeg, sizeof *pd.done);
+        if (pd.done == NULL) {
+            rc = RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+        }
+    }
+
+    if (rc == 0 && main->force == eForceNo
+        && KDirectoryPathType(main->dir, "%s", part) == kptFile)
+    {
+        rc = ParDownloadLoadRanges(&pd, main->dir, ranges);
+    }
+
+    if (rc == 0) {
+        STSMSG(STS_DBG, ("opening %s", part));
+        if (pd.nDone > 0) {
+            rc = KDirectoryOpenFileWrite(main->dir, &pd.out, true, "%s", part);
+        }
+        else {
+            rc = KDirectoryCreateFile(main->dir, &pd.out,
+                true, 0664, kcmInit | kcmParents, "%s", part);
+        }
+        DISP_RC2(rc, "Cannot OpenFileWrite", part);
+    }
+    if (rc == 0) {
+        rc = KFileSetSize(pd.out, pd.remoteSz);
+        DISP_RC2(rc, "Cannot KFileSetSize", part);
+    }
+
+    /* rewrite the sidecar: drops a partially written last line */
+    if (rc == 0) {
+        rc = ParDownloadSaveRanges(&pd, main->dir, ranges);
+    }
+
+    if (rc == 0) {
+        rc = KLockMake(&pd.lock);
+        DISP_RC(rc, "KLockMake");
+    }
+    if (rc == 0 && md5 != NULL) {
+        rc = KConditionMake(&pd.cond);
+        DISP_RC(rc, "KConditionMake");
+        if (rc == 0) {
+            rc = KThreadMake(&digest, ParDownloadMd5Thread, &pd);
+            DISP_RC(rc, "KThreadMake");
+        }
+    }
+
+    if (rc == 0) {
+        nThreads = main->parallel;
+        if (nThreads > pd.nSeg - pd.nDone) {
+            nThreads = (uint32_t)(pd.nSeg - pd.nDone);
+        }
+        threads = calloc(nThreads + 1, sizeof *threads);
+        if (threads == NULL) {
+            rc = RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+        }
+    }
+
+    if (rc == 0) {
+        STSMSG(STS_INFO, ("%S -> %s (%u connections, %lu segments)",
+            self->remote.str, part, nThreads, pd.nSeg - pd.nDone));
+    }
+
+    for (i = 0; rc == 0 && i < nThreads; ++i) {
+        rc = KThreadMake(&threads[i], ParDownloadThread, &pd);
+        DISP_RC(rc, "KThreadMake");
+        if (rc != 0 && KLockAcquire(pd.lock) == 0) {
+            /* stop the workers that have been started */
+            pd.rc = rc;
+            KLockUnlock(pd.lock);
+        }
+    }
+
+    for (i = 0; threads != NULL && threads[i] != NULL; ++i) {
+        KThreadWait(threads[i], NULL);
+        KThreadRelease(threads[i]);
+    }
+    free(threads);
+
+    if (rc == 0) {
+        rc = pd.rc;
+    }
+
+    if (digest != NULL) {
+        rc_t status = 0;
+        if (KLockAcquire(pd.lock) == 0) {
+            pd.finished = true;
+            KConditionBroadcast(pd.cond);
+            KLockUnlock(pd.lock);
+        }
+        KThreadWait(digest, &status);
+        if (rc == 0 && status != 0) {
+            rc = status;
+            DISP_RC2(rc, "Cannot calculate md5 of", part);
+        }
+        RELEASE(KThread, digest);
+    }
+
+    RELEASE(KFile, pd.ranges);
+
+    /* verify the result */
+    if (rc == 0 && pd.nDone != pd.nSeg) {
+        rc = RC(rcExe, rcFile, rcCopying, rcTransfer, rcIncomplete);
+        PLOGERR(klogErr, (klogErr, rc, "$(path): $(done) of $(total) "
+            "segments are downloaded", "path=%s,done=%lu,total=%lu",
+            part, pd.nDone, pd.nSeg));
+    }
+    if (rc == 0) {
+        rc = KFileSize(pd.out, &size);
+        DISP_RC2(rc, "Cannot KFileSize", part);
+        if (rc == 0 && size != pd.remoteSz) {
+            rc = RC(rcExe, rcFile, rcCopying, rcSize, rcUnequal);
+            PLOGERR(klogErr, (klogErr, rc, "$(path) size is $(size): "
+                "expected $(expected)", "path=%s,size=%lu,expected=%lu",
+                part, size, pd.remoteSz));
+        }
+    }
+
+    RELEASE(KFile, pd.out);
+    RELEASE(KCondition, pd.cond);
+    RELEASE(KLock, pd.lock);
+    free(pd.done);
+
+    if (rc == 0) {
+        rc = KDirectoryRename(main->dir, true, part, to);
+        DISP_RC2(rc, "Cannot rename", part);
+    }
+    if (rc == 0) {
+        rc_t rc2 = KDirectoryRemove(main->dir, false, "%s", ranges);
+        DISP_RC2(rc2, "Cannot remove", ranges);
+        STSMSG(STS_INFO, ("%s (%ld)", to, pd.remoteSz));
+    }
+
+    return rc;
+}
+
+static rc_t MainDownloadFileSerial(Resolved *self,
+    Main *main, const char *to, MD5State *md5)
 {
     rc_t rc = 0;
     KFile *out = NULL;
@@ -964,9 +1656,15 @@ static rc_t MainDownloadFile(Resolved *self,
     size_t num_writ = 0;
     uint64_t pos = 0;
     uint64_t prevPos = 0;
+    Md5Pipe pipe;
 
     assert(self && main);
 
+    memset(&pipe, 0, sizeof pipe);
+    if (md5 != NULL) {
+        rc = Md5PipeInit(&pipe, md5, main->bsize);
+    }
+
     if (rc == 0) {
         STSMSG(STS_DBG, ("creating %s", to));
         rc = KDirectoryCreateFile(main->dir, &out,
@@ -987,7 +1685,15 @@ static rc_t MainDownloadFile(Resolved *self,
     STSMSG(STS_INFO, ("%S -> %s", self->remote.str, to));
     do {
         bool print = pos - prevPos > 200000000;
-        rc = Quitting();
+        void *buffer = main->buffer;
+
+        if (rc == 0) {
+            rc = Quitting();
+        }
+
+        if (rc == 0 && md5 != NULL) {
+            rc = Md5PipeGetBuffer(&pipe, &buffer);
+        }
 
         if (rc == 0) {
             if (print) {
@@ -995,7 +1701,7 @@ static rc_t MainDownloadFile(Resolved *self,
                     ("Reading %lu bytes from pos. %lu", main->bsize, pos));
             }
             rc = KFileRead(self->file,
-                pos, main->buffer, main->bsize, &num_read);
+                pos, buffer, main->bsize, &num_read);
             if (rc != 0) {
                 DISP_RC2(rc, "Cannot KFileRead", self->remote.str->addr);
             }
@@ -1009,12 +1715,24 @@ static rc_t MainDownloadFile(Resolved *self,
         }
 
         if (rc == 0 && num_read > 0) {
-            rc = KFileWrite(out, opos, main->buffer, num_read, &num_writ);
+            rc = KFileWriteAll(out, opos, buffer, num_read, &num_writ);
             DISP_RC2(rc, "Cannot KFileWrite", to);
             opos += num_writ;
         }
+
+        if (rc == 0 && num_read > 0 && md5 != NULL) {
+            rc = Md5PipePost(&pipe, num_writ);
+        }
     } while (rc == 0 && num_read > 0);
 
+    if (md5 != NULL) {
+        rc_t rc2 = Md5PipeWhack(&pipe);
+        if (rc == 0 && rc2 != 0) {
+            rc = rc2;
+            DISP_RC2(rc, "Cannot calculate md5 of", to);
+        }
+    }
+
     RELEASE(KFile, out);
 
     if (rc == 0) {
@@ -1024,6 +1742,58 @@ static rc_t MainDownloadFile(Resolved *self,
     return rc;
 }
 
+/* The data is digested while it is being downloaded
+   and compared with the md5 reported by the resolver, if any:
+   no extra pass over the downloaded file is needed. */
+static rc_t MainDownloadFile(Resolved *self,
+    Main *main, const char *to)
+{
+    rc_t rc = 0;
+    MD5State md5;
+    uint8_t expected[16];
+    bool verify = false;
+
+    assert(self && main);
+
+    memset(expected, 0, sizeof expected);
+    if (self->remote.path != NULL
+        && VPathGetMd5(self->remote.path, expected) == 0)
+    {
+        static const uint8_t none[16];
+        verify = memcmp(expected, none, sizeof none) != 0;
+    }
+    if (verify) {
+        MD5StateInit(&md5);
+    }
+    else {
+        STSMSG(STS_DBG, ("md5 of %S is unknown: it will not be verified",
+            self->remote.str));
+    }
+
+    if (main->parallel > 1 && self->remoteSz > 0) {
+        rc = MainDownloadFileParallel(self, main, to, verify ? &md5 : NULL);
+    }
+    else {
+        rc = MainDownloadFileSerial(self, main, to, verify ? &md5 : NULL);
+    }
+
+    if (rc == 0 && verify) {
+        uint8_t digest[16];
+        MD5StateFinish(&md5, digest);
+        if (memcmp(digest, expected, sizeof digest) != 0) {
+            rc = RC(rcExe, rcFile, rcValidating, rcChecksum, rcUnequal);
+            PLOGERR(klogErr, (klogErr, rc,
+                "md5 of $(path) does not match: the download is corrupted",
+                "path=%S", self->remote.str));
+        }
+        else {
+            STSMSG(STS_INFO, ("%s: md5 is verified", to));
+        }
+    }
+
+    return rc;
+}
+
 /*  http://ftp-trace.ncbi.nlm.nih.gov/sra/sra-instant/reads/ByR.../SRR125365.sra
 anonftp@ftp-private.ncbi.nlm.nih.gov:/sra/sra-instant/reads/ByR.../SRR125365.sra
 */
@@ -2439,6 +3209,13 @@ static const char* HBEAT_USAGE[] = {
     "time period in minutes to display download progress",
     "(0: no progress), default: 1", NULL };
 
+#define PARALLEL_OPTION "parallel"
+#define PARALLEL_ALIAS  "P"
+static const char* PARALLEL_USAGE[] = {
+    "number of byte ranges of a file to download concurrently over http,",
+    "an interrupted download is resumed from the completed ranges.",
+    "Default: 1 (one connection, no resume)", NULL };
+
 #define ROWS_OPTION "rows"
 #define ROWS_ALIAS  "R"
 static const char* ROWS_USAGE[] =
@@ -2482,6 +3259,7 @@ static OptDef Options[] = {
    ,{ ORDR_OPTION     , ORDR_ALIAS     , NULL, ORDR_USAGE  , 1, true ,false }
    ,{ ASCP_OPTION     , ASCP_ALIAS     , NULL, ASCP_USAGE  , 1, true ,false }
    ,{ HBEAT_OPTION    , HBEAT_ALIAS    , NULL, HBEAT_USAGE , 1, true, false }
+   ,{ PARALLEL_OPTION , PARALLEL_ALIAS , NULL, PARALLEL_USAGE, 1, true, false}
    ,{ FAIL_ASCP_OPTION, FAIL_ASCP_ALIAS, NULL, FAIL_ASCP_USAGE, 1, false, false}
 #ifdef _DEBUGGING
    ,{ TEXTKART_OPTION , NULL           , NULL, TEXTKART_USAGE , 1, true , false}
@@ -2684,6 +3462,30 @@ static rc_t MainProcessArgs(Main *self, int argc, char *argv[]) {
             }
         }
 
+/* PARALLEL_OPTION */
+        rc = ArgsOptionCount(self->args, PARALLEL_OPTION, &pcount);
+        if (rc != 0) {
+            LOGERR(klogErr,
+                rc, "Failure to get '" PARALLEL_OPTION "' argument");
+            break;
+        }
+        if (pcount > 0) {
+            const char *val = NULL;
+            rc = ArgsOptionValue(self->args, PARALLEL_OPTION, 0, &val);
+            if (rc != 0) {
+                LOGERR(klogErr, rc,
+                    "Failure to get '" PARALLEL_OPTION "' argument value");
+                break;
+            }
+            self->parallel = strtou32(val, NULL, 10);
+            if (self->parallel == 0) {
+                rc = RC(rcExe, rcArgv, rcParsing, rcParam, rcInvalid);
+                LOGERR(klogErr, rc,
+                    "'" PARALLEL_OPTION "' argument value should be positive");
+                break;
+            }
+        }
+
 /* ROWS_OPTION */
         rc = ArgsOptionCount(self->args, ROWS_OPTION, &pcount);
         if (rc != 0) {
@@ -2860,6 +3662,9 @@ rc_t CC Usage(const Args *args) {
             else if (strcmp(Options[i].aliases, ROWS_ALIAS) == 0) {
                 param = "rows";
             }
+            else if (strcmp(Options[i].aliases, PARALLEL_ALIAS) == 0) {
+                param = "count";
+            }
             else if (strcmp(Options[i].aliases, SIZE_ALIAS) == 0
                   || strcmp(Options[i].aliases, MINSZ_ALIAS) == 0)
             {
@@ -2967,6 +3772,8 @@ static rc_t MainInit(int argc, char *argv[], Main *self) {
     self->heartbeat = 60000;
 /*  self->heartbeat = 69; */
 
+    self->parallel = 1;
+
     BSTreeInit(&self->downloaded);
 
     if (rc == 0) {
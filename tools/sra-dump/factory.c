@@ -26,27 +26,35 @@
 #include <klib/log.h>
 #include <klib/out.h>
 #include <klib/container.h>
+#include <klib/text.h>
+#include <klib/printf.h>
 #include <kfs/directory.h>
 #include <kfs/buffile.h>
 #include <kfs/gzip.h>
 #include <kfs/bzip.h>
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <time.h>
+#include <stddef.h>
 #include <os-native.h>
 #include <sysalloc.h>
 
 #include "factory.h"
 #include "debug.h"
+#include "compressed_file.h"
 
 #define DUMPER_MAX_KEY_LENGTH 63
 #define DUMPER_MAX_TREE_DEPTH 100
 #define DUMPER_MAX_OPEN_FILES 100
 
 #define OUTPUT_BUFFER_SIZE ( 128 * 1024 )
+/* each output file keeps own buffer, which is kept while file handle is closed */
+#define FILE_BUFFER_SIZE ( 32 * 1024 )
+/* initial number of buckets in files table, doubled when there are twice more files */
+#define FILE_TABLE_SIZE 64
 
 uint32_t nreads_max = 0;
 uint32_t quality_N_limit = 0;
@@ -54,12 +62,18 @@ bool g_legacy_report = false;
 
 typedef struct SRASplitterFile_struct {
     SLNode dad;
+    /* in list of opened files, most recently used first */
+    DLNode lru;
     char* key;
+    uint32_t hash;
     KDirectory* dir;
     char* name;
     KFile* file;
-    time_t opened;
     uint64_t pos;
+    /* data not yet written to file and file offset of it */
+    char* buf;
+    size_t buf_len;
+    uint64_t buf_pos;
     /* keep track of number of spots written to file */
     spotid_t curr_spot;
     uint64_t spot_qty;
@@ -73,19 +87,24 @@ typedef struct SRASplitterFiler_struct {
     bool keep_empty;
     bool do_gzip;
     bool do_bzip2;
+    /* compresses the blocks of all output files, NULL for single-threaded compression */
+    struct compress_pool* zip_pool;
     const char* arc_extension;
     KDirectory* dir;
 
-    /* TBD - this should be a BSTree */
-    SLList files;
+    /* files by hash of key */
+    SLList* files;
+    uint32_t files_buckets;
+    uint32_t files_qty;
 
     /* list of keys to construct a path */
     int path_tail; /* count of elements in path array */
     int path_len; /* cumulative length of path in array */
     const char* path[DUMPER_MAX_TREE_DEPTH];
     char key_buf[DUMPER_MAX_TREE_DEPTH * (DUMPER_MAX_KEY_LENGTH + 3) + 10];
-    /* holds opened files */
-    SRASplitterFile* open[DUMPER_MAX_OPEN_FILES];
+    /* holds opened files, least recently used is closed first */
+    DLList open;
+    uint32_t open_qty;
     /* keep track of number of spots written to file */
     spotid_t curr_spot;
     uint64_t spot_qty;
@@ -93,18 +112,113 @@ typedef struct SRASplitterFiler_struct {
 
 SRASplitterFiler* g_filer = NULL;
 
+#define SRASplitterFiler_LRUFile(node) \
+    ((SRASplitterFile*)((char*)(node) - offsetof(SRASplitterFile, lru)))
+
 static
-void CC SRASplitterFiler_WhackFile( SLNode *node, void *data )
+void SRASplitterFiler_CloseFile(SRASplitterFile* file)
+{
+    if( file->file != NULL ) {
+        SRA_DUMP_DBG(5, ("Close file: '%s%s'\n", file->key, g_filer->arc_extension));
+        KFileRelease(file->file);
+        file->file = NULL;
+        DLListUnlink(&g_filer->open, &file->lru);
+        g_filer->open_qty--;
+    }
+}
+
+static
+rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial);
+
+static
+rc_t SRASplitterFiler_FlushFile(SRASplitterFile* file)
+{
+    rc_t rc = 0;
+
+    if( file->buf_len > 0 ) {
+        if( (rc = SRASplitterFiler_OpenFile(file, false)) == 0 ) {
+            size_t writ = 0;
+            rc = KFileWriteAll(file->file, file->buf_pos, file->buf, file->buf_len, &writ);
+            if( rc == 0 && writ != file->buf_len ) {
+                rc = RC(rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
+            }
+        }
+        if( rc == 0 ) {
+            file->buf_len = 0;
+        }
+    }
+    return rc;
+}
+
+/* writes at file->pos, through file buffer if data fits to it */
+static
+rc_t SRASplitterFiler_WriteFile(SRASplitterFile* file, const void* buf, size_t size)
+{
+    rc_t rc = 0;
+    size_t writ = 0;
+
+    if( g_filer->kf_stdout ) {
+        /* stdout is buffered by itself */
+        if( (rc = SRASplitterFiler_OpenFile(file, false)) == 0 ) {
+            rc = KFileWriteAll(file->file, file->pos, buf, size, &writ);
+        }
+    } else {
+        if( file->buf_len > 0 &&
+            (file->pos != file->buf_pos + file->buf_len || file->buf_len + size > FILE_BUFFER_SIZE) ) {
+            rc = SRASplitterFiler_FlushFile(file);
+        }
+        if( rc == 0 ) {
+            if( size >= FILE_BUFFER_SIZE ) {
+                if( (rc = SRASplitterFiler_OpenFile(file, false)) == 0 ) {
+                    rc = KFileWriteAll(file->file, file->pos, buf, size, &writ);
+                }
+            } else if( file->buf == NULL && (file->buf = malloc(FILE_BUFFER_SIZE)) == NULL ) {
+                rc = RC(rcExe, rcFile, rcWriting, rcMemory, rcExhausted);
+            } else {
+                if( file->buf_len == 0 ) {
+                    file->buf_pos = file->pos;
+                }
+                memcpy(&file->buf[file->buf_len], buf, size);
+                file->buf_len += size;
+                writ = size;
+            }
+        }
+    }
+    if( rc == 0 && writ != size ) {
+        rc = RC(rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
+    }
+    if( rc == 0 ) {
+        file->pos += size;
+    }
+    return rc;
+}
+
+static
+void CC SRASplitterFiler_FinishFile( SLNode *node, void *data )
 {
     SRASplitterFile* file = (SRASplitterFile*)node;
-    bool* d = (bool*)data;
 
-    SRA_DUMP_DBG(5, ("Close file: '%s%s'\n", file->key, g_filer->arc_extension));
     if( file->spot_qty == 0 ) {
         /* truncate file which didn't get actual spots written */
+        file->buf_len = 0;
         KFileSetSize(file->file, 0);
+    } else {
+        rc_t rc = SRASplitterFiler_FlushFile(file);
+        if( rc != 0 ) {
+            PLOGERR(klogErr, (klogErr, rc, "writing file '$(s)$(e)'",
+                PLOG_2(PLOG_S(s),PLOG_S(e)), file->key, g_filer->arc_extension));
+        }
     }
-    KFileRelease(file->file);
+    SRASplitterFiler_CloseFile(file);
+}
+
+static
+void CC SRASplitterFiler_WhackFile( SLNode *node, void *data )
+{
+    SRASplitterFile* file = (SRASplitterFile*)node;
+    bool* d = (bool*)data;
+
+    SRASplitterFiler_CloseFile(file);
     if( !*d ) {
         uint64_t sz = ~0;
         if( KDirectoryFileSize(file->dir, &sz, "%s%s", file->name, g_filer->arc_extension) == 0 ) {
@@ -119,6 +233,7 @@ void CC SRASplitterFiler_WhackFile( SLNode *node, void *data )
     }
     free(file->key);
     free(file->name);
+    free(file->buf);
     free(file);
 }
 
@@ -136,8 +251,17 @@ void CC SRASplitterFiler_StatFile( SLNode *node, void *data )
 void SRASplitterFiler_Release(void)
 {
     if( g_filer != NULL ) {
-        SLListWhack(&g_filer->files, SRASplitterFiler_WhackFile, &g_filer->keep_empty);
+        uint32_t i;
+        /* all files are flushed and closed before any is gone */
+        for(i = 0; i < g_filer->files_buckets; i++) {
+            SLListForEach(&g_filer->files[i], SRASplitterFiler_FinishFile, NULL);
+        }
+        for(i = 0; i < g_filer->files_buckets; i++) {
+            SLListWhack(&g_filer->files[i], SRASplitterFiler_WhackFile, &g_filer->keep_empty);
+        }
+        free(g_filer->files);
         KFileRelease(g_filer->kf_stdout);
+        release_compress_pool(g_filer->zip_pool);
         KDirectoryRelease(g_filer->dir);
         free(g_filer->prefix);
         free(g_filer);
@@ -152,7 +276,10 @@ void SRASplitterFactory_FilerReport(uint64_t* total, uint64_t* biggest_file)
             *total = g_filer->spot_qty;
         }
         if( biggest_file != NULL ) {
-            SLListForEach(&g_filer->files, SRASplitterFiler_StatFile, biggest_file);
+            uint32_t i;
+            for(i = 0; i < g_filer->files_buckets; i++) {
+                SLListForEach(&g_filer->files[i], SRASplitterFiler_StatFile, biggest_file);
+            }
         }
     }
 }
@@ -194,26 +321,14 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
 
     if( file == NULL || (initial && file->file != NULL) ) {
         rc = RC(rcExe, rcFile, rcOpening, rcParam, rcInvalid);
-    } else if( initial || file->file == NULL ) {
-        int i, vacancy = -1;
-        time_t oldest = 0;
-
-        for(i = 0; i < DUMPER_MAX_OPEN_FILES; i++) {
-            if(g_filer->open[i] == NULL ) {
-                vacancy = i;
-                break;
-            }
-            if(g_filer->open[i]->opened < oldest || oldest == 0 ) {
-                oldest = g_filer->open[i]->opened;
-                vacancy = i;
-            }
-        }
-        if( g_filer->open[vacancy] != NULL ) {
-            SRA_DUMP_DBG(5, ("Close file[%i]: %lu '%s%s'\n", vacancy,
-                g_filer->open[vacancy]->opened, g_filer->open[vacancy]->key, g_filer->arc_extension));
-            KFileRelease(g_filer->open[vacancy]->file);
-            g_filer->open[vacancy]->file = NULL;
-            g_filer->open[vacancy] = NULL;
+    } else if( file->file != NULL ) {
+        /* move to head of opened files */
+        DLListUnlink(&g_filer->open, &file->lru);
+        DLListPushHead(&g_filer->open, &file->lru);
+    } else {
+        if( g_filer->open_qty >= DUMPER_MAX_OPEN_FILES ) {
+            /* file buffer stays, so file will be reopened only when buffer is full */
+            SRASplitterFiler_CloseFile(SRASplitterFiler_LRUFile(DLListTail(&g_filer->open)));
         }
         if( g_filer->kf_stdout ) {
             SRA_DUMP_DBG(5, ("attach to pre-opened stdout: '%s'\n", file->key));
@@ -223,17 +338,11 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
             SRA_DUMP_DBG(5, ("Create file: '%s%s'\n", file->key, g_filer->arc_extension));
             if( (rc = KDirectoryCreateFile(file->dir, &file->file, false, 0664, kcmInit,
                                            "%s%s", file->name, g_filer->arc_extension)) == 0 ) {
-                if( g_filer->do_gzip ) {
-                    KFile* gz;
-                    if( (rc = KFileMakeGzipForWrite(&gz, file->file)) == 0 ) {
-                        KFileRelease(file->file);
-                        file->file = gz;
-                    }
-                } else if( g_filer->do_bzip2 ) {
-                    KFile* bz;
-                    if( (rc = KFileMakeBzip2ForWrite(&bz, file->file)) == 0 ) {
+                if( g_filer->do_gzip || g_filer->do_bzip2 ) {
+                    KFile* z;
+                    if( (rc = make_pooled_compressed_file(&z, file->file, g_filer->do_bzip2, g_filer->zip_pool)) == 0 ) {
                         KFileRelease(file->file);
-                        file->file = bz;
+                        file->file = z;
                     }
                 }
             }
@@ -264,29 +373,14 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
 #endif
             }
         }
-#if OUTPUT_BUFFER_SIZE
-        if( rc == 0 && !g_filer->kf_stdout ) {
-            /* attach buffer */
-            KFile *buf = NULL;
-            if( (rc = KBufFileMakeWrite(&buf, file->file, false, OUTPUT_BUFFER_SIZE)) == 0 ) {
-                KFileRelease(file->file);
-                file->file = buf;
-            } else {
-#if _DEBUGGING
-                /* we only want to see this in debug */
-                PLOGERR(klogErr, (klogErr, rc, "creating buffer for file '$(s)$(e)'",
-                    PLOG_2(PLOG_S(s),PLOG_S(e)), file->key, g_filer->arc_extension));
-#else
-                rc = 0;
-#endif
-            }
-        }
-#endif
         if( rc == 0 ) {
-            g_filer->open[vacancy] = file;
-            file->opened = time(NULL);
-            SRA_DUMP_DBG(5, ("Opened file[%i]: %lu '%s%s'\n",
-                vacancy, file->opened, file->key, g_filer->arc_extension));
+            DLListPushHead(&g_filer->open, &file->lru);
+            g_filer->open_qty++;
+            SRA_DUMP_DBG(5, ("Opened file[%u]: '%s%s'\n",
+                g_filer->open_qty, file->key, g_filer->arc_extension));
+        } else if( file->file != NULL ) {
+            KFileRelease(file->file);
+            file->file = NULL;
         }
     }
     return rc;
@@ -325,6 +419,38 @@ rc_t SRASplitterFiler_FixFSName(const char* name, char** fname)
     return 0;
 }
 
+static
+void CC SRASplitterFiler_Rehash( SLNode *node, void *data )
+{
+    SRASplitterFile* file = (SRASplitterFile*)node;
+    SLList* files = (SLList*)data;
+
+    SLListPushTail(&files[file->hash % (g_filer->files_buckets * 2)], &file->dad);
+}
+
+static
+void SRASplitterFiler_AddFile(SRASplitterFile* file)
+{
+    if( g_filer->files_qty >= g_filer->files_buckets * 2 ) {
+        /* keep chains short, table is left as is if there is no memory */
+        SLList* files = calloc(g_filer->files_buckets * 2, sizeof(*files));
+        if( files != NULL ) {
+            uint32_t i;
+            for(i = 0; i < g_filer->files_buckets; i++) {
+                SLNode* node;
+                while( (node = SLListPopHead(&g_filer->files[i])) != NULL ) {
+                    SRASplitterFiler_Rehash(node, files);
+                }
+            }
+            free(g_filer->files);
+            g_filer->files = files;
+            g_filer->files_buckets *= 2;
+        }
+    }
+    SLListPushTail(&g_filer->files[file->hash % g_filer->files_buckets], &file->dad);
+    g_filer->files_qty++;
+}
+
 static
 rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
 {
@@ -332,6 +458,7 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
     int i;
     char* key = g_filer->key_buf; /* shortcut */
     SRASplitterFile* file = NULL;
+    uint32_t hash;
 
     if( out_file == NULL ) {
         return RC(rcExe, rcFile, rcOpening, rcParam, rcInvalid);
@@ -360,7 +487,8 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
             }
         }
     }
-    if( !SLListDoUntil( &g_filer->files, SRASplitterFiler_GetCurrFile_FindByKey, &file ) ) {
+    hash = string_hash(key, strlen(key));
+    if( !SLListDoUntil( &g_filer->files[hash % g_filer->files_buckets], SRASplitterFiler_GetCurrFile_FindByKey, &file ) ) {
         SRA_DUMP_DBG(5, ("New file: '%s'\n", key));
         file = calloc(1, sizeof(*file));
         key = strdup(key);
@@ -370,6 +498,7 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
             rc = RC(rcExe, rcFile, rcResolving, rcMemory, rcExhausted);
         } else {
             file->key = key;
+            file->hash = hash;
             if( g_filer->key_as_dir ) {
                 KDirectory* sub = g_filer->dir;
                 for(i = 0; rc == 0 && i < (g_filer->path_tail - 1); i++ ) {
@@ -393,14 +522,13 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
                 rc = SRASplitterFiler_FixFSName(file->key, &file->name);
             }
             if( rc == 0 && (rc = SRASplitterFiler_OpenFile(file, true)) == 0 ) {
-                SLListPushTail(&g_filer->files, &file->dad);
+                SRASplitterFiler_AddFile(file);
             } else {
                 SRASplitterFiler_WhackFile(&file->dad, &g_filer->keep_empty);
             }
         }
     } else {
         SRA_DUMP_DBG(5, ("Curr file key '%s': '%s'\n", key, file->name));
-        rc = SRASplitterFiler_OpenFile(file, false);
     }
     *out_file = rc ? NULL : file;
     return rc;
@@ -426,7 +554,20 @@ rc_t SRASplitterFactory_FilerPrefix(const char* prefix)
     return rc;
 }
 
-rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool key_as_dir, bool keep_empty, const char* path, ...)
+/* one pool compresses the blocks of all files, up to DUMPER_MAX_OPEN_FILES of them are written at once */
+static
+rc_t SRASplitterFiler_MakeZipPool(uint32_t zip_threads)
+{
+    rc_t rc = 0;
+
+    if( (g_filer->do_gzip || g_filer->do_bzip2) && zip_threads > 1 ) {
+        rc = make_compress_pool(&g_filer->zip_pool, zip_threads);
+    }
+    return rc;
+}
+
+rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, uint32_t zip_threads,
+                                  bool key_as_dir, bool keep_empty, const char* path, ...)
 {
     rc_t rc = 0;
 
@@ -442,25 +583,25 @@ rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool ke
         g_filer->do_gzip = gzip;
         g_filer->do_bzip2 = bzip2;
         g_filer->arc_extension = gzip ? ".gz" : (bzip2 ? ".bz2" : "");
-        SLListInit(&g_filer->files);
+        DLListInit(&g_filer->open);
+        if( (g_filer->files = calloc(FILE_TABLE_SIZE, sizeof(*g_filer->files))) != NULL ) {
+            g_filer->files_buckets = FILE_TABLE_SIZE;
+        }
         /* push empty prefix */
         g_filer->prefix = strdup("");
-        if( (rc = SRASplitterFiler_PushKey(g_filer->prefix)) == 0 &&
+        if( g_filer->files == NULL ) {
+            rc = RC(rcExe, rcFile, rcConstructing, rcMemory, rcExhausted);
+        } else if( (rc = SRASplitterFiler_MakeZipPool(zip_threads)) == 0 &&
+                   (rc = SRASplitterFiler_PushKey(g_filer->prefix)) == 0 &&
             (rc = KDirectoryNativeDir(&g_filer->dir)) == 0 ) {
             if( to_stdout ) {
                 if( (rc = KFileMakeStdOut(&g_filer->kf_stdout)) == 0 ) {
                     KFile *buf = NULL;
-                    if( gzip ) {
-                        KFile* gz;
-                        if( (rc = KFileMakeGzipForWrite(&gz, g_filer->kf_stdout)) == 0 ) {
-                            KFileRelease(g_filer->kf_stdout);
-                            g_filer->kf_stdout = gz;
-                        }
-                    } else if( bzip2 ) {
-                        KFile* bz;
-                        if( (rc = KFileMakeBzip2ForWrite(&bz, g_filer->kf_stdout)) == 0 ) {
+                    if( gzip || bzip2 ) {
+                        KFile* z;
+                        if( (rc = make_pooled_compressed_file(&z, g_filer->kf_stdout, bzip2, g_filer->zip_pool)) == 0 ) {
                             KFileRelease(g_filer->kf_stdout);
-                            g_filer->kf_stdout = bz;
+                            g_filer->kf_stdout = z;
                         }
                     }
 #if OUTPUT_BUFFER_SIZE
@@ -520,6 +661,118 @@ struct SRASplitterFactory {
 /* used to detect correct object pointers */
 const uint32_t SRASplitter_MAGIC = 0xFACE5325;
 
+/* output of chain recorded in batch: file activations with keys pushed
+   by chain, and writes with data, in order they are done by formatter */
+enum {
+    eBatchActivate = 1,
+    eBatchWrite,
+    eBatchWritePos
+};
+
+typedef struct SRASplitterBatchRecord_struct {
+    uint32_t type;
+    /* bytes of data after record */
+    uint32_t size;
+    spotid_t spot;
+    /* position for eBatchWritePos, number of keys for eBatchActivate */
+    uint64_t pos;
+} SRASplitterBatchRecord;
+
+#define BATCH_ALIGN(sz) (((sz) + 7) & ~((size_t)7))
+#define BATCH_RECENT_FILES 8
+
+struct SRASplitterBatch {
+    /* keys pushed by chain, filer prefix is not here */
+    int path_tail;
+    const char* path[DUMPER_MAX_TREE_DEPTH];
+    bool active;
+    char* data;
+    size_t data_len;
+    size_t data_sz;
+};
+
+static
+rc_t SRASplitterBatch_Reserve( SRASplitterBatch* self, size_t size, SRASplitterBatchRecord** r )
+{
+    size_t need = self->data_len + sizeof( **r ) + BATCH_ALIGN( size );
+
+    if ( size > 0xFFFFFFFF )
+    {
+        return RC( rcExe, rcData, rcWriting, rcData, rcExcessive );
+    }
+    if ( need > self->data_sz )
+    {
+        size_t sz = self->data_sz ? self->data_sz : 64 * 1024;
+        char* d;
+        while ( sz < need )
+        {
+            sz *= 2;
+        }
+        if ( ( d = realloc( self->data, sz ) ) == NULL )
+        {
+            return RC( rcExe, rcData, rcWriting, rcMemory, rcExhausted );
+        }
+        self->data = d;
+        self->data_sz = sz;
+    }
+    *r = ( SRASplitterBatchRecord* )&self->data[ self->data_len ];
+    self->data_len = need;
+    ( *r )->size = ( uint32_t )size;
+    return 0;
+}
+
+static
+rc_t SRASplitterBatch_Record( SRASplitterBatch* self, uint32_t type, spotid_t spot,
+                              uint64_t pos, const void* buf, size_t size )
+{
+    rc_t rc = 0;
+    SRASplitterBatchRecord* r = NULL;
+
+    if ( !self->active )
+    {
+        rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
+    }
+    else if ( buf != NULL && size > 0 && ( rc = SRASplitterBatch_Reserve( self, size, &r ) ) == 0 )
+    {
+        r->type = type;
+        r->spot = spot;
+        r->pos = pos;
+        memcpy( r + 1, buf, size );
+    }
+    return rc;
+}
+
+static
+rc_t SRASplitterBatch_Activate( SRASplitterBatch* self, const char* key )
+{
+    rc_t rc = 0;
+    SRASplitterBatchRecord* r = NULL;
+    size_t size = strlen( key ) + 1;
+    int i;
+
+    for ( i = 0; i < self->path_tail; i++ )
+    {
+        size += strlen( self->path[ i ] ) + 1;
+    }
+    if ( ( rc = SRASplitterBatch_Reserve( self, size, &r ) ) == 0 )
+    {
+        char* d = ( char* )( r + 1 );
+        r->type = eBatchActivate;
+        r->spot = 0;
+        r->pos = self->path_tail + 1;
+        for ( i = 0; i < self->path_tail; i++ )
+        {
+            strcpy( d, self->path[ i ] );
+            d += strlen( d ) + 1;
+        }
+        strcpy( d, key );
+        /* keep compare of records stable */
+        memset( d + strlen( key ) + 1, 0, BATCH_ALIGN( size ) - size );
+        self->active = true;
+    }
+    return rc;
+}
+
 typedef struct SRASplitter_Child SRASplitter_Child;
 
 struct SRASplitter {
@@ -532,6 +785,9 @@ struct SRASplitter {
     SRASplitter_Release_Func* Release;
     BSTree children;
     SRASplitter_Child* last_found;
+    /* first splitter in chain, it holds batch for whole chain */
+    SRASplitter* root;
+    SRASplitterBatch* batch;
 };
 
 struct SRASplitter_Child {
@@ -632,6 +888,8 @@ rc_t SRASplitter_FindNextSplitter(SRASplitter* self, const char* key)
             const SRASplitter* splitter = NULL;
             SRA_DUMP_DBG(5, ("New splitter on key '%s'\n", key));
             if( (rc = SRASplitterFactory_NewObj(self->next_fact, &splitter)) == 0 ) {
+                /* chain has one root */
+                ((SRASplitter*)splitter - 1)->root = self->root;
                 if( (rc = SRASplitter_Child_MakeSplitter(&self->last_found, key, splitter)) == 0 ) {
                     if( (rc = BSTreeInsertUnique(&self->children, &self->last_found->node, NULL, SRASplitter_Child_Cmp)) != 0 ) {
                         SRASplitter_Child_Whack(&self->last_found->node, NULL);
@@ -667,10 +925,6 @@ rc_t SRASplitter_FindNextFile(SRASplitter* self, const char* key)
             }
         }
     }
-    if( rc == 0 ) {
-        /* make sure file is opened */
-        rc = SRASplitterFiler_OpenFile((SRASplitterFile*)(self->last_found->child.file), false);
-    }
     return rc;
 }
 
@@ -690,6 +944,7 @@ rc_t SRASplitter_Make(const SRASplitter** cself, size_t type_size,
         return RC(rcExe, rcType, rcAllocating, rcMemory, rcExhausted);
     }
     self->magic = SRASplitter_MAGIC;
+    self->root = self;
     BSTreeInit(&self->children);
     self->GetKey = getkey;
     self->GetKeySet = get_keyset;
@@ -717,6 +972,41 @@ rc_t SRASplitter_ResolveSelf(const SRASplitter* self, enum RCContext ctx, SRASpl
     return 0;
 }
 
+/* keys go to filer, or to batch of chain, and in batch they are without prefix */
+static
+rc_t SRASplitter_PushKey( const SRASplitter* self, const char* key )
+{
+    SRASplitterBatch* batch = self->root->batch;
+
+    if ( batch == NULL )
+    {
+        return SRASplitterFiler_PushKey( key );
+    }
+    if ( batch->path_tail == DUMPER_MAX_TREE_DEPTH )
+    {
+        return RC( rcExe, rcFile, rcAttaching, rcDirEntry, rcTooLong );
+    }
+    batch->path[ batch->path_tail++ ] = key;
+    return 0;
+}
+
+static
+rc_t SRASplitter_PopKey( const SRASplitter* self )
+{
+    SRASplitterBatch* batch = self->root->batch;
+
+    if ( batch == NULL )
+    {
+        return SRASplitterFiler_PopKey();
+    }
+    if ( batch->path_tail == 0 )
+    {
+        return RC( rcExe, rcFile, rcDetaching, rcDirEntry, rcTooShort );
+    }
+    batch->path_tail--;
+    return 0;
+}
+
 rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t * readmask )
 {
     SRASplitter * self = NULL;
@@ -768,13 +1058,13 @@ rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t *
                         if ( rc == 0 )
                         {
                             /* push spot to next splitter in chain */
-                            rc = SRASplitterFiler_PushKey( self->last_found->key );
+                            rc = SRASplitter_PushKey( self, self->last_found->key );
                             if ( rc == 0 )
                             {
                                 /* here comes RECURSION!!! */
                                 rc_t rc2;
                                 rc = SRASplitter_AddSpot( self->last_found->child.splitter, spot, local_readmask );
-                                rc2 = SRASplitterFiler_PopKey();
+                                rc2 = SRASplitter_PopKey( self );
                                 rc = rc ? rc : rc2;
                             }
                         }
@@ -808,13 +1098,13 @@ rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t *
                     if ( rc == 0 )
                     {
                         /* push spot to next splitter in chain */
-                        rc = SRASplitterFiler_PushKey( self->last_found->key );
+                        rc = SRASplitter_PushKey( self, self->last_found->key );
                         if ( rc == 0 )
                         {
                             /* here comes RECURSION!!! */
                             rc_t rc2;
                             rc = SRASplitter_AddSpot( self->last_found->child.splitter, spot, readmask );
-                            rc2 = SRASplitterFiler_PopKey();
+                            rc2 = SRASplitter_PopKey( self );
                             rc = rc ? rc : rc2;
                         }
                     }
@@ -851,13 +1141,97 @@ rc_t SRASplitter_Release(const SRASplitter* cself)
     return rc;
 }
 
+/* rejected reads/spots summed over splitters of all chains, in order reasons were first added */
+typedef struct SRASplitterRejected_struct {
+    SLNode dad;
+    uint64_t qty;
+    char what[1];
+} SRASplitterRejected;
+
+static SLList g_rejected;
+
+typedef struct SRASplitterRejected_Find_struct {
+    const char* what;
+    SRASplitterRejected* found;
+} SRASplitterRejected_Find;
+
+static
+bool CC SRASplitterRejected_FindByWhat( SLNode *node, void *data )
+{
+    SRASplitterRejected_Find* d = (SRASplitterRejected_Find*)data;
+    SRASplitterRejected* r = (SRASplitterRejected*)node;
+
+    if( strcmp(r->what, d->what) == 0 ) {
+        d->found = r;
+        return true;
+    }
+    return false;
+}
+
+rc_t SRASplitter_AddRejected(uint64_t qty, const char* what, ...)
+{
+    rc_t rc = 0;
+
+    if( qty > 0 ) {
+        char buf[256];
+        size_t len = 0;
+        va_list args;
+
+        va_start(args, what);
+        rc = string_vprintf(buf, sizeof(buf), &len, what, args);
+        va_end(args);
+        if( rc == 0 ) {
+            SRASplitterRejected_Find d;
+            SRASplitterRejected* r;
+
+            d.what = buf;
+            d.found = NULL;
+            SLListDoUntil(&g_rejected, SRASplitterRejected_FindByWhat, &d);
+            r = d.found;
+            if( r == NULL ) {
+                r = malloc(sizeof(*r) + len);
+                if( r == NULL ) {
+                    return RC(rcExe, rcNode, rcExecuting, rcMemory, rcExhausted);
+                }
+                r->qty = 0;
+                memmove(r->what, buf, len + 1);
+                SLListPushTail(&g_rejected, &r->dad);
+            }
+            r->qty += qty;
+        }
+    }
+    return rc;
+}
+
+static
+void CC SRASplitterRejected_Whack( SLNode *node, void *data )
+{
+    free(node);
+}
+
+rc_t SRASplitter_RejectedReport(void)
+{
+    rc_t rc = 0;
+    SRASplitterRejected* r;
+
+    while( (r = (SRASplitterRejected*)SLListPopHead(&g_rejected)) != NULL ) {
+        if( rc == 0 && !g_legacy_report ) {
+            rc = KOutMsg("Rejected %lu %s\n", r->qty, r->what);
+        }
+        SRASplitterRejected_Whack(&r->dad, NULL);
+    }
+    return rc;
+}
+
 rc_t SRASplitter_FileActivate(const SRASplitter* cself, const char* key)
 {
     rc_t rc = 0, rc2 = 0;
     SRASplitter* self = NULL;
 
     if( (rc = SRASplitter_ResolveSelf(cself, rcExecuting, &self)) == 0 ) {
-        if( (rc = SRASplitterFiler_PushKey(key)) == 0 ) {
+        if( self->root->batch != NULL ) {
+            rc = SRASplitterBatch_Activate(self->root->batch, key);
+        } else if( (rc = SRASplitterFiler_PushKey(key)) == 0 ) {
             /* sets self->last_found */
             rc = SRASplitter_FindNextFile(self, key);
             rc2 = SRASplitterFiler_PopKey();
@@ -867,6 +1241,44 @@ rc_t SRASplitter_FileActivate(const SRASplitter* cself, const char* key)
     return rc;
 }
 
+static
+rc_t SRASplitterFiler_WriteSpot( SRASplitterFile* f, spotid_t spot, const void* buf, size_t size )
+{
+    rc_t rc = SRASplitterFiler_WriteFile( f, buf, size );
+    if ( rc == 0 )
+    {
+        if ( f->curr_spot != spot && spot != 0 )
+        {
+             f->curr_spot = spot;
+             f->spot_qty = f->spot_qty + 1;
+        }
+        if ( g_filer->curr_spot != spot && spot != 0 )
+        {
+            g_filer->curr_spot = spot;
+            g_filer->spot_qty = g_filer->spot_qty + 1;
+        }
+    }
+    return rc;
+}
+
+static
+rc_t SRASplitterFiler_WriteSpotPos( SRASplitterFile* f, spotid_t spot, 
+                                    uint64_t pos, const void* buf, size_t size )
+{
+    rc_t rc;
+    /* remember last position */
+    uint64_t old_pos = f->pos;
+    f->pos = pos;
+    /* write to requested position */
+    rc = SRASplitterFiler_WriteSpot( f, spot, buf, size );
+    if ( f->pos < old_pos )
+    {
+        /* revert to last position if wrote less than it was */
+        f->pos = old_pos;
+    }
+    return rc;
+}
+
 rc_t SRASplitter_FileWrite( const SRASplitter* cself, spotid_t spot, const void* buf, size_t size )
 {
     SRASplitter* self = NULL;
@@ -874,29 +1286,17 @@ rc_t SRASplitter_FileWrite( const SRASplitter* cself, spotid_t spot, const void*
     rc_t rc = SRASplitter_ResolveSelf( cself, rcWriting, &self );
     if ( rc == 0 )
     {
-        if ( self->last_found == NULL )
+        if ( self->root->batch != NULL )
+        {
+            rc = SRASplitterBatch_Record( self->root->batch, eBatchWrite, spot, 0, buf, size );
+        }
+        else if ( self->last_found == NULL )
         {
             rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
         }
         else if ( buf != NULL && size > 0 )
         {
-            size_t writ = 0;
-            SRASplitterFile* f = ( SRASplitterFile* )( self->last_found->child.file );
-            rc = KFileWrite( f->file, f->pos, buf, size, &writ );
-            if ( rc == 0 )
-            {
-                f->pos += writ;
-                if ( f->curr_spot != spot && spot != 0 )
-                {
-                     f->curr_spot = spot;
-                     f->spot_qty = f->spot_qty + 1;
-                }
-                if ( g_filer->curr_spot != spot && spot != 0 )
-                {
-                    g_filer->curr_spot = spot;
-                    g_filer->spot_qty = g_filer->spot_qty + 1;
-                }
-            }
+            rc = SRASplitterFiler_WriteSpot( ( SRASplitterFile* )( self->last_found->child.file ), spot, buf, size );
         }
     }
     return rc;
@@ -910,23 +1310,164 @@ rc_t SRASplitter_FileWritePos( const SRASplitter* cself, spotid_t spot,
     rc_t rc = SRASplitter_ResolveSelf( cself, rcWriting, &self );
     if ( rc == 0 )
     {
-        if ( self->last_found == NULL )
+        if ( self->root->batch != NULL )
+        {
+            rc = SRASplitterBatch_Record( self->root->batch, eBatchWritePos, spot, pos, buf, size );
+        }
+        else if ( self->last_found == NULL )
         {
             rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
         }
         else if ( buf != NULL && size > 0 )
         {
-            const SRASplitterFile* f = self->last_found->child.file;
-            /* remember last position */
-            uint64_t old_pos = f->pos;
-            ( ( SRASplitterFile* ) f )->pos = pos;
-            /* write to requested position */
-            rc = SRASplitter_FileWrite( cself, spot, buf, size );
-            if ( f->pos < old_pos )
-            {
-                /* revert to last position if wrote less than it was */
-                ( ( SRASplitterFile* ) f )->pos = old_pos;
-            }
+            rc = SRASplitterFiler_WriteSpotPos( ( SRASplitterFile* )( self->last_found->child.file ), spot, pos, buf, size );
+        }
+    }
+    return rc;
+}
+
+/* ### Batches ##################################################### */
+
+rc_t SRASplitter_SetBatch( const SRASplitter* cself, SRASplitterBatch* batch )
+{
+    SRASplitter* self = NULL;
+
+    rc_t rc = SRASplitter_ResolveSelf( cself, rcExecuting, &self );
+    if ( rc == 0 )
+    {
+        if ( self->root != self )
+        {
+            rc = RC( rcExe, rcNode, rcExecuting, rcSelf, rcInvalid );
+        }
+        else
+        {
+            self->batch = batch;
+        }
+    }
+    return rc;
+}
+
+rc_t SRASplitterBatch_Make( SRASplitterBatch** self )
+{
+    if ( self == NULL )
+    {
+        return RC( rcExe, rcData, rcAllocating, rcParam, rcNull );
+    }
+    *self = calloc( 1, sizeof( **self ) );
+    if ( *self == NULL )
+    {
+        return RC( rcExe, rcData, rcAllocating, rcMemory, rcExhausted );
+    }
+    return 0;
+}
+
+void SRASplitterBatch_Release( SRASplitterBatch* self )
+{
+    if ( self != NULL )
+    {
+        free( self->data );
+        free( self );
+    }
+}
+
+void SRASplitterBatch_Reset( SRASplitterBatch* self )
+{
+    if ( self != NULL )
+    {
+        self->path_tail = 0;
+        self->data_len = 0;
+        self->active = false;
+    }
+}
+
+rc_t SRASplitterBatch_Write( SRASplitterBatch* self )
+{
+    rc_t rc = 0;
+    size_t offset = 0;
+    SRASplitterFile* file = NULL;
+    /* recently activated files, to avoid making key of each activation */
+    struct {
+        const char* keys;
+        uint32_t size;
+        SRASplitterFile* file;
+    } recent[ BATCH_RECENT_FILES ];
+    uint32_t i, next = 0;
+
+    if ( self == NULL )
+    {
+        return RC( rcExe, rcData, rcWriting, rcSelf, rcNull );
+    }
+    memset( recent, 0, sizeof( recent ) );
+
+    while ( rc == 0 && offset < self->data_len )
+    {
+        const SRASplitterBatchRecord* r = ( const SRASplitterBatchRecord* )&self->data[ offset ];
+        const char* data = ( const char* )( r + 1 );
+
+        offset += sizeof( *r ) + BATCH_ALIGN( r->size );
+        switch ( r->type )
+        {
+            case eBatchActivate :
+                file = NULL;
+                for ( i = 0; i < BATCH_RECENT_FILES; i++ )
+                {
+                    if ( recent[ i ].file != NULL && recent[ i ].size == r->size &&
+                         memcmp( recent[ i ].keys, data, r->size ) == 0 )
+                    {
+                        file = recent[ i ].file;
+                        break;
+                    }
+                }
+                if ( file == NULL )
+                {
+                    /* keys are pushed on top of filer prefix, last one is file key */
+                    uint64_t k, pushed = 0;
+                    const char* key = data;
+                    const SRASplitterFile* f = NULL;
+
+                    for ( k = 0; rc == 0 && k < r->pos; k++ )
+                    {
+                        if ( ( rc = SRASplitterFiler_PushKey( key ) ) == 0 )
+                        {
+                            pushed++;
+                            key += strlen( key ) + 1;
+                        }
+                    }
+                    if ( rc == 0 && ( rc = SRASplitterFiler_GetCurrFile( &f ) ) == 0 )
+                    {
+                        file = ( SRASplitterFile* )f;
+                        recent[ next ].keys = data;
+                        recent[ next ].size = r->size;
+                        recent[ next ].file = file;
+                        next = ( next + 1 ) % BATCH_RECENT_FILES;
+                    }
+                    while ( pushed-- > 0 )
+                    {
+                        rc_t rc2 = SRASplitterFiler_PopKey();
+                        rc = rc ? rc : rc2;
+                    }
+                }
+                break;
+
+            case eBatchWrite :
+            case eBatchWritePos :
+                if ( file == NULL )
+                {
+                    rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
+                }
+                else if ( r->type == eBatchWrite )
+                {
+                    rc = SRASplitterFiler_WriteSpot( file, r->spot, data, r->size );
+                }
+                else
+                {
+                    rc = SRASplitterFiler_WriteSpotPos( file, r->spot, r->pos, data, r->size );
+                }
+                break;
+
+            default :
+                rc = RC( rcExe, rcData, rcWriting, rcData, rcCorrupt );
+                break;
         }
     }
     return rc;
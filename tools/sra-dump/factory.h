@@ -132,6 +132,33 @@ rc_t SRASplitter_FileActivate(const SRASplitter* self, const char* key);
 rc_t SRASplitter_FileWrite( const SRASplitter* cself, spotid_t spot, const void* buf, size_t size );
 rc_t SRASplitter_FileWritePos( const SRASplitter* cself, spotid_t spot, uint64_t pos, const void* buf, size_t size );
 
+/**
+  * Rejection counters: filters add what they rejected on Release instead of printing it,
+  * so several chains of a parallel dump sum up into one line per reason.
+  * what [IN] - printf-like reason, e.g. "READS because READLEN < %u"
+  * NOT thread safe, chains are released by main thread
+  */
+rc_t SRASplitter_AddRejected(uint64_t qty, const char* what, ...);
+/* prints "Rejected <qty> <what>" for every reason in order reasons were added and resets counters */
+rc_t SRASplitter_RejectedReport(void);
+
+/**
+  * Batch records output of a splitter chain in memory instead of writing to files,
+  * so chains can run on several threads while files are written by one thread.
+  */
+typedef struct SRASplitterBatch SRASplitterBatch;
+
+rc_t SRASplitterBatch_Make(SRASplitterBatch** self);
+void SRASplitterBatch_Release(SRASplitterBatch* self);
+/* drops recorded output, memory is kept for next use */
+void SRASplitterBatch_Reset(SRASplitterBatch* self);
+/* writes recorded output to files in order it was recorded, NOT thread safe,
+   all batches must be written from same thread */
+rc_t SRASplitterBatch_Write(SRASplitterBatch* self);
+
+/* direct output of chain started with root splitter into batch, NULL restores writing to files */
+rc_t SRASplitter_SetBatch(const SRASplitter* root, SRASplitterBatch* batch);
+
 typedef struct SRASplitterFactory SRASplitterFactory;
 
 typedef rc_t (SRASplitterFactory_Init_Func)(const SRASplitterFactory* self);
@@ -146,9 +173,11 @@ typedef void (SRASplitterFactory_Release_Func)(const SRASplitterFactory* self);
   * key_as_dir [IN] - if true, subdirs created for each splitting level: SPOT_GROUP/1/prefix.fastq
   *                   if false, single file is used in split chain: prefix_SPOT_GROUP_1.fastq
   * prefix [IN]     - file name prefix, usually run id (accession)
+  * zip_threads [IN] - number of threads compressing gzip/bzip2 output, shared by all files, 1 compresses inline
   * path, ... [IN]  - path to directory where file will reside
   */
-rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool key_as_dir, bool keep_empty, const char* path, ...);
+rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, uint32_t zip_threads,
+                                  bool key_as_dir, bool keep_empty, const char* path, ...);
 /* this only works correctly on top of the splitter tree !! */
 rc_t SRASplitterFactory_FilerPrefix(const char* prefix);
 void SRASplitterFactory_FilerReport(uint64_t* total, uint64_t* biggest_file);
@@ -89,6 +89,11 @@ char _4na_to_ascii( INSDC_4na_bin c, bool reverse )
     return _4na_2_ascii_tab[ ( c & 0x0F ) | ( reverse ? 0x10 : 0 ) ];
 }
 
+const char * _4na_ascii_tab( bool reverse )
+{
+    return &( _4na_2_ascii_tab[ reverse ? 0x10 : 0 ] );
+}
+
 uint32_t _4na_to_index( INSDC_4na_bin c )
 {
     return _4na_2_index_tab[ ( c & 0x0F ) ];
@@ -37,6 +37,9 @@ extern "C" {
 char _4na_to_ascii( INSDC_4na_bin c, bool reverse );
 uint32_t _4na_to_index( INSDC_4na_bin c );
 
+/* the 16 entry table used by _4na_to_ascii(), for loops that convert many bases */
+const char * _4na_ascii_tab( bool reverse );
+
 #ifdef __cplusplus
 }
 #endif
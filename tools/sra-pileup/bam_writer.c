@@ -0,0 +1,1490 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <klib/rc.h>
+#include <klib/log.h>
+#include <klib/text.h>
+#include <klib/container.h>
+
+#include <kfs/directory.h>
+#include <kfs/file.h>
+
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <zlib.h>
+
+#include "bam_writer.h"
+#include "compressed_file.h"
+
+/* uncompressed bytes per BGZF block, chosen so that even a stored block fits in 64K */
+#define BGZF_BLOCK_SIZE 0xff00
+#define BGZF_MAX_BLOCK_SIZE 0x10000
+#define BGZF_HEADER_SIZE 18
+#define BGZF_FOOTER_SIZE 8
+
+/* binning scheme of BAI, CSI uses more levels for references longer than 512M */
+#define INDEX_MIN_SHIFT 14
+#define INDEX_DEPTH 5
+
+static const uint8_t bgzf_eof[ 28 ] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+
+typedef struct bw_buf
+{
+    uint8_t * base;
+    size_t len;
+    size_t max;
+} bw_buf;
+
+
+static rc_t bw_buf_reserve( bw_buf * self, size_t more )
+{
+    if ( self->len + more > self->max )
+    {
+        size_t max = self->max ? self->max : 4096;
+        uint8_t * tmp;
+
+        while ( max < self->len + more )
+            max += max;
+        tmp = realloc( self->base, max );
+        if ( tmp == NULL )
+            return RC( rcApp, rcBuffer, rcResizing, rcMemory, rcExhausted );
+        self->base = tmp;
+        self->max = max;
+    }
+    return 0;
+}
+
+
+static rc_t bw_buf_add( bw_buf * self, const void * data, size_t len )
+{
+    rc_t rc = bw_buf_reserve( self, len );
+    if ( rc == 0 )
+    {
+        memcpy( self->base + self->len, data, len );
+        self->len += len;
+    }
+    return rc;
+}
+
+
+static void put_u16( uint8_t * dst, uint32_t value )
+{
+    dst[ 0 ] = ( uint8_t )value;
+    dst[ 1 ] = ( uint8_t )( value >> 8 );
+}
+
+
+static void put_u32( uint8_t * dst, uint32_t value )
+{
+    dst[ 0 ] = ( uint8_t )value;
+    dst[ 1 ] = ( uint8_t )( value >> 8 );
+    dst[ 2 ] = ( uint8_t )( value >> 16 );
+    dst[ 3 ] = ( uint8_t )( value >> 24 );
+}
+
+
+static void put_u64( uint8_t * dst, uint64_t value )
+{
+    put_u32( dst, ( uint32_t )value );
+    put_u32( dst + 4, ( uint32_t )( value >> 32 ) );
+}
+
+
+static rc_t bw_buf_add_u32( bw_buf * self, uint32_t value )
+{
+    uint8_t b[ 4 ];
+    put_u32( b, value );
+    return bw_buf_add( self, b, sizeof b );
+}
+
+
+static rc_t bw_buf_add_u64( bw_buf * self, uint64_t value )
+{
+    uint8_t b[ 8 ];
+    put_u64( b, value );
+    return bw_buf_add( self, b, sizeof b );
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+/* BGZF framing: a gzip member with the BC extra field holding the block size,
+   z is a raw deflate stream ready for use, it is reset afterwards */
+static rc_t CC bgzf_compress( const uint8_t * udata, size_t ulen,
+                              uint8_t * c, size_t cdata_size, size_t * clen,
+                              z_stream * z )
+{
+    uLong crc = crc32( 0L, Z_NULL, 0 );
+    size_t len;
+    int zr;
+
+    z->next_in = ( Bytef * )udata;
+    z->avail_in = ( uInt )ulen;
+    z->next_out = c + BGZF_HEADER_SIZE;
+    z->avail_out = ( uInt )( cdata_size - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE );
+    zr = deflate( z, Z_FINISH );
+    if ( zr != Z_STREAM_END )
+    {
+        /* incompressible data, store it */
+        z_stream s;
+
+        deflateReset( z );
+        memset( &s, 0, sizeof s );
+        if ( deflateInit2( &s, Z_NO_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+            return RC( rcApp, rcBuffer, rcPacking, rcMemory, rcExhausted );
+        s.next_in = ( Bytef * )udata;
+        s.avail_in = ( uInt )ulen;
+        s.next_out = c + BGZF_HEADER_SIZE;
+        s.avail_out = ( uInt )( cdata_size - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE );
+        zr = deflate( &s, Z_FINISH );
+        len = s.total_out;
+        deflateEnd( &s );
+        if ( zr != Z_STREAM_END )
+            return RC( rcApp, rcBuffer, rcPacking, rcBuffer, rcInsufficient );
+    }
+    else
+    {
+        len = z->total_out;
+        deflateReset( z );
+    }
+    len += BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE;
+
+    c[ 0 ] = 0x1f; c[ 1 ] = 0x8b; c[ 2 ] = 0x08; c[ 3 ] = 0x04;
+    put_u32( c + 4, 0 );
+    c[ 8 ] = 0; c[ 9 ] = 0xff;
+    put_u16( c + 10, 6 );
+    c[ 12 ] = 'B'; c[ 13 ] = 'C';
+    put_u16( c + 14, 2 );
+    put_u16( c + 16, ( uint32_t )( len - 1 ) );
+
+    crc = crc32( crc, udata, ( uInt )ulen );
+    put_u32( c + len - 8, ( uint32_t )crc );
+    put_u32( c + len - 4, ( uint32_t )ulen );
+    * clen = len;
+    return 0;
+}
+
+
+/* the blocks are compressed by the shared block-compressor, the EOF block ends the stream */
+static const block_format bgzf_format =
+{
+    BGZF_BLOCK_SIZE, BGZF_MAX_BLOCK_SIZE, -15, bgzf_compress, bgzf_eof, sizeof bgzf_eof
+};
+
+
+/* --------------------------------------------------------------------------- */
+
+typedef struct bam_ref
+{
+    BSTNode node;
+    String name;
+    uint32_t len;
+    int32_t id;
+} bam_ref;
+
+
+static int CC bam_ref_find( const void * item, const BSTNode * n )
+{
+    return StringCompare( ( const String * )item, &( ( const bam_ref * )n )->name );
+}
+
+
+static int CC bam_ref_sort( const BSTNode * item, const BSTNode * n )
+{
+    return StringCompare( &( ( const bam_ref * )item )->name, &( ( const bam_ref * )n )->name );
+}
+
+
+typedef struct index_bin
+{
+    BSTNode node;
+    uint32_t bin;
+    uint32_t chunk_qty;
+    uint32_t chunk_max;
+    uint64_t * chunk;   /* pairs of begin and end offset */
+} index_bin;
+
+
+static int CC index_bin_find( const void * item, const BSTNode * n )
+{
+    uint32_t const bin = *( const uint32_t * )item;
+    uint32_t const other = ( ( const index_bin * )n )->bin;
+    return bin < other ? -1 : bin > other;
+}
+
+
+static int CC index_bin_sort( const BSTNode * item, const BSTNode * n )
+{
+    return index_bin_find( &( ( const index_bin * )item )->bin, n );
+}
+
+
+static void CC index_bin_whack( BSTNode * n, void * data )
+{
+    free( ( ( index_bin * )n )->chunk );
+    free( n );
+}
+
+
+/* offsets in the index are kept as block-number << 16 | offset-in-block
+   until the compressed position of each block is known */
+typedef struct ref_index
+{
+    BSTree bins;
+    uint64_t * linear;
+    uint32_t linear_qty;
+    uint64_t beg;
+    uint64_t end;
+    uint64_t mapped;
+    uint64_t unmapped;
+    bool used;
+} ref_index;
+
+
+/* --------------------------------------------------------------------------- */
+
+typedef struct bam_writer
+{
+    /* BGZF blocks, their positions are kept only when indexing */
+    struct block_stream * bs;
+    rc_t rc;
+
+    /* SAM header text, then records */
+    bw_buf line;
+    bw_buf header;
+    bw_buf part;
+    bool header_done;
+    bam_ref ** ref;
+    uint32_t ref_qty;
+    uint32_t ref_max;
+    BSTree ref_names;
+
+    /* index */
+    char * index_path;
+    bool indexing;
+    bool csi;
+    int depth;
+    ref_index * ridx;
+    int32_t idx_ref;
+    int32_t idx_pos;
+    uint32_t idx_bin;
+    uint64_t idx_chunk_beg;
+    uint64_t idx_last_end;
+    bool idx_chunk_open;
+    bool idx_unplaced;
+    uint64_t no_coor;
+} bam_writer;
+
+
+/* appends data to the uncompressed stream, the position of its first byte
+   is returned in *beg and the position after its end in *end */
+static rc_t bgzf_append( bam_writer * self, const uint8_t * data, size_t len,
+                         uint64_t * beg, uint64_t * end )
+{
+    return block_stream_append( self->bs, data, len, true, beg, end );
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+/* bin of the 0-based region [beg, end) */
+static uint32_t reg2bin( int64_t beg, int64_t end, int min_shift, int depth )
+{
+    int l, s = min_shift, t = ( ( 1 << depth * 3 ) - 1 ) / 7;
+
+    for ( --end, l = depth; l > 0; --l, s += 3, t -= 1 << l * 3 )
+    {
+        if ( beg >> s == end >> s )
+            return ( uint32_t )( t + ( beg >> s ) );
+    }
+    return 0;
+}
+
+
+static void stop_indexing( bam_writer * self, const char * reason )
+{
+    uint32_t i;
+
+    if ( self->ridx != NULL )
+    {
+        for ( i = 0; i < self->ref_qty; ++i )
+        {
+            BSTreeWhack( &self->ridx[ i ].bins, index_bin_whack, NULL );
+            free( self->ridx[ i ].linear );
+        }
+        free( self->ridx );
+        self->ridx = NULL;
+    }
+    if ( self->indexing && reason != NULL )
+    {
+        PLOGMSG( klogWarn, ( klogWarn, "index '$(f)' not written: $(r)",
+                             "f=%s,r=%s", self->index_path, reason ) );
+    }
+    self->indexing = false;
+}
+
+
+/* records the chunk of the open bin */
+static rc_t index_save_chunk( bam_writer * self )
+{
+    ref_index * const ri = &self->ridx[ self->idx_ref ];
+    index_bin * b = ( index_bin * )BSTreeFind( &ri->bins, &self->idx_bin, index_bin_find );
+
+    self->idx_chunk_open = false;
+    if ( b == NULL )
+    {
+        b = calloc( 1, sizeof * b );
+        if ( b == NULL )
+            return RC( rcApp, rcIndex, rcInserting, rcMemory, rcExhausted );
+        b->bin = self->idx_bin;
+        BSTreeInsert( &ri->bins, &b->node, index_bin_sort );
+    }
+    /* chunks ending in the block the new one starts in are merged */
+    if ( b->chunk_qty > 0 && ( b->chunk[ 2 * b->chunk_qty - 1 ] >> 16 ) >= ( self->idx_chunk_beg >> 16 ) )
+    {
+        b->chunk[ 2 * b->chunk_qty - 1 ] = self->idx_last_end;
+        return 0;
+    }
+    if ( b->chunk_qty == b->chunk_max )
+    {
+        uint32_t max = b->chunk_max ? b->chunk_max * 2 : 4;
+        uint64_t * tmp = realloc( b->chunk, 2 * max * sizeof tmp[ 0 ] );
+        if ( tmp == NULL )
+            return RC( rcApp, rcIndex, rcInserting, rcMemory, rcExhausted );
+        b->chunk = tmp;
+        b->chunk_max = max;
+    }
+    b->chunk[ 2 * b->chunk_qty ] = self->idx_chunk_beg;
+    b->chunk[ 2 * b->chunk_qty + 1 ] = self->idx_last_end;
+    ++b->chunk_qty;
+    return 0;
+}
+
+
+/* adds a record placed at [pos, end) of reference ref_id,
+   stored from offset beg to offset end_ofs of the uncompressed stream */
+static rc_t index_record( bam_writer * self, int32_t ref_id, int64_t pos, int64_t end,
+                          bool unmapped, uint64_t beg_ofs, uint64_t end_ofs )
+{
+    rc_t rc = 0;
+    ref_index * ri;
+    uint32_t bin;
+    int64_t w, last_w;
+
+    if ( ref_id < 0 )
+    {
+        ++self->no_coor;
+        self->idx_unplaced = true;
+        return 0;
+    }
+    if ( self->idx_unplaced || ref_id < self->idx_ref || ( ref_id == self->idx_ref && pos < self->idx_pos ) )
+    {
+        stop_indexing( self, "records are not sorted by position" );
+        return 0;
+    }
+    if ( ref_id != self->idx_ref )
+    {
+        if ( self->idx_chunk_open )
+            rc = index_save_chunk( self );
+        self->idx_ref = ref_id;
+        self->ridx[ ref_id ].beg = beg_ofs;
+        self->ridx[ ref_id ].used = true;
+    }
+    ri = &self->ridx[ ref_id ];
+    if ( pos < 0 )
+        pos = 0;
+    if ( end <= pos )
+        end = pos + 1;
+
+    bin = reg2bin( pos, end, INDEX_MIN_SHIFT, self->depth );
+    if ( rc == 0 && self->idx_chunk_open && bin != self->idx_bin )
+        rc = index_save_chunk( self );
+    if ( rc == 0 && !self->idx_chunk_open )
+    {
+        self->idx_bin = bin;
+        self->idx_chunk_beg = beg_ofs;
+        self->idx_chunk_open = true;
+    }
+
+    /* linear index: first record overlapping each window */
+    last_w = ( end - 1 ) >> INDEX_MIN_SHIFT;
+    if ( rc == 0 && last_w >= ri->linear_qty )
+    {
+        uint32_t qty = ri->linear_qty ? ri->linear_qty : 64;
+        uint64_t * tmp;
+
+        while ( qty <= last_w )
+            qty *= 2;
+        tmp = realloc( ri->linear, qty * sizeof tmp[ 0 ] );
+        if ( tmp == NULL )
+            rc = RC( rcApp, rcIndex, rcInserting, rcMemory, rcExhausted );
+        else
+        {
+            memset( tmp + ri->linear_qty, 0, ( qty - ri->linear_qty ) * sizeof tmp[ 0 ] );
+            ri->linear = tmp;
+            ri->linear_qty = qty;
+        }
+    }
+    for ( w = pos >> INDEX_MIN_SHIFT; rc == 0 && w <= last_w; ++w )
+    {
+        if ( ri->linear[ w ] == 0 )
+            ri->linear[ w ] = beg_ofs;
+    }
+
+    if ( unmapped )
+        ++ri->unmapped;
+    else
+        ++ri->mapped;
+    ri->end = end_ofs;
+    self->idx_pos = ( int32_t )pos;
+    self->idx_last_end = end_ofs;
+    return rc;
+}
+
+
+static uint64_t index_offset( const bam_writer * self, uint64_t ofs )
+{
+    return block_stream_offset( self->bs, ofs );
+}
+
+
+typedef struct index_out
+{
+    const bam_writer * bw;
+    const ref_index * ri;
+    bw_buf * buf;
+    rc_t rc;
+} index_out;
+
+
+static void CC index_out_bin( BSTNode * n, void * data )
+{
+    const index_bin * b = ( const index_bin * )n;
+    index_out * o = data;
+    uint32_t i;
+
+    if ( o->rc != 0 )
+        return;
+    o->rc = bw_buf_add_u32( o->buf, b->bin );
+    if ( o->rc == 0 && o->bw->csi )
+    {
+        /* offset of the first record overlapping the start of the bin */
+        int l = 0, s;
+        uint32_t first = 0, level_ofs = 0;
+        uint64_t loff = 0;
+
+        while ( l < o->bw->depth && b->bin >= ( uint32_t )( ( ( 1 << ( l + 1 ) * 3 ) - 1 ) / 7 ) )
+            ++l;
+        level_ofs = ( ( 1 << l * 3 ) - 1 ) / 7;
+        s = INDEX_MIN_SHIFT + 3 * ( o->bw->depth - l );
+        first = ( uint32_t )( ( ( uint64_t )( b->bin - level_ofs ) << s ) >> INDEX_MIN_SHIFT );
+        if ( first < o->ri->linear_qty )
+            loff = o->ri->linear[ first ];
+        o->rc = bw_buf_add_u64( o->buf, loff ? index_offset( o->bw, loff ) : 0 );
+    }
+    if ( o->rc == 0 )
+        o->rc = bw_buf_add_u32( o->buf, b->chunk_qty );
+    for ( i = 0; o->rc == 0 && i < 2 * b->chunk_qty; ++i )
+        o->rc = bw_buf_add_u64( o->buf, index_offset( o->bw, b->chunk[ i ] ) );
+}
+
+
+static void CC index_count_bin( BSTNode * n, void * data )
+{
+    ++*( uint32_t * )data;
+}
+
+
+static rc_t index_serialize( bam_writer * self, bw_buf * buf )
+{
+    rc_t rc;
+    uint32_t i;
+    uint32_t const pseudo_bin = ( ( 1 << ( self->depth + 1 ) * 3 ) - 1 ) / 7 + 1;
+
+    if ( self->csi )
+    {
+        rc = bw_buf_add( buf, "CSI\1", 4 );
+        if ( rc == 0 ) rc = bw_buf_add_u32( buf, INDEX_MIN_SHIFT );
+        if ( rc == 0 ) rc = bw_buf_add_u32( buf, self->depth );
+        if ( rc == 0 ) rc = bw_buf_add_u32( buf, 0 );
+    }
+    else
+        rc = bw_buf_add( buf, "BAI\1", 4 );
+    if ( rc == 0 )
+        rc = bw_buf_add_u32( buf, self->ref_qty );
+
+    for ( i = 0; rc == 0 && i < self->ref_qty; ++i )
+    {
+        ref_index * const ri = &self->ridx[ i ];
+        uint32_t bins = 0;
+
+        if ( !ri->used )
+        {
+            rc = bw_buf_add_u32( buf, 0 );
+            if ( rc == 0 && !self->csi )
+                rc = bw_buf_add_u32( buf, 0 );
+            continue;
+        }
+
+        /* windows without records start where an earlier one does */
+        {
+            uint32_t w, n = ri->linear_qty;
+            uint64_t prev = 0;
+
+            while ( n > 0 && ri->linear[ n - 1 ] == 0 )
+                --n;
+            for ( w = 0; w < n; ++w )
+            {
+                if ( ri->linear[ w ] == 0 )
+                    ri->linear[ w ] = prev ? prev : ri->beg;
+                else
+                    prev = ri->linear[ w ];
+            }
+            ri->linear_qty = n;
+        }
+
+        BSTreeForEach( &ri->bins, false, index_count_bin, &bins );
+        rc = bw_buf_add_u32( buf, bins + 1 );
+        if ( rc == 0 )
+        {
+            index_out o;
+            o.bw = self;
+            o.ri = ri;
+            o.buf = buf;
+            o.rc = 0;
+            BSTreeForEach( &ri->bins, false, index_out_bin, &o );
+            rc = o.rc;
+        }
+        /* pseudo-bin with the extent of the reference and the record counts */
+        if ( rc == 0 ) rc = bw_buf_add_u32( buf, pseudo_bin );
+        if ( rc == 0 && self->csi ) rc = bw_buf_add_u64( buf, 0 );
+        if ( rc == 0 ) rc = bw_buf_add_u32( buf, 2 );
+        if ( rc == 0 ) rc = bw_buf_add_u64( buf, index_offset( self, ri->beg ) );
+        if ( rc == 0 ) rc = bw_buf_add_u64( buf, index_offset( self, ri->end ) );
+        if ( rc == 0 ) rc = bw_buf_add_u64( buf, ri->mapped );
+        if ( rc == 0 ) rc = bw_buf_add_u64( buf, ri->unmapped );
+
+        if ( rc == 0 && !self->csi )
+        {
+            uint32_t w;
+
+            rc = bw_buf_add_u32( buf, ri->linear_qty );
+            for ( w = 0; rc == 0 && w < ri->linear_qty; ++w )
+                rc = bw_buf_add_u64( buf, index_offset( self, ri->linear[ w ] ) );
+        }
+    }
+    if ( rc == 0 )
+        rc = bw_buf_add_u64( buf, self->no_coor );
+    return rc;
+}
+
+
+static rc_t write_index( bam_writer * self )
+{
+    bw_buf buf;
+    KDirectory * dir;
+    KFile * f = NULL;
+    rc_t rc;
+
+    memset( &buf, 0, sizeof buf );
+    if ( self->idx_chunk_open )
+    {
+        rc = index_save_chunk( self );
+        if ( rc != 0 )
+            return rc;
+    }
+    rc = index_serialize( self, &buf );
+    if ( rc == 0 )
+    {
+        rc = KDirectoryNativeDir( &dir );
+        if ( rc == 0 )
+        {
+            rc = KDirectoryCreateFile( dir, &f, false, 0664, kcmInit, "%s", self->index_path );
+            KDirectoryRelease( dir );
+        }
+        if ( rc != 0 )
+            PLOGERR( klogErr, ( klogErr, rc, "cannot create index '$(f)'", "f=%s", self->index_path ) );
+    }
+    if ( rc == 0 )
+    {
+        size_t num_writ;
+
+        if ( !self->csi )
+            rc = KFileWriteAll( f, 0, buf.base, buf.len, &num_writ );
+        else
+        {
+            /* CSI is BGZF compressed itself, on this thread */
+            struct block_stream * bs;
+
+            rc = make_block_stream( &bs, f, &bgzf_format, NULL, false );
+            if ( rc == 0 )
+            {
+                rc = block_stream_append( bs, buf.base, buf.len, false, NULL, NULL );
+                if ( rc == 0 )
+                    rc = block_stream_flush( bs );
+                release_block_stream( bs );
+            }
+        }
+        KFileRelease( f );
+    }
+    free( buf.base );
+    return rc;
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+static rc_t add_ref( bam_writer * self, const char * name, size_t name_len, uint32_t len )
+{
+    bam_ref * r;
+    String key;
+
+    StringInit( &key, name, name_len, ( uint32_t )name_len );
+    if ( BSTreeFind( &self->ref_names, &key, bam_ref_find ) != NULL )
+        return 0;
+    if ( self->ref_qty == self->ref_max )
+    {
+        uint32_t max = self->ref_max ? self->ref_max * 2 : 64;
+        bam_ref ** tmp = realloc( self->ref, max * sizeof tmp[ 0 ] );
+        if ( tmp == NULL )
+            return RC( rcApp, rcHeader, rcInserting, rcMemory, rcExhausted );
+        self->ref = tmp;
+        self->ref_max = max;
+    }
+    r = malloc( sizeof * r + name_len + 1 );
+    if ( r == NULL )
+        return RC( rcApp, rcHeader, rcInserting, rcMemory, rcExhausted );
+    memcpy( r + 1, name, name_len );
+    ( ( char * )( r + 1 ) )[ name_len ] = 0;
+    StringInit( &r->name, ( const char * )( r + 1 ), name_len, ( uint32_t )name_len );
+    r->len = len;
+    r->id = ( int32_t )self->ref_qty;
+    self->ref[ self->ref_qty++ ] = r;
+    BSTreeInsert( &self->ref_names, &r->node, bam_ref_sort );
+    return 0;
+}
+
+
+/* @SQ lines define the references, in their order */
+static rc_t header_line( bam_writer * self, const char * line, size_t len )
+{
+    rc_t rc = bw_buf_add( &self->header, line, len );
+    if ( rc == 0 )
+        rc = bw_buf_add( &self->header, "\n", 1 );
+    if ( rc == 0 && len > 4 && memcmp( line, "@SQ\t", 4 ) == 0 )
+    {
+        const char * name = NULL;
+        size_t name_len = 0;
+        uint32_t ref_len = 0;
+        const char * p = line + 3;
+        const char * const end = line + len;
+
+        while ( p < end )
+        {
+            const char * f = p + 1;
+            const char * fe = memchr( f, '\t', end - f );
+
+            if ( fe == NULL )
+                fe = end;
+            if ( fe - f > 3 && memcmp( f, "SN:", 3 ) == 0 )
+            {
+                name = f + 3;
+                name_len = fe - name;
+            }
+            else if ( fe - f > 3 && memcmp( f, "LN:", 3 ) == 0 )
+                ref_len = ( uint32_t )strtoul( f + 3, NULL, 10 );
+            p = fe;
+        }
+        if ( name != NULL )
+            rc = add_ref( self, name, name_len, ref_len );
+    }
+    return rc;
+}
+
+
+static rc_t write_header( bam_writer * self )
+{
+    rc_t rc;
+    uint32_t i;
+    uint8_t b[ 4 ];
+
+    self->header_done = true;
+    rc = bgzf_append( self, ( const uint8_t * )"BAM\1", 4, NULL, NULL );
+    put_u32( b, ( uint32_t )self->header.len );
+    if ( rc == 0 )
+        rc = bgzf_append( self, b, 4, NULL, NULL );
+    if ( rc == 0 )
+        rc = bgzf_append( self, self->header.base, self->header.len, NULL, NULL );
+    put_u32( b, self->ref_qty );
+    if ( rc == 0 )
+        rc = bgzf_append( self, b, 4, NULL, NULL );
+    for ( i = 0; rc == 0 && i < self->ref_qty; ++i )
+    {
+        const bam_ref * r = self->ref[ i ];
+
+        put_u32( b, r->name.size + 1 );
+        rc = bgzf_append( self, b, 4, NULL, NULL );
+        if ( rc == 0 )
+            rc = bgzf_append( self, ( const uint8_t * )r->name.addr, r->name.size + 1, NULL, NULL );
+        put_u32( b, r->len );
+        if ( rc == 0 )
+            rc = bgzf_append( self, b, 4, NULL, NULL );
+    }
+
+    if ( rc == 0 && self->indexing )
+    {
+        uint64_t max_len = 0;
+
+        for ( i = 0; i < self->ref_qty; ++i )
+        {
+            if ( self->ref[ i ]->len > max_len )
+                max_len = self->ref[ i ]->len;
+        }
+        self->depth = INDEX_DEPTH;
+        while ( max_len > ( ( uint64_t )1 << ( INDEX_MIN_SHIFT + 3 * self->depth ) ) )
+            ++self->depth;
+        /* like unsorted records, this only costs the index and not the BAM */
+        if ( self->depth > INDEX_DEPTH && !self->csi )
+        {
+            stop_indexing( self, "references are longer than 512M, use a '.csi' index" );
+            return 0;
+        }
+        self->ridx = calloc( self->ref_qty ? self->ref_qty : 1, sizeof self->ridx[ 0 ] );
+        if ( self->ridx == NULL )
+            return RC( rcApp, rcIndex, rcConstructing, rcMemory, rcExhausted );
+        for ( i = 0; i < self->ref_qty; ++i )
+            BSTreeInit( &self->ridx[ i ].bins );
+        self->idx_ref = -1;
+    }
+    return rc;
+}
+
+
+/* an empty name or '*' is no reference */
+static rc_t find_ref( const bam_writer * self, const char * name, size_t len, int32_t * id )
+{
+    String key;
+    const bam_ref * r;
+
+    if ( len == 0 || ( len == 1 && name[ 0 ] == '*' ) )
+    {
+        *id = -1;
+        return 0;
+    }
+    StringInit( &key, name, len, ( uint32_t )len );
+    r = ( const bam_ref * )BSTreeFind( &self->ref_names, &key, bam_ref_find );
+    if ( r == NULL )
+    {
+        rc_t rc = RC( rcApp, rcData, rcEncoding, rcId, rcNotFound );
+        PLOGERR( klogErr, ( klogErr, rc, "reference '$(r)' is not in the SAM header",
+                            "r=%.*s", ( int )len, name ) );
+        return rc;
+    }
+    *id = r->id;
+    return 0;
+}
+
+
+static const int8_t cigar_code[ 128 ] =
+{
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 7,-1,-1,
+    -1,-1,-1,-1, 2,-1,-1,-1, 5, 1,-1,-1,-1, 0, 3,-1,
+     6,-1,-1, 4,-1,-1,-1,-1, 8,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+
+
+/* "=ACMGRSVTWYHKDBN" */
+static const uint8_t seq_code[ 128 ] =
+{
+    15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+    15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+    15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+    15,15,15,15,15,15,15,15,15,15,15,15,15, 0,15,15,
+    15, 1,14, 2,13,15,15, 4,11,15,15,12,15, 3,15,15,
+    15,15, 5, 6, 8,15, 7, 9,15,10,15,15,15,15,15,15,
+    15, 1,14, 2,13,15,15, 4,11,15,15,12,15, 3,15,15,
+    15,15, 5, 6, 8,15, 7, 9,15,10,15,15,15,15,15,15
+};
+
+
+/* M, D, N, =, X consume the reference */
+static bool cigar_on_ref( uint32_t code )
+{
+    return code == 0 || code == 2 || code == 3 || code == 7 || code == 8;
+}
+
+
+static rc_t bad_record( const char * what )
+{
+    rc_t rc = RC( rcApp, rcData, rcEncoding, rcFormat, rcInvalid );
+    PLOGERR( klogErr, ( klogErr, rc, "cannot encode BAM record: $(w)", "w=%s", what ) );
+    return rc;
+}
+
+
+/* type and value of an integer field, in the smallest type holding it */
+static rc_t add_int_value( bw_buf * rec, int64_t v )
+{
+    uint8_t b[ 5 ];
+
+    if ( v < 0 )
+    {
+        if ( v >= -128 )
+        {
+            b[ 0 ] = 'c'; b[ 1 ] = ( uint8_t )v;
+            return bw_buf_add( rec, b, 2 );
+        }
+        if ( v >= -32768 )
+        {
+            b[ 0 ] = 's'; put_u16( b + 1, ( uint32_t )v );
+            return bw_buf_add( rec, b, 3 );
+        }
+        b[ 0 ] = 'i'; put_u32( b + 1, ( uint32_t )v );
+        return bw_buf_add( rec, b, 5 );
+    }
+    if ( v <= 255 )
+    {
+        b[ 0 ] = 'C'; b[ 1 ] = ( uint8_t )v;
+        return bw_buf_add( rec, b, 2 );
+    }
+    if ( v <= 65535 )
+    {
+        b[ 0 ] = 'S'; put_u16( b + 1, ( uint32_t )v );
+        return bw_buf_add( rec, b, 3 );
+    }
+    b[ 0 ] = 'I'; put_u32( b + 1, ( uint32_t )v );
+    return bw_buf_add( rec, b, 5 );
+}
+
+
+/* one SAM optional field, tag is NUL-terminated */
+static rc_t encode_tag( bw_buf * rec, const char * tag )
+{
+    size_t const len = strlen( tag );
+    uint8_t b[ 8 ];
+    rc_t rc;
+
+    if ( len < 5 || tag[ 2 ] != ':' || tag[ 4 ] != ':' )
+        return bad_record( "optional field" );
+    rc = bw_buf_add( rec, tag, 2 );
+    if ( rc != 0 )
+        return rc;
+    switch ( tag[ 3 ] )
+    {
+    case 'A' :
+        b[ 0 ] = 'A';
+        b[ 1 ] = tag[ 5 ];
+        return bw_buf_add( rec, b, 2 );
+
+    case 'i' :
+        return add_int_value( rec, strtoll( tag + 5, NULL, 10 ) );
+
+    case 'f' :
+        {
+            float const f = strtof( tag + 5, NULL );
+            uint32_t u;
+            memcpy( &u, &f, 4 );
+            b[ 0 ] = 'f'; put_u32( b + 1, u );
+            return bw_buf_add( rec, b, 5 );
+        }
+
+    case 'Z' :
+    case 'H' :
+        /* type, then the value with its terminating NUL */
+        rc = bw_buf_add( rec, tag + 3, 1 );
+        if ( rc == 0 )
+            rc = bw_buf_add( rec, tag + 5, len - 5 + 1 );
+        return rc;
+
+    case 'B' :
+        {
+            char const sub = tag[ 5 ];
+            const char * p = tag + 6;
+            uint32_t count = 0;
+            size_t count_at;
+
+            b[ 0 ] = 'B'; b[ 1 ] = sub;
+            rc = bw_buf_add( rec, b, 2 );
+            count_at = rec->len;
+            if ( rc == 0 )
+                rc = bw_buf_add_u32( rec, 0 );
+            while ( rc == 0 && *p == ',' )
+            {
+                char * e;
+                ++p;
+                switch ( sub )
+                {
+                case 'c' : case 'C' :
+                    b[ 0 ] = ( uint8_t )strtol( p, &e, 10 );
+                    rc = bw_buf_add( rec, b, 1 );
+                    break;
+                case 's' : case 'S' :
+                    put_u16( b, ( uint32_t )strtol( p, &e, 10 ) );
+                    rc = bw_buf_add( rec, b, 2 );
+                    break;
+                case 'i' : case 'I' :
+                    put_u32( b, ( uint32_t )strtoll( p, &e, 10 ) );
+                    rc = bw_buf_add( rec, b, 4 );
+                    break;
+                case 'f' :
+                    {
+                        float const f = strtof( p, &e );
+                        uint32_t u;
+                        memcpy( &u, &f, 4 );
+                        put_u32( b, u );
+                        rc = bw_buf_add( rec, b, 4 );
+                    }
+                    break;
+                default :
+                    return bad_record( "array type" );
+                }
+                p = e;
+                ++count;
+            }
+            if ( rc == 0 )
+                put_u32( rec->base + count_at, count );
+            return rc;
+        }
+    }
+    return bad_record( "optional field type" );
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+typedef struct bam_record
+{
+    const bam_writer * bw;
+    bw_buf qname;
+    bw_buf cigar;
+    bw_buf seq;
+    bw_buf qual;
+    bw_buf tags;
+    bw_buf text;    /* NUL-terminated copy of SAM optional fields */
+    bw_buf rec;
+    int32_t ref_id;
+    int32_t pos;
+    int32_t next_id;
+    int32_t next_pos;
+    int32_t tlen;
+    int64_t ref_len;
+    uint32_t flag;
+    uint32_t n_cigar;
+    uint32_t l_seq;
+    uint8_t mapq;
+} bam_record;
+
+
+rc_t make_bam_record( struct bam_record ** rec, const struct bam_writer * bw )
+{
+    bam_record * self;
+
+    if ( rec == NULL || bw == NULL )
+        return RC( rcApp, rcData, rcConstructing, rcParam, rcNull );
+    self = calloc( 1, sizeof * self );
+    if ( self == NULL )
+        return RC( rcApp, rcData, rcConstructing, rcMemory, rcExhausted );
+    self->bw = bw;
+    *rec = self;
+    return 0;
+}
+
+
+rc_t release_bam_record( struct bam_record * self )
+{
+    if ( self != NULL )
+    {
+        free( self->qname.base );
+        free( self->cigar.base );
+        free( self->seq.base );
+        free( self->qual.base );
+        free( self->tags.base );
+        free( self->text.base );
+        free( self->rec.base );
+        free( self );
+    }
+    return 0;
+}
+
+
+rc_t bam_record_start( struct bam_record * self, const char * rname, size_t rname_len,
+                       int32_t pos, uint8_t mapq, uint32_t flag )
+{
+    self->qname.len = 0;
+    self->cigar.len = 0;
+    self->seq.len = 0;
+    self->qual.len = 0;
+    self->tags.len = 0;
+    self->pos = pos;
+    self->next_id = -1;
+    self->next_pos = -1;
+    self->tlen = 0;
+    self->ref_len = 0;
+    self->flag = flag;
+    self->n_cigar = 0;
+    self->l_seq = 0;
+    self->mapq = mapq;
+    return find_ref( self->bw, rname, rname_len, &self->ref_id );
+}
+
+
+rc_t bam_record_mate( struct bam_record * self, const char * rnext, size_t rnext_len,
+                      int32_t pnext, int32_t tlen )
+{
+    self->next_pos = pnext;
+    self->tlen = tlen;
+    return find_ref( self->bw, rnext, rnext_len, &self->next_id );
+}
+
+
+rc_t bam_record_qname( struct bam_record * self, const char * name, size_t len )
+{
+    return bw_buf_add( &self->qname, name, len );
+}
+
+
+rc_t bam_record_cigar_op( struct bam_record * self, uint32_t count, char op )
+{
+    int const code = ( unsigned char )op < 128 ? cigar_code[ ( unsigned char )op ] : -1;
+
+    if ( code < 0 )
+        return bad_record( "CIGAR" );
+    if ( cigar_on_ref( ( uint32_t )code ) )
+        self->ref_len += count;
+    ++self->n_cigar;
+    return bw_buf_add_u32( &self->cigar, ( count << 4 ) | ( uint32_t )code );
+}
+
+
+rc_t bam_record_cigar( struct bam_record * self, const char * cigar, size_t len )
+{
+    rc_t rc = 0;
+    const char * c = cigar;
+    const char * const end = cigar + len;
+
+    if ( len == 1 && cigar[ 0 ] == '*' )
+        return 0;
+    while ( rc == 0 && c < end )
+    {
+        uint32_t count = 0;
+
+        while ( c < end && *c >= '0' && *c <= '9' )
+            count = count * 10 + ( uint32_t )( *c++ - '0' );
+        if ( c == end )
+            return bad_record( "CIGAR" );
+        rc = bam_record_cigar_op( self, count, *c++ );
+    }
+    return rc;
+}
+
+
+rc_t bam_record_seq( struct bam_record * self, const char * bases, size_t len )
+{
+    const uint8_t * const s = ( const uint8_t * )bases;
+    uint8_t * d;
+    size_t i;
+    rc_t rc;
+
+    self->seq.len = 0;
+    rc = bw_buf_reserve( &self->seq, ( len + 1 ) / 2 );
+    if ( rc != 0 )
+        return rc;
+    /* 2 bases per byte */
+    d = self->seq.base;
+    for ( i = 0; i < len; i += 2 )
+    {
+        uint8_t const hi = seq_code[ s[ i ] & 0x7f ];
+        uint8_t const lo = ( i + 1 < len ) ? seq_code[ s[ i + 1 ] & 0x7f ] : 0;
+        *d++ = ( uint8_t )( ( hi << 4 ) | lo );
+    }
+    self->seq.len = ( len + 1 ) / 2;
+    self->l_seq = ( uint32_t )len;
+    return 0;
+}
+
+
+rc_t bam_record_qual( struct bam_record * self, const char * qual, size_t len )
+{
+    size_t i;
+    rc_t rc;
+
+    self->qual.len = 0;
+    rc = bw_buf_reserve( &self->qual, len );
+    if ( rc != 0 )
+        return rc;
+    for ( i = 0; i < len; ++i )
+        self->qual.base[ i ] = ( uint8_t )( qual[ i ] - 33 );
+    self->qual.len = len;
+    return 0;
+}
+
+
+rc_t bam_record_tag_str( struct bam_record * self, const char tag[ 2 ], const char * value, size_t len )
+{
+    rc_t rc = bw_buf_add( &self->tags, tag, 2 );
+    if ( rc == 0 )
+        rc = bw_buf_add( &self->tags, "Z", 1 );
+    if ( rc == 0 )
+        rc = bw_buf_add( &self->tags, value, len );
+    if ( rc == 0 )
+        rc = bw_buf_add( &self->tags, "", 1 );
+    return rc;
+}
+
+
+rc_t bam_record_tag_int( struct bam_record * self, const char tag[ 2 ], int64_t value )
+{
+    rc_t rc = bw_buf_add( &self->tags, tag, 2 );
+    if ( rc == 0 )
+        rc = add_int_value( &self->tags, value );
+    return rc;
+}
+
+
+rc_t bam_record_tags_sam( struct bam_record * self, const char * text, size_t len )
+{
+    rc_t rc;
+    char * p;
+
+    self->text.len = 0;
+    rc = bw_buf_add( &self->text, text, len );
+    if ( rc == 0 )
+        rc = bw_buf_add( &self->text, "", 1 );
+    p = ( char * )self->text.base;
+    while ( rc == 0 && p != NULL && *p != 0 )
+    {
+        char * tab = strchr( p, '\t' );
+
+        if ( tab != NULL )
+            *tab++ = 0;
+        if ( *p != 0 )
+            rc = encode_tag( &self->tags, p );
+        p = tab;
+    }
+    return rc;
+}
+
+
+rc_t bam_record_finish( struct bam_record * self, const void ** data, size_t * len )
+{
+    bw_buf * const r = &self->rec;
+    size_t const l_qname = ( self->qname.len ? self->qname.len : 1 ) + 1;
+    bool const unmapped = ( self->flag & 4 ) != 0 || self->n_cigar == 0;
+    int64_t const end = ( unmapped || self->ref_len <= 0 ) ? ( int64_t )self->pos + 1 : self->pos + self->ref_len;
+    uint8_t * core;
+    rc_t rc;
+
+    if ( l_qname > 255 )
+        return bad_record( "QNAME too long" );
+    if ( self->n_cigar > 0xffff )
+        return bad_record( "too many CIGAR operations" );
+    if ( self->qual.len != 0 && self->qual.len != self->l_seq )
+        return bad_record( "QUAL and SEQ differ in length" );
+
+    r->len = 0;
+    rc = bw_buf_reserve( r, 36 + l_qname + self->cigar.len + self->seq.len + self->l_seq + self->tags.len );
+    if ( rc != 0 )
+        return rc;
+    core = r->base;
+    put_u32( core + 4, ( uint32_t )self->ref_id );
+    put_u32( core + 8, ( uint32_t )self->pos );
+    core[ 12 ] = ( uint8_t )l_qname;
+    core[ 13 ] = self->mapq;
+    put_u16( core + 14, reg2bin( self->pos, end, INDEX_MIN_SHIFT, INDEX_DEPTH ) );
+    put_u16( core + 16, self->n_cigar );
+    put_u16( core + 18, self->flag );
+    put_u32( core + 20, self->l_seq );
+    put_u32( core + 24, ( uint32_t )self->next_id );
+    put_u32( core + 28, ( uint32_t )self->next_pos );
+    put_u32( core + 32, ( uint32_t )self->tlen );
+    r->len = 36;
+
+    /* the space is reserved, the adds cannot fail */
+    if ( self->qname.len > 0 )
+        bw_buf_add( r, self->qname.base, self->qname.len );
+    else
+        bw_buf_add( r, "*", 1 );
+    bw_buf_add( r, "", 1 );
+    bw_buf_add( r, self->cigar.base, self->cigar.len );
+    bw_buf_add( r, self->seq.base, self->seq.len );
+    if ( self->qual.len > 0 )
+        bw_buf_add( r, self->qual.base, self->qual.len );
+    else
+    {
+        memset( r->base + r->len, 0xff, self->l_seq );
+        r->len += self->l_seq;
+    }
+    bw_buf_add( r, self->tags.base, self->tags.len );
+    put_u32( core, ( uint32_t )( r->len - 4 ) );
+
+    *data = r->base;
+    *len = r->len;
+    return 0;
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+static uint32_t get_u16( const uint8_t * src )
+{
+    return ( uint32_t )src[ 0 ] | ( ( uint32_t )src[ 1 ] << 8 );
+}
+
+
+static uint32_t get_u32( const uint8_t * src )
+{
+    return get_u16( src ) | ( get_u16( src + 2 ) << 16 );
+}
+
+
+/* one complete record made by bam_record_finish(), its end on the reference is found from its CIGAR */
+static rc_t write_record( bam_writer * self, const uint8_t * r, size_t len )
+{
+    int32_t ref_id, pos;
+    uint32_t n_cigar, flag;
+    uint64_t beg_ofs, end_ofs;
+    rc_t rc;
+
+    if ( len < 36 )
+        return bad_record( "truncated record" );
+    ref_id = ( int32_t )get_u32( r + 4 );
+    pos = ( int32_t )get_u32( r + 8 );
+    n_cigar = get_u16( r + 16 );
+    flag = get_u16( r + 18 );
+    if ( 36 + ( size_t )r[ 12 ] + 4 * ( size_t )n_cigar > len )
+        return bad_record( "truncated record" );
+
+    rc = bgzf_append( self, r, len, &beg_ofs, &end_ofs );
+    if ( rc == 0 && self->indexing )
+    {
+        const uint8_t * const c = r + 36 + r[ 12 ];
+        int64_t end = pos;
+        uint32_t i;
+
+        for ( i = 0; i < n_cigar; ++i )
+        {
+            uint32_t const op = get_u32( c + 4 * i );
+            if ( cigar_on_ref( op & 0xf ) )
+                end += op >> 4;
+        }
+        if ( ( flag & 4 ) != 0 || n_cigar == 0 || end <= pos )
+            end = ( int64_t )pos + 1;
+        rc = index_record( self, ref_id, pos, end, ( flag & 4 ) != 0, beg_ofs, end_ofs );
+    }
+    return rc;
+}
+
+
+/* records may be split between calls, the piece of one is kept in part */
+static rc_t write_records( bam_writer * self, const uint8_t * data, size_t len )
+{
+    rc_t rc = 0;
+
+    while ( rc == 0 && self->part.len > 0 && len > 0 )
+    {
+        size_t const want = self->part.len < 4 ? 4 : 4 + ( size_t )get_u32( self->part.base );
+        size_t const n = want - self->part.len < len ? want - self->part.len : len;
+
+        rc = bw_buf_add( &self->part, data, n );
+        data += n;
+        len -= n;
+        if ( rc == 0 && self->part.len >= 4 && self->part.len == 4 + ( size_t )get_u32( self->part.base ) )
+        {
+            rc = write_record( self, self->part.base, self->part.len );
+            self->part.len = 0;
+        }
+    }
+    while ( rc == 0 && len >= 4 )
+    {
+        size_t const n = 4 + ( size_t )get_u32( data );
+
+        if ( n > len )
+            break;
+        rc = write_record( self, data, n );
+        data += n;
+        len -= n;
+    }
+    if ( rc == 0 && len > 0 )
+        rc = bw_buf_add( &self->part, data, len );
+    return rc;
+}
+
+
+/* header lines are split on newlines */
+static rc_t write_header_text( bam_writer * self, const char * text, size_t len )
+{
+    rc_t rc = 0;
+
+    while ( rc == 0 && len > 0 )
+    {
+        const char * nl = memchr( text, '\n', len );
+        size_t const n = nl ? ( size_t )( nl - text ) : len;
+
+        rc = bw_buf_add( &self->line, text, n );
+        if ( rc == 0 )
+        {
+            if ( nl == NULL )
+                break;
+            if ( self->line.len > 0 )
+                rc = header_line( self, ( const char * )self->line.base, self->line.len );
+            self->line.len = 0;
+            text += n + 1;
+            len -= n + 1;
+        }
+    }
+    return rc;
+}
+
+
+rc_t bam_writer_write( struct bam_writer * self, const void * data, size_t len )
+{
+    rc_t rc = self->rc;
+
+    if ( rc == 0 )
+    {
+        if ( self->header_done )
+            rc = write_records( self, data, len );
+        else
+            rc = write_header_text( self, data, len );
+        self->rc = rc;
+    }
+    return rc;
+}
+
+
+rc_t bam_writer_end_header( struct bam_writer * self )
+{
+    rc_t rc = self->rc;
+
+    if ( rc == 0 && !self->header_done )
+    {
+        /* last line without a newline */
+        if ( self->line.len > 0 )
+            rc = header_line( self, ( const char * )self->line.base, self->line.len );
+        self->line.len = 0;
+        if ( rc == 0 )
+            rc = write_header( self );
+        self->rc = rc;
+    }
+    return rc;
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+rc_t make_bam_writer( struct bam_writer ** bw, struct KFile * dst, uint32_t threads, const char * index_path )
+{
+    rc_t rc = 0;
+    bam_writer * self;
+    struct compress_pool * pool = NULL;
+
+    if ( bw == NULL || dst == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcParam, rcNull );
+    self = calloc( 1, sizeof * self );
+    if ( self == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+
+    BSTreeInit( &self->ref_names );
+    if ( index_path != NULL )
+    {
+        size_t const l = strlen( index_path );
+
+        self->index_path = string_dup( index_path, l );
+        if ( self->index_path == NULL )
+            rc = RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+        self->indexing = true;
+        self->csi = l > 4 && strcmp( index_path + l - 4, ".csi" ) == 0;
+    }
+
+    /* the stream holds the only reference to the pool */
+    if ( rc == 0 && threads > 1 )
+        rc = make_compress_pool( &pool, threads );
+    if ( rc == 0 )
+        rc = make_block_stream( &self->bs, dst, &bgzf_format, pool, self->indexing );
+    release_compress_pool( pool );
+
+    if ( rc != 0 )
+    {
+        LOGERR( klogErr, rc, "cannot make BAM writer" );
+        release_bam_writer( self, false );
+    }
+    else
+        *bw = self;
+    return rc;
+}
+
+
+static void CC bam_ref_whack( BSTNode * n, void * data )
+{
+    free( n );
+}
+
+
+rc_t release_bam_writer( struct bam_writer * self, bool flush )
+{
+    rc_t rc = 0;
+
+    if ( self == NULL )
+        return 0;
+
+    if ( flush )
+    {
+        rc = bam_writer_end_header( self );
+        if ( rc == 0 && self->part.len > 0 )
+            rc = bad_record( "truncated record" );
+        /* the pending blocks and the EOF block */
+        if ( rc == 0 )
+            rc = block_stream_flush( self->bs );
+        if ( rc == 0 && self->indexing )
+            rc = write_index( self );
+    }
+    stop_indexing( self, NULL );
+
+    /* without the flush the pending blocks are dropped */
+    release_block_stream( self->bs );
+    free( self->line.base );
+    free( self->header.base );
+    free( self->part.base );
+    BSTreeWhack( &self->ref_names, bam_ref_whack, NULL );
+    free( self->ref );
+    free( self->index_path );
+    free( self );
+    return rc;
+}
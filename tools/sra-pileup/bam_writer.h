@@ -0,0 +1,108 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_bam_writer_
+#define _h_bam_writer_
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --------------------------------------------------------------------------- */
+
+struct bam_writer;
+
+/* writes BAM into dst, BGZF blocks are compressed on 'threads' threads
+   ( 0 or 1 compresses on the calling thread ),
+   if index_path is not NULL the records are indexed while they are written,
+   the index is CSI if index_path ends in ".csi", BAI otherwise;
+   unsorted records or references too long for BAI only drop the index, with a warning;
+   dst is not released by the writer */
+rc_t make_bam_writer( struct bam_writer ** bw,
+                      struct KFile * dst,
+                      uint32_t threads,
+                      const char * index_path );
+
+/* before bam_writer_end_header() takes the SAM header text, its @SQ lines define the references,
+   after it takes records made by bam_record_finish(), both in pieces of any size */
+rc_t bam_writer_write( struct bam_writer * bw, const void * data, size_t len );
+
+/* writes the BAM header, records can be made from then on */
+rc_t bam_writer_end_header( struct bam_writer * bw );
+
+/* with flush = true writes what is pending, the EOF block and the index,
+   otherwise just stops the writer */
+rc_t release_bam_writer( struct bam_writer * bw, bool flush );
+
+/* --------------------------------------------------------------------------- */
+
+/* encodes one alignment from its values into a BAM record,
+   needs the header of bw written, one per thread */
+struct bam_record;
+
+rc_t make_bam_record( struct bam_record ** rec, const struct bam_writer * bw );
+
+rc_t release_bam_record( struct bam_record * rec );
+
+/* starts the next record, an empty rname or '*' is no reference,
+   pos is 0-based, -1 for none, there is no mate until bam_record_mate() */
+rc_t bam_record_start( struct bam_record * rec, const char * rname, size_t rname_len,
+                       int32_t pos, uint8_t mapq, uint32_t flag );
+
+rc_t bam_record_mate( struct bam_record * rec, const char * rnext, size_t rnext_len,
+                      int32_t pnext, int32_t tlen );
+
+/* appends to the read name, which can be given in pieces */
+rc_t bam_record_qname( struct bam_record * rec, const char * name, size_t len );
+
+/* appends one operation or a SAM CIGAR string */
+rc_t bam_record_cigar_op( struct bam_record * rec, uint32_t count, char op );
+
+rc_t bam_record_cigar( struct bam_record * rec, const char * cigar, size_t len );
+
+/* bases as text, qualities as phred + 33 text, without qualities they are missing ( 0xff ) */
+rc_t bam_record_seq( struct bam_record * rec, const char * bases, size_t len );
+
+rc_t bam_record_qual( struct bam_record * rec, const char * qual, size_t len );
+
+/* appends optional fields: a string, an integer or SAM text of tab-separated fields */
+rc_t bam_record_tag_str( struct bam_record * rec, const char tag[ 2 ], const char * value, size_t len );
+
+rc_t bam_record_tag_int( struct bam_record * rec, const char tag[ 2 ], int64_t value );
+
+rc_t bam_record_tags_sam( struct bam_record * rec, const char * text, size_t len );
+
+/* the encoded record, valid until the next start, for bam_writer_write() */
+rc_t bam_record_finish( struct bam_record * rec, const void ** data, size_t * len );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  _h_bam_writer_ */
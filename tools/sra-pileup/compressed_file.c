@@ -0,0 +1,791 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <klib/rc.h>
+#include <klib/log.h>
+#include <klib/refcount.h>
+
+#include <kfs/file.h>
+#include <kfs/gzip.h>
+#include <kfs/bzip.h>
+
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+#include <bzlib.h>
+
+typedef struct compressed_file compressed_file;
+#define KFILE_IMPL compressed_file
+#include <kfs/impl.h>
+
+#include "compressed_file.h"
+
+#define CF_MAX_THREADS 64
+
+/* uncompressed bytes per block, one bzip2 block at level 9 */
+#define CF_GZIP_BLOCK_SIZE ( 256 * 1024 )
+#define CF_BZIP2_BLOCK_SIZE ( 900 * 1000 )
+
+/* worst case of incompressible data */
+#define CF_GZIP_CDATA_SIZE ( CF_GZIP_BLOCK_SIZE + ( CF_GZIP_BLOCK_SIZE >> 12 ) + ( CF_GZIP_BLOCK_SIZE >> 14 ) + 64 )
+#define CF_BZIP2_CDATA_SIZE ( CF_BZIP2_BLOCK_SIZE + CF_BZIP2_BLOCK_SIZE / 100 + 600 )
+
+
+/* --------------------------------------------------------------------------- */
+
+typedef struct cf_deflate
+{
+    z_stream z;
+    int window_bits;
+    bool ready;
+} cf_deflate;
+
+
+/* a deflate-stream with the requested window-bits, remade if the last block wanted other ones */
+static rc_t cf_deflate_get( cf_deflate * d, int window_bits, z_stream ** z )
+{
+    if ( d->ready && d->window_bits != window_bits )
+    {
+        deflateEnd( &d->z );
+        d->ready = false;
+    }
+    if ( !d->ready )
+    {
+        memset( &d->z, 0, sizeof d->z );
+        if ( deflateInit2( &d->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+            return RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+        d->window_bits = window_bits;
+        d->ready = true;
+    }
+    * z = &d->z;
+    return 0;
+}
+
+
+static void cf_deflate_end( cf_deflate * d )
+{
+    if ( d->ready )
+        deflateEnd( &d->z );
+    d->ready = false;
+}
+
+
+typedef struct cf_block
+{
+    const block_format * fmt;
+    uint8_t * udata;
+    uint8_t * cdata;
+    size_t ulen;
+    size_t clen;
+    rc_t rc;
+    bool done;
+} cf_block;
+
+
+static rc_t cf_compress( cf_block * blk, cf_deflate * d )
+{
+    const block_format * const fmt = blk->fmt;
+    z_stream * z = NULL;
+    rc_t rc = 0;
+
+    if ( fmt->window_bits != 0 )
+        rc = cf_deflate_get( d, fmt->window_bits, &z );
+    if ( rc == 0 )
+        rc = fmt->compress( blk->udata, blk->ulen, blk->cdata, fmt->cdata_size, &blk->clen, z );
+    return rc;
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+typedef struct cf_worker
+{
+    struct compress_pool * pool;
+    KThread * thread;
+    cf_deflate d;
+} cf_worker;
+
+
+struct compress_pool
+{
+    KRefcount refcount;
+    KLock * lock;                   /* guards the done-flag of the blocks of all streams too */
+    KCondition * cond;
+    cf_worker * worker;
+    uint32_t worker_qty;
+    cf_block ** pending;            /* blocks waiting for a worker, oldest first */
+    uint32_t pending_max;
+    uint32_t pending_first;
+    uint32_t pending_qty;
+    bool quit;
+};
+
+
+static rc_t CC cf_worker_thread( const KThread * t, void * data )
+{
+    cf_worker * const w = data;
+    struct compress_pool * const pool = w->pool;
+    rc_t rc = KLockAcquire( pool->lock );
+
+    if ( rc != 0 )
+        return rc;
+    for ( ; ; )
+    {
+        cf_block * blk;
+
+        /* what is pending is compressed even when quitting, its stream waits for it */
+        while ( !pool->quit && pool->pending_qty == 0 )
+            KConditionWait( pool->cond, pool->lock );
+        if ( pool->pending_qty == 0 )
+            break;
+        blk = pool->pending[ pool->pending_first ];
+        pool->pending_first = ( pool->pending_first + 1 ) % pool->pending_max;
+        --pool->pending_qty;
+        KLockUnlock( pool->lock );
+
+        blk->rc = cf_compress( blk, &w->d );
+
+        KLockAcquire( pool->lock );
+        blk->done = true;
+        KConditionBroadcast( pool->cond );
+    }
+    KLockUnlock( pool->lock );
+    return 0;
+}
+
+
+static void cf_pool_whack( struct compress_pool * self )
+{
+    uint32_t i;
+
+    if ( self->lock != NULL && KLockAcquire( self->lock ) == 0 )
+    {
+        self->quit = true;
+        KConditionBroadcast( self->cond );
+        KLockUnlock( self->lock );
+    }
+    for ( i = 0; self->worker != NULL && i < self->worker_qty; ++i )
+    {
+        cf_worker * const w = &self->worker[ i ];
+
+        if ( w->thread != NULL )
+        {
+            KThreadWait( w->thread, NULL );
+            KThreadRelease( w->thread );
+        }
+        cf_deflate_end( &w->d );
+    }
+    KConditionRelease( self->cond );
+    KLockRelease( self->lock );
+    free( self->worker );
+    free( self->pending );
+    free( self );
+}
+
+
+rc_t make_compress_pool( struct compress_pool ** pool, uint32_t threads )
+{
+    rc_t rc = 0;
+    uint32_t i;
+    struct compress_pool * self;
+
+    if ( pool == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcParam, rcNull );
+    if ( threads < 1 )
+        threads = 1;
+    if ( threads > CF_MAX_THREADS )
+        threads = CF_MAX_THREADS;
+
+    self = calloc( 1, sizeof * self );
+    if ( self == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+    KRefcountInit( &self->refcount, 1, "compress_pool", "make", "pool" );
+    self->worker_qty = threads;
+    self->pending_max = threads * 2;
+    self->worker = calloc( threads, sizeof self->worker[ 0 ] );
+    self->pending = calloc( self->pending_max, sizeof self->pending[ 0 ] );
+    if ( self->worker == NULL || self->pending == NULL )
+        rc = RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+    if ( rc == 0 )
+        rc = KLockMake( &self->lock );
+    if ( rc == 0 )
+        rc = KConditionMake( &self->cond );
+    for ( i = 0; rc == 0 && i < threads; ++i )
+    {
+        self->worker[ i ].pool = self;
+        rc = KThreadMake( &self->worker[ i ].thread, cf_worker_thread, &self->worker[ i ] );
+    }
+
+    if ( rc != 0 )
+    {
+        LOGERR( klogErr, rc, "cannot make compression threads" );
+        cf_pool_whack( self );
+    }
+    else
+        * pool = self;
+    return rc;
+}
+
+
+rc_t release_compress_pool( struct compress_pool * self )
+{
+    if ( self != NULL && KRefcountDrop( &self->refcount, "compress_pool" ) == krefWhack )
+        cf_pool_whack( self );
+    return 0;
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+struct block_stream
+{
+    KFile * dst;
+    uint64_t dst_pos;
+    const block_format * fmt;
+    struct compress_pool * pool;    /* NULL: the blocks are compressed on the appending thread */
+    cf_deflate d;                   /* for that */
+
+    /* blocks are filled by the appending thread, compressed by the pool and written in order,
+       the buffers of a block are made when it is used the first time */
+    cf_block * block;
+    uint32_t block_qty;
+    uint64_t queued;
+    uint64_t written;
+    cf_block * cur;
+
+    /* position in dst of every written block, only with track_blocks */
+    uint64_t * block_pos;
+    uint64_t block_pos_max;
+    uint64_t end_pos;
+    bool track_blocks;
+
+    rc_t rc;                        /* the first error, returned from then on */
+    bool flushed;
+};
+
+
+static rc_t bs_write( struct block_stream * self, const void * data, size_t len )
+{
+    size_t num_writ;
+    rc_t rc = KFileWriteAll( self->dst, self->dst_pos, data, len, &num_writ );
+    if ( rc == 0 && num_writ != len )
+        rc = RC( rcApp, rcFile, rcWriting, rcTransfer, rcIncomplete );
+    self->dst_pos += num_writ;
+    return rc;
+}
+
+
+static rc_t bs_track_block( struct block_stream * self )
+{
+    if ( self->written >= self->block_pos_max )
+    {
+        uint64_t max = self->block_pos_max ? self->block_pos_max * 2 : 1024;
+        uint64_t * tmp = realloc( self->block_pos, max * sizeof tmp[ 0 ] );
+        if ( tmp == NULL )
+            return RC( rcApp, rcBuffer, rcResizing, rcMemory, rcExhausted );
+        self->block_pos = tmp;
+        self->block_pos_max = max;
+    }
+    self->block_pos[ self->written ] = self->dst_pos;
+    return 0;
+}
+
+
+/* writes the oldest queued block, waits for it to be compressed if wait is set,
+   *ready tells if it was compressed */
+static rc_t bs_write_next( struct block_stream * self, bool wait, bool * ready )
+{
+    cf_block * const blk = &self->block[ self->written % self->block_qty ];
+    rc_t rc = 0;
+
+    if ( self->pool != NULL )
+    {
+        rc = KLockAcquire( self->pool->lock );
+        if ( rc != 0 )
+            return rc;
+        while ( wait && !blk->done )
+            KConditionWait( self->pool->cond, self->pool->lock );
+        * ready = blk->done;
+        KLockUnlock( self->pool->lock );
+        if ( !* ready )
+            return 0;
+    }
+    * ready = true;
+
+    rc = blk->rc;
+    if ( rc == 0 && self->track_blocks )
+        rc = bs_track_block( self );
+    if ( rc == 0 )
+        rc = bs_write( self, blk->cdata, blk->clen );
+    blk->done = false;
+    ++self->written;
+    return rc;
+}
+
+
+/* writes what is compressed already, so a stream does not hold on to its blocks */
+static rc_t bs_write_ready( struct block_stream * self )
+{
+    rc_t rc = 0;
+    bool ready = true;
+
+    while ( rc == 0 && ready && self->written < self->queued )
+        rc = bs_write_next( self, false, &ready );
+    return rc;
+}
+
+
+/* hands the filled block over to the pool, or compresses it */
+static rc_t bs_queue( struct block_stream * self )
+{
+    cf_block * const blk = self->cur;
+    struct compress_pool * const pool = self->pool;
+    rc_t rc;
+
+    self->cur = NULL;
+    if ( pool == NULL )
+    {
+        blk->rc = cf_compress( blk, &self->d );
+        blk->done = true;
+        ++self->queued;
+        return bs_write_ready( self );
+    }
+
+    rc = KLockAcquire( pool->lock );
+    if ( rc == 0 )
+    {
+        /* the workers always empty the queue, waiting here cannot block them */
+        while ( pool->pending_qty == pool->pending_max )
+            KConditionWait( pool->cond, pool->lock );
+        blk->rc = 0;
+        pool->pending[ ( pool->pending_first + pool->pending_qty ) % pool->pending_max ] = blk;
+        ++pool->pending_qty;
+        ++self->queued;
+        KConditionBroadcast( pool->cond );
+        KLockUnlock( pool->lock );
+        rc = bs_write_ready( self );
+    }
+    return rc;
+}
+
+
+/* makes self->cur an empty block, writes finished blocks to free one up */
+static rc_t bs_next_block( struct block_stream * self )
+{
+    rc_t rc = 0;
+    cf_block * blk;
+
+    while ( rc == 0 && self->queued >= self->written + self->block_qty )
+    {
+        bool ready;
+        rc = bs_write_next( self, true, &ready );
+    }
+    if ( rc != 0 )
+        return rc;
+
+    blk = &self->block[ self->queued % self->block_qty ];
+    if ( blk->udata == NULL )
+    {
+        blk->udata = malloc( self->fmt->block_size );
+        blk->cdata = malloc( self->fmt->cdata_size );
+        if ( blk->udata == NULL || blk->cdata == NULL )
+        {
+            free( blk->udata );
+            free( blk->cdata );
+            blk->udata = blk->cdata = NULL;
+            return RC( rcApp, rcFile, rcWriting, rcMemory, rcExhausted );
+        }
+        blk->fmt = self->fmt;
+    }
+    blk->ulen = 0;
+    self->cur = blk;
+    return 0;
+}
+
+
+rc_t make_block_stream( struct block_stream ** bs, struct KFile * dst, const block_format * fmt,
+                        struct compress_pool * pool, bool track_blocks )
+{
+    rc_t rc;
+    struct block_stream * self;
+
+    if ( bs == NULL || dst == NULL || fmt == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcParam, rcNull );
+    self = calloc( 1, sizeof * self );
+    if ( self == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+
+    rc = KFileAddRef( dst );
+    if ( rc == 0 )
+    {
+        self->dst = dst;
+        self->fmt = fmt;
+        self->track_blocks = track_blocks;
+        self->block_qty = 1;
+        if ( pool != NULL )
+        {
+            if ( KRefcountAdd( &pool->refcount, "compress_pool" ) != krefOkay )
+                rc = RC( rcApp, rcFile, rcConstructing, rcRange, rcExcessive );
+            else
+            {
+                self->pool = pool;
+                self->block_qty = pool->worker_qty * 2;
+            }
+        }
+    }
+    if ( rc == 0 )
+    {
+        self->block = calloc( self->block_qty, sizeof self->block[ 0 ] );
+        if ( self->block == NULL )
+            rc = RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+    }
+
+    if ( rc != 0 )
+        release_block_stream( self );
+    else
+        * bs = self;
+    return rc;
+}
+
+
+rc_t block_stream_append( struct block_stream * self, const void * data, size_t len,
+                          bool keep_together, uint64_t * beg, uint64_t * end )
+{
+    const uint8_t * src = data;
+    size_t const block_size = self->fmt->block_size;
+    rc_t rc = self->rc;
+
+    if ( rc == 0 && self->flushed )
+        rc = RC( rcApp, rcFile, rcWriting, rcFile, rcInvalid );
+    if ( rc == 0 && self->cur == NULL )
+        rc = bs_next_block( self );
+
+    /* do not split what fits into a block */
+    if ( rc == 0 && keep_together && self->cur->ulen > 0 && self->cur->ulen + len > block_size )
+    {
+        rc = bs_queue( self );
+        if ( rc == 0 )
+            rc = bs_next_block( self );
+    }
+    if ( rc == 0 && beg != NULL )
+        * beg = ( self->queued << 16 ) | self->cur->ulen;
+    while ( rc == 0 && len > 0 )
+    {
+        size_t n = block_size - self->cur->ulen;
+
+        if ( n == 0 )
+        {
+            rc = bs_queue( self );
+            if ( rc == 0 )
+                rc = bs_next_block( self );
+            continue;
+        }
+        if ( n > len )
+            n = len;
+        memcpy( self->cur->udata + self->cur->ulen, src, n );
+        self->cur->ulen += n;
+        src += n;
+        len -= n;
+    }
+    if ( rc == 0 && end != NULL )
+        * end = ( self->queued << 16 ) | self->cur->ulen;
+    if ( rc != 0 )
+        self->rc = rc;
+    return rc;
+}
+
+
+uint64_t block_stream_offset( const struct block_stream * self, uint64_t ofs )
+{
+    uint64_t const blk = ofs >> 16;
+    uint64_t const pos = ( self->track_blocks && blk < self->written ) ? self->block_pos[ blk ] : self->end_pos;
+    return ( pos << 16 ) | ( ofs & 0xffff );
+}
+
+
+rc_t block_stream_flush( struct block_stream * self )
+{
+    rc_t rc = self->rc;
+
+    if ( rc != 0 || self->flushed )
+        return rc;
+
+    /* the last block, an empty one if nothing was appended to still get a valid stream */
+    if ( self->cur == NULL && self->queued == 0 )
+        rc = bs_next_block( self );
+    if ( rc == 0 && self->cur != NULL && ( self->cur->ulen > 0 || self->queued == 0 ) )
+        rc = bs_queue( self );
+    self->cur = NULL;
+    while ( rc == 0 && self->written < self->queued )
+    {
+        bool ready;
+        rc = bs_write_next( self, true, &ready );
+    }
+    self->end_pos = self->dst_pos;
+    if ( rc == 0 && self->fmt->trailer_len > 0 )
+        rc = bs_write( self, self->fmt->trailer, self->fmt->trailer_len );
+    self->flushed = true;
+    self->rc = rc;
+    return rc;
+}
+
+
+rc_t release_block_stream( struct block_stream * self )
+{
+    uint32_t i;
+
+    if ( self == NULL )
+        return 0;
+
+    /* the pool may still compress blocks of a failed or not flushed stream */
+    if ( self->pool != NULL && self->written < self->queued && KLockAcquire( self->pool->lock ) == 0 )
+    {
+        uint64_t n;
+        for ( n = self->written; n < self->queued; ++n )
+        {
+            const cf_block * blk = &self->block[ n % self->block_qty ];
+            while ( !blk->done )
+                KConditionWait( self->pool->cond, self->pool->lock );
+        }
+        KLockUnlock( self->pool->lock );
+    }
+    for ( i = 0; self->block != NULL && i < self->block_qty; ++i )
+    {
+        free( self->block[ i ].udata );
+        free( self->block[ i ].cdata );
+    }
+    cf_deflate_end( &self->d );
+    release_compress_pool( self->pool );
+    KFileRelease( self->dst );
+    free( self->block );
+    free( self->block_pos );
+    free( self );
+    return 0;
+}
+
+
+/* --------------------------------------------------------------------------- */
+
+/* z was made with windowBits + 16, that produces a complete gzip-member for every block */
+static rc_t CC cf_gzip_compress( const uint8_t * udata, size_t ulen,
+                                 uint8_t * cdata, size_t cdata_size, size_t * clen,
+                                 z_stream * z )
+{
+    int zr;
+
+    z->next_in = ( Bytef * )udata;
+    z->avail_in = ( uInt )ulen;
+    z->next_out = ( Bytef * )cdata;
+    z->avail_out = ( uInt )cdata_size;
+    zr = deflate( z, Z_FINISH );
+    * clen = z->total_out;
+    deflateReset( z );
+    if ( zr != Z_STREAM_END )
+        return RC( rcApp, rcFile, rcWriting, rcData, rcUnexpected );
+    return 0;
+}
+
+
+static rc_t CC cf_bzip2_compress( const uint8_t * udata, size_t ulen,
+                                  uint8_t * cdata, size_t cdata_size, size_t * clen,
+                                  z_stream * z )
+{
+    unsigned int len = ( unsigned int )cdata_size;
+    int const bzr = BZ2_bzBuffToBuffCompress( ( char * )cdata, &len, ( char * )udata, ( unsigned int )ulen, 9, 0, 0 );
+
+    if ( bzr != BZ_OK )
+        return RC( rcApp, rcFile, rcWriting, rcData, rcUnexpected );
+    * clen = len;
+    return 0;
+}
+
+
+static const block_format cf_gzip_format =
+{
+    CF_GZIP_BLOCK_SIZE, CF_GZIP_CDATA_SIZE, 15 + 16, cf_gzip_compress, NULL, 0
+};
+
+
+static const block_format cf_bzip2_format =
+{
+    CF_BZIP2_BLOCK_SIZE, CF_BZIP2_CDATA_SIZE, 0, cf_bzip2_compress, NULL, 0
+};
+
+
+struct compressed_file
+{
+    KFile dad;
+    struct block_stream * bs;
+    uint64_t pos;
+};
+
+
+static rc_t CC compressed_file_destroy( compressed_file * self )
+{
+    rc_t rc = 0;
+
+    if ( self->bs != NULL )
+    {
+        rc = block_stream_flush( self->bs );
+        release_block_stream( self->bs );
+    }
+    free( self );
+    return rc;
+}
+
+
+static struct KSysFile * CC compressed_file_get_sysfile( const compressed_file * self, uint64_t * offset )
+{
+    * offset = 0;
+    return NULL;
+}
+
+
+static rc_t CC compressed_file_random_access( const compressed_file * self )
+{
+    return RC( rcApp, rcFile, rcUpdating, rcFunction, rcUnsupported );
+}
+
+
+static rc_t CC compressed_file_size( const compressed_file * self, uint64_t * size )
+{
+    * size = 0;
+    return RC( rcApp, rcFile, rcAccessing, rcFunction, rcUnsupported );
+}
+
+
+static rc_t CC compressed_file_set_size( compressed_file * self, uint64_t size )
+{
+    return RC( rcApp, rcFile, rcUpdating, rcFunction, rcUnsupported );
+}
+
+
+static rc_t CC compressed_file_read( const compressed_file * self, uint64_t pos,
+                                     void * buffer, size_t bsize, size_t * num_read )
+{
+    * num_read = 0;
+    return RC( rcApp, rcFile, rcReading, rcFunction, rcUnsupported );
+}
+
+
+static rc_t CC compressed_file_write( compressed_file * self, uint64_t pos,
+                                      const void * buffer, size_t size, size_t * num_writ )
+{
+    rc_t rc;
+
+    * num_writ = 0;
+    if ( pos != self->pos )
+        return RC( rcApp, rcFile, rcWriting, rcOffset, rcIncorrect );
+    /* the stream keeps its first error and returns it from every later call */
+    rc = block_stream_append( self->bs, buffer, size, false, NULL, NULL );
+    if ( rc == 0 )
+    {
+        self->pos += size;
+        * num_writ = size;
+    }
+    return rc;
+}
+
+
+static uint32_t CC compressed_file_type( const compressed_file * self )
+{
+    return kfdFile;
+}
+
+
+static KFile_vt_v1 compressed_file_vt =
+{
+    1, 1,
+    compressed_file_destroy,
+    compressed_file_get_sysfile,
+    compressed_file_random_access,
+    compressed_file_size,
+    compressed_file_set_size,
+    compressed_file_read,
+    compressed_file_write,
+    compressed_file_type
+};
+
+
+rc_t make_pooled_compressed_file( struct KFile ** f, struct KFile * dst, bool bzip2,
+                                  struct compress_pool * pool )
+{
+    rc_t rc;
+    compressed_file * self;
+
+    if ( f == NULL || dst == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcParam, rcNull );
+    if ( pool == NULL )
+        return bzip2 ? KFileMakeBzip2ForWrite( f, dst ) : KFileMakeGzipForWrite( f, dst );
+
+    self = calloc( 1, sizeof * self );
+    if ( self == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcMemory, rcExhausted );
+    rc = KFileInit( &self->dad, ( const KFile_vt * )&compressed_file_vt, "compressed_file", "no-name", false, true );
+    if ( rc != 0 )
+    {
+        free( self );
+        return rc;
+    }
+    rc = make_block_stream( &self->bs, dst, bzip2 ? &cf_bzip2_format : &cf_gzip_format, pool, false );
+
+    if ( rc != 0 )
+    {
+        LOGERR( klogErr, rc, "cannot make compressed output file" );
+        KFileRelease( &self->dad );
+    }
+    else
+        * f = &self->dad;
+    return rc;
+}
+
+
+rc_t make_compressed_file( struct KFile ** f, struct KFile * dst, bool bzip2, uint32_t threads )
+{
+    rc_t rc;
+    struct compress_pool * pool;
+
+    if ( f == NULL || dst == NULL )
+        return RC( rcApp, rcFile, rcConstructing, rcParam, rcNull );
+    if ( threads <= 1 )
+        return bzip2 ? KFileMakeBzip2ForWrite( f, dst ) : KFileMakeGzipForWrite( f, dst );
+
+    /* a pool of its own, the file holds the only reference after this */
+    rc = make_compress_pool( &pool, threads );
+    if ( rc == 0 )
+    {
+        rc = make_pooled_compressed_file( f, dst, bzip2, pool );
+        release_compress_pool( pool );
+    }
+    return rc;
+}
@@ -0,0 +1,112 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_compressed_file_
+#define _h_compressed_file_
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct z_stream_s;
+
+/* --------------------------------------------------------------------------- */
+
+/* how a block is compressed and framed:
+   compress() turns ulen bytes of udata into at most cdata_size bytes of cdata,
+   z is a deflate-stream made with window_bits ( NULL if window_bits is 0 ),
+   ready for use, compress() has to reset it before returning;
+   the trailer is written after the last block */
+typedef struct block_format
+{
+    size_t block_size;
+    size_t cdata_size;
+    int window_bits;
+    rc_t ( CC * compress )( const uint8_t * udata, size_t ulen,
+                            uint8_t * cdata, size_t cdata_size, size_t * clen,
+                            struct z_stream_s * z );
+    const void * trailer;
+    size_t trailer_len;
+} block_format;
+
+
+/* threads compressing the blocks of every stream made with the pool,
+   each stream gets a reference */
+struct compress_pool;
+
+rc_t make_compress_pool( struct compress_pool ** pool, uint32_t threads );
+
+rc_t release_compress_pool( struct compress_pool * pool );
+
+
+/* cuts what is appended into blocks, compresses them on the threads of pool
+   ( on the calling thread if pool is NULL ) and writes them to dst in order,
+   with track_blocks the position of every block in dst is kept for block_stream_offset(),
+   dst gets a reference, data has to be appended from one thread */
+struct block_stream;
+
+rc_t make_block_stream( struct block_stream ** bs, struct KFile * dst, const block_format * fmt,
+                        struct compress_pool * pool, bool track_blocks );
+
+/* the positions of the first byte of data and of the byte after it are returned in *beg and *end
+   as block-number << 16 | offset-in-block ( for formats with blocks of at most 64K ),
+   with keep_together data that fits into a block is not split between two */
+rc_t block_stream_append( struct block_stream * bs, const void * data, size_t len,
+                          bool keep_together, uint64_t * beg, uint64_t * end );
+
+/* turns block-number << 16 | offset-in-block into position-in-dst << 16 | offset-in-block,
+   only for written blocks of a stream made with track_blocks, the flushed end is valid too */
+uint64_t block_stream_offset( const struct block_stream * bs, uint64_t ofs );
+
+/* compresses and writes the pending data and the trailer, the stream cannot be appended to after it */
+rc_t block_stream_flush( struct block_stream * bs );
+
+/* without a flush before, what is pending is dropped */
+rc_t release_block_stream( struct block_stream * bs );
+
+
+/* --------------------------------------------------------------------------- */
+
+/* makes a write-only file that gzip- or bzip2-compresses what is written to it into dst,
+   with threads > 1 the data is cut into blocks compressed on that many threads,
+   each block becomes a gzip-member / bzip2-stream of its own, concatenated in order,
+   with threads <= 1 it is the file made by KFileMakeGzipForWrite / KFileMakeBzip2ForWrite,
+   dst gets a reference, data has to be written sequentially */
+rc_t make_compressed_file( struct KFile ** f, struct KFile * dst, bool bzip2, uint32_t threads );
+
+/* the same, but the blocks are compressed by the threads of a pool shared with other files,
+   with pool == NULL it is the file made by KFileMakeGzipForWrite / KFileMakeBzip2ForWrite */
+rc_t make_pooled_compressed_file( struct KFile ** f, struct KFile * dst, bool bzip2,
+                                  struct compress_pool * pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_compressed_file_ */
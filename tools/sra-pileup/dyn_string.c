@@ -136,7 +136,7 @@ rc_t add_string_2_dyn_string( struct dyn_string *self, const char * s )
 }
 
 
-rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
+rc_t vprint_2_dyn_string( struct dyn_string * self, const char *fmt, va_list args )
 {
     rc_t rc = 0;
     bool not_enough;
@@ -144,14 +144,14 @@ rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
     do
     {
         size_t num_writ;
-        va_list args;
-        va_start ( args, fmt );
+        va_list args2;
+        va_copy ( args2, args );
         rc = string_vprintf ( &(self->data[ self->data_len ]), 
                               self->allocated - ( self->data_len + 1 ),
                               &num_writ,
                               fmt,
-                              args );
-        va_end ( args );
+                              args2 );
+        va_end ( args2 );
 
         if ( rc == 0 )
         {
@@ -168,6 +168,31 @@ rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
 }
 
 
+rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... )
+{
+    rc_t rc;
+    va_list args;
+    va_start ( args, fmt );
+    rc = vprint_2_dyn_string( self, fmt, args );
+    va_end ( args );
+    return rc;
+}
+
+
+rc_t print_2_out( struct dyn_string * out, const char *fmt, ... )
+{
+    rc_t rc;
+    va_list args;
+    va_start ( args, fmt );
+    if ( out == NULL )
+        rc = KOutVMsg ( fmt, args );
+    else
+        rc = vprint_2_dyn_string( out, fmt, args );
+    va_end ( args );
+    return rc;
+}
+
+
 rc_t print_dyn_string( struct dyn_string * self )
 {
     if ( self != NULL )
@@ -184,3 +209,30 @@ size_t dyn_string_len( struct dyn_string * self )
     else
         return 0;
 }
+
+
+rc_t reserve_dyn_string( struct dyn_string *self, size_t len, char ** dst )
+{
+    rc_t rc = 0;
+    size_t needed = self->data_len + len + 1;
+    if ( needed > self->allocated )
+    {
+        /* grow geometrically, the pileup-lines grow in many small steps */
+        size_t new_size = self->allocated * 2;
+        if ( new_size < needed )
+            new_size = needed;
+        rc = expand_dyn_string( self, new_size );
+    }
+    if ( rc == 0 )
+        *dst = &( self->data[ self->data_len ] );
+    else
+        *dst = NULL;
+    return rc;
+}
+
+
+void commit_dyn_string( struct dyn_string *self, size_t len )
+{
+    self->data_len += len;
+    self->data[ self->data_len ] = 0;
+}
@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include <klib/rc.h>
+#include <stdarg.h>
 
 struct dyn_string;
 
@@ -44,9 +45,18 @@ rc_t add_char_2_dyn_string( struct dyn_string *self, const char c );
 char * dyn_string_char( struct dyn_string *self, uint32_t idx );
 rc_t add_string_2_dyn_string( struct dyn_string *self, const char * s );
 rc_t print_2_dyn_string( struct dyn_string * self, const char *fmt, ... );
+rc_t vprint_2_dyn_string( struct dyn_string * self, const char *fmt, va_list args );
+
+/* prints into out, or to the output ( KOutMsg ) if out is NULL */
+rc_t print_2_out( struct dyn_string * out, const char *fmt, ... );
 rc_t print_dyn_string( struct dyn_string * self );
 size_t dyn_string_len( struct dyn_string * self );
 
+/* make room for len more chars ( + terminator ), dst points to the end of the string,
+   the caller writes up to len chars there and calls commit_dyn_string() with the count */
+rc_t reserve_dyn_string( struct dyn_string *self, size_t len, char ** dst );
+void commit_dyn_string( struct dyn_string *self, size_t len );
+
 #ifdef __cplusplus
 }
 #endif
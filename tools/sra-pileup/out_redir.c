@@ -25,11 +25,10 @@
 */
 
 #include "out_redir.h"
+#include "compressed_file.h"
 
 #include <kfs/directory.h>
 #include <kfs/buffile.h>
-#include <kfs/bzip.h>
-#include <kfs/gzip.h>
 #include <sysalloc.h>
 
 static rc_t CC out_redir_callback( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
@@ -42,7 +41,8 @@ static rc_t CC out_redir_callback( void * self, const char * buffer, size_t bufs
 }
 
 
-rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize )
+rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename,
+                     size_t bufsize, uint32_t threads )
 {
     rc_t rc;
     KFile *output_file;
@@ -69,8 +69,8 @@ rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * fi
         /* wrap the output-file in compression, if requested */
         switch ( mode )
         {
-            case orm_gzip  : rc = KFileMakeGzipForWrite( &temp_file, output_file ); break;
-            case orm_bzip2 : rc = KFileMakeBzip2ForWrite( &temp_file, output_file ); break;
+            case orm_gzip  : rc = make_compressed_file( &temp_file, output_file, false, threads ); break;
+            case orm_bzip2 : rc = make_compressed_file( &temp_file, output_file, true, threads ); break;
             case orm_uncompressed : break;
         }
         if ( rc == 0 )
@@ -57,7 +57,9 @@ typedef struct out_redir
 } out_redir;
 
 
-rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize );
+/* threads > 1 compresses gzip/bzip2 output on that many threads */
+rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename,
+                     size_t bufsize, uint32_t threads );
 
 void release_out_redir( out_redir * self );
 
@@ -28,6 +28,7 @@
 
 #include "ref_walker_0.h"
 #include "4na_ascii.h"
+#include "dyn_string.h"
 
 static uint32_t percent( uint32_t v1, uint32_t v2 )
 {
@@ -145,6 +146,7 @@ typedef struct walk_fragment_ctx
 {
     rc_t rc;
     uint32_t n;
+    struct dyn_string * out;
 } walk_fragment_ctx;
 
 
@@ -155,19 +157,20 @@ static void CC on_fragment( BSTNode *n, void *data )
     if ( wctx->rc == 0 )
     {
         if ( wctx->n == 0 )
-            wctx->rc = KOutMsg( "%u-%.*s", fragment->count, fragment->len, fragment->bases );
+            wctx->rc = print_2_out( wctx->out, "%u-%.*s", fragment->count, fragment->len, fragment->bases );
         else
-            wctx->rc = KOutMsg( "|%u-%.*s", fragment->count, fragment->len, fragment->bases );
+            wctx->rc = print_2_out( wctx->out, "|%u-%.*s", fragment->count, fragment->len, fragment->bases );
         wctx->n++;
     }
 }
 
 
-static rc_t print_fragments( BSTree * fragments )
+static rc_t print_fragments( struct dyn_string * out, BSTree * fragments )
 {
     walk_fragment_ctx wctx;
     wctx.rc = 0;
     wctx.n = 0;
+    wctx.out = out;
     BSTreeForEach ( fragments, false, on_fragment, &wctx );
     return wctx.rc;
 }
@@ -264,7 +267,8 @@ static void walk_counter_state( ReferenceIterator *ref_iter, int32_t state, bool
 }
 
 
-static rc_t print_counter_line( const char * ref_name,
+static rc_t print_counter_line( struct dyn_string * out,
+                                const char * ref_name,
                                 INSDC_coord_zero ref_pos,
                                 INSDC_4na_bin ref_base,
                                 uint32_t depth,
@@ -272,44 +276,44 @@ static rc_t print_counter_line( const char * ref_name,
 {
     char c = _4na_to_ascii( ref_base, false );
 
-    rc_t rc = KOutMsg( "%s\t%u\t%c\t%u\t", ref_name, ref_pos + 1, c, depth );
+    rc_t rc = print_2_out( out, "%s\t%u\t%c\t%u\t", ref_name, ref_pos + 1, c, depth );
 
     if ( rc == 0 && counters->matches > 0 )
-        rc = KOutMsg( "%u", counters->matches );
+        rc = print_2_out( out, "%u", counters->matches );
 
     if ( rc == 0 /* && counters->mismatches[ 0 ] > 0 */ )
-        rc = KOutMsg( "\t%u-A", counters->mismatches[ 0 ] );
+        rc = print_2_out( out, "\t%u-A", counters->mismatches[ 0 ] );
 
     if ( rc == 0 /* && counters->mismatches[ 1 ] > 0 */ )
-        rc = KOutMsg( "\t%u-C", counters->mismatches[ 1 ] );
+        rc = print_2_out( out, "\t%u-C", counters->mismatches[ 1 ] );
 
     if ( rc == 0 /* && counters->mismatches[ 2 ] > 0 */ )
-        rc = KOutMsg( "\t%u-G", counters->mismatches[ 2 ] );
+        rc = print_2_out( out, "\t%u-G", counters->mismatches[ 2 ] );
 
     if ( rc == 0 /* && counters->mismatches[ 3 ] > 0 */ )
-        rc = KOutMsg( "\t%u-T", counters->mismatches[ 3 ] );
+        rc = print_2_out( out, "\t%u-T", counters->mismatches[ 3 ] );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\tI:" );
+        rc = print_2_out( out, "\tI:" );
     if ( rc == 0 )
-        rc = print_fragments( &(counters->insert_fragments) );
+        rc = print_fragments( out, &(counters->insert_fragments) );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\tD:" );
+        rc = print_2_out( out, "\tD:" );
     if ( rc == 0 )
-        rc = print_fragments( &(counters->delete_fragments) );
+        rc = print_fragments( out, &(counters->delete_fragments) );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\t%u%%", percent( counters->forward, counters->reverse ) );
+        rc = print_2_out( out, "\t%u%%", percent( counters->forward, counters->reverse ) );
 
     if ( rc == 0 && counters->starting > 0 )
-        rc = KOutMsg( "\tS%u", counters->starting );
+        rc = print_2_out( out, "\tS%u", counters->starting );
 
     if ( rc == 0 && counters->ending > 0 )
-        rc = KOutMsg( "\tE%u", counters->ending );
+        rc = print_2_out( out, "\tE%u", counters->ending );
 
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
+        rc = print_2_out( out, "\n" );
 
     free_fragments( &(counters->insert_fragments) );
     free_fragments( &(counters->delete_fragments) );
@@ -329,7 +333,7 @@ static rc_t CC walk_counters_enter_ref_pos( walk_data * data )
 
 static rc_t CC walk_counters_exit_ref_pos( walk_data * data )
 {
-    rc_t rc = print_counter_line( data->ref_name, data->ref_pos, data->ref_base, data->depth, data->data );
+    rc_t rc = print_counter_line( data->out, data->ref_name, data->ref_pos, data->ref_base, data->depth, data->data );
     return rc;
 }
 
@@ -339,7 +343,7 @@ static rc_t CC walk_counters_placement( walk_data * data )
     return 0;
 }
 
-rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
+rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options, struct dyn_string * out )
 {
     walk_data data;
     walk_funcs funcs;
@@ -348,6 +352,7 @@ rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
     data.ref_iter = ref_iter;
     data.options = options;
     data.data = &counters;
+    data.out = out;
 
     funcs.on_enter_ref = NULL;
     funcs.on_exit_ref = NULL;
@@ -370,7 +375,8 @@ rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
 /* =========================================================================================== */
 
 
-static rc_t print_mismatches_line( const char * ref_name,
+static rc_t print_mismatches_line( struct dyn_string * out,
+                                   const char * ref_name,
                                    INSDC_coord_zero ref_pos,
                                    uint32_t depth,
                                    uint32_t min_mismatch_percent,
@@ -385,7 +391,7 @@ static rc_t print_mismatches_line( const char * ref_name,
                                     counters->mismatches[ 3 ];
 	if ( total_mismatches * 100 >= min_mismatch_percent * depth) 
         {
-                rc = KOutMsg( "%s\t%u\t%u\t%u\n", ref_name, ref_pos + 1, depth, total_mismatches );
+                rc = print_2_out( out, "%s\t%u\t%u\t%u\n", ref_name, ref_pos + 1, depth, total_mismatches );
         }
     }
     
@@ -407,7 +413,7 @@ static rc_t CC walk_mismatches_enter_ref_pos( walk_data * data )
 
 static rc_t CC walk_mismatches_exit_ref_pos( walk_data * data )
 {
-    rc_t rc = print_mismatches_line( data->ref_name, data->ref_pos,
+    rc_t rc = print_mismatches_line( data->out, data->ref_name, data->ref_pos,
                                      data->depth, data->options->min_mismatch, data->data );
     return rc;
 }
@@ -419,7 +425,7 @@ static rc_t CC walk_mismatches_placement( walk_data * data )
 }
 
 
-rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options )
+rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options, struct dyn_string * out )
 {
     walk_data data;
     walk_funcs funcs;
@@ -428,6 +434,7 @@ rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options )
     data.ref_iter = ref_iter;
     data.options = options;
     data.data = &counters;
+    data.out = out;
 
     funcs.on_enter_ref = NULL;
     funcs.on_exit_ref = NULL;
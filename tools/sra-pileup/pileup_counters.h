@@ -31,8 +31,9 @@
 extern "C" {
 #endif
 
-rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options );
-rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options );
+/* out == NULL prints to the output, otherwise into out */
+rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options, struct dyn_string * out );
+rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options, struct dyn_string * out );
 
 #ifdef __cplusplus
 }
@@ -28,6 +28,7 @@
 
 #include "ref_walker_0.h"
 #include "4na_ascii.h"
+#include "dyn_string.h"
 
 static uint32_t percent( uint32_t v1, uint32_t v2 )
 {
@@ -63,7 +64,7 @@ static rc_t CC walk_index_exit_ref_pos( walk_data * data )
     if ( ic->forward + ic->reverse == 0 )
         return 0;
     else
-        return KOutMsg( "%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
+        return print_2_out( data->out, "%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
                      data->ref_name, data->ref_pos + 1, 
                      ic->base_counts[ 0 ], ic->base_counts[ 1 ], ic->base_counts[ 2 ], ic->base_counts[ 3 ],
                      ic->inserts, ic->deletes, percent( ic->forward, ic->reverse ) );
@@ -94,7 +95,7 @@ static rc_t CC walk_index_placement( walk_data * data )
 }
 
 
-rc_t walk_index( ReferenceIterator *ref_iter, pileup_options * options )
+rc_t walk_index( ReferenceIterator *ref_iter, pileup_options * options, struct dyn_string * out )
 {
     walk_data data;
     walk_funcs funcs;
@@ -103,6 +104,7 @@ rc_t walk_index( ReferenceIterator *ref_iter, pileup_options * options )
     data.ref_iter = ref_iter;
     data.options = options;
     data.data = &i_counters;
+    data.out = out;
 
     funcs.on_enter_ref = NULL;
     funcs.on_exit_ref = NULL;
@@ -31,7 +31,8 @@
 extern "C" {
 #endif
 
-rc_t walk_index( ReferenceIterator *ref_iter, pileup_options * options );
+/* out == NULL prints to the output, otherwise into out */
+rc_t walk_index( ReferenceIterator *ref_iter, pileup_options * options, struct dyn_string * out );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,217 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+
+#include "pileup_line.h"
+#include "ref_walker_0.h"
+#include "4na_ascii.h"
+#include "dyn_string.h"
+
+#include <kapp/main.h>
+
+void release_deletion_cache( deletion_cache * self )
+{
+    free( self->bases );
+    self->bases = NULL;
+    self->len = 0;
+}
+
+
+/* the iterator returns the deleted bases only together with a buffer it allocated,
+   the buffer is kept until a placement with a different deletion comes along */
+static const INSDC_4na_bin * deleted_bases( ReferenceIterator *ref_iter, deletion_cache * cache, uint32_t *n )
+{
+    INSDC_coord_zero ref_pos;
+    const INSDC_4na_bin *bases = NULL;
+    *n = ReferenceIteratorBasesDeleted ( ref_iter, &ref_pos, &bases );
+    if ( bases == NULL )
+        return NULL;
+    if ( cache->bases != NULL && cache->ref_pos == ref_pos && cache->len == *n )
+        free( (void *) bases );
+    else
+    {
+        free( cache->bases );
+        cache->bases = ( INSDC_4na_bin * ) bases;
+        cache->len = *n;
+        cache->ref_pos = ref_pos;
+    }
+    return cache->bases;
+}
+
+
+static char * put_uint32( char * dst, uint32_t value )
+{
+    char tmp[ 10 ];
+    uint32_t i = 0;
+    do
+    {
+        tmp[ i++ ] = '0' + ( value % 10 );
+        value /= 10;
+    } while ( value > 0 );
+    while ( i > 0 )
+        *( dst++ ) = tmp[ --i ];
+    return dst;
+}
+
+
+static char * put_bases( char * dst, const INSDC_4na_bin * bases, uint32_t n, const char * tab )
+{
+    uint32_t i;
+    for ( i = 0; i < n; ++i )
+        dst[ i ] = tab[ bases[ i ] & 0x0F ];
+    return dst + n;
+}
+
+
+static rc_t walk_ref_position( ReferenceIterator *ref_iter,
+                               const PlacementRecord *rec,
+                               struct dyn_string *line,
+                               char * qual,
+                               deletion_cache * dels,
+                               const pileup_options *options )
+{
+    rc_t rc = 0;
+    INSDC_coord_zero seq_pos;
+    int32_t state = ReferenceIteratorState ( ref_iter, &seq_pos );
+    tool_rec *xrec = ( tool_rec * ) PlacementRecordCast ( rec, placementRecordExtension1 );
+    bool reverse = xrec->reverse;
+    const char * tab = _4na_ascii_tab( reverse );
+    const INSDC_4na_bin *ins_bases = NULL;
+    const INSDC_4na_bin *del_bases = NULL;
+    uint32_t n_ins = 0, n_del = 0;
+    char * dst;
+
+    if ( !options->omit_qualities )
+    {
+        if ( seq_pos < xrec->quality_len )
+            *qual = xrec->quality[ seq_pos ];
+        else
+            *qual = 2;
+    }
+
+    if ( ( state & align_iter_invalid ) == align_iter_invalid )
+    {
+        return add_char_2_dyn_string( line, '?' );
+    }
+
+    if ( ( state & align_iter_insert ) == align_iter_insert )
+        n_ins = ReferenceIteratorBasesInserted ( ref_iter, &ins_bases );
+
+    if ( ( state & align_iter_delete ) == align_iter_delete )
+        del_bases = deleted_bases( ref_iter, dels, &n_del );
+
+    /* one capacity-check for everything this placement contributes:
+       '^' + mapq, base, '+' + count + inserts, '-' + count + deletes, '$' */
+    rc = reserve_dyn_string( line, 2 + 1 + ( 11 + n_ins ) + ( 11 + n_del ) + 1, &dst );
+    if ( rc == 0 )
+    {
+        char * start = dst;
+
+        if ( ( state & align_iter_first ) == align_iter_first )
+        {
+            int32_t c = rec->mapq + 33;
+            if ( c > '~' ) { c = '~'; }
+            if ( c < 33 ) { c = 33; }
+            *( dst++ ) = '^';
+            *( dst++ ) = c;
+        }
+
+        if ( ( state & align_iter_skip ) == align_iter_skip )
+        {
+            *( dst++ ) = reverse ? '<' : '>';
+            if ( !options->omit_qualities )
+                *qual = xrec->quality[ seq_pos + 1 ];
+        }
+        else if ( ( state & align_iter_match ) == align_iter_match )
+            *( dst++ ) = reverse ? ',' : '.';
+        else
+            *( dst++ ) = tab[ state & 0x0F ];
+
+        if ( ( state & align_iter_insert ) == align_iter_insert )
+        {
+            *( dst++ ) = '+';
+            dst = put_uint32( dst, n_ins );
+            dst = put_bases( dst, ins_bases, n_ins, tab );
+        }
+
+        if ( del_bases != NULL )
+        {
+            *( dst++ ) = '-';
+            dst = put_uint32( dst, n_del );
+            dst = put_bases( dst, del_bases, n_del, tab );
+        }
+
+        if ( ( state & align_iter_last ) == align_iter_last )
+            *( dst++ ) = '$';
+
+        commit_dyn_string( line, dst - start );
+    }
+
+    if ( rc == 0 && options->show_id )
+        rc = print_2_dyn_string( line, "(%,lu:%,d-%,d/%u)",
+                                 rec->id, rec->pos + 1, rec->pos + rec->len, seq_pos );
+
+    return rc;
+}
+
+
+rc_t walk_placements( ReferenceIterator *ref_iter,
+                      struct dyn_string *line,
+                      struct dyn_string *qualities,
+                      deletion_cache * dels,
+                      const pileup_options *options )
+{
+    uint32_t depth = 0;
+    rc_t rc;
+    do
+    {
+        const PlacementRecord *rec;
+        rc = ReferenceIteratorNextPlacement ( ref_iter, &rec );
+        if ( rc == 0 )
+            rc = walk_ref_position( ref_iter, rec, line, dyn_string_char( qualities, depth++ ), dels, options );
+        if ( rc == 0 )
+            rc = Quitting();
+    } while ( rc == 0 );
+
+    if ( GetRCState( rc ) == rcDone ) { rc = 0; }
+
+    if ( rc == 0 && !options->omit_qualities )
+    {
+        char * dst;
+        rc = reserve_dyn_string( line, depth + 1, &dst );
+        if ( rc == 0 )
+        {
+            uint32_t i;
+            const char * q = dyn_string_char( qualities, 0 );
+            dst[ 0 ] = '\t';
+            for ( i = 0; i < depth; ++i )
+                dst[ i + 1 ] = q[ i ] + 33;
+            commit_dyn_string( line, depth + 1 );
+        }
+    }
+
+    return rc;
+}
@@ -0,0 +1,63 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+
+#ifndef _h_pileup_line_
+#define _h_pileup_line_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pileup_options.h"
+
+struct dyn_string;
+
+/* the deleted bases of the last placement that had a deletion, placements
+   sharing a deletion ( same reference-position and length ) are formatted
+   from the same buffer */
+typedef struct deletion_cache
+{
+    INSDC_4na_bin * bases;
+    uint32_t len;
+    INSDC_coord_zero ref_pos;
+} deletion_cache;
+
+void release_deletion_cache( deletion_cache * self );
+
+/* appends the samtools-pileup column of the placements of the current spotgroup to line,
+   the quality of each placement goes into qualities and is appended after a tab */
+rc_t walk_placements( ReferenceIterator *ref_iter,
+                      struct dyn_string *line,
+                      struct dyn_string *qualities,
+                      deletion_cache * dels,
+                      const pileup_options *options );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  _h_pileup_line_ */
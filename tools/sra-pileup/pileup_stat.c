@@ -26,9 +26,11 @@
 
 #include <klib/out.h>
 #include <klib/sort.h>
+#include <klib/text.h>
 
 #include "ref_walker_0.h"
 #include "4na_ascii.h"
+#include "pileup_stat.h"
 
 static uint32_t percent( uint32_t v1, uint32_t v2 )
 {
@@ -131,11 +133,11 @@ typedef struct strand
 } strand;
 
 
-typedef struct stat_counters
+struct stat_counters
 {
     strand pos;
     strand neg;
-} stat_counters;
+};
 
 
 static rc_t prepare_strand( strand * strand, uint32_t initial_size )
@@ -245,40 +247,37 @@ static rc_t print_header_line( void )
 /* ........................................................................................... */
 
 
-static rc_t CC walk_stat_enter_ref_window( walk_data * data )
+static void stat_enter_window( stat_counters * counters )
 {
-    stat_counters * counters = data->data;
     counters->pos.tlen_w.members = 0;
     counters->pos.tlen_l.members = 0;
     counters->neg.tlen_w.members = 0;
     counters->neg.tlen_l.members = 0;
-    return 0;
 }
 
 
-static rc_t CC walk_stat_enter_ref_pos( walk_data * data )
+static rc_t stat_enter_pos( stat_counters * counters, uint32_t depth )
 {
     rc_t rc;
-    stat_counters * counters = data->data;
 
     on_new_ref_position_strand( &counters->pos );
     on_new_ref_position_strand( &counters->neg );
 
-    rc = realloc_strand( &counters->pos, data->depth );
+    rc = realloc_strand( &counters->pos, depth );
     if ( rc == 0 )
-        rc = realloc_strand( &counters->neg, data->depth );
+        rc = realloc_strand( &counters->neg, depth );
 
     return rc;
 }
 
 
-static rc_t CC walk_stat_exit_ref_pos( walk_data * data )
+static rc_t stat_exit_pos( stat_counters * counters, const char * ref_name, INSDC_coord_zero ref_pos,
+                           INSDC_4na_bin ref_base, uint32_t depth )
 {
-    char c = _4na_to_ascii( data->ref_base, false );
-    stat_counters * counters = data->data;
+    char c = _4na_to_ascii( ref_base, false );
 
     /* REF-NAME, REF-POS, REF-BASE, DEPTH */
-    rc_t rc = KOutMsg( "%s\t%u\t%c\t%u\t", data->ref_name, data->ref_pos + 1, c, data->depth );
+    rc_t rc = KOutMsg( "%s\t%u\t%c\t%u\t", ref_name, ref_pos + 1, c, depth );
 
     /* STRAND-ness */
     if ( rc == 0 )
@@ -333,6 +332,34 @@ static void walk_strand_placement( strand * strand, int32_t tlen, INSDC_coord_le
 }
 
 
+/* is the placement at this position one that counts for the TLEN-statistic? */
+static bool is_tlen_placement( int32_t state, bool reverse )
+{
+    if ( reverse )
+        return ( ( state & align_iter_last ) == align_iter_last );
+    return ( ( state & align_iter_first ) == align_iter_first );
+}
+
+
+static rc_t CC walk_stat_enter_ref_window( walk_data * data )
+{
+    stat_enter_window( data->data );
+    return 0;
+}
+
+
+static rc_t CC walk_stat_enter_ref_pos( walk_data * data )
+{
+    return stat_enter_pos( data->data, data->depth );
+}
+
+
+static rc_t CC walk_stat_exit_ref_pos( walk_data * data )
+{
+    return stat_exit_pos( data->data, data->ref_name, data->ref_pos, data->ref_base, data->depth );
+}
+
+
 static rc_t CC walk_stat_placement( walk_data * data )
 {
     int32_t state = data->state;
@@ -345,9 +372,7 @@ static rc_t CC walk_stat_placement( walk_data * data )
         strand->alignment_count++;
 
         /* for TLEN-statistic on starting/ending placements at this pos */
-        if ( ( ( state & align_iter_last ) == align_iter_last )&&( reverse ) )
-            walk_strand_placement( strand, data->xrec->tlen, data->rec->len );
-        else if ( ( ( state & align_iter_first ) == align_iter_first )&&( !reverse ) )
+        if ( is_tlen_placement( state, reverse ) )
             walk_strand_placement( strand, data->xrec->tlen, data->rec->len );
     }
     return 0;
@@ -368,6 +393,7 @@ rc_t walk_stat( ReferenceIterator *ref_iter, pileup_options *options )
         data.ref_iter = ref_iter;
         data.options = options;
         data.data = &counters;
+        data.out = NULL;
 
         funcs.on_enter_ref = NULL;
         funcs.on_exit_ref = NULL;
@@ -388,4 +414,221 @@ rc_t walk_stat( ReferenceIterator *ref_iter, pileup_options *options )
         finish_stat_counters( &counters );
     }
     return rc;
-}
\ No newline at end of file
+}
+
+
+/* ........................................................................................... */
+
+/* parallel stat:
+   the sliding tlen-window, its width and the strand-arrays run through all positions of all
+   references, so a window walked by a worker cannot print its own lines. The worker only
+   records what the walk sees at each position ( the expensive part ), the main-thread feeds
+   these records in reference-order through the same counters as walk_stat() */
+
+typedef struct stat_pos
+{
+    INSDC_coord_zero ref_pos;
+    uint32_t depth;
+    uint32_t pos_alignments;    /* valid placements on the forward strand */
+    uint32_t neg_alignments;    /* valid placements on the reverse strand */
+    uint32_t tlen_count;        /* how many stat_tlen's belong to this position */
+    INSDC_4na_bin ref_base;
+} stat_pos;
+
+
+typedef struct stat_tlen
+{
+    int32_t tlen;
+    INSDC_coord_len seq_len;
+    bool reverse;
+} stat_tlen;
+
+
+struct stat_window
+{
+    char * ref_name;
+    stat_pos * pos;
+    uint32_t pos_count, pos_allocated;
+    stat_tlen * tlen;
+    uint32_t tlen_count, tlen_allocated;
+};
+
+
+static rc_t grow_stat_array( void ** values, uint32_t * allocated, uint32_t count, size_t item_size )
+{
+    rc_t rc = 0;
+    if ( count == *allocated )
+    {
+        uint32_t new_allocated = ( *allocated == 0 ) ? 4096 : *allocated * 2;
+        void * p = realloc( *values, item_size * new_allocated );
+        if ( p == NULL )
+            rc = RC ( rcApp, rcArgv, rcAccessing, rcMemory, rcExhausted );
+        else
+        {
+            *values = p;
+            *allocated = new_allocated;
+        }
+    }
+    return rc;
+}
+
+
+static rc_t CC record_stat_enter_ref_pos( walk_data * data )
+{
+    stat_window * window = data->data;
+    rc_t rc = 0;
+
+    if ( window->ref_name == NULL )
+    {
+        window->ref_name = string_dup_measure( data->ref_name, NULL );
+        if ( window->ref_name == NULL )
+            rc = RC ( rcApp, rcArgv, rcAccessing, rcMemory, rcExhausted );
+    }
+    if ( rc == 0 )
+        rc = grow_stat_array( ( void ** )&window->pos, &window->pos_allocated,
+                              window->pos_count, sizeof window->pos[ 0 ] );
+    if ( rc == 0 )
+    {
+        stat_pos * pos = &window->pos[ window->pos_count++ ];
+        memset( pos, 0, sizeof *pos );
+        pos->ref_pos = data->ref_pos;
+        pos->depth = data->depth;
+        pos->ref_base = data->ref_base;
+    }
+    return rc;
+}
+
+
+static rc_t CC record_stat_placement( walk_data * data )
+{
+    rc_t rc = 0;
+    int32_t state = data->state;
+    if ( ( state & align_iter_invalid ) != align_iter_invalid )
+    {
+        bool reverse = data->xrec->reverse;
+        stat_window * window = data->data;
+        stat_pos * pos = &window->pos[ window->pos_count - 1 ];
+
+        if ( reverse )
+            pos->neg_alignments++;
+        else
+            pos->pos_alignments++;
+
+        if ( is_tlen_placement( state, reverse ) )
+        {
+            rc = grow_stat_array( ( void ** )&window->tlen, &window->tlen_allocated,
+                                  window->tlen_count, sizeof window->tlen[ 0 ] );
+            if ( rc == 0 )
+            {
+                stat_tlen * t = &window->tlen[ window->tlen_count++ ];
+                t->tlen = data->xrec->tlen;
+                t->seq_len = data->rec->len;
+                t->reverse = reverse;
+                pos->tlen_count++;
+            }
+        }
+    }
+    return rc;
+}
+
+
+rc_t walk_stat_window( ReferenceIterator *ref_iter, pileup_options *options, stat_window ** window )
+{
+    rc_t rc = 0;
+    stat_window * w = calloc( 1, sizeof *w );
+    if ( w == NULL )
+        rc = RC ( rcApp, rcArgv, rcAccessing, rcMemory, rcExhausted );
+    else
+    {
+        walk_data data;
+        walk_funcs funcs;
+
+        data.ref_iter = ref_iter;
+        data.options = options;
+        data.data = w;
+        data.out = NULL;
+
+        memset( &funcs, 0, sizeof funcs );
+        funcs.on_enter_ref_pos = record_stat_enter_ref_pos;
+        funcs.on_placement = record_stat_placement;
+
+        rc = walk_0( &data, &funcs );
+        if ( rc == 0 )
+            *window = w;
+        else
+            release_stat_window( w );
+    }
+    return rc;
+}
+
+
+void release_stat_window( stat_window * window )
+{
+    if ( window != NULL )
+    {
+        free( window->ref_name );
+        free( window->pos );
+        free( window->tlen );
+        free( window );
+    }
+}
+
+
+rc_t make_stat_reduction( stat_counters ** counters )
+{
+    rc_t rc = 0;
+    stat_counters * c = calloc( 1, sizeof *c );
+    if ( c == NULL )
+        rc = RC ( rcApp, rcArgv, rcAccessing, rcMemory, rcExhausted );
+    else
+    {
+        rc = print_header_line();
+        if ( rc == 0 )
+            rc = prepare_stat_counters( c, 1024 );
+        if ( rc == 0 )
+            *counters = c;
+        else
+            release_stat_reduction( c );
+    }
+    return rc;
+}
+
+
+rc_t reduce_stat_window( stat_counters * counters, const stat_window * window, bool enter_window )
+{
+    rc_t rc = 0;
+    uint32_t idx, tlen_idx = 0;
+
+    if ( enter_window )
+        stat_enter_window( counters );
+
+    for ( idx = 0; rc == 0 && idx < window->pos_count; ++idx )
+    {
+        const stat_pos * pos = &window->pos[ idx ];
+        rc = stat_enter_pos( counters, pos->depth );
+        if ( rc == 0 )
+        {
+            uint32_t end = tlen_idx + pos->tlen_count;
+
+            counters->pos.alignment_count = pos->pos_alignments;
+            counters->neg.alignment_count = pos->neg_alignments;
+            for ( ; tlen_idx < end; ++tlen_idx )
+            {
+                const stat_tlen * t = &window->tlen[ tlen_idx ];
+                walk_strand_placement( t->reverse ? &counters->neg : &counters->pos, t->tlen, t->seq_len );
+            }
+            rc = stat_exit_pos( counters, window->ref_name, pos->ref_pos, pos->ref_base, pos->depth );
+        }
+    }
+    return rc;
+}
+
+
+void release_stat_reduction( stat_counters * counters )
+{
+    if ( counters != NULL )
+    {
+        finish_stat_counters( counters );
+        free( counters );
+    }
+}
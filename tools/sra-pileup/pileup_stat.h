@@ -33,6 +33,21 @@ extern "C" {
 
 rc_t walk_stat( ReferenceIterator *ref_iter, pileup_options *options );
 
+/* parallel stat: a worker walks one window into a stat_window, the main-thread
+   reduces the stat_windows in reference-order into the output of walk_stat() */
+typedef struct stat_window stat_window;
+typedef struct stat_counters stat_counters;
+
+rc_t walk_stat_window( ReferenceIterator *ref_iter, pileup_options *options, stat_window ** window );
+void release_stat_window( stat_window * window );
+
+/* prints the header-line */
+rc_t make_stat_reduction( stat_counters ** counters );
+
+/* enter_window: the window starts a reference or slice, where walk_stat() enters a new ref-window */
+rc_t reduce_stat_window( stat_counters * counters, const stat_window * window, bool enter_window );
+void release_stat_reduction( stat_counters * counters );
+
 #ifdef __cplusplus
 }
 #endif
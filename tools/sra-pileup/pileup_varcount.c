@@ -28,6 +28,7 @@
 
 #include "ref_walker_0.h"
 #include "4na_ascii.h"
+#include "dyn_string.h"
 
 typedef struct var_counters
 {
@@ -77,7 +78,7 @@ static rc_t CC walk_varcount_exit_ref_pos( walk_data * data )
 
                           A   B   C   D   E   F   G   H   I   J   K   L   M   N
 */                         
-        return KOutMsg( "%s\t%u\t%c\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
+        return print_2_out( data->out, "%s\t%u\t%c\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", 
                      data->ref_name, data->ref_pos + 1, ref_base, data->depth,
 
                      vc->base_counts[ 0 ], vc->base_counts[ 1 ], vc->base_counts[ 2 ], vc->base_counts[ 3 ],
@@ -110,7 +111,7 @@ static rc_t CC walk_varcount_placement( walk_data * data )
 }
 
 
-rc_t walk_varcount( ReferenceIterator *ref_iter, pileup_options * options )
+rc_t walk_varcount( ReferenceIterator *ref_iter, pileup_options * options, struct dyn_string * out )
 {
     walk_data data;
     walk_funcs funcs;
@@ -120,6 +121,7 @@ rc_t walk_varcount( ReferenceIterator *ref_iter, pileup_options * options )
     data.ref_iter = ref_iter;
     data.options = options;
     data.data = &v_counters;
+    data.out = out;
 
     funcs.on_enter_ref = NULL;
     funcs.on_exit_ref = NULL;
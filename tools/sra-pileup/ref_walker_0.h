@@ -50,10 +50,13 @@ struct tool_rec
 };
 
 
+struct dyn_string;
+
 typedef struct walk_data walk_data;
 struct walk_data
 {
     void *data;                             /* opaque pointer to data passed to each function */
+    struct dyn_string *out;                 /* where the output goes, directly to KOutMsg() if NULL */
     ReferenceIterator *ref_iter;            /* the global reference-iter */
     pileup_options *options;                /* the tool-options */
     struct ReferenceObj const * ref_obj;    /* the current reference-object */
@@ -808,11 +808,16 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
     
     /* do we have to generate the MD-flag */ 
     rc = get_bool_option( args, OPT_MD_FLAG, &opts->with_md_flag );
+
+    if ( rc == 0 )
+        rc = get_bool_option( args, OPT_BAM, &opts->dump_bam );
+    if ( rc == 0 && !opts->dump_bam )
+        rc = get_bool_option( args, OPT_BAM_INDEX, &opts->dump_bam );
 	
-    /* forcing to use the legacy code in case of Evidence-Dnb was requested */
+    /* forcing to use the legacy code in case of Evidence-Dnb or BAM was requested */
     if ( rc == 0 )
     {
-        if ( opts->dump_cg_ev_dnb )
+        if ( opts->dump_cg_ev_dnb || opts->dump_bam )
         {
             opts->force_legacy = true;
             opts->force_new = false;
@@ -944,6 +949,14 @@ static rc_t gather_int_options( Args * args, samdump_opts * opts )
     if ( rc == 0 )
         rc = get_uint32_option( args, OPT_RNA_SPLICEL, 0, &opts->rna_splice_level, true );
 
+    if ( rc == 0 )
+    {
+        rc = get_uint32_option( args, OPT_THREADS, 1, &opts->threads, true );
+        /* only the legacy code formats records on several threads */
+        if ( rc == 0 && opts->threads > 1 && !opts->force_new && !opts->no_mt )
+            opts->force_legacy = true;
+    }
+
     return rc;
 }
 
@@ -1338,6 +1351,8 @@ void report_options( const samdump_opts * opts )
     KOutMsg( "rna-splice-log        : %s\n",  opts->rna_splice_log_file );
 
     KOutMsg( "multithreading        : %s\n",  opts->no_mt ? "NO" : "YES" );  
+    KOutMsg( "threads               : %u\n",  opts->threads );
+    KOutMsg( "dump bam              : %s\n",  opts->dump_bam ? "YES" : "NO" );
     KOutMsg( "with-MD-flag          : %s\n",  opts->with_md_flag ? "NO" : "YES" );
 	
 #if _DEBUGGING
@@ -1385,6 +1400,38 @@ void release_options( samdump_opts * opts )
 /* =========================================================================================== */
 
 
+/* options the legacy code-path does not know, it would reject them when it parses the commandline again */
+static const char * new_path_only_options[] =
+{
+    OPT_HDR_FILE, OPT_OUTPUTFILE, OPT_OUTBUFSIZE, OPT_REPORT, OPT_CACHEREPORT, OPT_UNALIGNED_ONLY,
+    OPT_CIGAR_TEST, OPT_CURSOR_CACHE, OPT_DUMP_MODE, OPT_MIN_MAPQ, OPT_NO_MATE_CACHE, OPT_RNA_SPLICE,
+    OPT_RNA_SPLICEL, OPT_RNA_SPLICE_LOG, OPT_MD_FLAG, OPT_TIMING, OPT_NO_MT, OPT_NEW, NULL
+};
+
+/* --threads and --bam switch to the legacy code-path, refuse options which only the new code-path can handle */
+static rc_t check_legacy_switch( Args * args, const samdump_opts * opts )
+{
+    uint32_t count;
+    rc_t rc = ArgsOptionCount( args, OPT_LEGACY, &count );
+    if ( rc == 0 && count == 0 && opts->force_legacy && ( opts->dump_bam || opts->threads > 1 ) )
+    {
+        const char * reason = opts->dump_bam ? OPT_BAM : OPT_THREADS;
+        uint32_t idx;
+        for ( idx = 0; rc == 0 && new_path_only_options[ idx ] != NULL; ++idx )
+        {
+            rc = ArgsOptionCount( args, new_path_only_options[ idx ], &count );
+            if ( rc == 0 && count > 0 )
+            {
+                rc = RC( rcExe, rcArgv, rcProcessing, rcParam, rcConflict );
+                (void)PLOGERR( klogErr, ( klogErr, rc, "the parameters '--$(p1)' and '--$(p2)' cannot be combined",
+                                          "p1=%s,p2=%s", reason, new_path_only_options[ idx ] ) );
+            }
+        }
+    }
+    return rc;
+}
+
+
 rc_t gather_options( Args * args, samdump_opts * opts )
 {
     rc_t rc = gather_region_options( args, opts );
@@ -1398,6 +1445,8 @@ rc_t gather_options( Args * args, samdump_opts * opts )
         rc = gather_matepair_distances( args, opts );
     if ( rc == 0 )
         gather_unaligned_options( opts );
+    if ( rc == 0 )
+        rc = check_legacy_switch( args, opts );
     return rc;
 }
 
@@ -99,6 +99,9 @@ extern "C" {
 #define OPT_NO_MT       "disable-multithreading"
 #define OPT_TIMING      "timing"
 #define OPT_MD_FLAG     "with-md-flag"
+#define OPT_THREADS     "threads"
+#define OPT_BAM         "bam"
+#define OPT_BAM_INDEX   "bam-index"
 
 typedef struct range
 {
@@ -208,6 +211,9 @@ typedef struct samdump_opts
 
     size_t cursor_cache_size;
 
+    /* number of threads formatting aligned records, implemented by the legacy code path */
+    uint32_t threads;
+
     /* how the sam-headers are treated */
     enum header_mode header_mode;
 
@@ -236,6 +242,9 @@ typedef struct samdump_opts
     bool dump_cg_ev_dnb;
     bool merge_cg_cigar;
 
+    /* BAM output, implemented by the legacy code path */
+    bool dump_bam;
+
     bool dump_unaligned_reads;
     bool dump_unaligned_only;
     bool dump_cga_tools_mode;
@@ -38,8 +38,6 @@
 #include <vfs/path-priv.h>
 #include <kfs/file.h>
 #include <kfs/buffile.h>
-#include <kfs/gzip.h>
-#include <kfs/bzip.h>
 #include <kdb/meta.h>
 #include <kdb/namelist.h>
 #include <kapp/main.h>
@@ -62,12 +60,16 @@
 #include <align/quality-quantizer.h>
 
 #include <kfs/directory.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 #include <os-native.h>
 #include <sysalloc.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <limits.h>
 #include <string.h>
 #include <strtol.h>
@@ -75,6 +77,8 @@
 #include <assert.h>
 
 #include "debug.h"
+#include "bam_writer.h"
+#include "compressed_file.h"
 /* #include "sam-dump.vers.h" */
 
 #if _ARCH_BITS == 64
@@ -134,6 +138,9 @@ struct params_s
     
     bool output_gzip;
     bool output_bz2;
+    /* records are converted to BAM, optionally indexed into bam_index */
+    bool output_bam;
+    char const *bam_index;
     
     bool xi;
     int cg_style; /* 0: raw; 1: with B's; 2: without B's, fixed up SEQ/QUAL; */
@@ -155,6 +162,9 @@ struct params_s
     bool quantizeQual;
     uint8_t qualQuant[256];
     uint8_t qualQuantSingle; /*** the quality is quantized - single value, no need to retrieve **/
+    
+    /* number of threads formatting aligned records */
+    uint32_t threads;
 };
 
 
@@ -188,6 +198,12 @@ typedef struct SCol_struct
     UData base;
     uint32_t len;
     bool optional;
+    /* value of a column missing in the table, base points here */
+    union
+    {
+        INSDC_coord_zero coord0;
+        INSDC_coord_len coord_len;
+    } synth;
 } SCol;
 
 
@@ -259,6 +275,13 @@ typedef struct SAM_dump_ctx_s
     DataSource evi;
     DataSource eva;
     DataSource seq;
+    
+    /* records are formatted here instead of the output, on worker threads */
+    struct SOutBuf_struct *out;
+    /* aligned rows are handed to worker threads */
+    struct DumpParallel_struct *parallel;
+    /* records are encoded here with BAM output */
+    struct BAMOut_struct *bam;
 } SAM_dump_ctx_t;
 
 
@@ -820,6 +843,7 @@ struct
     void* data;
     KFile* kfile;
     uint64_t pos;
+    struct bam_writer* bam;
 } g_out_writer = {NULL};
 
 
@@ -830,6 +854,13 @@ static rc_t CC BufferedWriter( void *const self, char const buffer[], size_t con
 
     assert( buffer != NULL );
 
+    if ( g_out_writer.bam != NULL )
+    {
+        rc = bam_writer_write( g_out_writer.bam, buffer, bufsize );
+        if ( pnum_writ != NULL )
+            *pnum_writ = rc == 0 ? bufsize : 0;
+        return rc;
+    }
     while ( written < bufsize )
     {
         size_t n;
@@ -846,11 +877,11 @@ static rc_t CC BufferedWriter( void *const self, char const buffer[], size_t con
 }
 
 
-static rc_t BufferedWriterMake( bool gzip, bool bzip2 )
+static rc_t BufferedWriterMake( bool gzip, bool bzip2, bool bam, char const *bam_index, uint32_t threads )
 {
     rc_t rc = 0;
 
-    if ( gzip && bzip2 )
+    if ( ( gzip && bzip2 ) || ( bam && ( gzip || bzip2 ) ) )
     {
         rc = RC( rcApp, rcFile, rcConstructing, rcParam, rcAmbiguous );
     }
@@ -864,24 +895,26 @@ static rc_t BufferedWriterMake( bool gzip, bool bzip2 )
         if ( rc == 0 )
         {
             g_out_writer.pos = 0;
-            if ( gzip )
+            if ( bam )
             {
-                KFile* gz;
-                rc = KFileMakeGzipForWrite( &gz, g_out_writer.kfile );
+                /* the BAM writer does its own BGZF blocking, no extra buffering */
+                rc = make_bam_writer( &g_out_writer.bam, g_out_writer.kfile, threads, bam_index );
                 if ( rc == 0 )
                 {
-                    KFileRelease( g_out_writer.kfile );
-                    g_out_writer.kfile = gz;
+                    g_out_writer.writer = KOutWriterGet();
+                    g_out_writer.data = KOutDataGet();
+                    rc = KOutHandlerSet( BufferedWriter, &g_out_writer );
                 }
+                return rc;
             }
-            else if ( bzip2 )
+            if ( gzip || bzip2 )
             {
-                KFile* bz;
-                rc = KFileMakeBzip2ForWrite( &bz, g_out_writer.kfile );
+                KFile* z;
+                rc = make_compressed_file( &z, g_out_writer.kfile, bzip2, threads );
                 if ( rc == 0 )
                 {
                     KFileRelease( g_out_writer.kfile );
-                    g_out_writer.kfile = bz;
+                    g_out_writer.kfile = z;
                 }
             }
             if ( rc == 0 )
@@ -903,8 +936,25 @@ static rc_t BufferedWriterMake( bool gzip, bool bzip2 )
 }
 
 
-static void BufferedWriterRelease( bool flush )
+/* what is written after it are BAM records instead of the header text */
+static rc_t BufferedWriterEndHeader( void )
 {
+    if ( g_out_writer.bam != NULL )
+        return bam_writer_end_header( g_out_writer.bam );
+    return 0;
+}
+
+
+static rc_t BufferedWriterRelease( bool flush )
+{
+    rc_t rc = 0;
+
+    if ( g_out_writer.bam != NULL )
+    {
+        /* writes the remaining blocks, the EOF marker and the index */
+        rc = release_bam_writer( g_out_writer.bam, flush );
+        g_out_writer.bam = NULL;
+    }
     if ( flush )
     {
         /* avoid flushing buffered data after failure */
@@ -915,6 +965,91 @@ static void BufferedWriterRelease( bool flush )
         KOutHandlerSet( g_out_writer.writer, g_out_writer.data );
     }
     g_out_writer.writer = NULL;
+    return rc;
+}
+
+
+typedef struct SOutBuf_struct
+{
+    char *base;
+    size_t len;
+    size_t size;
+} SOutBuf;
+
+
+static rc_t OutBufReserve( SOutBuf *const self, size_t const more )
+{
+    if ( self->len + more > self->size )
+    {
+        size_t size = self->size ? self->size : 64 * 1024;
+        char *base;
+        
+        while ( size < self->len + more )
+            size += size;
+        base = realloc( self->base, size );
+        if ( base == NULL )
+            return RC( rcExe, rcBuffer, rcResizing, rcMemory, rcExhausted );
+        self->base = base;
+        self->size = size;
+    }
+    return 0;
+}
+
+
+/* out == NULL writes to the output */
+static rc_t OutWrite( SOutBuf *const out, char const buffer[], size_t const bufsize )
+{
+    rc_t rc;
+    
+    if ( out == NULL )
+        return BufferedWriter( NULL, buffer, bufsize, NULL );
+    rc = OutBufReserve( out, bufsize );
+    if ( rc == 0 )
+    {
+        memcpy( out->base + out->len, buffer, bufsize );
+        out->len += bufsize;
+    }
+    return rc;
+}
+
+
+static rc_t OutMsg( SOutBuf *const out, char const fmt[], ... )
+{
+    rc_t rc;
+    va_list args;
+    
+    va_start( args, fmt );
+    if ( out == NULL )
+    {
+        rc = KOutVMsg( fmt, args );
+    }
+    else
+    {
+        size_t more = 256;
+        
+        for ( ; ; )
+        {
+            size_t written;
+            va_list args2;
+            
+            rc = OutBufReserve( out, more );
+            if ( rc != 0 )
+                break;
+            va_copy( args2, args );
+            rc = string_vprintf( out->base + out->len, out->size - out->len, &written, fmt, args2 );
+            va_end( args2 );
+            if ( rc == 0 )
+            {
+                out->len += written;
+                break;
+            }
+            if ( GetRCState( rc ) != rcInsufficient )
+                break;
+            more = out->size - out->len + out->size;
+        }
+    }
+    va_end( args );
+    return rc;
 }
 
 
@@ -1140,25 +1275,21 @@ static rc_t Cursor_ReadAlign( SCurs const *curs, int64_t row_id, SCol* cols, uin
         }
         else
         {
-            static INSDC_coord_zero readStart;
-            static INSDC_coord_len  readLen;
-            static INSDC_coord_len  cigarLen;
-            
             switch ( (int)idx )
             {
             case alg_READ_START:
-                readStart = 0;
-                c->base.coord0 = &readStart;
+                c->synth.coord0 = 0;
+                c->base.coord0 = &c->synth.coord0;
                 c->len = 1;
                 break;
             case alg_READ_LEN:
-                readLen = cols[ alg_READ ].len;
-                c->base.coord_len = &readLen;
+                c->synth.coord_len = cols[ alg_READ ].len;
+                c->base.coord_len = &c->synth.coord_len;
                 c->len = 1;
                 break;
             case alg_CIGAR_LEN:
-                cigarLen = cols[ alg_CIGAR ].len;
-                c->base.coord_len = &cigarLen;
+                c->synth.coord_len = cols[ alg_CIGAR ].len;
+                c->base.coord_len = &c->synth.coord_len;
                 c->len = 1;
                 break;
             }
@@ -1199,34 +1330,34 @@ static rc_t Cursor_ReadAlign( SCurs const *curs, int64_t row_id, SCol* cols, uin
 }
 
 
-static rc_t DumpName( char const *name, size_t name_len,
+static rc_t DumpName( SOutBuf *out, char const *name, size_t name_len,
                       const char spot_group_sep, char const *spot_group,
                       size_t spot_group_len, int64_t spot_id )
 {
     rc_t rc = 0;
     if ( param->cg_friendly_names )
     {
-        rc = KOutMsg( "%.*s-1:%lu", spot_group_len, spot_group, spot_id );
+        rc = OutMsg( out, "%.*s-1:%lu", spot_group_len, spot_group, spot_id );
     }
     else
     {
         if ( param->name_prefix != NULL )
         {
-            rc = KOutMsg( "%s.", param->name_prefix );
+            rc = OutMsg( out, "%s.", param->name_prefix );
         }
-        rc = BufferedWriter( NULL, name, name_len, NULL );
+        rc = OutWrite( out, name, name_len );
         if ( rc == 0 && param->spot_group_in_name && spot_group_len > 0 )
         {
-            rc = BufferedWriter( NULL, &spot_group_sep, 1, NULL );
+            rc = OutWrite( out, &spot_group_sep, 1 );
             if ( rc == 0 )
-                rc = BufferedWriter( NULL, spot_group, spot_group_len, NULL );
+                rc = OutWrite( out, spot_group, spot_group_len );
         }
     }
     return rc;
 }
 
 
-static rc_t DumpQuality( char const quality[], unsigned const count, bool const reverse, bool const quantize )
+static rc_t DumpQuality( SOutBuf *out, char const quality[], unsigned const count, bool const reverse, bool const quantize )
 {
     rc_t rc = 0;
     if ( quality == NULL )
@@ -1236,7 +1367,7 @@ static rc_t DumpQuality( char const quality[], unsigned const count, bool const
         for ( i = 0; rc == 0 && i < count; ++i )
         {
             char const newValue = ((param->qualQuant && param->qualQuantSingle)?param->qualQuantSingle:30) + 33;
-            rc = BufferedWriter( NULL, &newValue, 1, NULL );
+            rc = OutWrite( out, &newValue, 1 );
         }
     }
     else if ( reverse || quantize )
@@ -1248,18 +1379,18 @@ static rc_t DumpQuality( char const quality[], unsigned const count, bool const
             char const qual = quality[ reverse ? ( count - i - 1 ) : i ];
             char const newValue = quantize ? param->qualQuant[ qual - 33 ] + 33 : qual;
 
-            rc = BufferedWriter( NULL, &newValue, 1, NULL );
+            rc = OutWrite( out, &newValue, 1 );
         }
     }
     else
     {
-        rc = BufferedWriter( NULL, quality, count, NULL );
+        rc = OutWrite( out, quality, count );
     }
     return rc;
 }
 
 
-static rc_t DumpUnalignedFastX( const SCol cols[], uint32_t read_id, INSDC_coord_zero readStart, INSDC_coord_len readLen, int64_t row_id )
+static rc_t DumpUnalignedFastX( SOutBuf *out, const SCol cols[], uint32_t read_id, INSDC_coord_zero readStart, INSDC_coord_len readLen, int64_t row_id )
 {
     /* fast[AQ] represnted in SAM fields:
        [@|>]QNAME unaligned
@@ -1267,36 +1398,36 @@ static rc_t DumpUnalignedFastX( const SCol cols[], uint32_t read_id, INSDC_coord
        +
        QUAL
     */
-    rc_t rc = BufferedWriter( NULL, param->fastq ? "@" : ">", 1, NULL );
+    rc_t rc = OutWrite( out, param->fastq ? "@" : ">", 1 );
 
     /* QNAME: [PFX.]SEQUENCE:NAME[#SPOT_GROUP] */
     if ( rc == 0 )
-        rc = DumpName( cols[ seq_NAME ].base.str, cols[ seq_NAME ].len, '#',
+        rc = DumpName( out, cols[ seq_NAME ].base.str, cols[ seq_NAME ].len, '#',
                        cols[ seq_SPOT_GROUP ].base.str, cols[ seq_SPOT_GROUP ].len, row_id );
     if ( rc == 0 && read_id > 0 )
     {
-        rc = KOutMsg( "/%u", read_id );
+        rc = OutMsg( out, "/%u", read_id );
     }
     if ( rc == 0 )
-        rc = BufferedWriter( NULL, " unaligned\n", 11, NULL );
+        rc = OutWrite( out, " unaligned\n", 11 );
 
     /* SEQ: SEQUENCE.READ */
     if ( rc == 0 )
-        rc = BufferedWriter( NULL, &cols[ seq_READ ].base.str[readStart], readLen, NULL );
+        rc = OutWrite( out, &cols[ seq_READ ].base.str[readStart], readLen );
     if ( rc == 0 && param->fastq )
     {
         /* QUAL: SEQUENCE.QUALITY */
-        rc = BufferedWriter( NULL, "\n+\n", 3, NULL );
+        rc = OutWrite( out, "\n+\n", 3 );
         if ( rc == 0 )
-            rc = DumpQuality( &cols[ seq_QUALITY ].base.str[ readStart ], readLen, false, param->quantizeQual );
+            rc = DumpQuality( out, &cols[ seq_QUALITY ].base.str[ readStart ], readLen, false, param->quantizeQual );
     }
     if ( rc == 0 )
-        rc = BufferedWriter( NULL, "\n", 1, NULL );
+        rc = OutWrite( out, "\n", 1 );
     return rc;
 }
 
 
-static rc_t DumpAlignedFastX( const SCol cols[], int64_t const alignId, uint32_t read_id, bool primary, bool secondary )
+static rc_t DumpAlignedFastX( SOutBuf *out, const SCol cols[], int64_t const alignId, uint32_t read_id, bool primary, bool secondary )
 {
     rc_t rc = 0;
     size_t nm;
@@ -1321,7 +1452,7 @@ static rc_t DumpAlignedFastX( const SCol cols[], int64_t const alignId, uint32_t
            +
            QUAL
         */
-        rc = BufferedWriter( NULL, param->fastq ? "@" : ">", 1, NULL );
+        rc = OutWrite( out, param->fastq ? "@" : ">", 1 );
         /* QNAME: [PFX.]SEQ_NAME[#SPOT_GROUP] */
         if ( qname_len == 0 || qname == NULL )
         {
@@ -1330,72 +1461,372 @@ static rc_t DumpAlignedFastX( const SCol cols[], int64_t const alignId, uint32_t
         }
         nm = cols[ alg_SPOT_GROUP ].len ? alg_SPOT_GROUP : alg_SEQ_SPOT_GROUP;
         if ( rc == 0 )
-            rc = DumpName( qname, qname_len, '.', cols[ nm ].base.str, cols[ nm ].len, spot_id);
+            rc = DumpName( out, qname, qname_len, '.', cols[ nm ].base.str, cols[ nm ].len, spot_id);
 
         if ( rc == 0 && read_id > 0 )
-            rc = KOutMsg( "/%u", read_id );
+            rc = OutMsg( out, "/%u", read_id );
 
         if ( rc == 0 )
         {
             if ( primary )
             {
-                rc = BufferedWriter( NULL, " primary", 8, NULL );
+                rc = OutWrite( out, " primary", 8 );
             }
             else if ( secondary )
             {
-                rc = BufferedWriter( NULL, " secondary", 10, NULL );
+                rc = OutWrite( out, " secondary", 10 );
             }
         }
 
         /* RNAME: REF_NAME or REF_SEQ_ID */
         if ( rc == 0 )
-            rc = BufferedWriter( NULL, " ref=", 5, NULL );
+            rc = OutWrite( out, " ref=", 5 );
         if ( rc == 0 )
         {
             if ( param->use_seqid )
             {
-                rc = BufferedWriter( NULL, cols[ alg_REF_SEQ_ID ].base.str, cols[ alg_REF_SEQ_ID ].len, NULL );
+                rc = OutWrite( out, cols[ alg_REF_SEQ_ID ].base.str, cols[ alg_REF_SEQ_ID ].len );
             }
             else
             {
-                rc = BufferedWriter( NULL, cols[ alg_REF_NAME ].base.str, cols[ alg_REF_NAME ].len, NULL );
+                rc = OutWrite( out, cols[ alg_REF_NAME ].base.str, cols[ alg_REF_NAME ].len );
             }
         }
 
         /* POS: REF_POS, MAPQ: MAPQ */
         if ( rc == 0 )
-            rc = KOutMsg( " pos=%u mapq=%i\n", cols[ alg_REF_POS ].base.coord0[ 0 ] + 1, cols[ alg_MAPQ ].base.i32[ 0 ] );
+            rc = OutMsg( out, " pos=%u mapq=%i\n", cols[ alg_REF_POS ].base.coord0[ 0 ] + 1, cols[ alg_MAPQ ].base.i32[ 0 ] );
         
         /* SEQ: READ */
         if ( rc == 0 )
-            rc = BufferedWriter( NULL, read, readlen, NULL );
+            rc = OutWrite( out, read, readlen );
         if ( rc == 0 && param->fastq )
         {
             /* QUAL: SAM_QUALITY */
-            rc = BufferedWriter( NULL, "\n+\n", 3, NULL );
+            rc = OutWrite( out, "\n+\n", 3 );
             if ( rc == 0 )
-                rc = DumpQuality( qual, readlen, false, param->quantizeQual );
+                rc = DumpQuality( out, qual, readlen, false, param->quantizeQual );
         }
         if ( rc == 0 )
-            rc = BufferedWriter( NULL, "\n", 1, NULL );
+            rc = OutWrite( out, "\n", 1 );
     }
     return rc;
 }
 
 
+/* with BAM output the records are encoded from the column values instead of formatted,
+   text is where the pieces also formatted for SAM ( name, quality ) are made first */
+typedef struct BAMOut_struct
+{
+    struct bam_record *rec;
+    SOutBuf text;
+} BAMOut;
+
+
+static rc_t BAMOutGet( SAM_dump_ctx_t *const ctx, BAMOut **const pbam )
+{
+    rc_t rc = 0;
+    
+    if ( ctx->bam == NULL )
+    {
+        BAMOut *const self = calloc( 1, sizeof( *self ) );
+        
+        if ( self == NULL )
+            return RC( rcExe, rcData, rcAllocating, rcMemory, rcExhausted );
+        rc = make_bam_record( &self->rec, g_out_writer.bam );
+        if ( rc != 0 )
+        {
+            free( self );
+            return rc;
+        }
+        ctx->bam = self;
+    }
+    *pbam = ctx->bam;
+    return rc;
+}
+
+
+static void BAMOutRelease( SAM_dump_ctx_t *const ctx )
+{
+    if ( ctx->bam != NULL )
+    {
+        release_bam_record( ctx->bam->rec );
+        free( ctx->bam->text.base );
+        free( ctx->bam );
+        ctx->bam = NULL;
+    }
+}
+
+
+/* the record goes where the SAM line would */
+static rc_t BAMOutWrite( BAMOut *const bam, SOutBuf *const out )
+{
+    void const *data;
+    size_t len;
+    rc_t rc = bam_record_finish( bam->rec, &data, &len );
+    
+    if ( rc == 0 )
+        rc = OutWrite( out, data, len );
+    return rc;
+}
+
+
+static rc_t BAMName( BAMOut *const bam, char const *name, size_t name_len, const char spot_group_sep,
+                     char const *spot_group, size_t spot_group_len, int64_t spot_id )
+{
+    rc_t rc;
+    
+    bam->text.len = 0;
+    rc = DumpName( &bam->text, name, name_len, spot_group_sep, spot_group, spot_group_len, spot_id );
+    if ( rc == 0 )
+        rc = bam_record_qname( bam->rec, bam->text.base, bam->text.len );
+    return rc;
+}
+
+
+static rc_t BAMQuality( BAMOut *const bam, char const quality[], unsigned const count, bool const reverse )
+{
+    rc_t rc;
+    
+    bam->text.len = 0;
+    rc = DumpQuality( &bam->text, quality, count, reverse, param->quantizeQual );
+    if ( rc == 0 )
+        rc = bam_record_qual( bam->rec, bam->text.base, bam->text.len );
+    return rc;
+}
+
+
+/* the CIGAR of evidence is changed as it is for SAM: S becomes I for intervals,
+   consecutive equal operations are merged for alignments ( cg_canonical_print_cigar ) */
+static rc_t BAMCigar( BAMOut *const bam, char const cigar[], unsigned const len, enum eDSTableType const type )
+{
+    rc_t rc = 0;
+    uint32_t count = 0;
+    uint32_t total = 0;
+    char op = 0;
+    unsigned i;
+    
+    if ( type != edstt_EvidenceInterval && type != edstt_EvidenceAlignment )
+        return bam_record_cigar( bam->rec, cigar, len );
+    for ( i = 0; rc == 0 && i < len; ++i )
+    {
+        char const ch = cigar[ i ];
+        
+        if ( ch >= '0' && ch <= '9' )
+        {
+            count = count * 10 + ( ch - '0' );
+            continue;
+        }
+        if ( type == edstt_EvidenceInterval )
+        {
+            rc = bam_record_cigar_op( bam->rec, count, ch == 'S' ? 'I' : ch );
+        }
+        else if ( ch == op )
+        {
+            total += count;
+        }
+        else
+        {
+            if ( total > 0 )
+                rc = bam_record_cigar_op( bam->rec, total, op );
+            total = count;
+            op = ch;
+        }
+        count = 0;
+    }
+    if ( rc == 0 && total > 0 )
+        rc = bam_record_cigar_op( bam->rec, total, op );
+    return rc;
+}
+
+
+/* the BAM form of DumpUnalignedSAM() */
+static rc_t DumpUnalignedBAM( SAM_dump_ctx_t *const ctx, const SCol cols[], uint32_t flags,
+                              INSDC_coord_zero readStart, INSDC_coord_len readLen,
+                              char const *rnext, uint32_t rnext_len, INSDC_coord_zero pnext,
+                              char const readGroup[], int64_t row_id )
+{
+    BAMOut *bam;
+    rc_t rc = BAMOutGet( ctx, &bam );
+    
+    if ( rc == 0 )
+        rc = bam_record_start( bam->rec, NULL, 0, -1, 0, flags );
+    if ( rc == 0 )
+        rc = BAMName( bam, cols[ seq_NAME ].base.str, cols[ seq_NAME ].len, '.',
+                      cols[ seq_SPOT_GROUP ].base.str, cols[ seq_SPOT_GROUP ].len, row_id );
+    if ( rc == 0 )
+        rc = bam_record_mate( bam->rec, rnext, rnext_len, pnext - 1, 0 );
+    
+    /* SEQ: SEQUENCE.READ */
+    if ( rc == 0 )
+    {
+        if ( flags & 0x10 )
+        {
+            INSDC_coord_len i;
+            
+            bam->text.len = 0;
+            rc = OutBufReserve( &bam->text, readLen );
+            for ( i = 0; rc == 0 && i < readLen; i++ )
+                DNAReverseCompliment( &cols[ seq_READ ].base.str[ readStart + readLen - 1 - i ], &bam->text.base[ i ], 1 );
+            if ( rc == 0 )
+                rc = bam_record_seq( bam->rec, bam->text.base, readLen );
+        }
+        else
+        {
+            rc = bam_record_seq( bam->rec, &cols[ seq_READ ].base.str[ readStart ], readLen );
+        }
+    }
+    /* QUAL: SEQUENCE.QUALITY */
+    if ( rc == 0 )
+        rc = BAMQuality( bam, &cols[ seq_QUALITY ].base.str[ readStart ], readLen, flags & 0x10 );
+    
+    /* optional fields: */
+    if ( rc == 0 )
+    {
+        if ( readGroup )
+            rc = bam_record_tag_str( bam->rec, "RG", readGroup, string_size( readGroup ) );
+        else if ( cols[ seq_SPOT_GROUP ].len > 0 )
+            rc = bam_record_tag_str( bam->rec, "RG", cols[ seq_SPOT_GROUP ].base.str, cols[ seq_SPOT_GROUP ].len );
+    }
+    if ( rc == 0 )
+        rc = BAMOutWrite( bam, ctx->out );
+    return rc;
+}
+
+
+/* the BAM form of one read of DumpAlignedSAM(), with the values it has worked out */
+static rc_t DumpAlignedBAM( SAM_dump_ctx_t *const ctx, DataSource const *ds, int64_t alignId,
+                            char const readGroup[], int type, unsigned readId,
+                            char const *qname, size_t qname_len, int64_t spot_id, unsigned flags,
+                            char const *cigar, unsigned cigLen,
+                            char const *read, char const *qual, unsigned readlen )
+{
+    SCol const *const cols = ds->cols;
+    size_t const nm = cols[ alg_SPOT_GROUP ].len ? alg_SPOT_GROUP : alg_SEQ_SPOT_GROUP;
+    int32_t const pos = cols[ alg_REF_POS ].base.coord0[ 0 ];
+    uint8_t const mapq = ( uint8_t )cols[ alg_MAPQ ].base.i32[ 0 ];
+    int32_t const tlen = cols[ alg_TEMPLATE_LEN ].base.v ? cols[ alg_TEMPLATE_LEN ].base.i32[ 0 ] : 0;
+    BAMOut *bam;
+    rc_t rc = BAMOutGet( ctx, &bam );
+    
+    /* RNAME: REF_NAME or REF_SEQ_ID */
+    if ( rc == 0 )
+    {
+        if ( ds->type == edstt_EvidenceAlignment && type == 0 )
+        {
+            char rname[ 64 ];
+            size_t rname_len;
+            
+            rc = string_printf( rname, sizeof( rname ), &rname_len, "ALLELE_%li.%u",
+                                cols[ alg_REF_ID ].base.i64[ readId ], cols[ alg_REF_PLOIDY ].base.u32[ readId ] );
+            if ( rc == 0 )
+                rc = bam_record_start( bam->rec, rname, rname_len, pos, mapq, flags );
+        }
+        else if ( param->use_seqid )
+            rc = bam_record_start( bam->rec, cols[ alg_REF_SEQ_ID ].base.str, cols[ alg_REF_SEQ_ID ].len, pos, mapq, flags );
+        else
+            rc = bam_record_start( bam->rec, cols[ alg_REF_NAME ].base.str, cols[ alg_REF_NAME ].len, pos, mapq, flags );
+    }
+    if ( rc == 0 )
+        rc = BAMName( bam, qname, qname_len, '.', cols[ nm ].base.str, cols[ nm ].len, spot_id );
+    if ( rc == 0 )
+        rc = BAMCigar( bam, cigar, cigLen, ds->type );
+    
+    /* RNEXT: MATE_REF_NAME, PNEXT: MATE_REF_POS */
+    if ( rc == 0 )
+    {
+        if ( cols[ alg_MATE_REF_NAME ].len )
+            rc = bam_record_mate( bam->rec, cols[ alg_MATE_REF_NAME ].base.str, cols[ alg_MATE_REF_NAME ].len,
+                                  cols[ alg_MATE_REF_POS ].base.coord0[ 0 ], tlen );
+        else
+            rc = bam_record_mate( bam->rec, NULL, 0, -1, tlen );
+    }
+    
+    if ( rc == 0 )
+        rc = bam_record_seq( bam->rec, read, readlen );
+    if ( rc == 0 )
+        rc = BAMQuality( bam, qual, readlen, false );
+    
+    /* optional fields: */
+    if ( rc == 0 && ds->type == edstt_EvidenceInterval )
+    {
+        char rg[ 32 ];
+        size_t rg_len;
+        
+        rc = string_printf( rg, sizeof( rg ), &rg_len, "ALLELE_%u", readId + 1 );
+        if ( rc == 0 )
+            rc = bam_record_tag_str( bam->rec, "RG", rg, rg_len );
+    }
+    if ( rc == 0 )
+    {
+        if ( readGroup )
+            rc = bam_record_tag_str( bam->rec, "RG", readGroup, string_size( readGroup ) );
+        else if ( cols[ alg_SPOT_GROUP ].len > 0 )
+            rc = bam_record_tag_str( bam->rec, "RG", cols[ alg_SPOT_GROUP ].base.str, cols[ alg_SPOT_GROUP ].len );
+        else if ( cols[ alg_SEQ_SPOT_GROUP ].len > 0 )
+            rc = bam_record_tag_str( bam->rec, "RG", cols[ alg_SEQ_SPOT_GROUP ].base.str, cols[ alg_SEQ_SPOT_GROUP ].len );
+    }
+    if ( rc == 0 && param->cg_style > 0 && cols[ alg_CG_TAGS_STR ].len > 0 )
+        rc = bam_record_tags_sam( bam->rec, cols[ alg_CG_TAGS_STR ].base.str, cols[ alg_CG_TAGS_STR ].len );
+    if ( rc == 0 )
+    {
+        if ( param->cg_style > 0 && cols[ alg_ALIGN_GROUP ].len > 0 )
+        {
+            char const *ZI = cols[ alg_ALIGN_GROUP ].base.str;
+            unsigned i;
+            
+            for ( i = 0; rc == 0 && i < cols[ alg_ALIGN_GROUP ].len - 1; ++i )
+            {
+                if ( ZI[ i ] == '_' )
+                {
+                    bam->text.len = 0;
+                    rc = OutMsg( &bam->text, "ZI:i:%.*s\tZA:i:%.1s", i, ZI, ZI + i + 1 );
+                    if ( rc == 0 )
+                        rc = bam_record_tags_sam( bam->rec, bam->text.base, bam->text.len );
+                    break;
+                }
+            }
+        }
+        else if ( ds->type == edstt_EvidenceAlignment && type == 1 )
+        {
+            rc = bam_record_tag_int( bam->rec, "ZI", cols[ alg_REF_ID ].base.i64[ readId ] );
+            if ( rc == 0 )
+                rc = bam_record_tag_int( bam->rec, "ZA", cols[ alg_REF_PLOIDY ].base.u32[ readId ] );
+        }
+    }
+    
+    /* align id, hit count, edit distance */
+    if ( rc == 0 && param->xi )
+        rc = bam_record_tag_int( bam->rec, "XI", alignId );
+    if ( rc == 0 && cols[ alg_ALIGNMENT_COUNT ].len )
+        rc = bam_record_tag_int( bam->rec, "NH", cols[ alg_ALIGNMENT_COUNT ].base.u8[ readId ] );
+    if ( rc == 0 && cols[ alg_EDIT_DISTANCE ].len )
+        rc = bam_record_tag_int( bam->rec, "NM", cols[ alg_EDIT_DISTANCE ].base.i32[ readId ] );
+    
+    if ( rc == 0 )
+        rc = BAMOutWrite( bam, ctx->out );
+    return rc;
+}
+
+
 static
-rc_t DumpUnalignedSAM( const SCol cols[], uint32_t flags, INSDC_coord_zero readStart, INSDC_coord_len readLen,
+rc_t DumpUnalignedSAM( SAM_dump_ctx_t *const ctx, const SCol cols[], uint32_t flags, INSDC_coord_zero readStart, INSDC_coord_len readLen,
                        char const *rnext, uint32_t rnext_len, INSDC_coord_zero pnext, char const readGroup[], int64_t row_id )
 {
+    SOutBuf *const out = ctx->out;
     unsigned i;
+    rc_t rc;
+
+    if ( g_out_writer.bam != NULL )
+        return DumpUnalignedBAM( ctx, cols, flags, readStart, readLen, rnext, rnext_len, pnext, readGroup, row_id );
 
     /* QNAME: [PFX.]NAME[.SPOT_GROUP] */
-    rc_t rc = DumpName( cols[ seq_NAME ].base.str, cols[ seq_NAME ].len, '.',
+    rc = DumpName( out, cols[ seq_NAME ].base.str, cols[ seq_NAME ].len, '.',
               cols[ seq_SPOT_GROUP ].base.str, cols[ seq_SPOT_GROUP ].len, row_id );
 
     /* all these fields are const text for now */
     if ( rc == 0 )
-        rc = KOutMsg( "\t%u\t*\t0\t0\t*\t%.*s\t%u\t0\t",
+        rc = OutMsg( out, "\t%u\t*\t0\t0\t*\t%.*s\t%u\t0\t",
              flags, rnext_len ? rnext_len : 1, rnext_len ? rnext : "*", pnext );
     /* SEQ: SEQUENCE.READ */
     if ( flags & 0x10 )
@@ -1405,39 +1836,39 @@ rc_t DumpUnalignedSAM( const SCol cols[], uint32_t flags, INSDC_coord_zero readS
             char base;
 
             DNAReverseCompliment( &cols[ seq_READ ].base.str[ readStart + readLen - 1 - i ], &base, 1 );
-            rc = BufferedWriter( NULL, &base, 1, NULL );
+            rc = OutWrite( out, &base, 1 );
         }
     }
     else
     {
-        rc = BufferedWriter( NULL, &cols[ seq_READ ].base.str[ readStart ], readLen, NULL );
+        rc = OutWrite( out, &cols[ seq_READ ].base.str[ readStart ], readLen );
     }
 
     if ( rc == 0 )
-        rc = BufferedWriter( NULL, "\t", 1, NULL );
+        rc = OutWrite( out, "\t", 1 );
     /* QUAL: SEQUENCE.QUALITY */
     if ( rc == 0 )
-        rc = DumpQuality( &cols[ seq_QUALITY ].base.str[ readStart ], readLen, flags & 0x10, param->quantizeQual );
+        rc = DumpQuality( out, &cols[ seq_QUALITY ].base.str[ readStart ], readLen, flags & 0x10, param->quantizeQual );
 
     /* optional fields: */
     if ( rc == 0 )
     {
         if ( readGroup )
         {
-            rc = BufferedWriter( NULL, "\tRG:Z:", 6, NULL );
+            rc = OutWrite( out, "\tRG:Z:", 6 );
             if ( rc == 0 )
-                rc = BufferedWriter( NULL, readGroup, string_size( readGroup ), NULL );
+                rc = OutWrite( out, readGroup, string_size( readGroup ) );
         }
         else if ( cols[ seq_SPOT_GROUP ].len > 0 )
         {
             /* read group */
-            rc = BufferedWriter( NULL, "\tRG:Z:", 6, NULL );
+            rc = OutWrite( out, "\tRG:Z:", 6 );
             if ( rc == 0 )
-                rc = BufferedWriter( NULL, cols[ seq_SPOT_GROUP ].base.str, cols[ seq_SPOT_GROUP ].len, NULL );
+                rc = OutWrite( out, cols[ seq_SPOT_GROUP ].base.str, cols[ seq_SPOT_GROUP ].len );
         }
     }
     if ( rc == 0 )
-        rc = BufferedWriter( NULL, "\n", 1, NULL );
+        rc = OutWrite( out, "\n", 1 );
     return rc;
 }
 
@@ -1450,6 +1881,7 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
                      int type)
 {
     rc_t rc = 0;
+    SOutBuf *const out = ctx->out;
     unsigned const nreads = ds->cols[ alg_READ_LEN ].len;
     SCol const *const cols = ds->cols;
     int64_t const spot_id = cols[alg_SEQ_SPOT_ID].len > 0 ? cols[alg_SEQ_SPOT_ID].base.i64[0] : 0;
@@ -1483,6 +1915,7 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
         char const *const cigar = cols[ alg_CIGAR ].base.str + cigOffset;
         unsigned const cigLen = nreads > 1 ? cols[ alg_CIGAR_LEN ].base.coord_len[ readId ] : cols[ alg_CIGAR ].len;
         size_t nm;
+        unsigned oflags;
         char synth_qname[1024];
         
         cigOffset += cigLen;
@@ -1495,57 +1928,64 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
             string_printf( synth_qname, sizeof( synth_qname ), &qname_len, "%u/ALLELE_%li.%u", spot_id, cols[ alg_REF_ID ].base.i64[ readId ], cols[ alg_REF_PLOIDY ].base.u32[ readId ] );
             qname = synth_qname;
         }
-        nm = cols[ alg_SPOT_GROUP ].len ? alg_SPOT_GROUP : alg_SEQ_SPOT_GROUP;
-        rc = DumpName( qname, qname_len, '.', cols[ nm ].base.str, cols[ nm ].len, spot_id );
 
         /* FLAG: SAM_FLAGS */
-        if ( rc == 0 )
+        if ( ds->type == edstt_EvidenceAlignment )
         {
-            if ( ds->type == edstt_EvidenceAlignment )
-            {
-                bool const cmpl = cols[alg_REVERSED].base.v && readId < cols[alg_REVERSED].len ? cols[alg_REVERSED].base.tf[readId] : false;
-                rc = KOutMsg( "\t%u\t", 1 | (cmpl ? 0x10 : 0) | (read_id == 1 ? 0x40 : 0x80) );
-            }
-            else if ( !param->unaligned      /** not going to dump unaligned **/
-                 && ( flags & 0x1 )     /** but we have sequenced multiple fragments **/
-                 && ( flags & 0x8 ) )   /** and not all of them align **/
-            {
-                /*** remove flags talking about multiple reads **/
-                /* turn off 0x001 0x008 0x040 0x080 */
-                rc = KOutMsg( "\t%u\t", flags & ~0xC9 );
-            }
-            else
-            {
-                rc = KOutMsg( "\t%u\t", flags );
-            }
+            bool const cmpl = cols[alg_REVERSED].base.v && readId < cols[alg_REVERSED].len ? cols[alg_REVERSED].base.tf[readId] : false;
+            oflags = 1 | (cmpl ? 0x10 : 0) | (read_id == 1 ? 0x40 : 0x80);
+        }
+        else if ( !param->unaligned      /** not going to dump unaligned **/
+             && ( flags & 0x1 )     /** but we have sequenced multiple fragments **/
+             && ( flags & 0x8 ) )   /** and not all of them align **/
+        {
+            /*** remove flags talking about multiple reads **/
+            /* turn off 0x001 0x008 0x040 0x080 */
+            oflags = flags & ~0xC9;
+        }
+        else
+        {
+            oflags = flags;
         }
 
+        if ( g_out_writer.bam != NULL )
+        {
+            rc = DumpAlignedBAM( ctx, ds, alignId, readGroup, type, readId, qname, qname_len, spot_id,
+                                 oflags, cigar, cigLen, read, qual, readlen );
+            continue;
+        }
+
+        nm = cols[ alg_SPOT_GROUP ].len ? alg_SPOT_GROUP : alg_SEQ_SPOT_GROUP;
+        rc = DumpName( out, qname, qname_len, '.', cols[ nm ].base.str, cols[ nm ].len, spot_id );
+        if ( rc == 0 )
+            rc = OutMsg( out, "\t%u\t", oflags );
+
         if ( rc == 0 )
         {
             if ( ds->type == edstt_EvidenceAlignment && type == 0 )
             {
-                rc = KOutMsg( "ALLELE_%li.%u", cols[ alg_REF_ID ].base.i64[ readId ], cols[ alg_REF_PLOIDY ].base.u32[ readId ] );
+                rc = OutMsg( out, "ALLELE_%li.%u", cols[ alg_REF_ID ].base.i64[ readId ], cols[ alg_REF_PLOIDY ].base.u32[ readId ] );
             }
             else
             {
                 /* RNAME: REF_NAME or REF_SEQ_ID */
                 if ( param->use_seqid )
-                    rc = BufferedWriter( NULL, cols[ alg_REF_SEQ_ID ].base.str, cols[ alg_REF_SEQ_ID ].len, NULL );
+                    rc = OutWrite( out, cols[ alg_REF_SEQ_ID ].base.str, cols[ alg_REF_SEQ_ID ].len );
                 else
-                    rc = BufferedWriter( NULL, cols[ alg_REF_NAME ].base.str, cols[ alg_REF_NAME ].len, NULL );
+                    rc = OutWrite( out, cols[ alg_REF_NAME ].base.str, cols[ alg_REF_NAME ].len );
             }
         }
 
         if ( rc == 0 )
-            rc = BufferedWriter( NULL, "\t", 1, NULL );
+            rc = OutWrite( out, "\t", 1 );
         
         /* POS: REF_POS */
         if ( rc == 0 )
-            rc = KOutMsg( "%i\t", cols[ alg_REF_POS ].base.coord0[ 0 ] + 1 );
+            rc = OutMsg( out, "%i\t", cols[ alg_REF_POS ].base.coord0[ 0 ] + 1 );
 
         /* MAPQ: MAPQ */
         if ( rc == 0 )
-            rc = KOutMsg( "%i\t", cols[ alg_MAPQ ].base.i32[ 0 ] );
+            rc = OutMsg( out, "%i\t", cols[ alg_MAPQ ].base.i32[ 0 ] );
 
         /* CIGAR: CIGAR_* */
         if ( ds->type == edstt_EvidenceInterval )
@@ -1556,7 +1996,7 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
             {
                 char ch = cigar[i];
                 if ( ch == 'S' ) ch = 'I';
-                rc = BufferedWriter(NULL, &ch, 1, NULL);
+                rc = OutWrite( out, &ch, 1 );
             }
         }
 	else if(ds->type == edstt_EvidenceAlignment)
@@ -1566,11 +2006,11 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
         else
         {
             if ( rc == 0 )
-                rc = BufferedWriter( NULL, cigar, cigLen, NULL );
+                rc = OutWrite( out, cigar, cigLen );
         }
 
         if ( rc == 0 )
-            rc = BufferedWriter( NULL, "\t", 1, NULL );
+            rc = OutWrite( out, "\t", 1 );
         
         /* RNEXT: MATE_REF_NAME or '*' */
         /* PNEXT: MATE_REF_POS or 0 */
@@ -1581,67 +2021,67 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
                 if ( cols[ alg_MATE_REF_NAME ].len == cols[ alg_REF_NAME ].len &&
                     memcmp( cols[ alg_MATE_REF_NAME ].base.str, cols[ alg_REF_NAME ].base.str, cols[ alg_MATE_REF_NAME ].len ) == 0 )
                 {
-                    rc = BufferedWriter( NULL, "=\t", 2, NULL );
+                    rc = OutWrite( out, "=\t", 2 );
                 }
                 else
                 {
-                    rc = BufferedWriter( NULL, cols[ alg_MATE_REF_NAME ].base.str, cols[ alg_MATE_REF_NAME ].len, NULL );
+                    rc = OutWrite( out, cols[ alg_MATE_REF_NAME ].base.str, cols[ alg_MATE_REF_NAME ].len );
                     if ( rc == 0 )
-                        rc = BufferedWriter( NULL, "\t", 1, NULL );
+                        rc = OutWrite( out, "\t", 1 );
                 }
                 if ( rc == 0 )
-                    rc = KOutMsg( "%u\t", cols[ alg_MATE_REF_POS ].base.coord0[ 0 ] + 1 );
+                    rc = OutMsg( out, "%u\t", cols[ alg_MATE_REF_POS ].base.coord0[ 0 ] + 1 );
             }
             else
             {
-                rc = BufferedWriter( NULL, "*\t0\t", 4, NULL );
+                rc = OutWrite( out, "*\t0\t", 4 );
             }
         }
 
         /* TLEN: TEMPLATE_LEN */
         if ( rc == 0 )
-            rc = KOutMsg( "%i\t", cols[ alg_TEMPLATE_LEN ].base.v ? cols[ alg_TEMPLATE_LEN ].base.i32[ 0 ] : 0 );
+            rc = OutMsg( out, "%i\t", cols[ alg_TEMPLATE_LEN ].base.v ? cols[ alg_TEMPLATE_LEN ].base.i32[ 0 ] : 0 );
 
         /* SEQ: READ */
         if ( rc == 0 )
-            rc = BufferedWriter( NULL, read, readlen, NULL );
+            rc = OutWrite( out, read, readlen );
         if ( rc == 0 )
-            rc = BufferedWriter( NULL, "\t", 1, NULL );
+            rc = OutWrite( out, "\t", 1 );
 
         /* QUAL: SAM_QUALITY */
         if ( rc == 0 )
-            rc = DumpQuality( qual, readlen, false, param->quantizeQual );
+            rc = DumpQuality( out, qual, readlen, false, param->quantizeQual );
     
         /* optional fields: */
         if ( rc == 0 && ds->type == edstt_EvidenceInterval )
-            rc = KOutMsg( "\tRG:Z:ALLELE_%u", readId + 1 );
+            rc = OutMsg( out, "\tRG:Z:ALLELE_%u", readId + 1 );
 
         if ( rc == 0 )
         {
             if ( readGroup )
             {
-                rc = BufferedWriter( NULL, "\tRG:Z:", 6, NULL );
+                rc = OutWrite( out, "\tRG:Z:", 6 );
                 if ( rc == 0 )
-                    rc = BufferedWriter( NULL, readGroup, string_size( readGroup ), NULL );
+                    rc = OutWrite( out, readGroup, string_size( readGroup ) );
             }
             else if ( cols[ alg_SPOT_GROUP ].len > 0 )
             {
                 /* read group */
-                rc = BufferedWriter( NULL, "\tRG:Z:", 6, NULL );
+                rc = OutWrite( out, "\tRG:Z:", 6 );
                 if ( rc == 0 )
-                    rc = BufferedWriter( NULL, cols[ alg_SPOT_GROUP ].base.str, cols[ alg_SPOT_GROUP ].len, NULL );
+                    rc = OutWrite( out, cols[ alg_SPOT_GROUP ].base.str, cols[ alg_SPOT_GROUP ].len );
             }
             else if ( cols[ alg_SEQ_SPOT_GROUP ].len > 0 )
             {
                 /* backward compatibility */
-                rc = BufferedWriter( NULL, "\tRG:Z:", 6, NULL );
+                rc = OutWrite( out, "\tRG:Z:", 6 );
                 if ( rc == 0 )
-                    rc = BufferedWriter( NULL, cols[ alg_SEQ_SPOT_GROUP ].base.str, cols[ alg_SEQ_SPOT_GROUP ].len, NULL );
+                    rc = OutWrite( out, cols[ alg_SEQ_SPOT_GROUP ].base.str, cols[ alg_SEQ_SPOT_GROUP ].len );
             }
         }
 
         if ( rc == 0 && param->cg_style > 0 && cols[ alg_CG_TAGS_STR ].len > 0 )
-            rc = BufferedWriter( NULL, cols[ alg_CG_TAGS_STR ].base.str, cols[ alg_CG_TAGS_STR ].len, NULL );
+            rc = OutWrite( out, cols[ alg_CG_TAGS_STR ].base.str, cols[ alg_CG_TAGS_STR ].len );
 
         if ( rc == 0 )
         {
@@ -1654,31 +2094,31 @@ rc_t DumpAlignedSAM( SAM_dump_ctx_t *const ctx,
                 {
                     if ( ZI[ i ] == '_' )
                     {
-                        rc = KOutMsg( "\tZI:i:%.*s\tZA:i:%.1s", i, ZI, ZI + i + 1 );
+                        rc = OutMsg( out, "\tZI:i:%.*s\tZA:i:%.1s", i, ZI, ZI + i + 1 );
                         break;
                     }
                 }
             }
             else if ( ds->type == edstt_EvidenceAlignment && type == 1 )
             {
-                rc = KOutMsg( "\tZI:i:%li\tZA:i:%u", cols[ alg_REF_ID ].base.i64[ readId ], cols[ alg_REF_PLOIDY ].base.u32[ readId ] );
+                rc = OutMsg( out, "\tZI:i:%li\tZA:i:%u", cols[ alg_REF_ID ].base.i64[ readId ], cols[ alg_REF_PLOIDY ].base.u32[ readId ] );
             }
         }
 
         /* align id */
         if ( rc == 0 && param->xi )
-            rc = KOutMsg( "\tXI:i:%li", alignId );
+            rc = OutMsg( out, "\tXI:i:%li", alignId );
 
         /* hit count */
         if ( rc == 0 && cols[alg_ALIGNMENT_COUNT].len )
-            rc = KOutMsg( "\tNH:i:%i", (int)cols[ alg_ALIGNMENT_COUNT ].base.u8[ readId ] );
+            rc = OutMsg( out, "\tNH:i:%i", (int)cols[ alg_ALIGNMENT_COUNT ].base.u8[ readId ] );
 
         /* edit distance */
         if ( rc == 0 && cols[ alg_EDIT_DISTANCE ].len )
-            rc = KOutMsg( "\tNM:i:%i", cols[ alg_EDIT_DISTANCE ].base.i32[ readId ] );
+            rc = OutMsg( out, "\tNM:i:%i", cols[ alg_EDIT_DISTANCE ].base.i32[ readId ] );
 
         if ( rc == 0 )
-            rc = KOutMsg( "\n" );
+            rc = OutMsg( out, "\n" );
     }
     return rc;
 }
@@ -1770,7 +2210,7 @@ static rc_t DumpUnalignedReads( SAM_dump_ctx_t *const ctx, SCol const calg_col[]
                                 0;
                 if ( param->fasta || param->fastq )
                 {
-                    rc = DumpUnalignedFastX( ctx->seq.cols, nreads > 1 ? i + 1 : 0, readStart, readLen, row_id );
+                    rc = DumpUnalignedFastX( ctx->out, ctx->seq.cols, nreads > 1 ? i + 1 : 0, readStart, readLen, row_id );
                 }
                 else
                 {
@@ -1799,7 +2239,7 @@ static rc_t DumpUnalignedReads( SAM_dump_ctx_t *const ctx, SCol const calg_col[]
                     }
                     if ( calg_col == NULL )
                     {
-                        rc = DumpUnalignedSAM( ctx->seq.cols, cflags |
+                        rc = DumpUnalignedSAM( ctx, ctx->seq.cols, cflags |
                                           ( non_empty_reads > 1 ? ( 0x1 | 0x8 | ( i == 0 ? 0x40 : 0x00 ) | ( i == nreads - 1 ? 0x80 : 0x00 ) ) : 0x00 ),
                                           readStart, readLen, NULL, 0, 0, ctx->readGroup, row_id );
                     }
@@ -1809,7 +2249,7 @@ static rc_t DumpUnalignedReads( SAM_dump_ctx_t *const ctx, SCol const calg_col[]
                         uint16_t flags = cflags | 0x1 |
                                          ( ( calg_col[ alg_SAM_FLAGS ].base.u32[ 0 ] & 0x10 ) << 1 ) |
                                          ( ( calg_col[ alg_SAM_FLAGS ].base.u32[ 0 ] & 0x40 ) ? 0x80 : 0x40 );
-                        rc = DumpUnalignedSAM( ctx->seq.cols, flags, readStart, readLen,
+                        rc = DumpUnalignedSAM( ctx, ctx->seq.cols, flags, readStart, readLen,
                                           calg_col[ c ].base.str, calg_col[ c ].len,
                                           calg_col[ alg_REF_POS ].base.coord0[ 0 ] + 1, ctx->readGroup, row_id );
                     }
@@ -2458,7 +2898,7 @@ static bool DumpAlignedRow( SAM_dump_ctx_t *const ctx, DataSource *const ds,
     {
         unsigned const read_id = ds->cols[ alg_SEQ_READ_ID ].base.v ? ds->cols[ alg_SEQ_READ_ID ].base.coord1[ 0 ] : 0;
         
-        rc = DumpAlignedFastX( ctx->pri.cols, row, read_id, primary, false );
+        rc = DumpAlignedFastX( ctx->out, ctx->pri.cols, row, read_id, primary, false );
     }
     else
     {
@@ -2560,11 +3000,442 @@ enum e_IDS_opts
 };
 
 
+/* aligned records are formatted on worker threads in units of up to
+   DUMP_UNIT_ROWS rows into private buffers, the main thread keeps
+   feeding units and writes the buffers out in the order the units were made,
+   so the output is the same as with a single thread */
+#define DUMP_MAX_THREADS 64
+#define DUMP_UNIT_ROWS ( 16 * 1024 )
+#define ALG_COL_QTY ( sizeof( g_alg_col_tmpl ) / sizeof( g_alg_col_tmpl[ 0 ] ) )
+
+typedef struct DumpUnit_struct
+{
+    int which; /* primary_IDS or secondary_IDS */
+    /* list of alignment ids or, if ids_qty is 0, a range of rows */
+    int64_t *ids;
+    uint32_t ids_qty;
+    uint32_t ids_max;
+    int64_t first;
+    uint64_t count;
+    SOutBuf out;
+    int64_t rows;
+    rc_t rc;
+    bool done;
+} DumpUnit;
+
+
+typedef struct DumpWorker_struct
+{
+    struct DumpParallel_struct *parallel;
+    KThread *thread;
+    SAM_dump_ctx_t ctx;
+    SCol align_cols[ ALG_COL_QTY * 2 ];
+    SCol seq_cols[ sizeof( gSeqCol ) / sizeof( gSeqCol[ 0 ] ) ];
+} DumpWorker;
+
+
+typedef struct DumpParallel_struct
+{
+    KLock *lock;
+    KCondition *cond;
+    DumpWorker *worker;
+    uint32_t worker_qty;
+    DumpUnit *unit;
+    uint32_t unit_qty;
+    uint64_t queued;    /* units made available to workers */
+    uint64_t taken;     /* units picked up by workers */
+    uint64_t written;   /* units written to the output */
+    DumpUnit *filling;  /* unit being filled by main thread, not queued yet */
+    int64_t pri_rows;   /* records of written units */
+    int64_t sec_rows;
+    int64_t counted;    /* part of pri_rows + sec_rows already handed to the caller's record count */
+    bool closing;
+    bool failed;
+} DumpParallel;
+
+
+static void DumpUnitProcess( DumpWorker *const w, DumpUnit *const u )
+{
+    bool const primary = u->which == primary_IDS;
+    DataSource *const ds = primary ? &w->ctx.pri : &w->ctx.sec;
+    rc_t rc = 0;
+    
+    w->ctx.out = &u->out;
+    u->rows = 0;
+    if ( u->ids_qty > 0 )
+    {
+        SCol ids;
+        
+        memset( &ids, 0, sizeof( ids ) );
+        ids.base.i64 = u->ids;
+        ids.len = u->ids_qty;
+        rc = DumpAlignedRowList( &w->ctx, ds, &ids, &u->rows, primary, 0, false );
+    }
+    else
+    {
+        uint64_t i;
+        
+        for ( i = 0; i != u->count; ++i )
+        {
+            if ( DumpAlignedRow( &w->ctx, ds, u->first + i, primary, 0, &rc ) )
+                ++u->rows;
+            if ( rc != 0 || ( rc = Quitting() ) != 0 )
+                break;
+        }
+    }
+    w->ctx.out = NULL;
+    u->rc = rc;
+}
+
+
+static rc_t CC DumpWorkerThread( const KThread *t, void *data )
+{
+    DumpWorker *const w = data;
+    DumpParallel *const self = w->parallel;
+    rc_t rc = KLockAcquire( self->lock );
+    
+    if ( rc != 0 )
+        return rc;
+    for ( ; ; )
+    {
+        DumpUnit *u;
+        
+        while ( !self->failed && !self->closing && self->taken == self->queued )
+            KConditionWait( self->cond, self->lock );
+        if ( self->failed || self->taken == self->queued )
+            break;
+        u = &self->unit[ self->taken++ % self->unit_qty ];
+        KLockUnlock( self->lock );
+        
+        DumpUnitProcess( w, u );
+        
+        KLockAcquire( self->lock );
+        u->done = true;
+        KConditionBroadcast( self->cond );
+    }
+    KLockUnlock( self->lock );
+    return 0;
+}
+
+
+/* called with lock held, waits for next unit in order and writes it out */
+static rc_t DumpParallelWriteNext( DumpParallel *const self )
+{
+    DumpUnit *const u = &self->unit[ self->written % self->unit_qty ];
+    rc_t rc;
+    
+    while ( !u->done )
+        KConditionWait( self->cond, self->lock );
+    KLockUnlock( self->lock );
+    
+    rc = u->rc;
+    if ( rc == 0 && u->out.len > 0 )
+        rc = OutWrite( NULL, u->out.base, u->out.len );
+    if ( u->which == primary_IDS )
+        self->pri_rows += u->rows;
+    else
+        self->sec_rows += u->rows;
+    u->out.len = 0;
+    u->done = false;
+    
+    KLockAcquire( self->lock );
+    ++self->written;
+    if ( rc != 0 )
+    {
+        self->failed = true;
+        KConditionBroadcast( self->cond );
+    }
+    return rc;
+}
+
+
+static rc_t DumpParallelQueue( DumpParallel *const self )
+{
+    rc_t rc = 0;
+    
+    if ( self->filling != NULL )
+    {
+        self->filling = NULL;
+        rc = KLockAcquire( self->lock );
+        if ( rc == 0 )
+        {
+            ++self->queued;
+            KConditionBroadcast( self->cond );
+            KLockUnlock( self->lock );
+        }
+    }
+    return rc;
+}
+
+
+/* writes finished units until a free one is available for filling */
+static rc_t DumpParallelReserve( DumpParallel *const self, int const which )
+{
+    rc_t rc = KLockAcquire( self->lock );
+    
+    if ( rc == 0 )
+    {
+        while ( rc == 0 && self->queued >= self->written + self->unit_qty )
+            rc = DumpParallelWriteNext( self );
+        KLockUnlock( self->lock );
+    }
+    if ( rc == 0 )
+    {
+        DumpUnit *const u = &self->unit[ self->queued % self->unit_qty ];
+        
+        u->which = which;
+        u->ids_qty = 0;
+        u->first = 0;
+        u->count = 0;
+        u->rc = 0;
+        self->filling = u;
+    }
+    return rc;
+}
+
+
+static rc_t DumpParallelAddIds( DumpParallel *const self, int const which, SCol const *const ids )
+{
+    rc_t rc = 0;
+    DumpUnit *u;
+    
+    if ( self->filling != NULL && self->filling->which != which )
+        rc = DumpParallelQueue( self );
+    if ( rc == 0 && self->filling == NULL )
+        rc = DumpParallelReserve( self, which );
+    if ( rc != 0 )
+        return rc;
+    
+    u = self->filling;
+    if ( u->ids_qty + ids->len > u->ids_max )
+    {
+        uint32_t max = u->ids_max ? u->ids_max : DUMP_UNIT_ROWS;
+        int64_t *tmp;
+        
+        while ( max < u->ids_qty + ids->len )
+            max += max;
+        tmp = realloc( u->ids, max * sizeof( u->ids[ 0 ] ) );
+        if ( tmp == NULL )
+            return RC( rcExe, rcBuffer, rcResizing, rcMemory, rcExhausted );
+        u->ids = tmp;
+        u->ids_max = max;
+    }
+    memcpy( u->ids + u->ids_qty, ids->base.i64, ids->len * sizeof( u->ids[ 0 ] ) );
+    u->ids_qty += ids->len;
+    if ( u->ids_qty >= DUMP_UNIT_ROWS )
+        rc = DumpParallelQueue( self );
+    return rc;
+}
+
+
+/* adds the records of units written since the last call to the caller's record count,
+   units are written by the thread that queues them, so no lock is needed */
+static void DumpParallelCount( DumpParallel *const self, int64_t *const rcount )
+{
+    int64_t const rows = self->pri_rows + self->sec_rows;
+    
+    *rcount += rows - self->counted;
+    self->counted = rows;
+}
+
+
+static rc_t DumpParallelAddRange( DumpParallel *const self, int const which,
+                                  int64_t first, uint64_t count )
+{
+    rc_t rc = DumpParallelQueue( self );
+    
+    while ( rc == 0 && count > 0 )
+    {
+        uint64_t const n = count < DUMP_UNIT_ROWS ? count : DUMP_UNIT_ROWS;
+        
+        rc = DumpParallelReserve( self, which );
+        if ( rc == 0 )
+        {
+            self->filling->first = first;
+            self->filling->count = n;
+            rc = DumpParallelQueue( self );
+        }
+        first += n;
+        count -= n;
+    }
+    return rc;
+}
+
+
+static rc_t DumpWorkerOpen( DumpWorker *const w, SAM_dump_ctx_t const *const ctx )
+{
+    rc_t rc = 0;
+    
+    w->ctx = *ctx;
+    w->ctx.out = NULL;
+    w->ctx.parallel = NULL;
+    w->ctx.bam = NULL;
+    DATASOURCE_INIT( w->ctx.ref, NULL );
+    DATASOURCE_INIT( w->ctx.evi, NULL );
+    DATASOURCE_INIT( w->ctx.eva, NULL );
+    DATASOURCE_INIT( w->ctx.pri, ctx->pri.tbl.name );
+    DATASOURCE_INIT( w->ctx.sec, ctx->sec.tbl.name );
+    DATASOURCE_INIT( w->ctx.seq, ctx->seq.tbl.name );
+    
+    /* own tables and cursors, they are not shared between threads */
+    w->ctx.pri.cols = &w->align_cols[ 0 ];
+    w->ctx.sec.cols = &w->align_cols[ ALG_COL_QTY ];
+    memcpy( w->ctx.pri.cols, ctx->pri.cols, ALG_COL_QTY * sizeof( SCol ) );
+    memcpy( w->ctx.sec.cols, ctx->sec.cols, ALG_COL_QTY * sizeof( SCol ) );
+    w->ctx.pri.type = ctx->pri.type;
+    w->ctx.sec.type = ctx->sec.type;
+    if ( ctx->pri.curs.vcurs != NULL )
+        rc = VDatabaseOpenTableRead( ctx->db, &w->ctx.pri.tbl.vtbl, "%s", w->ctx.pri.tbl.name );
+    if ( rc == 0 && ctx->sec.curs.vcurs != NULL )
+        rc = VDatabaseOpenTableRead( ctx->db, &w->ctx.sec.tbl.vtbl, "%s", w->ctx.sec.tbl.name );
+    if ( rc == 0 && ctx->seq.cols != NULL && ctx->seq.tbl.vtbl != NULL )
+    {
+        w->ctx.seq.cols = w->seq_cols;
+        memcpy( w->seq_cols, gSeqCol, sizeof( gSeqCol ) );
+        rc = VDatabaseOpenTableRead( ctx->db, &w->ctx.seq.tbl.vtbl, "%s", w->ctx.seq.tbl.name );
+        if ( rc == 0 )
+            rc = Cursor_Open( &w->ctx.seq.tbl, &w->ctx.seq.curs, w->ctx.seq.cols, NULL );
+    }
+    if ( rc == 0 )
+        rc = Cursor_Open( &w->ctx.pri.tbl, &w->ctx.pri.curs, w->ctx.pri.cols, NULL );
+    if ( rc == 0 )
+        rc = Cursor_Open( &w->ctx.sec.tbl, &w->ctx.sec.curs, w->ctx.sec.cols, NULL );
+    return rc;
+}
+
+
+static void DumpWorkerClose( DumpWorker *const w )
+{
+    Cursor_Close( &w->ctx.pri.curs );
+    Cursor_Close( &w->ctx.sec.curs );
+    Cursor_Close( &w->ctx.seq.curs );
+    VTableRelease( w->ctx.pri.tbl.vtbl );
+    VTableRelease( w->ctx.sec.tbl.vtbl );
+    VTableRelease( w->ctx.seq.tbl.vtbl );
+    BAMOutRelease( &w->ctx );
+}
+
+
+/* waits for all queued units to be written out, unless cancel is set, and releases self */
+static rc_t DumpParallelFinish( DumpParallel *const self, bool const cancel,
+                                int64_t *const pri_rows, int64_t *const sec_rows )
+{
+    rc_t rc = cancel ? 0 : DumpParallelQueue( self );
+    uint32_t i;
+    
+    if ( KLockAcquire( self->lock ) == 0 )
+    {
+        self->closing = true;
+        if ( rc != 0 || cancel )
+            self->failed = true;
+        KConditionBroadcast( self->cond );
+        while ( rc == 0 && !self->failed && self->written < self->queued )
+            rc = DumpParallelWriteNext( self );
+        KLockUnlock( self->lock );
+    }
+    for ( i = 0; i < self->worker_qty; ++i )
+    {
+        DumpWorker *const w = &self->worker[ i ];
+        
+        if ( w->thread != NULL )
+        {
+            rc_t status = 0;
+            rc_t const rc2 = KThreadWait( w->thread, &status );
+            
+            if ( rc == 0 )
+                rc = rc2 ? rc2 : status;
+            KThreadRelease( w->thread );
+        }
+        DumpWorkerClose( w );
+    }
+    if ( pri_rows != NULL )
+        *pri_rows = self->pri_rows;
+    if ( sec_rows != NULL )
+        *sec_rows = self->sec_rows;
+    for ( i = 0; i < self->unit_qty; ++i )
+    {
+        free( self->unit[ i ].ids );
+        free( self->unit[ i ].out.base );
+    }
+    KConditionRelease( self->cond );
+    KLockRelease( self->lock );
+    free( self->unit );
+    free( self->worker );
+    free( self );
+    return rc;
+}
+
+
+static rc_t DumpParallelMake( DumpParallel **const pself, SAM_dump_ctx_t const *const ctx, uint32_t const threads )
+{
+    rc_t rc = 0;
+    uint32_t i;
+    DumpParallel *const self = calloc( 1, sizeof( *self ) );
+    
+    if ( self == NULL )
+        return RC( rcExe, rcData, rcAllocating, rcMemory, rcExhausted );
+    self->worker_qty = threads;
+    self->unit_qty = threads * 2;
+    self->worker = calloc( self->worker_qty, sizeof( self->worker[ 0 ] ) );
+    self->unit = calloc( self->unit_qty, sizeof( self->unit[ 0 ] ) );
+    if ( self->worker == NULL || self->unit == NULL )
+        rc = RC( rcExe, rcData, rcAllocating, rcMemory, rcExhausted );
+    if ( rc == 0 )
+        rc = KLockMake( &self->lock );
+    if ( rc == 0 )
+        rc = KConditionMake( &self->cond );
+    /* open all cursors before any thread starts */
+    for ( i = 0; rc == 0 && i < self->worker_qty; ++i )
+    {
+        self->worker[ i ].parallel = self;
+        rc = DumpWorkerOpen( &self->worker[ i ], ctx );
+    }
+    for ( i = 0; rc == 0 && i < self->worker_qty; ++i )
+        rc = KThreadMake( &self->worker[ i ].thread, DumpWorkerThread, &self->worker[ i ] );
+    if ( rc != 0 )
+    {
+        (void)PLOGERR( klogErr, ( klogErr, rc, "failed to start $(n) threads", "n=%u", threads ) );
+        if ( self->worker == NULL || self->unit == NULL )
+        {
+            free( self->unit );
+            free( self->worker );
+            free( self );
+        }
+        else
+        {
+            DumpParallelFinish( self, true, NULL, NULL );
+        }
+        return rc;
+    }
+    *pself = self;
+    return 0;
+}
+
+
+static bool DumpParallelUsable( void )
+{
+    return param->threads > 1
+        && !param->cg_evidence && !param->cg_ev_dnb && !param->cg_sam
+        && param->cg_style == 0
+        && param->test_rows == 0
+        /* unaligned mates of region output are found through the primary cursor cache */
+        && !( param->region_qty > 0 && param->unaligned );
+}
+
+
 static rc_t DumpAlignedRowList_cb( SAM_dump_ctx_t *const ctx, TAlignedRegion const *const rgn,
                                    int options, int which, int64_t *rcount, SCol const *const IDS )
 {
     /*SAM_DUMP_DBG(2, ("row %s index range is [%lu:%lu] pos %lu\n",
         param->region[r].name, start, start + count - 1, cur_pos));*/
+    if ( ctx->parallel != NULL && ( which == primary_IDS || which == secondary_IDS ) )
+    {
+        rc_t const rc = DumpParallelAddIds( ctx->parallel, which, IDS );
+        
+        DumpParallelCount( ctx->parallel, rcount );
+        return rc;
+    }
+
     switch ( which )
     {
     case primary_IDS:
@@ -3193,6 +4064,45 @@ static rc_t DumpAlignedTable( SAM_dump_ctx_t *const ctx, DataSource *const ds,
 }
 
 
+static rc_t DumpUnsortedParallel( SAM_dump_ctx_t *const ctx )
+{
+    DumpParallel *parallel;
+    int64_t start;
+    uint64_t count;
+    rc_t rc = DumpParallelMake( &parallel, ctx, param->threads );
+    
+    if ( rc != 0 )
+        return rc;
+    if ( ctx->pri.curs.vcurs )
+    {
+        SAM_DUMP_DBG( 2, ( "%s PRIMARY_ALIGNMENT\n", ctx->accession ) );
+        rc = VCursorIdRange( ctx->pri.curs.vcurs, 0, &start, &count );
+        if ( rc == 0 )
+            rc = DumpParallelAddRange( parallel, primary_IDS, start, count );
+    }
+    if ( rc == 0 && ctx->sec.curs.vcurs )
+    {
+        SAM_DUMP_DBG( 2, ( "%s SECONDARY_ALIGNMENT\n", ctx->accession ) );
+        rc = VCursorIdRange( ctx->sec.curs.vcurs, 0, &start, &count );
+        if ( rc == 0 )
+            rc = DumpParallelAddRange( parallel, secondary_IDS, start, count );
+    }
+    {
+        int64_t pri_rows = 0;
+        int64_t sec_rows = 0;
+        rc_t const rc2 = DumpParallelFinish( parallel, rc != 0, &pri_rows, &sec_rows );
+        
+        if ( rc == 0 )
+            rc = rc2;
+        if ( rc == 0 && ctx->pri.curs.vcurs )
+            (void)PLOGMSG( klogInfo, ( klogInfo, "$(a): $(c) primary sequences", "a=%s,c=%lu", ctx->accession, pri_rows ) );
+        if ( rc == 0 && ctx->sec.curs.vcurs )
+            (void)PLOGMSG( klogInfo, ( klogInfo, "$(a): $(c) secondary sequences", "a=%s,c=%lu", ctx->accession, sec_rows ) );
+    }
+    return rc;
+}
+
+
 static rc_t DumpUnsorted( SAM_dump_ctx_t *const ctx )
 {
     rc_t rc = 0;
@@ -3212,6 +4122,8 @@ static rc_t DumpUnsorted( SAM_dump_ctx_t *const ctx )
         rc = DumpAlignedTable( ctx, &ctx->eva, false, param->cg_style, &rcount );
         (void)PLOGMSG( klogInfo, ( klogInfo, "$(a): $(c) support sequences", "a=%s,c=%lu", ctx->accession, rcount ) );
     }
+    if ( rc == 0 && DumpParallelUsable() && ( ctx->pri.curs.vcurs || ctx->sec.curs.vcurs ) )
+        return DumpUnsortedParallel( ctx );
     if ( rc == 0 && ctx->pri.curs.vcurs )
     {
         SAM_DUMP_DBG( 2, ( "%s PRIMARY_ALIGNMENT\n", ctx->accession ) );
@@ -3452,15 +4364,28 @@ static rc_t DumpDB( SAM_dump_ctx_t *const ctx )
         rc = ReferenceList_MakeTable( &gRefList, ctx->ref.tbl.vtbl, 0, CURSOR_CACHE, NULL, 0 );
     if ( !param->noheader )
         rc = DumpHeader( ctx );
+    if ( rc == 0 )
+        rc = BufferedWriterEndHeader();
     if ( rc == 0 )
     {
         if ( param->region_qty ){
-            rc = ForEachAlignedRegion(  ctx
-                                      ,   ( param->primaries   ? primary_IDS : 0 )
-                                        | ( param->secondaries ? secondary_IDS : 0 )
-                                        | ( param->cg_evidence ? evidence_interval_IDS : 0 )
-                                        | ( param->cg_ev_dnb   ? evidence_alignment_IDS : 0 )
-                                      , DumpAlignedRowList_cb );
+            if ( DumpParallelUsable() )
+                rc = DumpParallelMake( &ctx->parallel, ctx, param->threads );
+            if ( rc == 0 )
+                rc = ForEachAlignedRegion(  ctx
+                                          ,   ( param->primaries   ? primary_IDS : 0 )
+                                            | ( param->secondaries ? secondary_IDS : 0 )
+                                            | ( param->cg_evidence ? evidence_interval_IDS : 0 )
+                                            | ( param->cg_ev_dnb   ? evidence_alignment_IDS : 0 )
+                                          , DumpAlignedRowList_cb );
+            if ( ctx->parallel != NULL )
+            {
+                rc_t const rc2 = DumpParallelFinish( ctx->parallel, rc != 0, NULL, NULL );
+                
+                ctx->parallel = NULL;
+                if ( rc == 0 )
+                    rc = rc2;
+            }
 #if USE_MATE_CACHE
 	    if ( rc == 0 && param->unaligned ){
                 rc = FlushUnaligned( ctx,ctx->pri.curs.cache);
@@ -3477,6 +4402,7 @@ static rc_t DumpDB( SAM_dump_ctx_t *const ctx )
                 rc = DumpUnaligned( ctx, ctx->pri.tbl.vtbl != NULL );
         }
     }
+    BAMOutRelease( ctx );
     ReferenceList_Release( gRefList );
     return rc;
 }
@@ -3488,8 +4414,11 @@ static rc_t DumpTable( SAM_dump_ctx_t *ctx )
 
     if ( !param->noheader )
         rc = DumpHeader( ctx );
+    if ( rc == 0 )
+        rc = BufferedWriterEndHeader();
     if ( rc == 0 )
         rc = DumpUnaligned( ctx, false );
+    BAMOutRelease( ctx );
     return rc;
 }
 
@@ -4104,6 +5033,10 @@ char const *XI_usage[] = {"Output cSRA alignment id in XI column", NULL};
 char const *qual_quant_usage[] = {"Quality scores quantization level",
                                   "a string like '1:10,10:20,20:30,30:-'", NULL};
 char const *CG_names[] = { "Generate CG friendly read names", NULL};
+char const *threads_legacy_usage[] = { "Number of threads formatting aligned records and compressing output, default 1", NULL};
+char const *bam_usage[] = { "Produce BAM formatted output, compressed on --threads threads", NULL};
+char const *bam_index_usage[] = { "Write index of coordinate sorted BAM output to file,",
+                                  "CSI if the name ends in '.csi', BAI otherwise", NULL};
 
 char const *usage_params[] =
 {
@@ -4131,12 +5064,14 @@ char const *usage_params[] =
     NULL,                       /* cigarCGMerge */
     NULL,                       /* XI */
     "quantization string",      /* qual-quant */
-    NULL,                       /* cigarCGMerge */
     NULL,                       /* CG-evidence */
     NULL,                       /* CG-ev-dnb */
     NULL,                       /* CG-mappings */
     NULL,                       /* CG-SAM */
-    NULL                        /* CG-names */
+    NULL,                       /* CG-names */
+    "count",                    /* threads */
+    NULL,                       /* bam */
+    "path"                      /* bam-index */
 };
 
 enum eArgs
@@ -4169,7 +5104,10 @@ enum eArgs
     earg_CG_ev_dnb,             /* CG-ev-dnb */
     earg_CG_mappings,           /* CG-mappings */
     earg_CG_SAM,                /* CG-SAM */
-    earg_CG_names               /* CG-names */
+    earg_CG_names,              /* CG-names */
+    earg_threads,               /* threads */
+    earg_bam,                   /* bam */
+    earg_bam_index              /* bam-index */
 };
 
 OptDef DumpArgs[] =
@@ -4203,6 +5141,9 @@ OptDef DumpArgs[] =
     { "CG-mappings", NULL, NULL, CG_mappings, 0, false, false },            /* CG-mappings */
     { "CG-SAM", NULL, NULL, CG_SAM, 0, false, false },                      /* CG-SAM */
     { "CG-names", NULL, NULL, CG_names, 0, false, false },                  /* CG-names */
+    { "threads", NULL, NULL, threads_legacy_usage, 0, true, false },        /* threads */
+    { "bam", NULL, NULL, bam_usage, 0, false, false },                      /* bam */
+    { "bam-index", NULL, NULL, bam_index_usage, 0, true, false },           /* bam-index */
     { "legacy", NULL, NULL, NULL, 0, false, false }
 };
 
@@ -4334,8 +5275,11 @@ static rc_t CountArgs( Args const *const args, unsigned count[],
     /* output encoding options */
     COUNT_ARG( earg_gzip );
     COUNT_ARG( earg_bzip2 );
+    COUNT_ARG( earg_bam );
+    COUNT_ARG( earg_bam_index );
     
     COUNT_ARG( earg_mate_row_gap_cachable );
+    COUNT_ARG( earg_threads );
     
     /* debug options */
     COUNT_ARG( earg_XI );
@@ -4728,7 +5672,28 @@ static rc_t GetArgs( Args const *const args, unsigned const count[],
     parms.reverse_unaligned = ( count[ earg_reverse ] != 0 );
     parms.cg_friendly_names = count[ earg_CG_names ] != 0;
     parms.spot_group_in_name = ( count[ earg_qname ] != 0 || multipass );
-    parms.noheader = ( ( count[ earg_noheader ] != 0 ) || parms.fasta || parms.fastq || multipass );
+    parms.output_gzip = ( count[ earg_gzip ] != 0 );
+    parms.output_bz2 = ( count[ earg_bzip2 ] != 0 );
+    parms.output_bam = ( count[ earg_bam ] != 0 || count[ earg_bam_index ] != 0 );
+    if ( parms.output_bam )
+    {
+        if ( parms.fasta || parms.fastq || parms.output_gzip || parms.output_bz2 || multipass )
+        {
+            *errmsg = "bam can not be combined with fasta, fastq, gzip, bzip2 or several inputs";
+            return RC( rcExe, rcArgv, rcProcessing, rcParam, rcInconsistent );
+        }
+        if ( count[ earg_bam_index ] != 0 )
+        {
+            rc = ArgsOptionValue( args, DumpArgs[ earg_bam_index ].name, 0, &parms.bam_index );
+            if ( rc != 0 )
+            {
+                *errmsg = DumpArgs[ earg_bam_index ].name;
+                return rc;
+            }
+        }
+    }
+    /* BAM records need the references from the header */
+    parms.noheader = ( ( count[ earg_noheader ] != 0 && !parms.output_bam ) || parms.fasta || parms.fastq || multipass );
     parms.reheader = ( ( count[ earg_header ] != 0 ) && !parms.noheader );
     parms.xi = ( count[ earg_XI ] != 0 );
     if ( ( count[ earg_cigarCG ] == 0 ) && ( count[ earg_cigarCG_merge ] == 0 ) )
@@ -4765,6 +5730,11 @@ static rc_t GetArgs( Args const *const args, unsigned const count[],
     
     parms.test_rows = GetOptValU( args, DumpArgs[ earg_test_rows ].name, 0, NULL );
     parms.mate_row_gap_cachable = GetOptValU( args, DumpArgs[ earg_mate_row_gap_cachable ].name, 1000000, NULL );
+    parms.threads = GetOptValU( args, DumpArgs[ earg_threads ].name, 1, NULL );
+    if ( parms.threads < 1 )
+        parms.threads = 1;
+    else if ( parms.threads > DUMP_MAX_THREADS )
+        parms.threads = DUMP_MAX_THREADS;
     
     param = &parms;
     return 0;
@@ -4819,7 +5789,8 @@ rc_t CC SAM_Dump_Main( int argc, char* argv[] )
             rc = VDBManagerMakeRead( &mgr, NULL );
             if ( rc == 0 )
             {
-                rc = BufferedWriterMake( param->output_gzip, param->output_bz2 );
+                rc = BufferedWriterMake( param->output_gzip, param->output_bz2,
+                                         param->output_bam, param->bam_index, param->threads );
                 if ( rc == 0 )
                 {
                     unsigned i;
@@ -4844,7 +5815,11 @@ rc_t CC SAM_Dump_Main( int argc, char* argv[] )
 #endif
                         if ( rc != 0 ) break;
                     }
-                    BufferedWriterRelease( rc == 0 );
+                    {
+                        rc_t const rc2 = BufferedWriterRelease( rc == 0 );
+                        if ( rc == 0 )
+                            rc = rc2;
+                    }
                 }
                 VDBManagerRelease( mgr );
             }
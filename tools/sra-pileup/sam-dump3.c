@@ -166,6 +166,19 @@ char const *rna_splice_log_usage[]    = { "file, into which rna-splice events ar
 char const *no_mt_usage[]             = { "disable multithreading", NULL };
 
 char const *with_md_flag_usage[]      = { "print MD-flag", NULL };
+
+char const *threads_usage[]           = { "number of threads formatting aligned records, default 1",
+                                          "and compressing gzip/bzip2/BAM output",
+                                          "records are written in the same order as with one thread",
+                                       NULL };
+
+char const *bam_usage[]               = { "produce BAM formatted output,",
+                                          "BGZF blocks are compressed on --threads threads",
+                                       NULL };
+
+char const *bam_index_usage[]         = { "write index of coordinate sorted BAM output to file,",
+                                          "CSI if the name ends in '.csi', BAI otherwise",
+                                       NULL };
                                       
 OptDef SamDumpArgs[] =
 {
@@ -210,6 +223,9 @@ OptDef SamDumpArgs[] =
     { OPT_RNA_SPLICE_LOG,  NULL, NULL, rna_splice_log_usage, 0, true,  false },  /* filename to log rna-splice events into */
     { OPT_NO_MT,        NULL, NULL, no_mt_usage,              0, false, false },   /* force new code-path */    
     { OPT_MD_FLAG,		NULL, NULL, with_md_flag_usage,       0, false, false },    /* print the MD-flag */	
+    { OPT_THREADS,      NULL, NULL, threads_usage,           0, true,  false },  /* threads formatting records */
+    { OPT_BAM,          NULL, NULL, bam_usage,               0, false, false },  /* BAM output */
+    { OPT_BAM_INDEX,    NULL, NULL, bam_index_usage,         0, true,  false },  /* index of BAM output */
     { OPT_DUMP_MODE,    NULL, NULL, NULL,                    0, true,  false },  /* how to produce aligned reads if no regions given */
     { OPT_CIGAR_TEST,   NULL, NULL, NULL,                    0, true,  false },  /* test cg-treatment of cigar string */
     { OPT_LEGACY,       NULL, NULL, NULL,                    0, false, false },  /* force legacy code-path */
@@ -260,6 +276,9 @@ char const *sd_usage_params[] =
     NULL,                       /* file to log rna-splice-events into */
     NULL,                       /* no-mt */
     NULL,                       /* with-md-flag */	
+    "count",                    /* threads */
+    NULL,                       /* bam */
+    "path",                     /* bam-index */
     NULL,                       /* dump_mode */
     NULL,                       /* cigar test */
     NULL,                       /* force legacy code path */
@@ -480,7 +499,8 @@ static rc_t samdump_main( Args * args, const samdump_opts * const opts )
         case oc_bzip2 : mode = orm_bzip2; break;
     }
 
-    rc = init_out_redir( &redir, mode, opts->outputfile, opts->output_buffer_size ); /* from out_redir.c */
+    rc = init_out_redir( &redir, mode, opts->outputfile, opts->output_buffer_size,
+                         opts->no_mt ? 1 : opts->threads ); /* from out_redir.c */
     if ( rc == 0 )
     {
         if ( opts->report_options )
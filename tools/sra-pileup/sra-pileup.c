@@ -41,6 +41,8 @@
 #include "pileup_varcount.h"
 #include "pileup_stat.h"
 #include "pileup_v2.h"
+#include "pileup_line.h"
+#include "compressed_file.h"
 
 #include <kapp/main.h>
 
@@ -51,8 +53,10 @@
 
 #include <kfs/file.h>
 #include <kfs/buffile.h>
-#include <kfs/bzip.h>
-#include <kfs/gzip.h>
+
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 
 #include <insdc/sra.h>
 
@@ -99,6 +103,8 @@
 #define OPTION_MIN_M   "minmismatch"
 #define OPTION_MERGE   "merge-dist"
 
+#define OPTION_THREADS "threads"
+
 #define OPTION_FUNC    "function"
 #define ALIAS_FUNC     NULL
 
@@ -150,6 +156,8 @@ static const char * merge_usage[]           = { "If adjacent slices are closer t
                                                 "they are merged and a skiplist is created. ", 
                                                 "a value of zero disables the feature, default is 10000", NULL };
 
+static const char * threads_usage[]         = { "number of threads walking the references and compressing gzip/bzip2 output, default is 1 ( debug and --skiplist walk with one thread )", NULL };
+
 static const char * no_qual_usage[]         = { "omit qualities", NULL };
 
 static const char * func_ref_usage[]        = { "list references", NULL };
@@ -181,6 +189,7 @@ OptDef MyOptions[] =
     { OPTION_SEQNAME, ALIAS_SEQNAME, NULL, seqname_usage, 1,        false,       false },
     { OPTION_MIN_M,   NULL,          NULL, min_m_usage,   1,        true,        false },
     { OPTION_MERGE,   NULL,          NULL, merge_usage,   1,        true,        false },
+    { OPTION_THREADS, NULL,          NULL, threads_usage, 1,        true,        false },
     { OPTION_FUNC,    ALIAS_FUNC,    NULL, func_usage,    1,        true,        false }
 };
 
@@ -276,6 +285,9 @@ static rc_t get_pileup_options( Args * args, pileup_options *opts )
 
     if ( rc == 0 )
         rc = get_uint32_option( args, OPTION_MERGE, &opts->merge_dist, 10000 );
+
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPTION_THREADS, &opts->threads, 1 );
         
     if ( rc == 0 )
         rc = get_bool_option( args, OPTION_DUPS, &opts->process_dups, false );
@@ -369,6 +381,7 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine ( ALIAS_SEQNAME, OPTION_SEQNAME, NULL, seqname_usage );
     HelpOptionLine ( NULL, OPTION_MIN_M, NULL, min_m_usage );
     HelpOptionLine ( NULL, OPTION_MERGE, NULL, merge_usage );
+    HelpOptionLine ( NULL, OPTION_THREADS, "count", threads_usage );
     HelpOptionLine ( ALIAS_NOQUAL, OPTION_NOQUAL, NULL, no_qual_usage );
 
     HelpOptionLine ( NULL, "function ref",      NULL, func_ref_usage );
@@ -424,7 +437,7 @@ static rc_t CC BufferedWriter ( void* self, const char* buffer, size_t bufsize,
 }
 
 
-static rc_t set_stdout_to( bool gzip, bool bzip2, const char * filename, size_t bufsize )
+static rc_t set_stdout_to( bool gzip, bool bzip2, const char * filename, size_t bufsize, uint32_t threads )
 {
     rc_t rc = 0;
     if ( gzip && bzip2 )
@@ -446,28 +459,19 @@ static rc_t set_stdout_to( bool gzip, bool bzip2, const char * filename, size_t
             if ( rc == 0 )
             {
                 KFile *buf;
-                if ( gzip )
-                {
-                    KFile *gz;
-                    rc = KFileMakeGzipForWrite( &gz, of );
-                    if ( rc == 0 )
-                    {
-                        KFileRelease( of );
-                        of = gz;
-                    }
-                }
-                if ( bzip2 )
+                if ( gzip || bzip2 )
                 {
-                    KFile *bz;
-                    rc = KFileMakeBzip2ForWrite( &bz, of );
+                    KFile *z;
+                    rc = make_compressed_file( &z, of, bzip2, threads ); /* compressed_file.h */
                     if ( rc == 0 )
                     {
                         KFileRelease( of );
-                        of = bz;
+                        of = z;
                     }
                 }
 
-                rc = KBufFileMakeWrite( &buf, of, false, bufsize );
+                if ( rc == 0 )
+                    rc = KBufFileMakeWrite( &buf, of, false, bufsize );
                 if ( rc == 0 )
                 {
                     g_out_writer.kfile = buf;
@@ -621,140 +625,10 @@ static rc_t CC alloc_size( struct VCursor const *curs, int64_t row_id, size_t *
 }
 
 
-static rc_t walk_ref_position( ReferenceIterator *ref_iter,
-                               const PlacementRecord *rec,
-                               struct dyn_string *line,
-                               char * qual,
-                               pileup_options *options )
-{
-    rc_t rc = 0;
-    INSDC_coord_zero seq_pos;
-    int32_t state = ReferenceIteratorState ( ref_iter, &seq_pos );
-    tool_rec *xrec = ( tool_rec * ) PlacementRecordCast ( rec, placementRecordExtension1 );
-    bool reverse = xrec->reverse;
-
-    if ( !options->omit_qualities )
-    {
-        if ( seq_pos < xrec->quality_len )
-            *qual = xrec->quality[ seq_pos ];
-        else
-            *qual = 2;
-    }
-
-    if ( ( state & align_iter_invalid ) == align_iter_invalid )
-    {
-        return add_char_2_dyn_string( line, '?' );
-    }
-
-    if ( ( state & align_iter_first ) == align_iter_first )
-    {
-        char s[ 3 ];
-        int32_t c = rec->mapq + 33;
-        if ( c > '~' ) { c = '~'; }
-        if ( c < 33 ) { c = 33; }
-        s[ 0 ] = '^';
-        s[ 1 ] = c;
-        s[ 2 ] = 0;
-        rc = add_string_2_dyn_string( line, s );
-    }
-
-    if ( rc == 0 )
-    {
-        if ( ( state & align_iter_skip ) == align_iter_skip )
-        {
-            if ( reverse )
-                rc = add_char_2_dyn_string( line, '<' );
-            else
-                rc = add_char_2_dyn_string( line, '>' );
-            if ( !options->omit_qualities )
-                *qual = xrec->quality[ seq_pos + 1 ];
-        }
-        else
-        {
-            if ( ( state & align_iter_match ) == align_iter_match )
-                rc = add_char_2_dyn_string( line, ( reverse ? ',' : '.' ) );
-            else
-                rc = add_char_2_dyn_string( line, _4na_to_ascii( state, reverse ) );
-        }
-    }
-
-    if ( ( state & align_iter_insert ) == align_iter_insert )
-    {
-        const INSDC_4na_bin *bases;
-        uint32_t i;
-        uint32_t n = ReferenceIteratorBasesInserted ( ref_iter, &bases );
-        
-        rc = print_2_dyn_string( line, "+%u", n );
-        for ( i = 0; i < n && rc == 0; ++i )
-        {
-            rc = add_char_2_dyn_string( line, _4na_to_ascii( bases[ i ], reverse ) );
-        }
-    }
-
-    if ( ( state & align_iter_delete ) == align_iter_delete )
-    {
-        const INSDC_4na_bin *bases;
-        INSDC_coord_zero ref_pos;
-        uint32_t n = ReferenceIteratorBasesDeleted ( ref_iter, &ref_pos, &bases );
-        if ( bases != NULL )
-        {
-            uint32_t i;
-            rc = print_2_dyn_string( line, "-%u", n );
-            for ( i = 0; i < n && rc == 0; ++i )
-            {
-                rc = add_char_2_dyn_string( line, _4na_to_ascii( bases[ i ], reverse ) );
-            }
-            free( (void *) bases );
-        }
-    }
-
-    if ( ( ( state & align_iter_last ) == align_iter_last )&& ( rc == 0 ) )
-        rc = add_char_2_dyn_string( line, '$' );
-
-    if ( options->show_id )
-        rc = print_2_dyn_string( line, "(%,lu:%,d-%,d/%u)",
-                                 rec->id, rec->pos + 1, rec->pos + rec->len, seq_pos );
-
-    return rc;
-}
-
-
-static rc_t walk_alignments( ReferenceIterator *ref_iter,
-                             struct dyn_string *line,
-                             struct dyn_string *qualities,
-                             pileup_options *options )
-{
-    uint32_t depth = 0;
-    rc_t rc;
-    do
-    {
-        const PlacementRecord *rec;
-        rc = ReferenceIteratorNextPlacement ( ref_iter, &rec );
-        if ( rc == 0 )
-            rc = walk_ref_position( ref_iter, rec, line, dyn_string_char( qualities, depth++ ), options );
-        if ( rc == 0 )
-            rc = Quitting();
-    } while ( rc == 0 );
-
-    if ( !options->omit_qualities )
-    {
-        uint32_t i;
-        add_char_2_dyn_string( line, '\t' );
-        for ( i = 0; i < depth; ++i )
-        {
-            char * c = dyn_string_char( qualities, i );
-            add_char_2_dyn_string( line, *c + 33 );
-        }
-    }
-
-    if ( GetRCState( rc ) == rcDone ) { rc = 0; }
-    return rc;
-}
-
-
 static rc_t walk_spot_groups( ReferenceIterator *ref_iter,
                               struct dyn_string *line,
                               struct dyn_string *qualities,
+                              deletion_cache * dels,
                               pileup_options *options )
 {
     rc_t rc;
@@ -764,7 +638,7 @@ static rc_t walk_spot_groups( ReferenceIterator *ref_iter,
         if ( rc == 0 )
             add_char_2_dyn_string( line, '\t' );
         if ( rc == 0 )
-            rc = walk_alignments( ref_iter, line, qualities, options );
+            rc = walk_placements( ref_iter, line, qualities, dels, options );
     } while ( rc == 0 );
 
     if ( GetRCState( rc ) == rcDone ) { rc = 0; }
@@ -776,7 +650,9 @@ static rc_t walk_position( ReferenceIterator *ref_iter,
                            const char * refname,
                            struct dyn_string *line,
                            struct dyn_string *qualities,
-                           pileup_options *options )
+                           deletion_cache * dels,
+                           pileup_options *options,
+                           struct dyn_string *out )
 {
     INSDC_coord_zero pos;
     uint32_t depth;
@@ -808,11 +684,11 @@ static rc_t walk_position( ReferenceIterator *ref_iter,
                     if ( rc == 0 )
                     {
                         if ( depth > 0 )
-                            rc = walk_spot_groups( ref_iter, line, qualities, options );
+                            rc = walk_spot_groups( ref_iter, line, qualities, dels, options );
 
                         /* only one KOutMsg() per line... */
                         if ( rc == 0 )
-                            rc = KOutMsg( "%s\n", dyn_string_char( line, 0 ) );
+                            rc = print_2_out( out, "%s\n", dyn_string_char( line, 0 ) );
 
                         if ( GetRCState( rc ) == rcDone )
                             rc = 0;
@@ -829,7 +705,9 @@ static rc_t walk_reference_window( ReferenceIterator *ref_iter,
                                    const char * refname,
                                    struct dyn_string *line,
                                    struct dyn_string *qualities,
-                                   pileup_options *options )
+                                   deletion_cache * dels,
+                                   pileup_options *options,
+                                   struct dyn_string *out )
 {
     rc_t rc = 0;
     while ( rc == 0 )
@@ -844,7 +722,7 @@ static rc_t walk_reference_window( ReferenceIterator *ref_iter,
         }
         else
         {
-            rc = walk_position( ref_iter, refname, line, qualities, options );
+            rc = walk_position( ref_iter, refname, line, qualities, dels, options, out );
         }
         if ( rc == 0 )
         {
@@ -858,7 +736,8 @@ static rc_t walk_reference_window( ReferenceIterator *ref_iter,
 
 static rc_t walk_reference( ReferenceIterator *ref_iter,
                             const char * refname,
-                            pileup_options *options )
+                            pileup_options *options,
+                            struct dyn_string *out )
 {
     struct dyn_string * line;
     rc_t rc = allocated_dyn_string ( &line, 4096 );
@@ -868,6 +747,8 @@ static rc_t walk_reference( ReferenceIterator *ref_iter,
         rc = allocated_dyn_string ( &qualities, 4096 );
         if ( rc == 0 )
         {
+            deletion_cache dels;
+            memset( &dels, 0, sizeof dels );
             while ( rc == 0 )
             {
                 rc = Quitting ();
@@ -884,9 +765,10 @@ static rc_t walk_reference( ReferenceIterator *ref_iter,
                         }
                     }
                     else
-                        rc = walk_reference_window( ref_iter, refname, line, qualities, options );
+                        rc = walk_reference_window( ref_iter, refname, line, qualities, &dels, options, out );
                 }
             }
+            release_deletion_cache( &dels );
             free_dyn_string ( qualities );
         }
         free_dyn_string ( line );
@@ -899,7 +781,7 @@ static rc_t walk_reference( ReferenceIterator *ref_iter,
 /* =========================================================================================== */
 
 
-static rc_t walk_ref_iter( ReferenceIterator *ref_iter, pileup_options *options )
+static rc_t walk_ref_iter( ReferenceIterator *ref_iter, pileup_options *options, struct dyn_string *out )
 {
     rc_t rc = 0;
     while( rc == 0 )
@@ -923,7 +805,7 @@ static rc_t walk_ref_iter( ReferenceIterator *ref_iter, pileup_options *options
                 {
                     if ( options->skiplist != NULL )
                         skiplist_enter_ref( options->skiplist, refname );
-                    rc = walk_reference( ref_iter, refname, options );
+                    rc = walk_reference( ref_iter, refname, options, out );
                 }
                 else
                 {
@@ -1264,12 +1146,10 @@ typedef struct foreach_arg_ctx
 } foreach_arg_ctx;
 
 
-/* called for each source-file/accession */
-static rc_t CC on_argument( const char * path, const char * spot_group, void * data )
+/* the pileup works only on csra-databases */
+static rc_t check_csra_path( const foreach_arg_ctx * ctx, const char * path )
 {
     rc_t rc = 0;
-    foreach_arg_ctx * ctx = ( foreach_arg_ctx * )data;
-
     int path_type = ( VDBManagerPathType ( ctx->vdb_mgr, "%s", path ) & ~ kptAlias );
     if ( path_type != kptDatabase )
     {
@@ -1294,46 +1174,710 @@ static rc_t CC on_argument( const char * path, const char * spot_group, void * d
                 rc = RC ( rcApp, rcNoTarg, rcOpening, rcItem, rcUnsupported );
                 PLOGERR( klogErr, ( klogErr, rc, "failed to open '$(path)', it is not a csra-database", "path=%s", path ) );
             }
+        }
+    }
+    return rc;
+}
+
+
+static void init_prepare_ctx( prepare_ctx * prep, const pileup_options * options, const char * path,
+                              const char * spot_group, Vector * cursor_ids )
+{
+    prep->omit_qualities = options->omit_qualities;
+    prep->read_tlen = options->read_tlen;
+    prep->use_primary_alignments = ( ( options->cmn.tab_select & primary_ats ) == primary_ats );
+    prep->use_secondary_alignments = ( ( options->cmn.tab_select & secondary_ats ) == secondary_ats );
+    prep->use_evidence_alignments = ( ( options->cmn.tab_select & evidence_ats ) == evidence_ats );
+    prep->ref_iter = NULL;
+    prep->spot_group = spot_group;
+    prep->on_section = prepare_section_cb;
+    prep->data = cursor_ids;
+    prep->path = path;
+    prep->db = NULL;
+    prep->reflist = NULL;
+    prep->refobj = NULL;
+    prep->prim_cur = NULL;
+    prep->sec_cur = NULL;
+    prep->ev_cur = NULL;
+}
+
+
+/* called for each source-file/accession */
+static rc_t CC on_argument( const char * path, const char * spot_group, void * data )
+{
+    foreach_arg_ctx * ctx = ( foreach_arg_ctx * )data;
+    rc_t rc = check_csra_path( ctx, path );
+    if ( rc == 0 )
+    {
+        prepare_ctx prep;   /* from cmdline_cmn.h */
+
+        init_prepare_ctx( &prep, ctx->options, path, spot_group, ctx->cursor_ids );
+        prep.ref_iter = ctx->ref_iter;
+
+        rc = prepare_ref_iter( &prep, ctx->vdb_mgr, ctx->vdb_schema, path, ctx->ranges ); /* cmdline_cmn.c */
+        if ( rc == 0 && prep.db == NULL )
+        {
+            rc = RC ( rcApp, rcNoTarg, rcOpening, rcSelf, rcInvalid );
+            LOGERR( klogInt, rc, "unsupported source" );
+        }
+        if ( prep.prim_cur != NULL ) VCursorRelease( prep.prim_cur );
+        if ( prep.sec_cur != NULL ) VCursorRelease( prep.sec_cur );
+        if ( prep.ev_cur != NULL ) VCursorRelease( prep.ev_cur );
+    }
+    return rc;
+}
+
+
+/* free all cursor-ids-blocks created in parallel with the alignment-cursor */
+static void CC cur_id_vector_entry_whack( void *item, void *data )
+{
+    pileup_col_ids * ids = item;
+    free( ids );
+}
+
+
+/* =========================================================================================== */
+/* reference-parallel pileup:
+   the references ( or the requested slices of them ) are cut into windows, worker-threads
+   load each window into their own reference-iterator with their own cursors and walk it
+   into a buffer, the main-thread prints the buffers in reference-order */
+
+#define PILEUP_WINDOW_SIZE ( 256 * 1024 )
+#define PILEUP_MAX_THREADS 64
+
+
+typedef struct pileup_job
+{
+    const char * refname;       /* points into pileup_parallel.refs */
+    uint64_t start;             /* 1-based */
+    uint64_t end;               /* inclusive */
+    struct dyn_string * out;    /* the output of this window */
+    stat_window * stat;         /* function stat: what the walk saw, reduced by the main-thread */
+    rc_t rc;
+    bool first;                 /* the window starts a reference or slice */
+    bool done;
+} pileup_job;
+
+
+typedef struct pileup_ref_node
+{
+    BSTNode node;
+    char * name;
+    INSDC_coord_len len;
+} pileup_ref_node;
+
+
+typedef struct pileup_parallel
+{
+    Args * args;
+    KDirectory * dir;
+    const foreach_arg_ctx * arg_ctx;    /* vdb-manager, schema and options */
+    PlacementRecordExtendFuncs * cb_block;
+    const AlignMgr *almgr;
+    BSTree * regions;                   /* the requested slices, can be empty */
+    BSTree refs;                        /* pileup_ref_node, every reference only once */
+    stat_counters * stat;               /* function stat: the counters running through all windows */
+
+    pileup_job * jobs;
+    uint32_t job_count;
+    uint32_t job_allocated;
+
+    KLock * lock;
+    KCondition * cond;
+    KLock * load_lock;                  /* opening the inputs is done one at a time */
+    uint32_t next;                      /* jobs picked up by workers */
+    uint32_t written;                   /* jobs printed by the main-thread */
+    uint32_t slots;                     /* how many jobs can be ahead of the printing */
+    bool quit;
+} pileup_parallel;
+
+
+/* one input opened by a worker, kept open with its reference-list and cursors for all its windows */
+typedef struct pileup_input
+{
+    prepare_ctx prep;
+    char * path;
+    char * spot_group;
+} pileup_input;
+
+
+typedef struct pileup_worker
+{
+    pileup_parallel * parallel;
+    KThread * thread;
+    Vector inputs;                      /* pileup_input */
+    Vector cursor_ids;                  /* pileup_col_ids of the cursors of all inputs */
+} pileup_worker;
+
+
+/* the walk for the requested function, out == NULL prints to the output */
+static rc_t walk_function( ReferenceIterator *ref_iter, pileup_options *options, struct dyn_string *out )
+{
+    rc_t rc;
+    switch( options->function )
+    {
+        case sra_pileup_stat        : rc = walk_stat( ref_iter, options ); break;
+        case sra_pileup_counters    : rc = walk_counters( ref_iter, options, out ); break;
+        case sra_pileup_debug       : rc = walk_debug( ref_iter, options ); break;
+        case sra_pileup_mismatch    : rc = walk_mismatches( ref_iter, options, out ); break;
+        case sra_pileup_index       : rc = walk_index( ref_iter, options, out ); break;
+        case sra_pileup_varcount    : rc = walk_varcount( ref_iter, options, out ); break;
+        default :  rc = walk_ref_iter( ref_iter, options, out ); break;
+    }
+    return rc;
+}
+
+
+/* these walks stay serial even with --threads:
+   - debug prints the structure of the whole walk
+   - merged slices are skipped via the shared skiplist */
+static bool can_walk_parallel( const pileup_options *options )
+{
+    if ( options->cmn.no_mt || options->threads < 2 || options->skiplist != NULL )
+        return false;
+    return ( options->function != sra_pileup_debug );
+}
+
+
+static int CC pchar_vs_ref_node_cmp( const void * item, const BSTNode * n )
+{
+    const pileup_ref_node * b = ( const pileup_ref_node * )n;
+    return cmp_pchar( item, b->name );
+}
+
+
+static int CC ref_node_vs_ref_node_cmp( const BSTNode *item, const BSTNode *n )
+{
+    const pileup_ref_node * a = ( const pileup_ref_node * )item;
+    const pileup_ref_node * b = ( const pileup_ref_node * )n;
+    return cmp_pchar( a->name, b->name );
+}
+
+
+static void CC release_ref_node( BSTNode * n, void * data )
+{
+    pileup_ref_node * node = ( pileup_ref_node * )n;
+    free( node->name );
+    free( node );
+}
+
+
+static rc_t add_pileup_jobs( pileup_parallel * self, const char * refname, uint64_t start, uint64_t end )
+{
+    rc_t rc = 0;
+    uint64_t pos;
+    for ( pos = start; rc == 0 && pos <= end; pos += PILEUP_WINDOW_SIZE )
+    {
+        pileup_job * job;
+        if ( self->job_count == self->job_allocated )
+        {
+            uint32_t new_allocated = self->job_allocated == 0 ? 1024 : self->job_allocated * 2;
+            pileup_job * tmp = realloc( self->jobs, new_allocated * sizeof tmp[ 0 ] );
+            if ( tmp == NULL )
+            {
+                rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+                break;
+            }
+            self->jobs = tmp;
+            self->job_allocated = new_allocated;
+        }
+        job = &self->jobs[ self->job_count++ ];
+        memset( job, 0, sizeof *job );
+        job->refname = refname;
+        job->first = ( pos == start );
+        job->start = pos;
+        job->end = ( end - pos >= PILEUP_WINDOW_SIZE ) ? pos + PILEUP_WINDOW_SIZE - 1 : end;
+    }
+    return rc;
+}
+
+
+static rc_t add_ref_node( pileup_parallel * self, const char * name, INSDC_coord_len len )
+{
+    rc_t rc = 0;
+    pileup_ref_node * node = calloc( 1, sizeof *node );
+    if ( node != NULL )
+        node->name = string_dup_measure( name, NULL );
+    if ( node == NULL || node->name == NULL )
+    {
+        free( node );
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    }
+    else
+    {
+        node->len = len;
+        BSTreeInsert( &self->refs, ( BSTNode * )node, ref_node_vs_ref_node_cmp );
+    }
+    return rc;
+}
+
+
+/* no slices requested: every reference found in an input is walked as a whole, in reference-list order */
+static rc_t add_reference_jobs( pileup_parallel * self, const ReferenceObj * refobj )
+{
+    const char * seq_id;
+    INSDC_coord_len len;
+    rc_t rc = ReferenceObj_SeqId( refobj, &seq_id );
+    if ( rc == 0 )
+        rc = ReferenceObj_SeqLength( refobj, &len );
+    if ( rc != 0 )
+    {
+        LOGERR( klogInt, rc, "cannot read name/length of reference" );
+    }
+    else if ( len > 0 && BSTreeFind( &self->refs, seq_id, pchar_vs_ref_node_cmp ) == NULL )
+    {
+        rc = add_ref_node( self, seq_id, len );
+        if ( rc == 0 )
+        {
+            const pileup_ref_node * node = ( const pileup_ref_node * )BSTreeFind( &self->refs, seq_id, pchar_vs_ref_node_cmp );
+            rc = add_pileup_jobs( self, node->name, 1, len );
+        }
+    }
+    return rc;
+}
+
+
+/* slices requested: remember the length of every sliced reference an input has,
+   the slices can name the reference by seq-id or by name ( like ReferenceList_Find() ) */
+static rc_t find_region_references( pileup_parallel * self, const ReferenceList * reflist )
+{
+    rc_t rc = 0;
+    const struct reference_region * r;
+    for ( r = get_first_ref_node( self->regions ); rc == 0 && r != NULL; r = get_next_ref_node( r ) )
+    {
+        const char * r_name = get_ref_node_name( r );
+        if ( BSTreeFind( &self->refs, r_name, pchar_vs_ref_node_cmp ) == NULL )
+        {
+            const ReferenceObj * refobj;
+            if ( ReferenceList_Find( reflist, &refobj, r_name, string_size( r_name ) ) == 0 )
+            {
+                INSDC_coord_len len;
+                rc = ReferenceObj_SeqLength( refobj, &len );
+                if ( rc != 0 )
+                {
+                    LOGERR( klogInt, rc, "ReferenceObj_SeqLength() failed" );
+                }
+                else if ( len > 0 )
+                    rc = add_ref_node( self, r_name, len );
+                ReferenceObj_Release( refobj );
+            }
+        }
+    }
+    return rc;
+}
+
+
+/* the jobs for the slices, in the order of the region-tree like the serial walk */
+static rc_t add_region_jobs( pileup_parallel * self )
+{
+    rc_t rc = 0;
+    const struct reference_region * r;
+    for ( r = get_first_ref_node( self->regions ); rc == 0 && r != NULL; r = get_next_ref_node( r ) )
+    {
+        const pileup_ref_node * node = ( const pileup_ref_node * )BSTreeFind( &self->refs,
+                                            get_ref_node_name( r ), pchar_vs_ref_node_cmp );
+        if ( node != NULL )
+        {
+            uint32_t idx, n = get_ref_node_range_count( r );
+            for ( idx = 0; rc == 0 && idx < n; ++idx )
+            {
+                const struct reference_range * range = get_ref_range( r, idx );
+                uint64_t start = get_ref_range_start( range );
+                uint64_t end = get_ref_range_end( range );
+                if ( start == 0 ) start = 1;
+                if ( end == 0 || end > node->len ) end = node->len;
+                if ( start <= end )
+                    rc = add_pileup_jobs( self, node->name, start, end );
+            }
+        }
+    }
+    return rc;
+}
+
+
+static rc_t make_reflist( const VDatabase * db, const pileup_options * options, const ReferenceList ** reflist )
+{
+    rc_t rc;
+    uint32_t reflist_options = ereferencelist_4na;
+
+    if ( ( options->cmn.tab_select & primary_ats ) == primary_ats )
+        reflist_options |= ereferencelist_usePrimaryIds;
+    if ( ( options->cmn.tab_select & secondary_ats ) == secondary_ats )
+        reflist_options |= ereferencelist_useSecondaryIds;
+    if ( ( options->cmn.tab_select & evidence_ats ) == evidence_ats )
+        reflist_options |= ereferencelist_useEvidenceIds;
+
+    rc = ReferenceList_MakeDatabase( reflist, db, reflist_options, 0, NULL, 0 );
+    if ( rc != 0 )
+    {
+        LOGERR( klogInt, rc, "ReferenceList_MakeDatabase() failed" );
+    }
+    return rc;
+}
+
+
+/* called for each source-file/accession, to find the references to be walked */
+static rc_t CC on_argument_collect_jobs( const char * path, const char * spot_group, void * data )
+{
+    pileup_parallel * self = data;
+    const pileup_options * options = self->arg_ctx->options;
+    const VDatabase *db;
+    rc_t rc = VDBManagerOpenDBRead ( self->arg_ctx->vdb_mgr, &db, self->arg_ctx->vdb_schema, "%s", path );
+    if ( rc != 0 )
+    {
+        PLOGERR( klogErr, ( klogErr, rc, "failed to open '$(path)'", "path=%s", path ) );
+    }
+    else
+    {
+        const ReferenceList *reflist;
+        rc = make_reflist( db, options, &reflist );
+        if ( rc == 0 && count_ref_regions( self->regions ) > 0 )
+        {
+            rc = find_region_references( self, reflist );
+            ReferenceList_Release( reflist );
+        }
+        else if ( rc == 0 )
+        {
+            uint32_t idx, count;
+            rc = ReferenceList_Count( reflist, &count );
+            for ( idx = 0; rc == 0 && idx < count; ++idx )
+            {
+                const ReferenceObj * refobj;
+                rc = ReferenceList_Get( reflist, &refobj, idx );
+                if ( rc != 0 )
+                {
+                    LOGERR( klogInt, rc, "ReferenceList_Get() failed" );
+                }
+                else
+                {
+                    rc = add_reference_jobs( self, refobj );
+                    ReferenceObj_Release( refobj );
+                }
+            }
+            ReferenceList_Release( reflist );
+        }
+        VDatabaseRelease( db );
+    }
+    return rc;
+}
+
+
+static void release_input( pileup_input * input )
+{
+    if ( input->prep.prim_cur != NULL ) VCursorRelease( input->prep.prim_cur );
+    if ( input->prep.sec_cur != NULL ) VCursorRelease( input->prep.sec_cur );
+    if ( input->prep.ev_cur != NULL ) VCursorRelease( input->prep.ev_cur );
+    if ( input->prep.reflist != NULL ) ReferenceList_Release( input->prep.reflist );
+    if ( input->prep.db != NULL ) VDatabaseRelease( input->prep.db );
+    free( input->path );
+    free( input->spot_group );
+    free( input );
+}
+
+
+static void CC input_vector_entry_whack( void *item, void *data )
+{
+    release_input( item );
+}
+
+
+/* creates the alignment-cursors of an input up front, a table that cannot be opened is not used */
+static rc_t prepare_input_cursors( prepare_ctx * prep )
+{
+    rc_t rc1 = 0, rc2 = 0, rc3 = 0;
+    if ( prep->use_primary_alignments )
+    {
+        rc1 = make_cursor_ids( prep->data, &prep->prim_cur_ids );
+        if ( rc1 == 0 )
+            rc1 = prepare_prim_cursor( prep->db, &prep->prim_cur, prep->omit_qualities,
+                                       prep->read_tlen, prep->prim_cur_ids );
+        prep->use_primary_alignments = ( rc1 == 0 );
+    }
+    if ( prep->use_secondary_alignments )
+    {
+        rc2 = make_cursor_ids( prep->data, &prep->sec_cur_ids );
+        if ( rc2 == 0 )
+            rc2 = prepare_sec_cursor( prep->db, &prep->sec_cur, prep->omit_qualities,
+                                      prep->read_tlen, prep->sec_cur_ids );
+        prep->use_secondary_alignments = ( rc2 == 0 );
+    }
+    if ( prep->use_evidence_alignments )
+    {
+        rc3 = make_cursor_ids( prep->data, &prep->ev_cur_ids );
+        if ( rc3 == 0 )
+            rc3 = prepare_evidence_cursor( prep->db, &prep->ev_cur, prep->omit_qualities,
+                                           prep->read_tlen, prep->ev_cur_ids );
+        prep->use_evidence_alignments = ( rc3 == 0 );
+    }
+    /* like prepare_section_cb(): the input is usable if one of the tables is */
+    if ( prep->use_primary_alignments || prep->use_secondary_alignments || prep->use_evidence_alignments )
+        return 0;
+    return rc1 != 0 ? rc1 : ( rc2 != 0 ? rc2 : rc3 );
+}
+
+
+/* called for each source-file/accession, opens it for a worker */
+static rc_t CC on_argument_open_input( const char * path, const char * spot_group, void * data )
+{
+    pileup_worker * w = data;
+    const foreach_arg_ctx * arg_ctx = w->parallel->arg_ctx;
+    rc_t rc = check_csra_path( arg_ctx, path );
+    if ( rc == 0 )
+    {
+        pileup_input * input = calloc( 1, sizeof *input );
+        if ( input == NULL )
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        else
+        {
+            input->path = string_dup_measure( path, NULL );
+            if ( spot_group != NULL )
+                input->spot_group = string_dup_measure( spot_group, NULL );
+            if ( input->path == NULL || ( spot_group != NULL && input->spot_group == NULL ) )
+                rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
             else
             {
-                prepare_ctx prep;   /* from cmdline_cmn.h */
-
-                prep.omit_qualities = ctx->options->omit_qualities;
-                prep.read_tlen = ctx->options->read_tlen;
-                prep.use_primary_alignments = ( ( ctx->options->cmn.tab_select & primary_ats ) == primary_ats );
-                prep.use_secondary_alignments = ( ( ctx->options->cmn.tab_select & secondary_ats ) == secondary_ats );
-                prep.use_evidence_alignments = ( ( ctx->options->cmn.tab_select & evidence_ats ) == evidence_ats );
-                prep.ref_iter = ctx->ref_iter;
-                prep.spot_group = spot_group;
-                prep.on_section = prepare_section_cb;
-                prep.data = ctx->cursor_ids;
-                prep.path = path;
-                prep.db = NULL;
-                prep.prim_cur = NULL;
-                prep.sec_cur = NULL;
-                prep.ev_cur = NULL;
-                
-                rc = prepare_ref_iter( &prep, ctx->vdb_mgr, ctx->vdb_schema, path, ctx->ranges ); /* cmdline_cmn.c */
-                if ( rc == 0 && prep.db == NULL )
+                init_prepare_ctx( &input->prep, arg_ctx->options, input->path, input->spot_group, &w->cursor_ids );
+                rc = VDBManagerOpenDBRead ( arg_ctx->vdb_mgr, &input->prep.db, arg_ctx->vdb_schema, "%s", path );
+                if ( rc != 0 )
                 {
-                    rc = RC ( rcApp, rcNoTarg, rcOpening, rcSelf, rcInvalid );
-                    LOGERR( klogInt, rc, "unsupported source" );
+                    PLOGERR( klogErr, ( klogErr, rc, "failed to open '$(path)'", "path=%s", path ) );
                 }
-                if ( prep.prim_cur != NULL ) VCursorRelease( prep.prim_cur );
-                if ( prep.sec_cur != NULL ) VCursorRelease( prep.sec_cur );
-                if ( prep.ev_cur != NULL ) VCursorRelease( prep.ev_cur );
             }
+            if ( rc == 0 )
+                rc = make_reflist( input->prep.db, arg_ctx->options, &input->prep.reflist );
+            if ( rc == 0 )
+                rc = prepare_input_cursors( &input->prep );
+            if ( rc == 0 )
+                rc = VectorAppend ( &w->inputs, NULL, input );
+            if ( rc != 0 )
+                release_input( input );
         }
     }
     return rc;
 }
 
 
-/* free all cursor-ids-blocks created in parallel with the alignment-cursor */
-static void CC cur_id_vector_entry_whack( void *item, void *data )
+/* load one window of all inputs into a new reference-iterator and walk it,
+   the inputs and their cursors are the ones the worker opened at start */
+static rc_t walk_pileup_job( pileup_worker * w, pileup_job * job )
 {
-    pileup_col_ids * ids = item;
-    free( ids );
+    pileup_parallel * self = w->parallel;
+    const foreach_arg_ctx * arg_ctx = self->arg_ctx;
+    ReferenceIterator * ref_iter = NULL;
+    BSTree ranges;
+    rc_t rc;
+
+    BSTreeInit( &ranges );
+    rc = allocated_dyn_string( &job->out, 64 * 1024 );
+    if ( rc == 0 )
+        rc = add_region( &ranges, job->refname, job->start, job->end );
+    if ( rc == 0 )
+    {
+        rc = AlignMgrMakeReferenceIterator ( self->almgr, &ref_iter, self->cb_block, arg_ctx->options->minmapq );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "AlignMgrMakeReferenceIterator() failed" );
+        }
+    }
+    if ( rc == 0 )
+    {
+        const struct reference_range * range = get_ref_range( get_first_ref_node( &ranges ), 0 );
+        uint32_t idx, count = VectorLength( &w->inputs );
+        for ( idx = 0; rc == 0 && idx < count; ++idx )
+        {
+            pileup_input * input = VectorGet( &w->inputs, idx );
+            prepare_ctx * prep = &input->prep;
+            /* not every input has every reference */
+            if ( ReferenceList_Find( prep->reflist, &prep->refobj, job->refname, string_size( job->refname ) ) == 0 )
+            {
+                prep->ref_iter = ref_iter;
+                rc = prepare_section_cb( prep, range );
+                ReferenceObj_Release( prep->refobj );
+                prep->refobj = NULL;
+                prep->ref_iter = NULL;
+            }
+        }
+    }
+    if ( rc == 0 )
+    {
+        if ( arg_ctx->options->function == sra_pileup_stat )
+            rc = walk_stat_window( ref_iter, arg_ctx->options, &job->stat );
+        else
+            rc = walk_function( ref_iter, arg_ctx->options, job->out );
+    }
+
+    if ( ref_iter != NULL ) ReferenceIteratorRelease( ref_iter );
+    free_ref_regions( &ranges );
+    return rc;
+}
+
+
+static rc_t CC pileup_worker_thread( const KThread * t, void * data )
+{
+    pileup_worker * w = data;
+    pileup_parallel * self = w->parallel;
+    rc_t open_rc, rc;
+
+    /* open the inputs once, one worker at a time: opening touches the shared schema and manager */
+    open_rc = KLockAcquire( self->load_lock );
+    if ( open_rc == 0 )
+    {
+        open_rc = foreach_argument( self->args, self->dir, self->arg_ctx->options->div_by_spotgrp,
+                                    NULL, on_argument_open_input, w ); /* cmdline_cmn.c */
+        KLockUnlock( self->load_lock );
+    }
+
+    rc = KLockAcquire( self->lock );
+    while ( rc == 0 )
+    {
+        pileup_job * job;
+        while ( !self->quit && self->next < self->job_count && self->next >= self->written + self->slots )
+            KConditionWait( self->cond, self->lock );
+        if ( self->quit || self->next >= self->job_count )
+            break;
+        job = &self->jobs[ self->next++ ];
+        KLockUnlock( self->lock );
+
+        /* a worker that could not open its inputs still completes its jobs, with the error */
+        job->rc = open_rc != 0 ? open_rc : walk_pileup_job( w, job );
+
+        KLockAcquire( self->lock );
+        job->done = true;
+        KConditionBroadcast( self->cond );
+    }
+    KLockUnlock( self->lock );
+    return 0;
+}
+
+
+/* print the windows in order, as soon as they are done */
+static rc_t print_pileup_jobs( pileup_parallel * self )
+{
+    rc_t rc = 0;
+    while ( rc == 0 && self->written < self->job_count )
+    {
+        pileup_job * job = &self->jobs[ self->written ];
+        rc = KLockAcquire( self->lock );
+        if ( rc == 0 )
+        {
+            while ( !job->done )
+                KConditionWait( self->cond, self->lock );
+            KLockUnlock( self->lock );
+
+            rc = job->rc;
+            if ( rc == 0 && job->stat != NULL )
+                rc = reduce_stat_window( self->stat, job->stat, job->first );
+            if ( rc == 0 )
+                rc = print_dyn_string( job->out );
+            if ( rc == 0 )
+                rc = Quitting();
+            if ( job->out != NULL )
+            {
+                free_dyn_string( job->out );
+                job->out = NULL;
+            }
+            release_stat_window( job->stat );
+            job->stat = NULL;
+
+            KLockAcquire( self->lock );
+            self->written++;
+            KConditionBroadcast( self->cond );
+            KLockUnlock( self->lock );
+        }
+    }
+    if ( GetRCState( rc ) == rcCanceled ) { rc = 0; }
+    return rc;
+}
+
+
+static rc_t walk_parallel( Args * args, KDirectory * dir, const foreach_arg_ctx * arg_ctx,
+                           const AlignMgr *almgr, PlacementRecordExtendFuncs * cb_block,
+                           BSTree * regions, bool * empty )
+{
+    pileup_parallel self;
+    pileup_worker workers[ PILEUP_MAX_THREADS ];
+    uint32_t i, thread_count = arg_ctx->options->threads;
+    rc_t rc;
+
+    if ( thread_count > PILEUP_MAX_THREADS )
+        thread_count = PILEUP_MAX_THREADS;
+
+    memset( &self, 0, sizeof self );
+    self.args = args;
+    self.dir = dir;
+    self.arg_ctx = arg_ctx;
+    self.cb_block = cb_block;
+    self.almgr = almgr;
+    self.regions = regions;
+    self.slots = thread_count * 2;
+    BSTreeInit( &self.refs );
+
+    rc = foreach_argument( args, dir, arg_ctx->options->div_by_spotgrp, empty, on_argument_collect_jobs, &self ); /* cmdline_cmn.c */
+    if ( rc == 0 && count_ref_regions( regions ) > 0 )
+        rc = add_region_jobs( &self );
+    if ( rc == 0 )
+        rc = KLockMake( &self.lock );
+    if ( rc == 0 )
+        rc = KLockMake( &self.load_lock );
+    if ( rc == 0 )
+        rc = KConditionMake( &self.cond );
+    if ( rc == 0 && arg_ctx->options->function == sra_pileup_stat )
+        rc = make_stat_reduction( &self.stat ); /* pileup_stat.c */
+    if ( rc != 0 )
+    {
+        LOGERR( klogInt, rc, "cannot prepare parallel pileup" );
+    }
+
+    for ( i = 0; i < thread_count; ++i )
+    {
+        workers[ i ].parallel = &self;
+        workers[ i ].thread = NULL;
+        VectorInit ( &workers[ i ].inputs, 0, 5 );
+        VectorInit ( &workers[ i ].cursor_ids, 0, 15 );
+    }
+    for ( i = 0; rc == 0 && i < thread_count; ++i )
+    {
+        rc = KThreadMake( &workers[ i ].thread, pileup_worker_thread, &workers[ i ] );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "KThreadMake() failed" );
+        }
+    }
+
+    if ( rc == 0 )
+        rc = print_pileup_jobs( &self );
+
+    /* stop the workers, an error or quitting leaves jobs behind */
+    if ( self.lock != NULL && KLockAcquire( self.lock ) == 0 )
+    {
+        self.quit = true;
+        KConditionBroadcast( self.cond );
+        KLockUnlock( self.lock );
+    }
+    for ( i = 0; i < thread_count; ++i )
+    {
+        if ( workers[ i ].thread != NULL )
+        {
+            KThreadWait( workers[ i ].thread, NULL );
+            KThreadRelease( workers[ i ].thread );
+        }
+        VectorWhack ( &workers[ i ].inputs, input_vector_entry_whack, NULL );
+        VectorWhack ( &workers[ i ].cursor_ids, cur_id_vector_entry_whack, NULL );
+    }
+
+    for ( i = 0; i < self.job_count; ++i )
+    {
+        if ( self.jobs[ i ].out != NULL )
+            free_dyn_string( self.jobs[ i ].out );
+        release_stat_window( self.jobs[ i ].stat );
+    }
+    free( self.jobs );
+    release_stat_reduction( self.stat );
+    BSTreeWhack( &self.refs, release_ref_node, NULL );
+    KConditionRelease( self.cond );
+    KLockRelease( self.load_lock );
+    KLockRelease( self.lock );
+    return rc;
 }
 
 
@@ -1341,8 +1885,10 @@ static rc_t pileup_main( Args * args, pileup_options *options )
 {
     foreach_arg_ctx arg_ctx;
     pileup_callback_data cb_data;
+    PlacementRecordExtendFuncs cb_block;
     KDirectory * dir = NULL;
     Vector cur_ids_vector;
+    bool walked = false;
 
     /* (1) make the align-manager ( necessary to make a ReferenceIterator... ) */
     rc_t rc = AlignMgrMakeRead ( &cb_data.almgr );
@@ -1360,8 +1906,6 @@ static rc_t pileup_main( Args * args, pileup_options *options )
     /* (2) make the reference-iterator */
     if ( rc == 0 )
     {
-        PlacementRecordExtendFuncs cb_block;
-
         cb_block.data = &cb_data;
         cb_block.destroy = NULL;
         cb_block.populate = populate_tooldata;
@@ -1473,7 +2017,14 @@ static rc_t pileup_main( Args * args, pileup_options *options )
             options->skiplist = skiplist_make( &regions ); /* create skiplist for neighboring slices */
 
             arg_ctx.ranges = &regions;
-            rc = foreach_argument( args, dir, options->div_by_spotgrp, &empty, on_argument, &arg_ctx ); /* cmdline_cmn.c */
+            if ( can_walk_parallel( options ) )
+            {
+                /* every worker loads its windows into its own ref-iter, the pileup happens here */
+                rc = walk_parallel( args, dir, &arg_ctx, cb_data.almgr, &cb_block, &regions, &empty );
+                walked = true;
+            }
+            else
+                rc = foreach_argument( args, dir, options->div_by_spotgrp, &empty, on_argument, &arg_ctx ); /* cmdline_cmn.c */
             if ( empty )
             {
                 Usage ( args );
@@ -1483,19 +2034,10 @@ static rc_t pileup_main( Args * args, pileup_options *options )
     }
 
     /* (6) walk the "loaded" ref-iterator ===> perform the pileup */
-    if ( rc == 0 )
+    if ( rc == 0 && !walked )
     {
         /* ============================================== */
-        switch( options->function )
-        {
-            case sra_pileup_stat        : rc = walk_stat( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_counters    : rc = walk_counters( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_debug       : rc = walk_debug( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_mismatch    : rc = walk_mismatches( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_index       : rc = walk_index( arg_ctx.ref_iter, options ); break;
-            case sra_pileup_varcount    : rc = walk_varcount( arg_ctx.ref_iter, options ); break;
-            default :  rc = walk_ref_iter( arg_ctx.ref_iter, options ); break;
-        }
+        rc = walk_function( arg_ctx.ref_iter, options, NULL );
         /* ============================================== */
     }
 
@@ -1544,7 +2086,8 @@ rc_t CC KMain( int argc, char *argv [] )
                         rc = set_stdout_to( options.cmn.gzip_output,
                                             options.cmn.bzip_output,
                                             options.cmn.output_file,
-                                            32 * 1024 );
+                                            32 * 1024,
+                                            options.threads );
                     }
 
                     if ( rc == 0 )
@@ -68,6 +68,7 @@ rc_t walk_debug( ReferenceIterator *ref_iter, pileup_options *options )
 
     data.ref_iter = ref_iter;
     data.options = options;
+    data.out = NULL;
     
     funcs.on_enter_ref = walk_debug_enter_ref;
     funcs.on_exit_ref = walk_debug_exit_ref;
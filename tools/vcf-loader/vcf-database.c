@@ -33,8 +33,50 @@
 
 #include <align/writer-reference.h>
 
+#include <klib/container.h>
+#include <klib/log.h>
+
 #include "vcf-reader.h"
 
+#define MAX_CHROMOSOME_NAME_LENGTH 1024
+
+/* a chromosome resolved by the reference manager, kept for the whole load */
+typedef struct Chromosome
+{
+    BSTNode node;
+    String name;                /* the text follows the object */
+    const ReferenceSeq* seq;
+    
+    /* the last translated position; multi-allelic sites come as consecutive lines at the same position */
+    bool translated;
+    uint32_t position;
+    int64_t ref_id;
+    INSDC_coord_zero ref_start;
+} Chromosome;
+
+/* rows of the VARIANT table, written one line at a time */
+typedef struct VariantWriter
+{
+    VTable* tbl;
+    VCursor* cur;
+    uint32_t ref_id_idx, position_idx, length_idx, sequence_idx;
+    const ReferenceMgr* refMgr;
+    
+    /* chromosomes by name, the last one used is checked first */
+    BSTree chromosomes;
+    Chromosome* lastChromosome;
+    
+    /* statistics */
+    uint64_t lines;
+    uint64_t chromosomeHits;
+    uint64_t chromosomeMisses;
+    uint64_t positionHits;
+} VariantWriter;
+
+static rc_t VariantWriterOpen   ( VariantWriter* self, const char configPath[], VDatabase* db, VDBManager* dbMgr );
+static rc_t VariantWriterWrite  ( VariantWriter* self, const VcfDataLine* line );
+static rc_t VariantWriterClose  ( VariantWriter* self, bool commit );
+
 static rc_t SaveVariants        ( const VcfReader* reader, const char configPath[], VDatabase* db, VDBManager* dbMgr );
 static rc_t SaveVariantPhases   ( const VcfReader* reader, VDatabase* db, VDBManager* dbMgr );
 static rc_t SaveAlignments      ( const VcfReader* reader, VDatabase* db, VDBManager* dbMgr );
@@ -60,98 +102,221 @@ rc_t VcfDatabaseSave ( const struct VcfReader* reader, const char configPath[],
     return rc;
 }
 
-rc_t SaveVariants( const VcfReader* reader, const char configPath[], VDatabase* db, VDBManager* dbMgr )
+static rc_t CC LoadVariant ( void* data, const VcfDataLine* line )
 {
-    VTable* tbl;
-    rc_t rc = VDatabaseCreateTable(db, &tbl, "VARIANT", kcmCreate | kcmMD5, "VARIANT");
+    return VariantWriterWrite( (VariantWriter*)data, line );
+}
+
+rc_t VcfDatabaseLoad ( struct VcfReader* reader, const struct KFile* file, const char configPath[], VDatabase* db, const struct VNamelist** messages )
+{
+    VDBManager* dbMgr;
+    rc_t rc = VDatabaseOpenManagerUpdate(db, &dbMgr);
     if (rc == 0)
     {
         rc_t rc2;
-        VCursor *cur;
-        rc = VTableCreateCursorWrite( tbl, &cur, kcmInsert );
+        VariantWriter writer;
+        
+        rc = VariantWriterOpen(&writer, configPath, db, dbMgr);
         if (rc == 0)
         {
-            uint32_t ref_id_idx, position_idx, length_idx, sequence_idx;
-            rc = VCursorAddColumn( cur, &ref_id_idx, "ref_id" );
-            if (rc == 0) rc = VCursorAddColumn( cur, &position_idx, "position" );
-            if (rc == 0) rc = VCursorAddColumn( cur, &length_idx, "length" );
-            if (rc == 0) rc = VCursorAddColumn( cur, &sequence_idx, "sequence" );
-
+            rc = VcfReaderParseStream(reader, file, 0, LoadVariant, &writer, messages);
+            rc2 = VariantWriterClose(&writer, rc == 0);
             if (rc == 0)
+                rc = rc2;
+        }
+        if (rc == 0)
+            rc = SaveVariantPhases(reader, db, dbMgr);
+        if (rc == 0)
+            rc = SaveAlignments(reader, db, dbMgr);
+            
+        rc2 = VDBManagerRelease(dbMgr);
+        if (rc == 0)
+            rc = rc2;
+    }
+    return rc;
+}
+
+rc_t VariantWriterOpen( VariantWriter* self, const char configPath[], VDatabase* db, VDBManager* dbMgr )
+{
+    rc_t rc;
+    
+    memset(self, 0, sizeof(*self));
+    BSTreeInit(&self->chromosomes);
+    rc = VDatabaseCreateTable(db, &self->tbl, "VARIANT", kcmCreate | kcmMD5, "VARIANT");
+    if (rc == 0)
+    {
+        rc = VTableCreateCursorWrite( self->tbl, &self->cur, kcmInsert );
+        if (rc == 0)
+        {
+            rc = VCursorAddColumn( self->cur, &self->ref_id_idx, "ref_id" );
+            if (rc == 0) rc = VCursorAddColumn( self->cur, &self->position_idx, "position" );
+            if (rc == 0) rc = VCursorAddColumn( self->cur, &self->length_idx, "length" );
+            if (rc == 0) rc = VCursorAddColumn( self->cur, &self->sequence_idx, "sequence" );
+            if (rc == 0) rc = VCursorOpen( self->cur );
+            if (rc == 0) rc = ReferenceMgr_Make(&self->refMgr, db, dbMgr, 0, configPath, NULL, 0, 0, 0);
+            if (rc != 0)
+            {
+                VCursorRelease(self->cur);
+                self->cur = NULL;
+            }
+        }
+        if (rc != 0)
+        {
+            VTableRelease(self->tbl);
+            self->tbl = NULL;
+        }
+    }
+    return rc;
+}
+
+static int CC ChromosomeFind ( const void* item, const BSTNode* n )
+{
+    return StringCompare ( (const String*)item, & ((const Chromosome*)n) -> name );
+}
+
+static int CC ChromosomeSort ( const BSTNode* item, const BSTNode* n )
+{
+    return StringCompare ( & ((const Chromosome*)item) -> name, & ((const Chromosome*)n) -> name );
+}
+
+static void CC ChromosomeWhack ( BSTNode* n, void* data )
+{
+    Chromosome* self = (Chromosome*)n;
+    rc_t* rc = (rc_t*)data;
+    rc_t rc2 = ReferenceSeq_Release(self->seq);
+    if (*rc == 0)
+        *rc = rc2;
+    free(self);
+}
+
+static rc_t GetChromosome( VariantWriter* self, const String* name, Chromosome** result )
+{
+    rc_t rc = 0;
+    Chromosome* chrom = self->lastChromosome;
+    
+    if (chrom == NULL || ! StringEqual(&chrom->name, name))
+        chrom = (Chromosome*)BSTreeFind(&self->chromosomes, name, ChromosomeFind);
+        
+    if (chrom != NULL)
+        ++ self->chromosomeHits;
+    else if (name->size >= MAX_CHROMOSOME_NAME_LENGTH)
+        return RC ( rcAlign, rcTable, rcWriting, rcName, rcExcessive );
+    else
+    {
+        bool shouldUnmap = false;
+        char* text;
+        
+        chrom = calloc(1, sizeof(Chromosome) + name->size + 1);
+        if (chrom == NULL)
+            return RC ( rcAlign, rcTable, rcWriting, rcMemory, rcExhausted );
+        text = (char*)(chrom + 1);
+        string_copy(text, name->size + 1, name->addr, name->size);
+        StringInit(&chrom->name, text, name->size, name->len);
+        
+        rc = ReferenceMgr_GetSeq(self->refMgr, &chrom->seq, text, &shouldUnmap);
+        if (rc != 0)
+        {
+            free(chrom);
+            return rc;
+        }
+        assert(shouldUnmap == false);
+        BSTreeInsert(&self->chromosomes, &chrom->node, ChromosomeSort);
+        ++ self->chromosomeMisses;
+    }
+    
+    self->lastChromosome = chrom;
+    *result = chrom;
+    return 0;
+}
+
+rc_t VariantWriterWrite( VariantWriter* self, const VcfDataLine* line )
+{
+    Chromosome* chrom;
+    rc_t rc = GetChromosome(self, &line->chromosome, &chrom);
+    
+    ++ self->lines;
+    if (rc == 0)
+    {
+        if (chrom->translated && chrom->position == line->position)
+            ++ self->positionHits;
+        else
+        {
+            rc = ReferenceSeq_TranslateOffset_int(chrom->seq, line->position, &chrom->ref_id, &chrom->ref_start, NULL);
+            chrom->translated = rc == 0;
+            chrom->position = line->position;
+        }
+        if (rc == 0)
+        {
+            rc = VCursorOpenRow( self->cur );
+        
+            if (rc == 0) 
+                rc = VCursorWrite( self->cur, self->ref_id_idx,    sizeof(chrom->ref_id) * 8, &chrom->ref_id, 0, 1);
+            if (rc == 0) 
+                rc = VCursorWrite( self->cur, self->position_idx,  sizeof(chrom->ref_start) * 8, &chrom->ref_start, 0, 1);
+            if (rc == 0) 
+                rc = VCursorWrite( self->cur, self->length_idx,    sizeof(line->altBases.len) * 8,   &line->altBases.len,   0, 1);
+            if (rc == 0) 
+                rc = VCursorWrite( self->cur, self->sequence_idx,  line->altBases.len * 8,    line->altBases.addr,    0, 1);
+        }
+    }    
+    if (rc == 0) rc = VCursorCommitRow( self->cur );
+    if (rc == 0) rc = VCursorCloseRow( self->cur );
+    
+    return rc;
+}
+
+rc_t VariantWriterClose( VariantWriter* self, bool commit )
+{
+    rc_t rc = 0;
+    rc_t rc2;
+    
+    PLOGMSG ( klogInfo, ( klogInfo, "VARIANT: $(lines) lines, $(chroms) chromosomes, "
+                          "$(hits) chromosome cache hits, $(pos) repeated positions",
+                          "lines=%lu,chroms=%lu,hits=%lu,pos=%lu",
+                          (unsigned long)self->lines, (unsigned long)self->chromosomeMisses,
+                          (unsigned long)self->chromosomeHits, (unsigned long)self->positionHits ) );
+    
+    BSTreeWhack(&self->chromosomes, ChromosomeWhack, &rc);
+    rc2 = ReferenceMgr_Release(self->refMgr, commit && rc == 0, NULL, false, NULL);
+    if (rc == 0)
+        rc = rc2;
+    if (commit && rc == 0)
+        rc = VCursorCommit( self->cur );
+    rc2 = VCursorRelease(self->cur);
+    if (rc == 0)
+        rc = rc2;
+    rc2 = VTableRelease(self->tbl);
+    if (rc == 0)
+        rc = rc2;
+    
+    memset(self, 0, sizeof(*self));
+    return rc;
+}
+
+rc_t SaveVariants( const VcfReader* reader, const char configPath[], VDatabase* db, VDBManager* dbMgr )
+{
+    uint32_t count;
+    rc_t rc = VcfReaderGetDataLineCount(reader, &count);
+    if (rc == 0)
+    {
+        VariantWriter writer;
+        rc = VariantWriterOpen(&writer, configPath, db, dbMgr);
+        if (rc == 0)
+        {
+            rc_t rc2;
+            uint32_t i;
+            for (i = 0; i < count && rc == 0; ++i)
             {
-                rc = VCursorOpen( cur );
+                const VcfDataLine* line;
+                rc = VcfReaderGetDataLine(reader, i, &line);            
                 if (rc == 0)
-                {
-                    uint32_t count;
-                    rc_t rc = VcfReaderGetDataLineCount(reader, &count);
-                    if (rc == 0)
-                    {   
-                        const ReferenceMgr* refMgr;
-                        rc = ReferenceMgr_Make(&refMgr, db, dbMgr, 0, configPath, NULL, 0, 0, 0);
-                        if (rc == 0)
-                        {
-                            uint32_t i;
-                            for (i = 0; i < count; ++i)
-                            {
-                                const VcfDataLine* line;
-                                rc = VcfReaderGetDataLine(reader, i, &line);            
-
-                                if (rc == 0)
-                                {
-                                    const ReferenceSeq* seq;
-                                    #define MAX_CHROMOSOME_NAME_LENGTH 1024
-                                    char chromName[MAX_CHROMOSOME_NAME_LENGTH];
-                                    bool shouldUnmap = false;
-                                    string_copy(chromName, sizeof(chromName), line->chromosome.addr, line->chromosome.size);
-                                    rc = (ReferenceMgr_GetSeq(refMgr, &seq, chromName, &shouldUnmap));
-                                    if (rc == 0)
-                                    {
-                                        int64_t ref_id;
-                                        INSDC_coord_zero ref_start;
-                                        assert(shouldUnmap == false);
-                                        rc = ReferenceSeq_TranslateOffset_int(seq, line->position, &ref_id, &ref_start, NULL);
-                                        if (rc == 0)
-                                        {
-                                            rc = VCursorOpenRow( cur );
-                                        
-                                            if (rc == 0) 
-                                                rc = VCursorWrite( cur, ref_id_idx,    sizeof(ref_id) * 8, &ref_id, 0, 1);
-                                            if (rc == 0) 
-                                                rc = VCursorWrite( cur, position_idx,  sizeof(ref_start) * 8, &ref_start, 0, 1);
-                                            if (rc == 0) 
-                                                rc = VCursorWrite( cur, length_idx,    sizeof(line->altBases.len) * 8,   &line->altBases.len,   0, 1);
-                                            if (rc == 0) 
-                                                rc = VCursorWrite( cur, sequence_idx,  line->altBases.len * 8,    line->altBases.addr,    0, 1);
-                                        }
-                                        rc2 = ReferenceSeq_Release(seq);
-                                        if (rc == 0)
-                                            rc = rc2;
-                                    }    
-                                    if (rc == 0) rc = VCursorCommitRow( cur );
-                                    if (rc == 0) rc = VCursorCloseRow( cur );
-                                }
-                                if (rc != 0)
-                                    break;
-                            }
-                            rc2 = ReferenceMgr_Release(refMgr, rc == 0, NULL, false, NULL);
-                            if (rc == 0)
-                                rc = rc2;
-                        }
-                    }
-                    if (rc == 0)
-                        rc = VCursorCommit( cur );
-                }
+                    rc = VariantWriterWrite(&writer, line);
             }
-            rc2 = VCursorRelease(cur);
+            rc2 = VariantWriterClose(&writer, rc == 0);
             if (rc == 0)
                 rc = rc2;
         }
-        
-        rc2 = VTableRelease(tbl);
-        if (rc == 0)
-            rc = rc2;
     }
-            
     return rc;
 }
 
@@ -31,10 +31,18 @@
 
 struct VcfReader;
 struct VDatabase;
+struct KFile;
+struct VNamelist;
 
 /*
  * Save into a database
  */
 extern rc_t VcfDatabaseSave ( const struct VcfReader* reader, const char configPath[], struct VDatabase* db );
 
+/*
+ * Parse a VCF file and save it into a database in one pass, without keeping the file in memory.
+ * messages are the parser's, as in VcfReaderParse
+ */
+extern rc_t VcfDatabaseLoad ( struct VcfReader* reader, const struct KFile* file, const char configPath[], struct VDatabase* db, const struct VNamelist** messages );
+
 #endif /* _h_vcf_database_ */
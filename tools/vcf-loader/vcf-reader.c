@@ -35,6 +35,7 @@
 #include <klib/printf.h>
 
 #include <kfs/mmap.h>
+#include <kfs/file.h>
 
 #include <sysalloc.h>
 #include <stdlib.h>
@@ -46,6 +47,7 @@
 #define MESSAGE_LIST_BLOCK_SIZE 64
 #define PARSE_ERROR RC ( rcAlign, rcFile, rcParsing, rcFormat, rcIncorrect )
 #define MANDATORY_DATA_FIELDS_NUMBER 8
+#define STREAM_WINDOW_SIZE ( 1024 * 1024 )
 
 /*=============== VcfDataLine ================*/
 static
@@ -88,18 +90,48 @@ rc_t VcfDataLineWhack(VcfDataLine* self)
     return rc;
 }
 
+/* move the fields pointing into the input window along with its contents */
+static
+void VcfDataLineRebase(VcfDataLine* self, const char* oldBase, const char* newBase)
+{
+    #define REBASE(field) if ( (field).addr != NULL ) (field).addr = newBase + ( (field).addr - oldBase )
+    REBASE(self->chromosome);
+    REBASE(self->id);
+    REBASE(self->refBases);
+    REBASE(self->altBases);
+    REBASE(self->filter);
+    REBASE(self->info);
+    #undef REBASE
+}
+
 /*=============== VcfReader ================*/
 
 struct VcfReader
 {
     char* input;
-    size_t inputSize;
+    size_t inputSize;   /* bytes of data in input */
     size_t curPos;
     VCFParseBlock pb;
     
     Vector lines;  /* the element type is VcfDataLine* */
     
     VNamelist* messages;
+    
+    /* streaming: input is a window into the file, starting at inputStart bytes from the start of the file */
+    const struct KFile* file;
+    uint64_t filePos;
+    size_t inputStart;
+    size_t inputMax;
+    rc_t readRc;
+    
+    /* streaming: the only data line, handed to the handler when closed */
+    VcfDataLine* streamLine;
+    bool lineOpen;
+    size_t lineStart;   /* offset of the line's first byte from the start of the file */
+    uint32_t lineMessages;
+    VcfReaderLineHandler handler;
+    void* handlerData;
+    rc_t handlerRc;
 };
 
 /* bison helpers */
@@ -117,7 +149,7 @@ static void CloseDataLine(VCFParseBlock* pb);
 static 
 rc_t VcfReaderInit(VcfReader* self)
 {
-    self->input = NULL;
+    memset(self, 0, sizeof(*self));
     
     self->pb.self           = self;
     self->pb.input          = Input;
@@ -153,6 +185,7 @@ rc_t VcfReaderWhack( struct VcfReader* self)
         return RC ( rcAlign, rcFile, rcDestroying, rcSelf, rcNull );
 
     VectorWhack( &self->lines, WhackLineVectorElement, NULL );
+    VcfDataLineWhack( self->streamLine );
 
     rc = VNamelistRelease( self->messages );
     
@@ -174,11 +207,58 @@ rc_t VcfReaderMake( const struct VcfReader **pself)
     return VcfReaderInit((VcfReader*)*pself);
 }
 
+/* Reads the next part of the file into the window. 
+ * Only the bytes the parser can still refer to are kept: the open data line or, between lines,
+ * whatever the scanner has not matched yet. The window grows only when a single line does not fit. */
+static void FillWindow(VcfReader* self)
+{
+    size_t keep = ( self->lineOpen ? self->lineStart : self->pb.offset ) - self->inputStart;
+    size_t num_read = 0;
+    
+    if (keep > 0)
+    {
+        memmove(self->input, self->input + keep, self->inputSize - keep);
+        if (self->lineOpen)
+            VcfDataLineRebase(self->streamLine, self->input + keep, self->input);
+        self->inputStart += keep;
+        self->inputSize -= keep;
+        self->curPos -= keep;
+    }
+    
+    if (self->inputSize == self->inputMax)
+    {
+        char* input = malloc(self->inputMax * 2);
+        if (input == NULL)
+        {
+            self->readRc = RC ( rcAlign, rcFile, rcReading, rcMemory, rcExhausted );
+            return;
+        }
+        memcpy(input, self->input, self->inputSize);
+        if (self->lineOpen)
+            VcfDataLineRebase(self->streamLine, self->input, input);
+        free(self->input);
+        self->input = input;
+        self->inputMax *= 2;
+    }
+    
+    self->readRc = KFileRead(self->file, self->filePos, self->input + self->inputSize, self->inputMax - self->inputSize, &num_read);
+    if (self->readRc == 0)
+    {
+        self->inputSize += num_read;
+        self->filePos += num_read;
+    }
+}
+
 /*=============== callbacks for the bison parser ================*/
 static size_t Input(VCFParseBlock* pb, char* buf, size_t maxSize)
 {
     VcfReader* self = (VcfReader*)(pb->self);
-    size_t ret = string_copy(buf, maxSize, self->input + self->curPos, self->inputSize - self->curPos);
+    size_t ret;
+    
+    if (self->file != NULL && self->curPos == self->inputSize && self->readRc == 0 && self->handlerRc == 0)
+        FillWindow(self);
+        
+    ret = string_copy(buf, maxSize, self->input + self->curPos, self->inputSize - self->curPos);
     
     self->curPos += ret;
     
@@ -210,6 +290,13 @@ static void HeaderItem(VCFParseBlock* pb, VCFToken* value)
 {
 }
 
+static VcfDataLine* CurrentLine(VcfReader* self)
+{
+    if (self->handler != NULL)
+        return self->lineOpen ? self->streamLine : NULL;
+    return (VcfDataLine*) VectorLast( & self->lines );
+}
+
 static void OpenDataLine(VCFParseBlock* pb)
 {
     VcfReader* self;
@@ -221,8 +308,28 @@ static void OpenDataLine(VCFParseBlock* pb)
     self = (VcfReader*)(pb->self);
     assert(self);
     
+    if (self->handler != NULL)
+    {   /* streaming: start over with a clean line object */
+        VcfDataLineWhack( self->streamLine );
+        rc = VcfDataLineMake( &self->streamLine );
+        if (rc == 0)
+        {
+            self->lineOpen = true;
+            /* the line's first item is the last token matched */
+            self->lineStart = pb->lastToken != NULL ? pb->lastToken->tokenStart : pb->offset;
+            VNameListCount( self->messages, &self->lineMessages );
+        }
+        else
+        {
+            self->streamLine = NULL;
+            SET_RC_FILE_FUNC_LINE(rc);
+            Error(pb, "failed to create a line object");
+        }
+        return;
+    }
+    
     /* create new line object */
-    VcfDataLineMake( &line );
+    rc = VcfDataLineMake( &line );
     if (rc == 0)
     {   /* append to the vector */
         rc = VectorAppend( &self->lines, NULL, line );
@@ -248,10 +355,11 @@ static void DataItem(VCFParseBlock* pb, VCFToken* value)
     self = (VcfReader*)(pb->self);
     assert(self);
     
-    line = (VcfDataLine*) VectorLast( & self->lines );
-    assert(line);
+    line = CurrentLine( self );
+    if (line == NULL)
+        return;
     
-    #define SAVE_TOKEN(field) StringInit( field, self->input + value->tokenStart, value->tokenLength, (uint32_t)string_size(value->tokenText) )
+    #define SAVE_TOKEN(field) StringInit( field, self->input + ( value->tokenStart - self->inputStart ), value->tokenLength, (uint32_t)string_size(value->tokenText) )
 
     switch (line->lastPopulated)
     {
@@ -324,8 +432,9 @@ static void CloseDataLine(VCFParseBlock* pb)
     self = (VcfReader*)(pb->self);
     assert(self);
     
-    line = (VcfDataLine*) VectorLast( & self->lines );
-    assert(line);
+    line = CurrentLine( self );
+    if (line == NULL)
+        return;
     
     if (line->lastPopulated < MANDATORY_DATA_FIELDS_NUMBER)
     {
@@ -333,9 +442,33 @@ static void CloseDataLine(VCFParseBlock* pb)
                                    /* and the line # reported by flex incremented; fix that for error reporting */
         Error(pb, "one or more of the 8 mandatory columns are missing");
     }
+    
+    if (self->handler != NULL)
+    {   /* streaming: hand the line out unless it had errors, it is not needed after that */
+        uint32_t messageCount;
+        VNameListCount( self->messages, &messageCount );
+        if (messageCount == self->lineMessages && self->handlerRc == 0)
+            self->handlerRc = self->handler(self->handlerData, line);
+        self->lineOpen = false;
+    }
 }
 
 
+static rc_t ResetMessages( struct VcfReader *self )
+{
+    rc_t rc = 0;
+    uint32_t messageCount;
+    
+    VNameListCount ( self->messages, &messageCount );       
+    if (messageCount > 0)
+    {   /* blow away old mesages */
+        rc = VNamelistRelease( self->messages );
+        if (rc == 0)
+            rc = VNamelistMake( &self->messages, MESSAGE_LIST_BLOCK_SIZE);
+    }
+    return rc;
+}
+
 rc_t VcfReaderParse( struct VcfReader *self, struct KFile* inputFile, const struct VNamelist** messages)
 {
     rc_t rc = 0;
@@ -348,15 +481,9 @@ rc_t VcfReaderParse( struct VcfReader *self, struct KFile* inputFile, const stru
     if (inputFile == NULL)
         return RC ( rcAlign, rcFile, rcParsing, rcParam, rcNull );
         
-    VNameListCount ( self->messages, &messageCount );       
-    if (messageCount > 0)
-    {   /* blow away old mesages */
-        rc = VNamelistRelease( self->messages );
-        if (rc == 0)
-            rc = VNamelistMake( &self->messages, MESSAGE_LIST_BLOCK_SIZE);
-        if (rc != 0)
-            return rc;
-    }
+    rc = ResetMessages( self );
+    if (rc != 0)
+        return rc;
         
     rc = KMMapMakeRead ( (const KMMap**)& mm, inputFile );
     if ( rc == 0 )
@@ -371,6 +498,8 @@ rc_t VcfReaderParse( struct VcfReader *self, struct KFile* inputFile, const stru
             if ( rc == 0 )
             {
                 /* make a 0-terminated copy for parsing */
+                free(self->input);
+                self->inputStart = 0;
                 self->input = malloc(self->inputSize+1);
                 if (self->input == 0)
                     rc = RC ( rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted );
@@ -410,6 +539,82 @@ rc_t VcfReaderParse( struct VcfReader *self, struct KFile* inputFile, const stru
     return rc;
 }
 
+rc_t VcfReaderParseStream( struct VcfReader *self, const struct KFile* inputFile, size_t windowSize, 
+                           VcfReaderLineHandler handler, void* data, const struct VNamelist** messages )
+{
+    rc_t rc = 0;
+    uint32_t messageCount;
+    
+    if ( self == NULL )
+        return RC ( rcAlign, rcFile, rcParsing, rcSelf, rcNull );
+        
+    if (inputFile == NULL || handler == NULL)
+        return RC ( rcAlign, rcFile, rcParsing, rcParam, rcNull );
+        
+    rc = ResetMessages( self );
+    if (rc != 0)
+        return rc;
+    
+    free(self->input);
+    self->inputMax = windowSize == 0 ? STREAM_WINDOW_SIZE : windowSize;
+    self->input = malloc(self->inputMax);
+    if (self->input == NULL)
+        return RC ( rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted );
+        
+    self->file          = inputFile;
+    self->filePos       = 0;
+    self->inputStart    = 0;
+    self->inputSize     = 0;
+    self->curPos        = 0;
+    self->readRc        = 0;
+    self->lineOpen      = false;
+    self->handler       = handler;
+    self->handlerData   = data;
+    self->handlerRc     = 0;
+    self->pb.offset     = 0;
+    
+    FillWindow(self);
+    rc = self->readRc;
+    if (rc == 0)
+    {
+        if (self->inputSize == 0)
+        {
+            VNamelistAppend(self->messages, "Empty file");
+            rc = PARSE_ERROR;
+        }
+        else
+        {
+            VCFScan_yylex_init(&self->pb, false);
+            
+            if (VCF_parse(&self->pb) == 0)
+                rc = PARSE_ERROR;
+            else
+            {
+                VNameListCount ( self->messages, &messageCount );       
+                if (messageCount > 0)
+                    rc = PARSE_ERROR;
+            }
+            /* a failure to read or to save a line explains a parse error, if any */
+            if (self->handlerRc != 0)
+                rc = self->handlerRc;
+            else if (self->readRc != 0)
+                rc = self->readRc;
+                
+            VCFScan_yylex_destroy(&self->pb);
+        }
+    }
+    *messages = (const struct VNamelist*)self->messages;
+    
+    self->file = NULL;
+    self->handler = NULL;
+    self->handlerData = NULL;
+    self->lineOpen = false;
+    VcfDataLineWhack( self->streamLine );
+    self->streamLine = NULL;
+    
+    return rc;
+}
+
 rc_t VcfReaderGetDataLineCount( const VcfReader* self, uint32_t* count )
 {
     if ( self == NULL )
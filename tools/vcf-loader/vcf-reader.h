@@ -87,6 +87,31 @@ rc_t VcfReaderMake( const VcfReader** self );
  */
 rc_t VcfReaderParse( VcfReader* self, struct KFile* file, const struct VNamelist** messages );
 
+/* LineHandler
+ *  receives data lines from ParseStream, one at a time.
+ *  The line is valid only until the handler returns; a non-0 return stops parsing.
+ */
+typedef rc_t ( CC * VcfReaderLineHandler ) ( void* data, const VcfDataLine* line );
+
+/* ParseStream
+ *  Parses a VCF file without loading all of it into memory. The file is read through a window
+ *  which grows only if a single line does not fit; every data line is passed to the handler as
+ *  soon as it is parsed, lines with errors are not. The lines are not kept in the reader,
+ *  GetDataLineCount/GetDataLine do not see them.
+ *
+ *  self [ IN ] the reader object
+ *
+ *  file [ IN ] a readable file object, read sequentially
+ *
+ *  windowSize [ IN ] initial size of the input window in bytes, 0 for the default
+ *
+ *  handler, data [ IN ] the line handler and its data
+ *
+ *  message [ OUT ] error messages generated by the parser, as in Parse.
+ */
+rc_t VcfReaderParseStream( VcfReader* self, const struct KFile* file, size_t windowSize, 
+                           VcfReaderLineHandler handler, void* data, const struct VNamelist** messages );
+
 /* Whack
  *  releases object obtained from VcfReaderMake
  */